@@ -1,21 +1,30 @@
 // RestoreEngine.cpp
 #include "BackupEngine.h"
+#include "Core/FileBackup.h"
 #include <Windows.h>
 #include <filesystem>
 #include <queue>
 #include <string>
 
 namespace fs = std::filesystem;
+extern void SetLastErrorMessage(const std::wstring& error);
+extern std::wstring Widen(const std::string& utf8);
+extern BackupCore::ProgressChannel::Sink MakeStatusSink(ProgressStatusCallback callback, void* context);
+extern uint32_t StatusInterval(int intervalMs);
+extern void SetLastFileErrors(const std::vector<BackupCore::FileError>& errors);
 
 class FileRestorer {
 private:
     ProgressCallback progressCallback;
+    BackupCore::ProgressChannel* channel;
+    BackupCore::JobControl* control;
     std::wstring lastError;
 
     struct FileEntry {
         std::wstring source;
         std::wstring dest;
         DWORD attributes;
+        uintmax_t size;
     };
 
     bool CopyFileWithProgress(const std::wstring& source,
@@ -51,7 +60,9 @@ private:
     }
 
 public:
-    FileRestorer(ProgressCallback callback) : progressCallback(callback) {}
+    FileRestorer(ProgressCallback callback, BackupCore::ProgressChannel* channel = nullptr,
+        BackupCore::JobControl* control = nullptr)
+        : progressCallback(callback), channel(channel), control(control) {}
 
     int RestoreDirectory(const std::wstring& source,
         const std::wstring& dest,
@@ -75,6 +86,9 @@ public:
             if (progressCallback) {
                 progressCallback(0, L"Scanning backup files...");
             }
+            if (channel) {
+                channel->SetPhase(BackupCore::ProgressPhase::Scanning);
+            }
 
             for (const auto& entry : fs::recursive_directory_iterator(source)) {
                 if (entry.is_regular_file()) {
@@ -85,10 +99,11 @@ public:
                     fs::path relativePath = fs::relative(entry.path(), source);
                     fe.dest = (fs::path(dest) / relativePath).wstring();
                     fe.attributes = GetFileAttributesW(fe.source.c_str());
+                    fe.size = entry.file_size();
 
                     fileQueue.push(fe);
                     totalFiles++;
-                    totalSize += entry.file_size();
+                    totalSize += fe.size;
                 }
             }
 
@@ -96,12 +111,22 @@ public:
                 std::wstring msg = L"Restoring " + std::to_wstring(totalFiles) + L" files...";
                 progressCallback(0, msg.c_str());
             }
+            if (channel) {
+                channel->SetTotals(totalFiles, totalSize);
+                channel->SetPhase(BackupCore::ProgressPhase::Restoring);
+            }
 
             // Restore files
             size_t processedFiles = 0;
             size_t processedSize = 0;
+            int lastPercent = 0;
 
             while (!fileQueue.empty()) {
+                if (!BackupCore::Checkpoint(control)) {
+                    lastError = L"Job cancelled";
+                    return BackupCore::JobCancelledResult;
+                }
+
                 FileEntry fe = fileQueue.front();
                 fileQueue.pop();
 
@@ -127,9 +152,15 @@ public:
                 SetFileAttributesW(fe.dest.c_str(), fe.attributes);
 
                 processedFiles++;
+                if (channel) {
+                    channel->AddBytes(fe.size);
+                    channel->AddFile(true);
+                }
 
-                if (progressCallback && totalFiles > 0) {
-                    int percent = (int)((processedFiles * 100) / totalFiles);
+                // Only report when the percentage moves, not once per file
+                int percent = totalFiles > 0 ? (int)((processedFiles * 100) / totalFiles) : 100;
+                if (progressCallback && percent != lastPercent) {
+                    lastPercent = percent;
                     std::wstring msg = L"Restored " + std::to_wstring(processedFiles) +
                         L" of " + std::to_wstring(totalFiles) + L" files";
                     progressCallback(percent, msg.c_str());
@@ -155,6 +186,60 @@ public:
     const std::wstring& GetLastError() const { return lastError; }
 };
 
+// Shared by RestoreFiles, RestoreFilesWithStatus and StartRestoreJob
+int RunRestoreFiles(
+    const wchar_t* sourcePath,
+    const wchar_t* destPath,
+    bool overwriteExisting,
+    ProgressCallback callback,
+    BackupCore::ProgressChannel* channel,
+    BackupCore::JobControl* control,
+    const std::string& password) {
+
+    SetLastFileErrors({});
+    try {
+        // Visible to the service and UIs through GetRunningJobs
+        if (sourcePath && destPath) {
+            channel->Publish("Restore files " + fs::path(sourcePath).u8string() + " -> " + fs::path(destPath).u8string());
+        }
+
+        // Backup sets written by BackupFiles carry a catalog; older ones are plain copies
+        if (sourcePath && destPath && BackupCore::HasCatalog(sourcePath)) {
+            BackupCore::FileRestoreOptions options;
+            options.overwriteExisting = overwriteExisting;
+            options.password = password;
+            options.channel = channel;
+            options.control = control;
+
+            BackupCore::BackupProgress progress;
+            if (callback) {
+                progress = [callback](int percentage, const std::string& message) {
+                    callback(percentage, Widen(message).c_str());
+                };
+            }
+
+            BackupCore::FileSetResult result;
+            std::string error;
+            int rc = BackupCore::RestoreFileSet(sourcePath, destPath, options, progress, result, error);
+            SetLastFileErrors(result.errors);
+            if (rc != 0) {
+                SetLastErrorMessage(Widen(error));
+            }
+            return (rc == 0 && result.failed > 0) ? -5 : rc;
+        }
+
+        FileRestorer restorer(callback, channel, control);
+        int rc = restorer.RestoreDirectory(sourcePath, destPath, overwriteExisting);
+        if (rc != 0) {
+            SetLastErrorMessage(restorer.GetLastError());
+        }
+        return rc;
+    }
+    catch (...) {
+        return -99;
+    }
+}
+
 extern "C" {
     BACKUPENGINE_API int RestoreFiles(
         const wchar_t* sourcePath,
@@ -162,12 +247,23 @@ extern "C" {
         bool overwriteExisting,
         ProgressCallback callback) {
 
-        try {
-            FileRestorer restorer(callback);
-            return restorer.RestoreDirectory(sourcePath, destPath, overwriteExisting);
-        }
-        catch (...) {
-            return -99;
-        }
+        BackupCore::ProgressChannel channel(nullptr);
+        int rc = RunRestoreFiles(sourcePath, destPath, overwriteExisting, callback, &channel, nullptr, std::string());
+        channel.Finish(rc == 0);
+        return rc;
+    }
+
+    BACKUPENGINE_API int RestoreFilesWithStatus(
+        const wchar_t* sourcePath,
+        const wchar_t* destPath,
+        bool overwriteExisting,
+        ProgressStatusCallback callback,
+        void* context,
+        int intervalMs) {
+
+        BackupCore::ProgressChannel channel(MakeStatusSink(callback, context), StatusInterval(intervalMs));
+        int rc = RunRestoreFiles(sourcePath, destPath, overwriteExisting, nullptr, &channel, nullptr, std::string());
+        channel.Finish(rc == 0);
+        return rc;
     }
 }
\ No newline at end of file
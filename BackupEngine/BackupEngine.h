@@ -10,10 +10,103 @@
 #define BACKUPENGINE_API __declspec(dllimport)
 #endif
 
+// Flags for BackupFilesEx
+#define BACKUP_FLAG_COMPRESS                0x0001  // Store files LZ-compressed
+#define BACKUP_FLAG_PARITY                  0x0002  // Add Reed-Solomon parity (2 per 16 shards)
+
+// Phases reported in BACKUP_PROGRESS.phase
+#define PROGRESS_PHASE_IDLE                 0
+#define PROGRESS_PHASE_SCANNING             1
+#define PROGRESS_PHASE_COPYING              2
+#define PROGRESS_PHASE_VERIFYING            3
+#define PROGRESS_PHASE_RESTORING            4
+#define PROGRESS_PHASE_FINALIZING           5
+#define PROGRESS_PHASE_COMPLETED            6
+#define PROGRESS_PHASE_FAILED               7
+
+// States returned by PollJob
+#define JOB_STATE_QUEUED                    0
+#define JOB_STATE_RUNNING                   1
+#define JOB_STATE_PAUSED                    2
+#define JOB_STATE_COMPLETED                 3
+#define JOB_STATE_FAILED                    4
+#define JOB_STATE_CANCELLED                 5
+
+// Result of a job stopped by CancelJob
+#define BACKUP_RESULT_CANCELLED             -10
+
+// Codes in BACKUP_FILE_ERROR.code
+#define FILE_ERROR_OPEN_FAILED              1   // Source file cannot be opened
+#define FILE_ERROR_CREATE_FAILED            2   // Stored or restored file cannot be created
+#define FILE_ERROR_READ_FAILED              3
+#define FILE_ERROR_WRITE_FAILED             4
+#define FILE_ERROR_MISSING_FROM_BACKUP      5
+#define FILE_ERROR_CORRUPT                  6   // Malformed or truncated compressed file
+#define FILE_ERROR_CHECKSUM_MISMATCH        7
+#define FILE_ERROR_INVALID_PATH             8
+#define FILE_ERROR_CANCELLED                9   // Job cancelled while the file was in progress
+
+// Formats for GetEngineMetrics
+#define METRICS_FORMAT_JSON                 0
+#define METRICS_FORMAT_PROMETHEUS           1
+
+// Flags for RestoreDiskEx and CloneDisk
+#define RESTORE_FLAG_COMPARE_BEFORE_WRITE   0x0001  // Read target blocks, write only those that differ
+#define RESTORE_FLAG_DISCARD_ZERO_RANGES    0x0002  // TRIM zero ranges instead of writing zeros
+#define RESTORE_FLAG_VERIFY_WRITES          0x0004  // Read back and compare every written block
+#define RESTORE_FLAG_NO_VERIFY              0x0008  // CloneDisk only: skip the read-back it does by default
+
 extern "C" {
     // Callback for progress updates
     typedef void (*ProgressCallback)(int percentage, const wchar_t* message);
 
+    // Aggregated job status delivered by the *WithStatus functions
+    typedef struct BACKUP_PROGRESS {
+        int phase;                          // PROGRESS_PHASE_*
+        int percent;
+        unsigned long long filesDone;
+        unsigned long long filesTotal;
+        unsigned long long filesFailed;
+        unsigned long long bytesDone;
+        unsigned long long bytesTotal;
+        double bytesPerSecond;              // Smoothed transfer rate
+        double elapsedSeconds;
+        double etaSeconds;                  // -1 while unknown
+    } BACKUP_PROGRESS;
+
+    // Called at most once per interval, on every phase change and once with
+    // PROGRESS_PHASE_COMPLETED or PROGRESS_PHASE_FAILED at the end
+    typedef void (*ProgressStatusCallback)(const BACKUP_PROGRESS* progress, void* context);
+
+    // One running job as published by any process using the engine (GetRunningJobs)
+    typedef struct JOB_STATUS {
+        unsigned long long jobId;
+        unsigned int processId;
+        int phase;                          // PROGRESS_PHASE_*
+        int percent;
+        unsigned long long filesDone;
+        unsigned long long filesTotal;
+        unsigned long long filesFailed;
+        unsigned long long bytesDone;
+        unsigned long long bytesTotal;
+        double bytesPerSecond;
+        double elapsedSeconds;
+        double etaSeconds;                  // -1 while unknown
+        long long updatedUnixMs;            // Time of the last update
+        wchar_t name[128];
+    } JOB_STATUS;
+
+    // One file that failed during a backup, verify or restore
+    typedef struct BACKUP_FILE_ERROR {
+        int code;                           // FILE_ERROR_* (FILE_ERROR_CANCELLED if the job was cancelled)
+        int systemError;                    // C runtime errno, or 0
+        wchar_t path[512];                  // Relative to the backup set
+        wchar_t message[256];
+    } BACKUP_FILE_ERROR;
+
+    // Handle to an asynchronous job started by StartBackupJob and friends
+    typedef struct BACKUP_JOB_T* BACKUP_JOB;
+
     // ====================
     // Backup Functions
     // ====================
@@ -30,6 +123,22 @@ extern "C" {
         const wchar_t* destPath,
         ProgressCallback callback);
 
+    // Backup files/folders with BACKUP_FLAG_* options
+    BACKUPENGINE_API int BackupFilesEx(
+        const wchar_t* sourcePath,
+        const wchar_t* destPath,
+        int backupFlags,
+        ProgressCallback callback);
+
+    // BackupFilesEx with structured status updates every intervalMs (0 = 100 ms)
+    BACKUPENGINE_API int BackupFilesWithStatus(
+        const wchar_t* sourcePath,
+        const wchar_t* destPath,
+        int backupFlags,
+        ProgressStatusCallback callback,
+        void* context,
+        int intervalMs);
+
     // Backup an entire volume (with optional system state)
     BACKUPENGINE_API int BackupVolume(
         const wchar_t* volumePath,
@@ -38,7 +147,7 @@ extern "C" {
         bool compress,
         ProgressCallback callback);
 
-    // Backup an entire disk by disk number
+    // Backup an entire disk by disk number (one image stream per partition, gaps skipped)
     BACKUPENGINE_API int BackupDisk(
         int diskNumber,
         const wchar_t* destPath,
@@ -81,6 +190,15 @@ extern "C" {
         bool overwriteExisting,
         ProgressCallback callback);
 
+    // RestoreFiles with structured status updates every intervalMs (0 = 100 ms)
+    BACKUPENGINE_API int RestoreFilesWithStatus(
+        const wchar_t* sourcePath,
+        const wchar_t* destPath,
+        bool overwriteExisting,
+        ProgressStatusCallback callback,
+        void* context,
+        int intervalMs);
+
     // Restore volume from backup
     BACKUPENGINE_API int RestoreVolume(
         const wchar_t* backupPath,
@@ -95,6 +213,22 @@ extern "C" {
         bool restoreSystemState,
         ProgressCallback callback);
 
+    // Restore disk from backup with RESTORE_FLAG_* options (write-avoiding restore)
+    BACKUPENGINE_API int RestoreDiskEx(
+        const wchar_t* backupPath,
+        int targetDiskNumber,
+        bool restoreSystemState,
+        int restoreFlags,
+        ProgressCallback callback);
+
+    // Copy a physical disk onto another without an intermediate image (RESTORE_FLAG_* options).
+    // Every written block is read back and compared unless RESTORE_FLAG_NO_VERIFY is given.
+    BACKUPENGINE_API int CloneDisk(
+        int sourceDiskNumber,
+        int targetDiskNumber,
+        int cloneFlags,
+        ProgressCallback callback);
+
     // Restore a Hyper-V VM from backup
     BACKUPENGINE_API int RestoreHyperVVM(
         const wchar_t* backupPath,
@@ -132,6 +266,13 @@ extern "C" {
         const wchar_t* backupPath,
         ProgressCallback callback);
 
+    // VerifyBackup with structured status updates every intervalMs (0 = 100 ms)
+    BACKUPENGINE_API int VerifyBackupWithStatus(
+        const wchar_t* backupPath,
+        ProgressStatusCallback callback,
+        void* context,
+        int intervalMs);
+
     // Enumerate all volumes on the system
     BACKUPENGINE_API int EnumerateVolumes(
         wchar_t* buffer,
@@ -158,6 +299,176 @@ extern "C" {
         wchar_t* buffer,
         int bufferSize);
 
+    // Applies a retention policy to the backups of one job, the directories
+    // <destPath>\<jobName>_YYYYMMDD_HHMMSS. Keeps the keepLast newest (at
+    // least one), the newest of each of the last keepDaily days, keepWeekly
+    // weeks and keepMonthly months, anything less than a day old, and every
+    // backup an incremental or differential one that stays depends on. The
+    // rest is deleted, or with dryRun only reported; every decision goes
+    // through the callback. Safe to run while the job's next backup does.
+    BACKUPENGINE_API int PruneBackups(
+        const wchar_t* destPath,
+        const wchar_t* jobName,
+        int keepLast,
+        int keepDaily,
+        int keepWeekly,
+        int keepMonthly,
+        bool dryRun,
+        ProgressCallback callback);
+
+    // Deletes the stored and parity files of a file backup set that its
+    // catalog no longer lists: what earlier backups into the same directory
+    // left behind for sources deleted since. Stops after budgetBytes
+    // (0 = no limit); the next call carries on. With dryRun the files are
+    // only reported. Fails if a backup is writing into the set.
+    BACKUPENGINE_API int CompactBackup(
+        const wchar_t* backupPath,
+        unsigned long long budgetBytes,
+        bool dryRun,
+        ProgressCallback callback);
+
+    // ====================
+    // Asynchronous Jobs
+    // ====================
+
+    // The Start*Job functions queue the operation on the engine's thread pool
+    // and return a handle at once (NULL on bad arguments). The callback, if
+    // any, runs on a pool thread. Every handle must be released with CloseJob;
+    // closing a running job does not stop it.
+
+    // BackupFilesWithStatus as a job
+    BACKUPENGINE_API BACKUP_JOB StartBackupJob(
+        const wchar_t* sourcePath,
+        const wchar_t* destPath,
+        int backupFlags,
+        ProgressStatusCallback callback,
+        void* context,
+        int intervalMs);
+
+    // Backs up several sources into one set with one catalog, each source in
+    // a folder of its own name ("Documents", "Photos", ...). Sources on
+    // different disks are read at the same time.
+    BACKUPENGINE_API BACKUP_JOB StartBackupSourcesJob(
+        const wchar_t* const* sourcePaths,
+        int sourceCount,
+        const wchar_t* destPath,
+        int backupFlags,
+        ProgressStatusCallback callback,
+        void* context,
+        int intervalMs);
+
+    // StartBackupSourcesJob with the set encrypted under password (AES-256-GCM,
+    // or ChaCha20-Poly1305 on CPUs without AES instructions). The same
+    // password is needed to verify or restore the set.
+    BACKUPENGINE_API BACKUP_JOB StartEncryptedBackupJob(
+        const wchar_t* const* sourcePaths,
+        int sourceCount,
+        const wchar_t* destPath,
+        int backupFlags,
+        const wchar_t* password,
+        ProgressStatusCallback callback,
+        void* context,
+        int intervalMs);
+
+    // VerifyBackupWithStatus as a job
+    BACKUPENGINE_API BACKUP_JOB StartVerifyJob(
+        const wchar_t* backupPath,
+        ProgressStatusCallback callback,
+        void* context,
+        int intervalMs);
+
+    // StartVerifyJob for an encrypted set
+    BACKUPENGINE_API BACKUP_JOB StartEncryptedVerifyJob(
+        const wchar_t* backupPath,
+        const wchar_t* password,
+        ProgressStatusCallback callback,
+        void* context,
+        int intervalMs);
+
+    // Re-reads the stored files of a backup set at idle I/O priority and
+    // bytesPerSecond (0 = 64 MB/s; SetJobThrottle changes it while the job
+    // runs), repairing damage from parity where the set has it. Each run
+    // carries on where the last one stopped; with continuous it starts the
+    // next pass at the end of each until cancelled. password may be NULL
+    // unless the set is encrypted and has no parity.
+    BACKUPENGINE_API BACKUP_JOB StartScrubJob(
+        const wchar_t* backupPath,
+        const wchar_t* password,
+        unsigned long long bytesPerSecond,
+        bool continuous,
+        ProgressStatusCallback callback,
+        void* context,
+        int intervalMs);
+
+    // RestoreFilesWithStatus as a job
+    BACKUPENGINE_API BACKUP_JOB StartRestoreJob(
+        const wchar_t* backupPath,
+        const wchar_t* restorePath,
+        bool overwriteExisting,
+        ProgressStatusCallback callback,
+        void* context,
+        int intervalMs);
+
+    // StartRestoreJob for an encrypted set
+    BACKUPENGINE_API BACKUP_JOB StartEncryptedRestoreJob(
+        const wchar_t* backupPath,
+        const wchar_t* restorePath,
+        bool overwriteExisting,
+        const wchar_t* password,
+        ProgressStatusCallback callback,
+        void* context,
+        int intervalMs);
+
+    // Returns the JOB_STATE_* of the job (-1 for a bad handle) and, if
+    // progress is not NULL, the most recent status
+    BACKUPENGINE_API int PollJob(
+        BACKUP_JOB job,
+        BACKUP_PROGRESS* progress);
+
+    // Waits up to timeoutMs (negative = forever) for the job to finish.
+    // Returns 0 once finished, with the job's return code in *result,
+    // 1 on timeout and -1 for a bad handle.
+    BACKUPENGINE_API int WaitJob(
+        BACKUP_JOB job,
+        int timeoutMs,
+        int* result);
+
+    // Stops the job at its next block; it finishes with BACKUP_RESULT_CANCELLED
+    BACKUPENGINE_API int CancelJob(
+        BACKUP_JOB job);
+
+    // Suspends the job at its next block until ResumeJob or CancelJob
+    BACKUPENGINE_API int PauseJob(
+        BACKUP_JOB job);
+
+    BACKUPENGINE_API int ResumeJob(
+        BACKUP_JOB job);
+
+    // Limits the job's read and write bandwidth (bytes per second) and I/O
+    // operations per second; 0 leaves that one unlimited. May be called at any
+    // time while the job runs.
+    BACKUPENGINE_API int SetJobThrottle(
+        BACKUP_JOB job,
+        unsigned long long readBytesPerSecond,
+        unsigned long long writeBytesPerSecond,
+        unsigned long long operationsPerSecond);
+
+    // Error message of a failed job
+    BACKUPENGINE_API int GetJobError(
+        BACKUP_JOB job,
+        wchar_t* buffer,
+        int bufferSize);
+
+    // Files that failed in a finished job, as GetLastFileErrors
+    BACKUPENGINE_API int GetJobFileErrors(
+        BACKUP_JOB job,
+        BACKUP_FILE_ERROR* errors,
+        int maxErrors);
+
+    // Releases the handle
+    BACKUPENGINE_API void CloseJob(
+        BACKUP_JOB job);
+
     // ====================
     // Recovery Environment Functions
     // ====================
@@ -173,15 +484,50 @@ extern "C" {
         const wchar_t* usbDriveLetter,
         ProgressCallback callback);
 
+    // ====================
+    // Diagnostics
+    // ====================
+
+    // Per-phase counters/timers and file latency histograms (METRICS_FORMAT_*)
+    BACKUPENGINE_API int GetEngineMetrics(
+        wchar_t* buffer,
+        int bufferSize,
+        int format);
+
+    // Zero all engine metrics, e.g. before starting a job
+    BACKUPENGINE_API void ResetEngineMetrics();
+
+    // Record job/directory/file/stage spans until StopTrace writes them to
+    // tracePath as Chrome trace-event JSON (open in Perfetto or chrome://tracing)
+    BACKUPENGINE_API int StartTrace(
+        const wchar_t* tracePath);
+
+    BACKUPENGINE_API int StopTrace();
+
+    // Snapshot of the file backup, verify and restore jobs running in any
+    // process on this machine, read from shared memory without blocking them.
+    // Fills up to maxJobs entries and returns how many jobs are running.
+    BACKUPENGINE_API int GetRunningJobs(
+        JOB_STATUS* jobs,
+        int maxJobs);
+
     // ====================
     // Error Handling
     // ====================
 
-    // Get last error message
+    // Get last error message. Errors are kept per calling thread, so engine
+    // calls on different threads never see each other's messages.
     BACKUPENGINE_API void GetLastErrorMessage(
         wchar_t* buffer,
         int bufferSize);
 
+    // Files that failed in the last file backup, verify or restore on this
+    // thread. Fills up to maxErrors entries and returns how many were recorded
+    // (the engine keeps the first 1000).
+    BACKUPENGINE_API int GetLastFileErrors(
+        BACKUP_FILE_ERROR* errors,
+        int maxErrors);
+
     // Get Windows version information
     BACKUPENGINE_API int GetWindowsVersion(
         int* major,
@@ -2,17 +2,83 @@
 // This file contains the exported C functions that interface with C#
 
 #include "BackupEngine.h"
+#include "Core/FileBackup.h"
+#include "Core/JobStatus.h"
+#include "Core/Metrics.h"
+#include "Core/Progress.h"
+#include "Core/Trace.h"
 #include <Windows.h>
 #include <string>
 #include <thread>
+#include <vector>
 
 // Thread-local error storage
 thread_local std::wstring g_lastError;
+thread_local std::vector<BackupCore::FileError> g_lastFileErrors;
 
 void SetLastErrorMessage(const std::wstring& error) {
     g_lastError = error;
 }
 
+// Core messages and catalog paths are UTF-8
+std::wstring Widen(const std::string& utf8) {
+    if (utf8.empty()) return std::wstring();
+    int length = MultiByteToWideChar(CP_UTF8, 0, utf8.data(), (int)utf8.size(), NULL, 0);
+    std::wstring wide(length, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, utf8.data(), (int)utf8.size(), &wide[0], length);
+    return wide;
+}
+
+// Per-file failures of the last file backup, verify or restore on this thread
+void SetLastFileErrors(const std::vector<BackupCore::FileError>& errors) {
+    g_lastFileErrors = errors;
+}
+
+const std::vector<BackupCore::FileError>& LastFileErrors() {
+    return g_lastFileErrors;
+}
+
+// Copies core file errors into a caller's BACKUP_FILE_ERROR array; returns the full count
+int CopyFileErrors(const std::vector<BackupCore::FileError>& source, BACKUP_FILE_ERROR* errors, int maxErrors) {
+    int count = (int)source.size();
+    for (int i = 0; errors && i < count && i < maxErrors; i++) {
+        const BackupCore::FileError& error = source[i];
+        errors[i] = BACKUP_FILE_ERROR();
+        errors[i].code = (int)error.code;
+        errors[i].systemError = error.osError;
+        MultiByteToWideChar(CP_UTF8, 0, error.path.c_str(), -1, errors[i].path, _countof(errors[i].path) - 1);
+        MultiByteToWideChar(CP_UTF8, 0, error.message.c_str(), -1, errors[i].message, _countof(errors[i].message) - 1);
+    }
+    return count;
+}
+
+// Forwards core progress to a *WithStatus caller as BACKUP_PROGRESS
+BackupCore::ProgressChannel::Sink MakeStatusSink(ProgressStatusCallback callback, void* context) {
+    if (!callback) {
+        return nullptr;
+    }
+
+    return [callback, context](const BackupCore::ProgressStatus& status) {
+        BACKUP_PROGRESS progress = {};
+        progress.phase = status.phase;
+        progress.percent = status.percent;
+        progress.filesDone = status.filesDone;
+        progress.filesTotal = status.filesTotal;
+        progress.filesFailed = status.filesFailed;
+        progress.bytesDone = status.bytesDone;
+        progress.bytesTotal = status.bytesTotal;
+        progress.bytesPerSecond = status.bytesPerSecond;
+        progress.elapsedSeconds = status.elapsedSeconds;
+        progress.etaSeconds = status.etaSeconds;
+        callback(&progress, context);
+    };
+}
+
+// Interval for the *WithStatus functions; 0 or less means the 10 Hz default
+uint32_t StatusInterval(int intervalMs) {
+    return intervalMs > 0 ? (uint32_t)intervalMs : 100;
+}
+
 extern "C" {
 
 // Get last error message
@@ -22,6 +88,10 @@ BACKUPENGINE_API void GetLastErrorMessage(wchar_t* buffer, int bufferSize) {
     }
 }
 
+BACKUPENGINE_API int GetLastFileErrors(BACKUP_FILE_ERROR* errors, int maxErrors) {
+    return CopyFileErrors(g_lastFileErrors, errors, maxErrors);
+}
+
     // Get Windows version
     BACKUPENGINE_API int GetWindowsVersion(int* major, int* minor, int* build) {
         if (!major || !minor || !build) {
@@ -45,6 +115,93 @@ BACKUPENGINE_API void GetLastErrorMessage(wchar_t* buffer, int bufferSize) {
         return -1;
     }
 
+    // Engine metrics as JSON or Prometheus text (ASCII, so a plain widen is exact)
+    BACKUPENGINE_API int GetEngineMetrics(wchar_t* buffer, int bufferSize, int format) {
+        if (!buffer || bufferSize <= 0) {
+            SetLastErrorMessage(L"Invalid parameters");
+            return -1;
+        }
+
+        BackupCore::EngineMetrics& metrics = BackupCore::EngineMetrics::Global();
+        std::string text = (format == METRICS_FORMAT_PROMETHEUS) ? metrics.ToPrometheus() : metrics.ToJson();
+        std::wstring result(text.begin(), text.end());
+
+        if (result.length() >= (size_t)bufferSize) {
+            SetLastErrorMessage(L"Buffer too small - metrics need " + std::to_wstring(result.length() + 1) + L" characters");
+            buffer[0] = L'\0';
+            return -2;
+        }
+
+        wcscpy_s(buffer, bufferSize, result.c_str());
+        return 0;
+    }
+
+    BACKUPENGINE_API void ResetEngineMetrics() {
+        BackupCore::EngineMetrics::Global().Reset();
+    }
+
+    BACKUPENGINE_API int GetRunningJobs(JOB_STATUS* jobs, int maxJobs) {
+        if (maxJobs < 0 || (maxJobs > 0 && !jobs)) {
+            SetLastErrorMessage(L"Invalid parameters");
+            return -1;
+        }
+
+        std::vector<BackupCore::JobStatusEntry> running;
+        std::string error;
+        if (!BackupCore::ReadJobStatus(running, error)) {
+            SetLastErrorMessage(Widen(error));
+            return -2;
+        }
+
+        for (int i = 0; i < maxJobs && i < (int)running.size(); i++) {
+            const BackupCore::JobStatusEntry& entry = running[i];
+            JOB_STATUS& job = jobs[i];
+            job.jobId = entry.jobId;
+            job.processId = entry.processId;
+            job.phase = entry.phase;
+            job.percent = entry.percent;
+            job.filesDone = entry.filesDone;
+            job.filesTotal = entry.filesTotal;
+            job.filesFailed = entry.filesFailed;
+            job.bytesDone = entry.bytesDone;
+            job.bytesTotal = entry.bytesTotal;
+            job.bytesPerSecond = entry.bytesPerSecond;
+            job.elapsedSeconds = entry.elapsedSeconds;
+            job.etaSeconds = entry.etaSeconds;
+            job.updatedUnixMs = entry.updatedUnixMs;
+
+            // Names are UTF-8 in shared memory
+            int length = MultiByteToWideChar(CP_UTF8, 0, entry.name, -1, job.name, _countof(job.name));
+            if (length == 0) {
+                job.name[0] = L'\0';
+            }
+        }
+        return (int)running.size();
+    }
+
+    BACKUPENGINE_API int StartTrace(const wchar_t* tracePath) {
+        if (!tracePath) {
+            SetLastErrorMessage(L"Invalid parameters");
+            return -1;
+        }
+
+        std::string error;
+        if (!BackupCore::StartTrace(tracePath, error)) {
+            SetLastErrorMessage(Widen(error));
+            return -2;
+        }
+        return 0;
+    }
+
+    BACKUPENGINE_API int StopTrace() {
+        std::string error;
+        if (!BackupCore::StopTrace(error)) {
+            SetLastErrorMessage(Widen(error));
+            return -1;
+        }
+        return 0;
+    }
+
     // Backup volume - implementation in BackupManager.cpp
     BACKUPENGINE_API int BackupVolume(
         const wchar_t* volumePath,
@@ -89,6 +246,21 @@ BACKUPENGINE_API void GetLastErrorMessage(wchar_t* buffer, int bufferSize) {
         bool restoreSystemState,
         ProgressCallback callback);
 
+    // Restore disk with options - implementation in RestoreEngine.cpp
+    BACKUPENGINE_API int RestoreDiskEx(
+        const wchar_t* backupPath,
+        int targetDiskNumber,
+        bool restoreSystemState,
+        int restoreFlags,
+        ProgressCallback callback);
+
+    // Clone disk - implementation in RestoreEngine.cpp
+    BACKUPENGINE_API int CloneDisk(
+        int sourceDiskNumber,
+        int targetDiskNumber,
+        int cloneFlags,
+        ProgressCallback callback);
+
     // Restore boot disk as Hyper-V - implementation in HyperVRestore.cpp
     BACKUPENGINE_API int RestoreBootDiskAsHyperV(
         const wchar_t* backupPath,
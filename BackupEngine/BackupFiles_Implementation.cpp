@@ -1,56 +1,57 @@
-// BackupFiles_Implementation.cpp - Core file backup with progress tracking
+// BackupFiles_Implementation.cpp - File backup exports on top of the portable core
 #include "BackupEngine.h"
+#include "Core/Catalog.h"
+#include "Core/FileBackup.h"
 #include <Windows.h>
 #include <string>
 #include <filesystem>
 #include <vector>
-#include <queue>
 #include <fstream>
 
 namespace fs = std::filesystem;
 extern void SetLastErrorMessage(const std::wstring& error);
+extern std::wstring Widen(const std::string& utf8);
+extern BackupCore::ProgressChannel::Sink MakeStatusSink(ProgressStatusCallback callback, void* context);
+extern uint32_t StatusInterval(int intervalMs);
+extern void SetLastFileErrors(const std::vector<BackupCore::FileError>& errors);
 
 namespace {
-    struct FileBackupEntry {
-        std::wstring sourcePath;
-        std::wstring destPath;
-        uintmax_t size;
-        FILETIME modifiedTime;
-        DWORD attributes;
-    };
-
-    bool CopyFileWithProgress(
-        const std::wstring& source,
-        const std::wstring& dest,
-        ProgressCallback callback,
-        void* context) {
-
-        BOOL result = CopyFileExW(
-            source.c_str(),
-            dest.c_str(),
-            [](LARGE_INTEGER totalSize,
-                LARGE_INTEGER totalTransferred,
-                LARGE_INTEGER streamSize,
-                LARGE_INTEGER streamTransferred,
-                DWORD streamNumber,
-                DWORD callbackReason,
-                HANDLE sourceFile,
-                HANDLE destFile,
-                LPVOID context) -> DWORD {
-
-                // Individual file progress can be reported here if needed
-                return PROGRESS_CONTINUE;
-            },
-            context,
-            NULL,
-            0);
-
-        return result != 0;
+    // A single-source call; no source at all is reported as invalid parameters
+    std::vector<std::wstring> SourceList(const wchar_t* sourcePath) {
+        std::vector<std::wstring> sources;
+        if (sourcePath) {
+            sources.push_back(sourcePath);
+        }
+        return sources;
     }
 
+    // backup_metadata.dat is still written for the incremental/differential code,
+    // which keys on FILETIME values; backup_catalog.dat is the portable record
     void SaveBackupMetadata(
         const std::wstring& backupPath,
-        const std::vector<FileBackupEntry>& files) {
+        const std::vector<std::wstring>& sources,
+        const BackupCore::BackupCatalog& catalog) {
+
+        // Entries of a multi-source set start with their source's folder
+        std::vector<fs::path> roots;
+        std::vector<fs::path> paths(sources.begin(), sources.end());
+        std::vector<std::string> folders = BackupCore::SourceFolders(paths);
+        for (const auto& source : paths) {
+            roots.push_back(BackupCore::ScanRoot(source));
+        }
+        auto sourcePath = [&](const std::string& relativePath) {
+            for (size_t i = 0; i < folders.size(); i++) {
+                const std::string& folder = folders[i];
+                if (folder.empty()) {
+                    return BackupCore::EntryPath(roots[i], relativePath);
+                }
+                if (relativePath.size() > folder.size() && relativePath.compare(0, folder.size(), folder) == 0 &&
+                    relativePath[folder.size()] == '/') {
+                    return BackupCore::EntryPath(roots[i], relativePath.substr(folder.size() + 1));
+                }
+            }
+            return fs::u8path(relativePath);
+        };
 
         std::wstring metadataPath = backupPath + L"\\backup_metadata.dat";
 
@@ -60,16 +61,18 @@ namespace {
 
             // Write header
             metadata << L"BACKUP_METADATA_V1\n";
-            metadata << L"FileCount:" << files.size() << L"\n";
+            metadata << L"FileCount:" << catalog.entries.size() << L"\n";
             metadata << L"---\n";
 
             // Write file entries
-            for (const auto& file : files) {
-                metadata << file.sourcePath << L"|"
-                    << file.size << L"|"
-                    << file.modifiedTime.dwLowDateTime << L"|"
-                    << file.modifiedTime.dwHighDateTime << L"|"
-                    << file.attributes << L"\n";
+            for (const auto& entry : catalog.entries) {
+                // Catalog times are Unix nanoseconds; FILETIME counts 100 ns since 1601
+                ULONGLONG ticks = (ULONGLONG)(entry.file.modifiedTime / 100 + 116444736000000000LL);
+                metadata << sourcePath(entry.file.relativePath).wstring() << L"|"
+                    << entry.file.size << L"|"
+                    << (DWORD)(ticks & 0xFFFFFFFF) << L"|"
+                    << (DWORD)(ticks >> 32) << L"|"
+                    << entry.file.attributes << L"\n";
             }
 
             metadata.close();
@@ -80,218 +83,163 @@ namespace {
     }
 }
 
-extern "C" {
-
-    BACKUPENGINE_API int BackupFiles(
-        const wchar_t* sourcePath,
-        const wchar_t* destPath,
-        ProgressCallback callback) {
+// Shared by BackupFilesEx, BackupFilesWithStatus and the backup jobs.
+// Several sources make one set (BackupFileSources); a non-empty UTF-8
+// password encrypts it.
+int RunFileBackup(
+    const std::vector<std::wstring>& sourcePaths,
+    const wchar_t* destPath,
+    int backupFlags,
+    ProgressCallback callback,
+    BackupCore::ProgressChannel* channel,
+    BackupCore::JobControl* control,
+    const std::string& password) {
+
+    SetLastFileErrors({});
+    if (sourcePaths.empty() || !destPath) {
+        SetLastErrorMessage(L"Invalid parameters");
+        return -1;
+    }
 
-        if (!sourcePath || !destPath) {
-            SetLastErrorMessage(L"Invalid parameters");
-            return -1;
+    try {
+        if (callback) {
+            callback(0, L"Starting file backup...");
         }
 
-        try {
-            if (callback) {
-                callback(0, L"Starting file backup...");
-            }
-
-            // Verify source exists
+        // Verify the sources exist
+        std::vector<fs::path> sources;
+        std::string names;
+        for (const auto& sourcePath : sourcePaths) {
             if (!fs::exists(sourcePath)) {
-                SetLastErrorMessage(L"Source path does not exist");
+                SetLastErrorMessage(L"Source path does not exist: " + sourcePath);
                 return -2;
             }
+            sources.push_back(sourcePath);
+            names += (names.empty() ? "" : ", ") + sources.back().u8string();
+        }
 
-            // Create destination directory
-            fs::create_directories(destPath);
-
-            if (callback) {
-                callback(5, L"Scanning files...");
-            }
-
-            // Collect all files to backup
-            std::vector<FileBackupEntry> filesToBackup;
-            uintmax_t totalSize = 0;
-
-            if (fs::is_directory(sourcePath)) {
-                // Backup entire directory recursively
-                for (const auto& entry : fs::recursive_directory_iterator(
-                    sourcePath,
-                    fs::directory_options::skip_permission_denied)) {
-
-                    if (entry.is_regular_file()) {
-                        try {
-                            FileBackupEntry fileEntry;
-                            fileEntry.sourcePath = entry.path().wstring();
-                            fileEntry.size = entry.file_size();
-                            fileEntry.attributes = GetFileAttributesW(fileEntry.sourcePath.c_str());
-
-                            // Get modification time
-                            HANDLE hFile = CreateFileW(
-                                fileEntry.sourcePath.c_str(),
-                                GENERIC_READ,
-                                FILE_SHARE_READ,
-                                NULL,
-                                OPEN_EXISTING,
-                                FILE_ATTRIBUTE_NORMAL,
-                                NULL);
-
-                            if (hFile != INVALID_HANDLE_VALUE) {
-                                GetFileTime(hFile, nullptr, nullptr, &fileEntry.modifiedTime);
-                                CloseHandle(hFile);
-                            }
-
-                            // Calculate relative path for destination
-                            fs::path relativePath = fs::relative(entry.path(), sourcePath);
-                            fileEntry.destPath = (fs::path(destPath) / relativePath).wstring();
+        // Visible to the service and UIs through GetRunningJobs
+        channel->Publish("Backup files " + names + " -> " + fs::path(destPath).u8string());
+
+        // Scan, copy, compression and catalog are shared with the Linux tools
+        BackupCore::FileBackupOptions options;
+        options.codec = (backupFlags & BACKUP_FLAG_COMPRESS)
+            ? BackupCore::CompressionCodec::Lz
+            : BackupCore::CompressionCodec::None;
+        options.password = password;
+        options.parityShards = (backupFlags & BACKUP_FLAG_PARITY) ? 2 : 0;
+        options.channel = channel;
+        options.control = control;
+
+        // Left empty without a callback so the core never builds messages
+        BackupCore::BackupProgress progress;
+        if (callback) {
+            progress = [callback](int percentage, const std::string& message) {
+                callback(percentage, Widen(message).c_str());
+            };
+        }
 
-                            filesToBackup.push_back(fileEntry);
-                            totalSize += fileEntry.size;
-                        }
-                        catch (const fs::filesystem_error&) {
-                            // Skip files we can't access
-                            continue;
-                        }
-                    }
-                }
-            }
-            else if (fs::is_regular_file(sourcePath)) {
-                // Backup single file
-                FileBackupEntry fileEntry;
-                fileEntry.sourcePath = sourcePath;
-                fileEntry.size = fs::file_size(sourcePath);
-                fileEntry.attributes = GetFileAttributesW(sourcePath);
+        BackupCore::FileSetResult result;
+        std::string error;
+        int rc = BackupCore::BackupFileSources(sources, destPath, options, progress, result, error);
+        SetLastFileErrors(result.errors);
 
-                fs::path sourceFilePath(sourcePath);
-                fileEntry.destPath = (fs::path(destPath) / sourceFilePath.filename()).wstring();
+        if (rc != 0) {
+            SetLastErrorMessage(Widen(error));
+            return rc;
+        }
 
-                filesToBackup.push_back(fileEntry);
-                totalSize = fileEntry.size;
-            }
-            else {
-                SetLastErrorMessage(L"Source is not a valid file or directory");
-                return -3;
-            }
+        // Unreadable files were skipped; report the first one but keep the backup
+        if (result.failed > 0) {
+            SetLastErrorMessage(L"Failed to copy " + std::to_wstring(result.failed) +
+                L" files, first: " + Widen(result.firstFailure));
+        }
 
-            if (filesToBackup.empty()) {
-                SetLastErrorMessage(L"No files to backup");
-                return -4;
-            }
+        BackupCore::BackupCatalog catalog;
+        if (BackupCore::LoadCatalog(destPath, catalog, error)) {
+            SaveBackupMetadata(destPath, sourcePaths, catalog);
+        }
 
-            if (callback) {
-                std::wstring msg = L"Backing up " + std::to_wstring(filesToBackup.size()) + 
-                    L" files (" + std::to_wstring(totalSize / (1024 * 1024)) + L" MB)...";
-                callback(10, msg.c_str());
+        // Create backup info file
+        std::wstring infoPath = std::wstring(destPath) + L"\\backup_info.txt";
+        try {
+            std::wofstream info(infoPath);
+            info << L"Backup Information\n";
+            info << L"==================\n\n";
+            for (const auto& sourcePath : sourcePaths) {
+                info << L"Source: " << sourcePath << L"\n";
             }
+            info << L"Destination: " << destPath << L"\n";
+            info << L"Date: " << __DATE__ << L" " << __TIME__ << L"\n";
+            info << L"Total Files: " << result.files << L"\n";
+            info << L"Total Size: " << (result.bytes / (1024 * 1024)) << L" MB\n";
+            info << L"Stored Size: " << (result.storedBytes / (1024 * 1024)) << L" MB\n";
+            info << L"Compression: " << (options.codec == BackupCore::CompressionCodec::Lz ? L"LZ" : L"None") << L"\n";
+            info << L"Parity: " << options.parityShards << L" per " << BackupCore::ParityDataShards << L" shards\n";
+            info << L"Encryption: " << Widen(BackupCore::CipherName(catalog.encryption.cipher)) << L"\n";
+            info.close();
+        }
+        catch (...) {
+            // Non-critical
+        }
 
-            // Backup files
-            size_t processedFiles = 0;
-            uintmax_t processedBytes = 0;
-
-            for (const auto& fileEntry : filesToBackup) {
-                // Create destination directory
-                fs::path destDir = fs::path(fileEntry.destPath).parent_path();
-                if (!fs::exists(destDir)) {
-                    fs::create_directories(destDir);
-                }
-
-                // Copy file
-                if (!CopyFileWithProgress(
-                    fileEntry.sourcePath,
-                    fileEntry.destPath,
-                    callback,
-                    nullptr)) {
-
-                    DWORD error = ::GetLastError();
-                    if (error == ERROR_ACCESS_DENIED) {
-                        // Skip files we can't access
-                        continue;
-                    }
-                    else {
-                        std::wstring errorMsg = L"Failed to copy file: " + fileEntry.sourcePath +
-                            L" (Error: " + std::to_wstring(error) + L")";
-                        SetLastErrorMessage(errorMsg);
-                        // Continue with other files instead of failing completely
-                        continue;
-                    }
-                }
-
-                // Preserve file attributes and timestamps
-                SetFileAttributesW(fileEntry.destPath.c_str(), fileEntry.attributes);
-
-                HANDLE hDest = CreateFileW(
-                    fileEntry.destPath.c_str(),
-                    FILE_WRITE_ATTRIBUTES,
-                    0,
-                    NULL,
-                    OPEN_EXISTING,
-                    FILE_ATTRIBUTE_NORMAL,
-                    NULL);
-
-                if (hDest != INVALID_HANDLE_VALUE) {
-                    SetFileTime(hDest, nullptr, nullptr, &fileEntry.modifiedTime);
-                    CloseHandle(hDest);
-                }
+        if (callback) {
+            callback(100, L"Backup completed successfully");
+        }
 
-                processedFiles++;
-                processedBytes += fileEntry.size;
+        return 0;
+    }
+    catch (const fs::filesystem_error& e) {
+        std::wstring error = L"Filesystem error: ";
+        error += std::wstring(e.what(), e.what() + strlen(e.what()));
+        SetLastErrorMessage(error);
+        return -5;
+    }
+    catch (const std::exception& e) {
+        std::wstring error = L"Exception: ";
+        error += std::wstring(e.what(), e.what() + strlen(e.what()));
+        SetLastErrorMessage(error);
+        return -6;
+    }
+    catch (...) {
+        SetLastErrorMessage(L"Unknown exception in BackupFiles");
+        return -99;
+    }
+}
 
-                if (callback && !filesToBackup.empty()) {
-                    int percent = 10 + (int)((processedBytes * 85) / totalSize);
-                    std::wstring msg = L"Backed up " + std::to_wstring(processedFiles) +
-                        L" of " + std::to_wstring(filesToBackup.size()) + L" files";
-                    callback(percent, msg.c_str());
-                }
-            }
+extern "C" {
 
-            // Save backup metadata
-            if (callback) {
-                callback(95, L"Saving backup metadata...");
-            }
+    BACKUPENGINE_API int BackupFiles(
+        const wchar_t* sourcePath,
+        const wchar_t* destPath,
+        ProgressCallback callback) {
 
-            SaveBackupMetadata(destPath, filesToBackup);
+        return BackupFilesEx(sourcePath, destPath, 0, callback);
+    }
 
-            // Create backup info file
-            std::wstring infoPath = std::wstring(destPath) + L"\\backup_info.txt";
-            try {
-                std::wofstream info(infoPath);
-                info << L"Backup Information\n";
-                info << L"==================\n\n";
-                info << L"Source: " << sourcePath << L"\n";
-                info << L"Destination: " << destPath << L"\n";
-                info << L"Date: " << __DATE__ << L" " << __TIME__ << L"\n";
-                info << L"Total Files: " << filesToBackup.size() << L"\n";
-                info << L"Total Size: " << (totalSize / (1024 * 1024)) << L" MB\n";
-                info.close();
-            }
-            catch (...) {
-                // Non-critical
-            }
+    BACKUPENGINE_API int BackupFilesEx(
+        const wchar_t* sourcePath,
+        const wchar_t* destPath,
+        int backupFlags,
+        ProgressCallback callback) {
 
-            if (callback) {
-                callback(100, L"Backup completed successfully");
-            }
+        BackupCore::ProgressChannel channel(nullptr);
+        int rc = RunFileBackup(SourceList(sourcePath), destPath, backupFlags, callback, &channel, nullptr, std::string());
+        channel.Finish(rc == 0);
+        return rc;
+    }
 
-            return 0;
-        }
-        catch (const fs::filesystem_error& e) {
-            std::wstring error = L"Filesystem error: ";
-            error += std::wstring(e.what(), e.what() + strlen(e.what()));
-            SetLastErrorMessage(error);
-            return -5;
-        }
-        catch (const std::exception& e) {
-            std::wstring error = L"Exception: ";
-            error += std::wstring(e.what(), e.what() + strlen(e.what()));
-            SetLastErrorMessage(error);
-            return -6;
-        }
-        catch (...) {
-            SetLastErrorMessage(L"Unknown exception in BackupFiles");
-            return -99;
-        }
+    BACKUPENGINE_API int BackupFilesWithStatus(
+        const wchar_t* sourcePath,
+        const wchar_t* destPath,
+        int backupFlags,
+        ProgressStatusCallback callback,
+        void* context,
+        int intervalMs) {
+
+        BackupCore::ProgressChannel channel(MakeStatusSink(callback, context), StatusInterval(intervalMs));
+        int rc = RunFileBackup(SourceList(sourcePath), destPath, backupFlags, nullptr, &channel, nullptr, std::string());
+        channel.Finish(rc == 0);
+        return rc;
     }
 }
-
-
@@ -1,5 +1,6 @@
 // BackupInfo_Implementation.cpp - Get backup information and list contents
 #include "BackupEngine.h"
+#include "Core/Retention.h"
 #include <Windows.h>
 #include <string>
 #include <filesystem>
@@ -9,6 +10,7 @@
 
 namespace fs = std::filesystem;
 extern void SetLastErrorMessage(const std::wstring& error);
+extern std::wstring Widen(const std::string& utf8);
 
 extern "C" {
 
@@ -56,7 +58,11 @@ extern "C" {
                     if (entry.is_regular_file()) {
                         // Skip metadata files
                         if (entry.path().filename() != L"backup_metadata.dat" &&
-                            entry.path().filename() != L"backup_info.txt") {
+                            entry.path().filename() != L"backup_catalog.dat" &&
+                            entry.path().filename() != L"backup_info.txt" &&
+                            entry.path().filename() != L"backup_base.txt" &&
+                            entry.path().filename() != L"backup_scrub.dat" &&
+                            entry.path().filename() != L"backup_lock") {
                             fileCount++;
                             try {
                                 totalSize += entry.file_size();
@@ -118,7 +124,9 @@ extern "C" {
                 if (entry.is_regular_file()) {
                     // Skip metadata files
                     std::wstring filename = entry.path().filename().wstring();
-                    if (filename == L"backup_metadata.dat" || filename == L"backup_info.txt") {
+                    if (filename == L"backup_metadata.dat" || filename == L"backup_catalog.dat" ||
+                        filename == L"backup_info.txt" || filename == L"backup_base.txt" ||
+                        filename == L"backup_scrub.dat" || filename == L"backup_lock") {
                         continue;
                     }
 
@@ -186,4 +194,95 @@ extern "C" {
             return -99;
         }
     }
+
+    BACKUPENGINE_API int PruneBackups(
+        const wchar_t* destPath,
+        const wchar_t* jobName,
+        int keepLast,
+        int keepDaily,
+        int keepWeekly,
+        int keepMonthly,
+        bool dryRun,
+        ProgressCallback callback) {
+
+        if (!destPath || !jobName || !*jobName || keepLast < 0 || keepDaily < 0 || keepWeekly < 0 || keepMonthly < 0) {
+            SetLastErrorMessage(L"Invalid parameters");
+            return -1;
+        }
+
+        try {
+            BackupCore::PruneOptions options;
+            options.policy.keepLast = (uint32_t)keepLast;
+            options.policy.keepDaily = (uint32_t)keepDaily;
+            options.policy.keepWeekly = (uint32_t)keepWeekly;
+            options.policy.keepMonthly = (uint32_t)keepMonthly;
+            options.dryRun = dryRun;
+
+            BackupCore::BackupProgress progress;
+            if (callback) {
+                progress = [callback](int percentage, const std::string& message) {
+                    callback(percentage, Widen(message).c_str());
+                };
+            }
+
+            BackupCore::PruneResult result;
+            std::string error;
+            int rc = BackupCore::PruneBackupSets(destPath, fs::path(jobName).u8string(), options, progress, result, error);
+            if (callback) {
+                for (const auto& set : result.sets) {
+                    std::string line = (set.keep ? "Keep " : (dryRun ? "Would delete " : "Delete ")) + set.name +
+                        (set.keep ? " (" + set.reason + ")" : "");
+                    callback(100, Widen(line).c_str());
+                }
+                for (const auto& warning : result.warnings) {
+                    callback(100, Widen(warning).c_str());
+                }
+            }
+            if (rc != 0) {
+                SetLastErrorMessage(Widen(error));
+            }
+            return rc;
+        }
+        catch (...) {
+            SetLastErrorMessage(L"Exception in PruneBackups");
+            return -99;
+        }
+    }
+
+    BACKUPENGINE_API int CompactBackup(
+        const wchar_t* backupPath,
+        unsigned long long budgetBytes,
+        bool dryRun,
+        ProgressCallback callback) {
+
+        if (!backupPath) {
+            SetLastErrorMessage(L"Invalid parameters");
+            return -1;
+        }
+
+        try {
+            BackupCore::FileCompactOptions options;
+            options.budgetBytes = budgetBytes;
+            options.dryRun = dryRun;
+
+            BackupCore::BackupProgress progress;
+            if (callback) {
+                progress = [callback](int percentage, const std::string& message) {
+                    callback(percentage, Widen(message).c_str());
+                };
+            }
+
+            BackupCore::FileSetResult result;
+            std::string error;
+            int rc = BackupCore::CompactFileSet(backupPath, options, progress, result, error);
+            if (rc != 0) {
+                SetLastErrorMessage(Widen(error));
+            }
+            return rc;
+        }
+        catch (...) {
+            SetLastErrorMessage(L"Exception in CompactBackup");
+            return -99;
+        }
+    }
 }
@@ -0,0 +1,392 @@
+// BackupJobs.cpp - Asynchronous job exports (StartBackupJob, PollJob, CancelJob, ...)
+#include "BackupEngine.h"
+#include "Core/FileBackup.h"
+#include "Core/Job.h"
+#include <Windows.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+extern void SetLastErrorMessage(const std::wstring& error);
+extern std::wstring Widen(const std::string& utf8);
+extern BackupCore::ProgressChannel::Sink MakeStatusSink(ProgressStatusCallback callback, void* context);
+extern uint32_t StatusInterval(int intervalMs);
+extern const std::vector<BackupCore::FileError>& LastFileErrors();
+extern int CopyFileErrors(const std::vector<BackupCore::FileError>& source, BACKUP_FILE_ERROR* errors, int maxErrors);
+
+extern int RunFileBackup(const std::vector<std::wstring>& sourcePaths, const wchar_t* destPath, int backupFlags,
+    ProgressCallback callback, BackupCore::ProgressChannel* channel, BackupCore::JobControl* control,
+    const std::string& password);
+extern int RunVerifyBackup(const wchar_t* backupPath, ProgressCallback callback,
+    BackupCore::ProgressChannel* channel, BackupCore::JobControl* control, const std::string& password);
+extern int RunScrubBackup(const wchar_t* backupPath, uint64_t bytesPerSecond, bool continuous,
+    BackupCore::ProgressChannel* channel, BackupCore::JobControl* control, const std::string& password);
+extern int RunRestoreFiles(const wchar_t* sourcePath, const wchar_t* destPath, bool overwriteExisting,
+    ProgressCallback callback, BackupCore::ProgressChannel* channel, BackupCore::JobControl* control,
+    const std::string& password);
+
+// The handle keeps the job alive; the pool holds its own reference while it runs.
+// fileErrors is written by the work before the job finishes, so it is read
+// only once Wait says the job is done.
+struct BACKUP_JOB_T {
+    std::shared_ptr<BackupCore::Job> job;
+    std::shared_ptr<std::vector<BackupCore::FileError>> fileErrors;
+};
+
+namespace {
+    // Job errors are kept as UTF-8 like the rest of the core
+    std::string Narrow(const std::wstring& wide) {
+        if (wide.empty()) return std::string();
+        int length = WideCharToMultiByte(CP_UTF8, 0, wide.data(), (int)wide.size(), NULL, 0, NULL, NULL);
+        std::string utf8(length, '\0');
+        WideCharToMultiByte(CP_UTF8, 0, wide.data(), (int)wide.size(), &utf8[0], length, NULL, NULL);
+        return utf8;
+    }
+
+    // Runs one of the Run* functions on a pool thread. The error text and file
+    // errors live in that thread's storage, so they are copied into the job
+    // before the next job on the same thread replaces them.
+    template <typename Run>
+    BACKUP_JOB Start(Run run, ProgressStatusCallback callback, void* context, int intervalMs) {
+        try {
+            auto fileErrors = std::make_shared<std::vector<BackupCore::FileError>>();
+            auto work = [run, fileErrors](BackupCore::Job& job) -> int {
+                SetLastErrorMessage(L"");
+                int rc = run(job);
+                *fileErrors = LastFileErrors();
+                if (rc != 0) {
+                    wchar_t buffer[1024] = {};
+                    GetLastErrorMessage(buffer, 1024);
+                    job.SetError(Narrow(buffer));
+                }
+                return rc;
+            };
+
+            BACKUP_JOB handle = new BACKUP_JOB_T;
+            handle->fileErrors = fileErrors;
+            handle->job = BackupCore::StartJob(work, MakeStatusSink(callback, context), StatusInterval(intervalMs));
+            return handle;
+        }
+        catch (const std::exception& e) {
+            SetLastErrorMessage(L"Failed to start job: " + Widen(e.what()));
+            return NULL;
+        }
+    }
+
+    int ToJobState(BackupCore::JobState state) {
+        switch (state) {
+        case BackupCore::JobState::Queued: return JOB_STATE_QUEUED;
+        case BackupCore::JobState::Running: return JOB_STATE_RUNNING;
+        case BackupCore::JobState::Paused: return JOB_STATE_PAUSED;
+        case BackupCore::JobState::Completed: return JOB_STATE_COMPLETED;
+        case BackupCore::JobState::Failed: return JOB_STATE_FAILED;
+        case BackupCore::JobState::Cancelled: return JOB_STATE_CANCELLED;
+        }
+        return JOB_STATE_FAILED;
+    }
+}
+
+extern "C" {
+
+    BACKUPENGINE_API BACKUP_JOB StartBackupJob(
+        const wchar_t* sourcePath,
+        const wchar_t* destPath,
+        int backupFlags,
+        ProgressStatusCallback callback,
+        void* context,
+        int intervalMs) {
+
+        if (!sourcePath || !destPath) {
+            SetLastErrorMessage(L"Invalid parameters");
+            return NULL;
+        }
+
+        // The caller's strings may be gone by the time the job runs
+        std::vector<std::wstring> sources{ sourcePath };
+        std::wstring dest(destPath);
+        return Start([sources, dest, backupFlags](BackupCore::Job& job) {
+            return RunFileBackup(sources, dest.c_str(), backupFlags, nullptr,
+                &job.Progress(), &job.Control(), std::string());
+        }, callback, context, intervalMs);
+    }
+
+    BACKUPENGINE_API BACKUP_JOB StartBackupSourcesJob(
+        const wchar_t* const* sourcePaths,
+        int sourceCount,
+        const wchar_t* destPath,
+        int backupFlags,
+        ProgressStatusCallback callback,
+        void* context,
+        int intervalMs) {
+
+        if (!sourcePaths || sourceCount <= 0 || !destPath) {
+            SetLastErrorMessage(L"Invalid parameters");
+            return NULL;
+        }
+
+        std::vector<std::wstring> sources;
+        for (int i = 0; i < sourceCount; i++) {
+            if (!sourcePaths[i]) {
+                SetLastErrorMessage(L"Invalid parameters");
+                return NULL;
+            }
+            sources.push_back(sourcePaths[i]);
+        }
+
+        std::wstring dest(destPath);
+        return Start([sources, dest, backupFlags](BackupCore::Job& job) {
+            return RunFileBackup(sources, dest.c_str(), backupFlags, nullptr,
+                &job.Progress(), &job.Control(), std::string());
+        }, callback, context, intervalMs);
+    }
+
+    BACKUPENGINE_API BACKUP_JOB StartEncryptedBackupJob(
+        const wchar_t* const* sourcePaths,
+        int sourceCount,
+        const wchar_t* destPath,
+        int backupFlags,
+        const wchar_t* password,
+        ProgressStatusCallback callback,
+        void* context,
+        int intervalMs) {
+
+        if (!sourcePaths || sourceCount <= 0 || !destPath || !password || !*password) {
+            SetLastErrorMessage(L"Invalid parameters");
+            return NULL;
+        }
+
+        std::vector<std::wstring> sources;
+        for (int i = 0; i < sourceCount; i++) {
+            if (!sourcePaths[i]) {
+                SetLastErrorMessage(L"Invalid parameters");
+                return NULL;
+            }
+            sources.push_back(sourcePaths[i]);
+        }
+
+        std::wstring dest(destPath);
+        std::string secret = Narrow(password);
+        return Start([sources, dest, backupFlags, secret](BackupCore::Job& job) {
+            return RunFileBackup(sources, dest.c_str(), backupFlags, nullptr,
+                &job.Progress(), &job.Control(), secret);
+        }, callback, context, intervalMs);
+    }
+
+    BACKUPENGINE_API BACKUP_JOB StartVerifyJob(
+        const wchar_t* backupPath,
+        ProgressStatusCallback callback,
+        void* context,
+        int intervalMs) {
+
+        if (!backupPath) {
+            SetLastErrorMessage(L"Invalid parameters");
+            return NULL;
+        }
+
+        std::wstring backup(backupPath);
+        return Start([backup](BackupCore::Job& job) {
+            return RunVerifyBackup(backup.c_str(), nullptr, &job.Progress(), &job.Control(), std::string());
+        }, callback, context, intervalMs);
+    }
+
+    BACKUPENGINE_API BACKUP_JOB StartEncryptedVerifyJob(
+        const wchar_t* backupPath,
+        const wchar_t* password,
+        ProgressStatusCallback callback,
+        void* context,
+        int intervalMs) {
+
+        if (!backupPath || !password) {
+            SetLastErrorMessage(L"Invalid parameters");
+            return NULL;
+        }
+
+        std::wstring backup(backupPath);
+        std::string secret = Narrow(password);
+        return Start([backup, secret](BackupCore::Job& job) {
+            return RunVerifyBackup(backup.c_str(), nullptr, &job.Progress(), &job.Control(), secret);
+        }, callback, context, intervalMs);
+    }
+
+    BACKUPENGINE_API BACKUP_JOB StartScrubJob(
+        const wchar_t* backupPath,
+        const wchar_t* password,
+        unsigned long long bytesPerSecond,
+        bool continuous,
+        ProgressStatusCallback callback,
+        void* context,
+        int intervalMs) {
+
+        if (!backupPath) {
+            SetLastErrorMessage(L"Invalid parameters");
+            return NULL;
+        }
+
+        std::wstring backup(backupPath);
+        std::string secret = password ? Narrow(password) : std::string();
+        uint64_t rate = bytesPerSecond > 0 ? bytesPerSecond : BackupCore::DefaultScrubBytesPerSecond;
+        return Start([backup, secret, rate, continuous](BackupCore::Job& job) {
+            return RunScrubBackup(backup.c_str(), rate, continuous, &job.Progress(), &job.Control(), secret);
+        }, callback, context, intervalMs);
+    }
+
+    BACKUPENGINE_API BACKUP_JOB StartRestoreJob(
+        const wchar_t* backupPath,
+        const wchar_t* restorePath,
+        bool overwriteExisting,
+        ProgressStatusCallback callback,
+        void* context,
+        int intervalMs) {
+
+        if (!backupPath || !restorePath) {
+            SetLastErrorMessage(L"Invalid parameters");
+            return NULL;
+        }
+
+        std::wstring backup(backupPath), restore(restorePath);
+        return Start([backup, restore, overwriteExisting](BackupCore::Job& job) {
+            return RunRestoreFiles(backup.c_str(), restore.c_str(), overwriteExisting, nullptr,
+                &job.Progress(), &job.Control(), std::string());
+        }, callback, context, intervalMs);
+    }
+
+    BACKUPENGINE_API BACKUP_JOB StartEncryptedRestoreJob(
+        const wchar_t* backupPath,
+        const wchar_t* restorePath,
+        bool overwriteExisting,
+        const wchar_t* password,
+        ProgressStatusCallback callback,
+        void* context,
+        int intervalMs) {
+
+        if (!backupPath || !restorePath || !password) {
+            SetLastErrorMessage(L"Invalid parameters");
+            return NULL;
+        }
+
+        std::wstring backup(backupPath), restore(restorePath);
+        std::string secret = Narrow(password);
+        return Start([backup, restore, overwriteExisting, secret](BackupCore::Job& job) {
+            return RunRestoreFiles(backup.c_str(), restore.c_str(), overwriteExisting, nullptr,
+                &job.Progress(), &job.Control(), secret);
+        }, callback, context, intervalMs);
+    }
+
+    BACKUPENGINE_API int PollJob(
+        BACKUP_JOB job,
+        BACKUP_PROGRESS* progress) {
+
+        if (!job) {
+            return -1;
+        }
+
+        if (progress) {
+            BackupCore::ProgressStatus status = job->job->Status();
+            *progress = BACKUP_PROGRESS();
+            progress->phase = status.phase;
+            progress->percent = status.percent;
+            progress->filesDone = status.filesDone;
+            progress->filesTotal = status.filesTotal;
+            progress->filesFailed = status.filesFailed;
+            progress->bytesDone = status.bytesDone;
+            progress->bytesTotal = status.bytesTotal;
+            progress->bytesPerSecond = status.bytesPerSecond;
+            progress->elapsedSeconds = status.elapsedSeconds;
+            progress->etaSeconds = status.etaSeconds;
+        }
+        return ToJobState(job->job->State());
+    }
+
+    BACKUPENGINE_API int WaitJob(
+        BACKUP_JOB job,
+        int timeoutMs,
+        int* result) {
+
+        if (!job) {
+            return -1;
+        }
+
+        if (!job->job->Wait(timeoutMs)) {
+            return 1;
+        }
+        if (result) {
+            *result = job->job->Result();
+        }
+        return 0;
+    }
+
+    BACKUPENGINE_API int CancelJob(
+        BACKUP_JOB job) {
+
+        if (!job) {
+            return -1;
+        }
+        job->job->Control().Cancel();
+        return 0;
+    }
+
+    BACKUPENGINE_API int PauseJob(
+        BACKUP_JOB job) {
+
+        if (!job) {
+            return -1;
+        }
+        job->job->Control().Pause();
+        return 0;
+    }
+
+    BACKUPENGINE_API int ResumeJob(
+        BACKUP_JOB job) {
+
+        if (!job) {
+            return -1;
+        }
+        job->job->Control().Resume();
+        return 0;
+    }
+
+    BACKUPENGINE_API int SetJobThrottle(
+        BACKUP_JOB job,
+        unsigned long long readBytesPerSecond,
+        unsigned long long writeBytesPerSecond,
+        unsigned long long operationsPerSecond) {
+
+        if (!job) {
+            return -1;
+        }
+        job->job->Control().Throttle().SetLimits(readBytesPerSecond, writeBytesPerSecond, operationsPerSecond);
+        return 0;
+    }
+
+    BACKUPENGINE_API int GetJobError(
+        BACKUP_JOB job,
+        wchar_t* buffer,
+        int bufferSize) {
+
+        if (!job || !buffer || bufferSize <= 0) {
+            return -1;
+        }
+        wcsncpy_s(buffer, bufferSize, Widen(job->job->Error()).c_str(), _TRUNCATE);
+        return 0;
+    }
+
+    BACKUPENGINE_API int GetJobFileErrors(
+        BACKUP_JOB job,
+        BACKUP_FILE_ERROR* errors,
+        int maxErrors) {
+
+        if (!job) {
+            return -1;
+        }
+        if (!job->job->Wait(0)) {
+            return 0;
+        }
+        return CopyFileErrors(*job->fileErrors, errors, maxErrors);
+    }
+
+    BACKUPENGINE_API void CloseJob(
+        BACKUP_JOB job) {
+
+        delete job;
+    }
+}
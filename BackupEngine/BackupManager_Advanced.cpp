@@ -1,19 +1,25 @@
 // BackupManager_Advanced.cpp - Advanced backup functions (Volume, Disk, Incremental, Differential)
 #include "BackupEngine.h"
+#include "Core/BlockDevice.h"
+#include "Core/DiskImage.h"
+#include "Core/Retention.h"
 #include <Windows.h>
 #include <string>
 #include <filesystem>
 #include <fstream>
 #include <map>
+#include <memory>
 #include <vector>
 
 namespace fs = std::filesystem;
 extern void SetLastErrorMessage(const std::wstring& error);
+extern std::wstring Widen(const std::string& utf8);
 
-// Forward declare BackupFiles from BackupEngine.cpp
-extern "C" BACKUPENGINE_API int BackupFiles(
+// Forward declare BackupFilesEx from BackupFiles_Implementation.cpp
+extern "C" BACKUPENGINE_API int BackupFilesEx(
     const wchar_t* sourcePath,
     const wchar_t* destPath,
+    int backupFlags,
     ProgressCallback callback);
 
 namespace {
@@ -110,7 +116,7 @@ extern "C" {
             }
 
             // Backup files from volume
-            int result = BackupFiles(volumePath, destPath, callback);
+            int result = BackupFilesEx(volumePath, destPath, compress ? BACKUP_FLAG_COMPRESS : 0, callback);
             
             if (result != 0) {
                 SetLastErrorMessage(L"Failed to backup volume files");
@@ -160,93 +166,38 @@ extern "C" {
 
             // Open physical disk
             std::wstring diskPath = L"\\\\.\\PhysicalDrive" + std::to_wstring(diskNumber);
-            
-            HANDLE hDisk = CreateFileW(
-                diskPath.c_str(),
-                GENERIC_READ,
-                FILE_SHARE_READ | FILE_SHARE_WRITE,
-                NULL,
-                OPEN_EXISTING,
-                0,
-                NULL);
-
-            if (hDisk == INVALID_HANDLE_VALUE) {
-                SetLastErrorMessage(L"Failed to open disk");
-                return -2;
-            }
 
-            // Get disk size
-            DISK_GEOMETRY_EX diskGeometry = { 0 };
-            DWORD bytesReturned = 0;
+            std::string error;
+            std::unique_ptr<BackupCore::BlockDevice> disk =
+                BackupCore::BlockDevice::Open(diskPath, false, error);
 
-            if (!DeviceIoControl(hDisk, IOCTL_DISK_GET_DRIVE_GEOMETRY_EX,
-                NULL, 0, &diskGeometry, sizeof(diskGeometry),
-                &bytesReturned, NULL)) {
-                CloseHandle(hDisk);
-                SetLastErrorMessage(L"Failed to get disk geometry");
-                return -3;
+            if (!disk) {
+                SetLastErrorMessage(L"Failed to open disk");
+                return -2;
             }
 
             if (callback) {
-                callback(10, L"Reading disk sectors...");
+                callback(10, L"Reading partition table...");
             }
 
-            // Create backup file
+            // Image each partition as its own stream; gaps between partitions are skipped
             fs::create_directories(destPath);
-            std::wstring backupFile = std::wstring(destPath) + L"\\disk_" + 
-                std::to_wstring(diskNumber) + L".img";
-
-            HANDLE hBackup = CreateFileW(
-                backupFile.c_str(),
-                GENERIC_WRITE,
-                0,
-                NULL,
-                CREATE_ALWAYS,
-                FILE_ATTRIBUTE_NORMAL,
-                NULL);
-
-            if (hBackup == INVALID_HANDLE_VALUE) {
-                CloseHandle(hDisk);
-                SetLastErrorMessage(L"Failed to create backup file");
-                return -4;
-            }
-
-            // Read and write disk sectors
-            const DWORD bufferSize = 1024 * 1024; // 1MB buffer
-            std::vector<BYTE> buffer(bufferSize);
-            LONGLONG totalBytes = diskGeometry.DiskSize.QuadPart;
-            LONGLONG bytesProcessed = 0;
-
-            while (bytesProcessed < totalBytes) {
-                DWORD bytesToRead = (DWORD)min((LONGLONG)bufferSize, totalBytes - bytesProcessed);
-                DWORD bytesRead = 0;
-
-                if (!ReadFile(hDisk, buffer.data(), bytesToRead, &bytesRead, NULL)) {
-                    CloseHandle(hDisk);
-                    CloseHandle(hBackup);
-                    SetLastErrorMessage(L"Failed to read disk");
-                    return -5;
-                }
+            std::string baseName = "disk_" + std::to_string(diskNumber);
 
-                DWORD bytesWritten = 0;
-                if (!WriteFile(hBackup, buffer.data(), bytesRead, &bytesWritten, NULL)) {
-                    CloseHandle(hDisk);
-                    CloseHandle(hBackup);
-                    SetLastErrorMessage(L"Failed to write backup");
-                    return -6;
-                }
-
-                bytesProcessed += bytesRead;
+            BackupCore::DiskImageOptions options;
+            int result = BackupCore::ImageDisk(*disk, destPath, baseName, options,
+                [callback](int percentage, const std::string& message) {
+                    if (callback) {
+                        callback(10 + (percentage * 90) / 100, Widen(message).c_str());
+                    }
+                },
+                error);
 
-                if (callback && totalBytes > 0) {
-                    int percent = (int)((bytesProcessed * 90) / totalBytes) + 10;
-                    callback(percent, L"Backing up disk...");
-                }
+            if (result != 0) {
+                SetLastErrorMessage(Widen(error));
+                return result;
             }
 
-            CloseHandle(hDisk);
-            CloseHandle(hBackup);
-
             if (callback) {
                 callback(100, L"Disk backup completed successfully");
             }
@@ -281,9 +232,30 @@ extern "C" {
                 baseMetadata = LoadBackupMetadata(baseBackupPath);
             }
 
+            // The marker names the base backup folder; a trailing separator on
+            // the base path must not leave that name empty
+            std::string baseName;
+            if (baseBackupPath && wcslen(baseBackupPath) > 0) {
+                fs::path base = fs::path(baseBackupPath).lexically_normal();
+                if (base.filename().empty()) {
+                    base = base.parent_path();
+                }
+                baseName = base.filename().u8string();
+                if (baseName.empty()) {
+                    SetLastErrorMessage(L"Base backup path has no folder name");
+                    return -1;
+                }
+            }
+
             // Create destination directory
             fs::create_directories(destPath);
 
+            // Written before anything else, so pruning keeps the base while this runs
+            if (!baseName.empty()) {
+                std::ofstream base(fs::path(destPath) / BackupCore::BaseFileName, std::ios::binary);
+                base << baseName << "\n";
+            }
+
             if (callback) {
                 callback(10, L"Scanning for changed files...");
             }
@@ -4,11 +4,17 @@
 // This file now only contains VerifyBackup implementation
 //
 #include "BackupEngine.h"
+#include "Core/FileBackup.h"
 #include <Windows.h>
 #include <filesystem>
 #include <sstream>
 
 namespace fs = std::filesystem;
+extern void SetLastErrorMessage(const std::wstring& error);
+extern std::wstring Widen(const std::string& utf8);
+extern BackupCore::ProgressChannel::Sink MakeStatusSink(ProgressStatusCallback callback, void* context);
+extern uint32_t StatusInterval(int intervalMs);
+extern void SetLastFileErrors(const std::vector<BackupCore::FileError>& errors);
 
 // ListBackupContents is now in BackupInfo_Implementation.cpp
 // Commented out to avoid duplicate symbol
@@ -51,83 +57,192 @@ extern "C" {
 }
 */
 
-// VerifyBackup implementation
-extern "C" {
-    BACKUPENGINE_API int VerifyBackup(
-        const wchar_t* backupPath,
-        ProgressCallback callback) {
+// VerifyBackup implementation, shared by VerifyBackup, VerifyBackupWithStatus and StartVerifyJob
+int RunVerifyBackup(
+    const wchar_t* backupPath,
+    ProgressCallback callback,
+    BackupCore::ProgressChannel* channel,
+    BackupCore::JobControl* control,
+    const std::string& password) {
+
+    SetLastFileErrors({});
+    try {
+        if (callback) {
+            callback(0, L"Starting backup verification...");
+        }
 
-        try {
+        if (!fs::exists(backupPath)) {
             if (callback) {
-                callback(0, L"Starting backup verification...");
+                callback(0, L"Backup path does not exist");
             }
+            return -1;
+        }
 
-            if (!fs::exists(backupPath)) {
+        // Visible to the service and UIs through GetRunningJobs
+        channel->Publish("Verify " + fs::path(backupPath).u8string());
+
+        // Backup sets with a catalog are checked against their stored hashes
+        if (BackupCore::HasCatalog(backupPath)) {
+            BackupCore::FileSetResult result;
+            std::string error;
+            BackupCore::BackupProgress progress;
+            if (callback) {
+                progress = [callback](int percentage, const std::string& message) {
+                    callback(percentage, Widen(message).c_str());
+                };
+            }
+            BackupCore::FileVerifyOptions options;
+            options.password = password;
+            options.channel = channel;
+            options.control = control;
+            int rc = BackupCore::VerifyFileSet(backupPath, options, progress, result, error);
+            SetLastFileErrors(result.errors);
+
+            if (rc != 0) {
+                std::wstring msg = Widen(error);
+                SetLastErrorMessage(msg);
                 if (callback) {
-                    callback(0, L"Backup path does not exist");
+                    callback(0, msg.c_str());
                 }
-                return -1;
             }
+            return rc;
+        }
 
-            size_t totalFiles = 0;
-            size_t verifiedFiles = 0;
+        size_t totalFiles = 0;
+        size_t verifiedFiles = 0;
 
-            // Count files
-            for (const auto& entry : fs::recursive_directory_iterator(backupPath)) {
-                if (entry.is_regular_file()) {
-                    totalFiles++;
-                }
+        // Count files
+        for (const auto& entry : fs::recursive_directory_iterator(backupPath)) {
+            if (entry.is_regular_file()) {
+                totalFiles++;
             }
+        }
 
-            if (callback) {
-                std::wstring msg = L"Verifying " + std::to_wstring(totalFiles) + L" files...";
-                callback(10, msg.c_str());
-            }
+        if (callback) {
+            std::wstring msg = L"Verifying " + std::to_wstring(totalFiles) + L" files...";
+            callback(10, msg.c_str());
+        }
+        if (channel) {
+            channel->SetTotals(totalFiles, 0);
+            channel->SetPhase(BackupCore::ProgressPhase::Verifying);
+        }
+        int lastPercent = 10;
 
-            // Verify each file can be read
-            for (const auto& entry : fs::recursive_directory_iterator(backupPath)) {
-                if (entry.is_regular_file()) {
-                    HANDLE hFile = CreateFileW(
-                        entry.path().wstring().c_str(),
-                        GENERIC_READ,
-                        FILE_SHARE_READ,
-                        NULL,
-                        OPEN_EXISTING,
-                        FILE_ATTRIBUTE_NORMAL,
-                        NULL);
-
-                    if (hFile == INVALID_HANDLE_VALUE) {
-                        if (callback) {
-                            std::wstring msg = L"Failed to verify: " +
-                                entry.path().filename().wstring();
-                            callback(0, msg.c_str());
-                        }
-                        return -2;
+        // Verify each file can be read
+        for (const auto& entry : fs::recursive_directory_iterator(backupPath)) {
+            if (entry.is_regular_file()) {
+                if (!BackupCore::Checkpoint(control)) {
+                    return BackupCore::JobCancelledResult;
+                }
+
+                HANDLE hFile = CreateFileW(
+                    entry.path().wstring().c_str(),
+                    GENERIC_READ,
+                    FILE_SHARE_READ,
+                    NULL,
+                    OPEN_EXISTING,
+                    FILE_ATTRIBUTE_NORMAL,
+                    NULL);
+
+                if (hFile == INVALID_HANDLE_VALUE) {
+                    if (callback) {
+                        std::wstring msg = L"Failed to verify: " +
+                            entry.path().filename().wstring();
+                        callback(0, msg.c_str());
                     }
+                    return -2;
+                }
 
-                    CloseHandle(hFile);
-                    verifiedFiles++;
+                CloseHandle(hFile);
+                verifiedFiles++;
+                if (channel) {
+                    channel->AddFile(true);
+                }
 
-                    if (callback && totalFiles > 0) {
-                        int percent = 10 + (int)((verifiedFiles * 90) / totalFiles);
-                        std::wstring msg = L"Verified " + std::to_wstring(verifiedFiles) +
-                            L" of " + std::to_wstring(totalFiles) + L" files";
-                        callback(percent, msg.c_str());
-                    }
+                // Only report when the percentage moves, not once per file
+                int percent = totalFiles > 0 ? 10 + (int)((verifiedFiles * 90) / totalFiles) : 100;
+                if (callback && percent != lastPercent) {
+                    lastPercent = percent;
+                    std::wstring msg = L"Verified " + std::to_wstring(verifiedFiles) +
+                        L" of " + std::to_wstring(totalFiles) + L" files";
+                    callback(percent, msg.c_str());
                 }
             }
+        }
 
-            if (callback) {
-                callback(100, L"Backup verification completed successfully");
-            }
+        if (callback) {
+            callback(100, L"Backup verification completed successfully");
+        }
 
-            return 0;
+        return 0;
+    }
+    catch (...) {
+        if (callback) {
+            callback(0, L"Error during backup verification");
         }
-        catch (...) {
-            if (callback) {
-                callback(0, L"Error during backup verification");
-            }
-            return -99;
+        return -99;
+    }
+}
+
+// StartScrubJob; only sets with a catalog can be scrubbed
+int RunScrubBackup(
+    const wchar_t* backupPath,
+    uint64_t bytesPerSecond,
+    bool continuous,
+    BackupCore::ProgressChannel* channel,
+    BackupCore::JobControl* control,
+    const std::string& password) {
+
+    SetLastFileErrors({});
+    try {
+        if (!BackupCore::HasCatalog(backupPath)) {
+            SetLastErrorMessage(L"Not a backup set with a catalog");
+            return -1;
         }
+
+        channel->Publish("Scrub " + fs::path(backupPath).u8string());
+
+        BackupCore::FileScrubOptions options;
+        options.bytesPerSecond = bytesPerSecond;
+        options.continuous = continuous;
+        options.password = password;
+        options.channel = channel;
+        options.control = control;
+        BackupCore::FileSetResult result;
+        std::string error;
+        int rc = BackupCore::ScrubFileSet(backupPath, options, nullptr, result, error);
+        SetLastFileErrors(result.errors);
+        if (rc != 0) {
+            SetLastErrorMessage(Widen(error));
+        }
+        return rc;
+    }
+    catch (...) {
+        SetLastErrorMessage(L"Error during backup scrub");
+        return -99;
+    }
+}
+
+extern "C" {
+    BACKUPENGINE_API int VerifyBackup(
+        const wchar_t* backupPath,
+        ProgressCallback callback) {
+
+        BackupCore::ProgressChannel channel(nullptr);
+        int rc = RunVerifyBackup(backupPath, callback, &channel, nullptr, std::string());
+        channel.Finish(rc == 0);
+        return rc;
+    }
+
+    BACKUPENGINE_API int VerifyBackupWithStatus(
+        const wchar_t* backupPath,
+        ProgressStatusCallback callback,
+        void* context,
+        int intervalMs) {
+
+        BackupCore::ProgressChannel channel(MakeStatusSink(callback, context), StatusInterval(intervalMs));
+        int rc = RunVerifyBackup(backupPath, nullptr, &channel, nullptr, std::string());
+        channel.Finish(rc == 0);
+        return rc;
     }
 }
@@ -0,0 +1,207 @@
+// AllocationMap.cpp - Per-filesystem allocation strategies for partition imaging
+#include "AllocationMap.h"
+#include <algorithm>
+#include <cstring>
+
+namespace BackupCore {
+
+    namespace {
+        const uint32_t NtfsBitmapRecord = 6;        // $Bitmap is MFT record 6
+        const uint32_t NtfsDataAttribute = 0x80;
+        const uint32_t NtfsEndMarker = 0xFFFFFFFF;
+        const uint64_t MaxBitmapBytes = 512ULL * 1024 * 1024;
+
+        uint16_t Le16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+        uint32_t Le32(const uint8_t* p) { return (uint32_t)Le16(p) | ((uint32_t)Le16(p + 2) << 16); }
+        uint64_t Le64(const uint8_t* p) { return (uint64_t)Le32(p) | ((uint64_t)Le32(p + 4) << 32); }
+
+        // Apply the NTFS update sequence array so each sector's last two bytes are restored
+        bool ApplyFixups(std::vector<uint8_t>& record, uint32_t bytesPerSector) {
+            uint16_t usaOffset = Le16(&record[4]);
+            uint16_t usaCount = Le16(&record[6]);
+            if (usaCount == 0 || usaOffset + usaCount * 2u > record.size()) {
+                return false;
+            }
+
+            uint16_t usn = Le16(&record[usaOffset]);
+            for (uint16_t i = 1; i < usaCount; i++) {
+                size_t pos = (size_t)i * bytesPerSector - 2;
+                if (pos + 2 > record.size() || Le16(&record[pos]) != usn) {
+                    return false;
+                }
+                record[pos] = record[usaOffset + i * 2];
+                record[pos + 1] = record[usaOffset + i * 2 + 1];
+            }
+            return true;
+        }
+    }
+
+    std::unique_ptr<AllocationMap> AllocationMap::ForPartition(BlockDevice& device, const PartitionInfo& partition) {
+        std::unique_ptr<AllocationMap> map(new AllocationMap());
+        map->partitionLength = partition.length;
+
+        if (partition.fileSystem == FileSystemType::NTFS && !map->LoadNtfsBitmap(device, partition)) {
+            map->bitmap.clear();    // Unreadable metadata: image every non-zero block
+        }
+        return map;
+    }
+
+    bool AllocationMap::LoadNtfsBitmap(BlockDevice& device, const PartitionInfo& partition) {
+        uint8_t boot[512];
+        if (!device.ReadAt(partition.offset, boot, sizeof(boot))) {
+            return false;
+        }
+
+        uint32_t bytesPerSector = Le16(boot + 0x0B);
+        uint32_t sectorsPerCluster = boot[0x0D];
+        if (sectorsPerCluster > 0x80) {
+            sectorsPerCluster = 1u << (256 - sectorsPerCluster);
+        }
+        if (bytesPerSector < 256 || bytesPerSector > 4096 || sectorsPerCluster == 0) {
+            return false;
+        }
+
+        clusterSize = (uint64_t)bytesPerSector * sectorsPerCluster;
+        clusterCount = Le64(boot + 0x28) / sectorsPerCluster;
+        uint64_t mftCluster = Le64(boot + 0x30);
+
+        int8_t recordSizeCode = (int8_t)boot[0x40];
+        uint64_t recordSize = recordSizeCode < 0
+            ? (1ULL << -recordSizeCode)
+            : (uint64_t)recordSizeCode * clusterSize;
+        if (recordSize < 512 || recordSize > 65536) {
+            return false;
+        }
+
+        // The first MFT records are always contiguous at the start of $MFT
+        std::vector<uint8_t> record((size_t)recordSize);
+        uint64_t recordOffset = mftCluster * clusterSize + NtfsBitmapRecord * recordSize;
+        if (recordOffset + recordSize > partition.length ||
+            !device.ReadAt(partition.offset + recordOffset, record.data(), record.size())) {
+            return false;
+        }
+        if (std::memcmp(record.data(), "FILE", 4) != 0 || !ApplyFixups(record, bytesPerSector)) {
+            return false;
+        }
+
+        size_t attrOffset = Le16(&record[0x14]);
+        while (attrOffset + 16 <= record.size()) {
+            const uint8_t* attr = &record[attrOffset];
+            uint32_t type = Le32(attr);
+            uint32_t attrLength = Le32(attr + 4);
+            if (type == NtfsEndMarker || attrLength == 0 || attrOffset + attrLength > record.size()) {
+                break;
+            }
+
+            // Unnamed $DATA holds the bitmap itself
+            if (type == NtfsDataAttribute && attr[9] == 0) {
+                if (attr[8] == 0) {
+                    uint32_t valueLength = Le32(attr + 0x10);
+                    uint16_t valueOffset = Le16(attr + 0x14);
+                    if (valueOffset + valueLength > attrLength) {
+                        return false;
+                    }
+                    bitmap.assign(attr + valueOffset, attr + valueOffset + valueLength);
+                }
+                else {
+                    uint64_t realSize = Le64(attr + 0x30);
+                    if (realSize > MaxBitmapBytes) {
+                        return false;
+                    }
+                    bitmap.assign((size_t)realSize, 0);
+
+                    // Decode the data run list
+                    const uint8_t* run = attr + Le16(attr + 0x20);
+                    const uint8_t* runEnd = attr + attrLength;
+                    uint64_t vcnBytes = 0;
+                    int64_t lcn = 0;
+
+                    while (run < runEnd && *run != 0 && vcnBytes < realSize) {
+                        int lengthSize = *run & 0x0F;
+                        int offsetSize = *run >> 4;
+                        if (lengthSize == 0 || lengthSize > 8 || offsetSize > 8 ||
+                            run + 1 + lengthSize + offsetSize > runEnd) {
+                            return false;
+                        }
+
+                        uint64_t runClusters = 0;
+                        for (int i = 0; i < lengthSize; i++) {
+                            runClusters |= (uint64_t)run[1 + i] << (8 * i);
+                        }
+
+                        int64_t delta = 0;
+                        for (int i = 0; i < offsetSize; i++) {
+                            delta |= (int64_t)run[1 + lengthSize + i] << (8 * i);
+                        }
+                        if (offsetSize > 0 && offsetSize < 8 && (run[lengthSize + offsetSize] & 0x80)) {
+                            delta -= (int64_t)1 << (8 * offsetSize);   // Sign-extend
+                        }
+                        run += 1 + lengthSize + offsetSize;
+
+                        uint64_t runBytes = runClusters * clusterSize;
+                        uint64_t toCopy = std::min<uint64_t>(runBytes, realSize - vcnBytes);
+                        if (offsetSize != 0) {
+                            lcn += delta;
+                            uint64_t diskOffset = (uint64_t)lcn * clusterSize;
+                            if (diskOffset + toCopy > partition.length ||
+                                !device.ReadAt(partition.offset + diskOffset, &bitmap[(size_t)vcnBytes], (size_t)toCopy)) {
+                                return false;
+                            }
+                        }
+                        vcnBytes += toCopy;
+                    }
+                }
+
+                return bitmap.size() * 8 >= clusterCount;
+            }
+
+            attrOffset += attrLength;
+        }
+        return false;
+    }
+
+    bool AllocationMap::IsAllocated(uint64_t offset, uint64_t length) const {
+        if (bitmap.empty() || length == 0) {
+            return true;
+        }
+
+        uint64_t first = offset / clusterSize;
+        uint64_t last = (offset + length - 1) / clusterSize;
+
+        // Space past the last cluster (e.g. the NTFS backup boot sector) is always kept
+        if (last >= clusterCount) {
+            return true;
+        }
+
+        for (uint64_t cluster = first; cluster <= last; ) {
+            uint8_t byte = bitmap[(size_t)(cluster >> 3)];
+            if ((cluster & 7) == 0 && cluster + 7 <= last) {
+                if (byte != 0) return true;
+                cluster += 8;
+                continue;
+            }
+            if (byte & (1u << (cluster & 7))) return true;
+            cluster++;
+        }
+        return false;
+    }
+
+    const char* AllocationMap::StrategyName() const {
+        return bitmap.empty() ? "zero-skip" : "ntfs-bitmap";
+    }
+
+    uint64_t AllocationMap::AllocatedBytes() const {
+        if (bitmap.empty()) {
+            return partitionLength;
+        }
+
+        uint64_t used = 0;
+        for (uint64_t cluster = 0; cluster < clusterCount; cluster++) {
+            if (bitmap[(size_t)(cluster >> 3)] & (1u << (cluster & 7))) {
+                used++;
+            }
+        }
+        uint64_t volumeBytes = clusterCount * clusterSize;
+        return used * clusterSize + (partitionLength > volumeBytes ? partitionLength - volumeBytes : 0);
+    }
+}
@@ -0,0 +1,39 @@
+// AllocationMap.h - Per-filesystem allocation strategies for partition imaging
+//
+// A partition's filesystem decides which of its clusters hold live data.
+// Imaging skips clusters the filesystem reports as free; partitions whose
+// filesystem we cannot read fall back to skipping all-zero blocks only.
+
+#pragma once
+
+#include "BlockDevice.h"
+#include "PartitionTable.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace BackupCore {
+
+    class AllocationMap {
+    public:
+        // Build the best available map for a partition (never returns null)
+        static std::unique_ptr<AllocationMap> ForPartition(BlockDevice& device, const PartitionInfo& partition);
+
+        // True if any byte of [offset, offset + length) - relative to the partition start - may be in use
+        bool IsAllocated(uint64_t offset, uint64_t length) const;
+
+        // "ntfs-bitmap" or "zero-skip"; recorded in the image manifest
+        const char* StrategyName() const;
+
+        uint64_t AllocatedBytes() const;
+
+    private:
+        AllocationMap() = default;
+        bool LoadNtfsBitmap(BlockDevice& device, const PartitionInfo& partition);
+
+        uint64_t partitionLength = 0;
+        uint64_t clusterSize = 0;
+        uint64_t clusterCount = 0;
+        std::vector<uint8_t> bitmap;    // One bit per cluster; empty = everything allocated
+    };
+}
@@ -0,0 +1,342 @@
+// BlockDevice.cpp - Positional I/O over physical disks, partitions and image files
+#include "BlockDevice.h"
+#include "Metrics.h"
+#include "Throttle.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <winioctl.h>
+#include <cstddef>
+#else
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/falloc.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace BackupCore {
+
+#ifdef _WIN32
+
+    std::unique_ptr<BlockDevice> BlockDevice::Open(const fs::path& path, bool writable, std::string& error) {
+        HANDLE h = CreateFileW(
+            path.wstring().c_str(),
+            writable ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ,
+            FILE_SHARE_READ | FILE_SHARE_WRITE,
+            NULL,
+            OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL,
+            NULL);
+
+        if (h == INVALID_HANDLE_VALUE) {
+            error = "Failed to open " + path.string() + " (Error: " + std::to_string(::GetLastError()) + ")";
+            return nullptr;
+        }
+
+        std::unique_ptr<BlockDevice> device(new BlockDevice());
+        device->path = path;
+        device->handle = h;
+        device->isDisk = path.wstring().rfind(L"\\\\.\\", 0) == 0;
+
+        if (!device->QueryGeometry()) {
+            error = "Failed to query size of " + path.string();
+            return nullptr;
+        }
+        return device;
+    }
+
+    std::unique_ptr<BlockDevice> BlockDevice::Create(const fs::path& path, std::string& error) {
+        HANDLE h = CreateFileW(
+            path.wstring().c_str(),
+            GENERIC_READ | GENERIC_WRITE,
+            0,
+            NULL,
+            CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL,
+            NULL);
+
+        if (h == INVALID_HANDLE_VALUE) {
+            error = "Failed to create " + path.string() + " (Error: " + std::to_string(::GetLastError()) + ")";
+            return nullptr;
+        }
+
+        std::unique_ptr<BlockDevice> device(new BlockDevice());
+        device->path = path;
+        device->handle = h;
+        return device;
+    }
+
+    BlockDevice::~BlockDevice() {
+        if (handle) {
+            CloseHandle(handle);
+        }
+    }
+
+    bool BlockDevice::QueryGeometry() {
+        if (isDisk) {
+            GET_LENGTH_INFORMATION lengthInfo = { 0 };
+            DWORD bytesReturned = 0;
+            if (!DeviceIoControl(handle, IOCTL_DISK_GET_LENGTH_INFO, NULL, 0,
+                &lengthInfo, sizeof(lengthInfo), &bytesReturned, NULL)) {
+                return false;
+            }
+            size = (uint64_t)lengthInfo.Length.QuadPart;
+
+            DISK_GEOMETRY_EX geometry = { 0 };
+            if (DeviceIoControl(handle, IOCTL_DISK_GET_DRIVE_GEOMETRY_EX, NULL, 0,
+                &geometry, sizeof(geometry), &bytesReturned, NULL) &&
+                geometry.Geometry.BytesPerSector > 0) {
+                sectorSize = geometry.Geometry.BytesPerSector;
+            }
+            return true;
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(handle, &fileSize)) {
+            return false;
+        }
+        size = (uint64_t)fileSize.QuadPart;
+        return true;
+    }
+
+    bool BlockDevice::ReadAt(uint64_t offset, void* buffer, size_t length) {
+        if (throttle) {
+            throttle->Read(length);
+        }
+        PhaseTimer timer(MetricPhase::Read, length);
+        BYTE* p = static_cast<BYTE*>(buffer);
+        while (length > 0) {
+            OVERLAPPED ov = { 0 };
+            ov.Offset = (DWORD)(offset & 0xFFFFFFFF);
+            ov.OffsetHigh = (DWORD)(offset >> 32);
+
+            DWORD chunk = (DWORD)(length > 0x40000000 ? 0x40000000 : length);
+            DWORD bytesRead = 0;
+            if (!ReadFile(handle, p, chunk, &bytesRead, &ov) || bytesRead == 0) {
+                return false;
+            }
+            p += bytesRead;
+            offset += bytesRead;
+            length -= bytesRead;
+        }
+        return true;
+    }
+
+    bool BlockDevice::WriteAt(uint64_t offset, const void* buffer, size_t length) {
+        if (throttle) {
+            throttle->Write(length);
+        }
+        PhaseTimer timer(MetricPhase::Write, length);
+        const BYTE* p = static_cast<const BYTE*>(buffer);
+        while (length > 0) {
+            OVERLAPPED ov = { 0 };
+            ov.Offset = (DWORD)(offset & 0xFFFFFFFF);
+            ov.OffsetHigh = (DWORD)(offset >> 32);
+
+            DWORD chunk = (DWORD)(length > 0x40000000 ? 0x40000000 : length);
+            DWORD bytesWritten = 0;
+            if (!WriteFile(handle, p, chunk, &bytesWritten, &ov) || bytesWritten == 0) {
+                return false;
+            }
+            p += bytesWritten;
+            offset += bytesWritten;
+            length -= bytesWritten;
+        }
+        if (!isDisk && offset > size) {
+            size = offset;
+        }
+        return true;
+    }
+
+    bool BlockDevice::Flush() {
+        return FlushFileBuffers(handle) != 0;
+    }
+
+    bool BlockDevice::Truncate(uint64_t length) {
+        if (isDisk) {
+            return false;
+        }
+
+        LARGE_INTEGER newSize;
+        newSize.QuadPart = (LONGLONG)length;
+        if (!SetFilePointerEx(handle, newSize, NULL, FILE_BEGIN) || !SetEndOfFile(handle)) {
+            return false;
+        }
+        size = length;
+        return true;
+    }
+
+    bool BlockDevice::Discard(uint64_t offset, uint64_t length) {
+        DWORD bytesReturned = 0;
+
+        if (isDisk) {
+            struct {
+                DEVICE_MANAGE_DATA_SET_ATTRIBUTES attributes;
+                DEVICE_DATA_SET_RANGE range;
+            } request = {};
+
+            request.attributes.Size = sizeof(DEVICE_MANAGE_DATA_SET_ATTRIBUTES);
+            request.attributes.Action = DeviceDsmAction_Trim;
+            request.attributes.DataSetRangesOffset = (DWORD)offsetof(decltype(request), range);
+            request.attributes.DataSetRangesLength = sizeof(DEVICE_DATA_SET_RANGE);
+            request.range.StartingOffset = (LONGLONG)offset;
+            request.range.LengthInBytes = length;
+
+            return DeviceIoControl(handle, IOCTL_STORAGE_MANAGE_DATA_SET_ATTRIBUTES,
+                &request, sizeof(request), NULL, 0, &bytesReturned, NULL) != 0;
+        }
+
+        // Extend first so the zeroed range exists, then release its clusters
+        if (offset + length > size) {
+            LARGE_INTEGER newSize;
+            newSize.QuadPart = (LONGLONG)(offset + length);
+            if (!SetFilePointerEx(handle, newSize, NULL, FILE_BEGIN) || !SetEndOfFile(handle)) {
+                return false;
+            }
+            size = offset + length;
+        }
+
+        FILE_ZERO_DATA_INFORMATION zeroData;
+        zeroData.FileOffset.QuadPart = (LONGLONG)offset;
+        zeroData.BeyondFinalZero.QuadPart = (LONGLONG)(offset + length);
+        return DeviceIoControl(handle, FSCTL_SET_ZERO_DATA,
+            &zeroData, sizeof(zeroData), NULL, 0, &bytesReturned, NULL) != 0;
+    }
+
+#else
+
+    std::unique_ptr<BlockDevice> BlockDevice::Open(const fs::path& path, bool writable, std::string& error) {
+        int f = ::open(path.c_str(), (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+        if (f < 0) {
+            error = "Failed to open " + path.string() + ": " + std::strerror(errno);
+            return nullptr;
+        }
+
+        std::unique_ptr<BlockDevice> device(new BlockDevice());
+        device->path = path;
+        device->fd = f;
+
+        if (!device->QueryGeometry()) {
+            error = "Failed to query size of " + path.string() + ": " + std::strerror(errno);
+            return nullptr;
+        }
+        return device;
+    }
+
+    std::unique_ptr<BlockDevice> BlockDevice::Create(const fs::path& path, std::string& error) {
+        int f = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (f < 0) {
+            error = "Failed to create " + path.string() + ": " + std::strerror(errno);
+            return nullptr;
+        }
+
+        std::unique_ptr<BlockDevice> device(new BlockDevice());
+        device->path = path;
+        device->fd = f;
+        return device;
+    }
+
+    BlockDevice::~BlockDevice() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    bool BlockDevice::QueryGeometry() {
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            return false;
+        }
+
+        if (S_ISBLK(st.st_mode)) {
+            isDisk = true;
+            uint64_t bytes = 0;
+            if (ioctl(fd, BLKGETSIZE64, &bytes) != 0) {
+                return false;
+            }
+            size = bytes;
+
+            int logicalSector = 0;
+            if (ioctl(fd, BLKSSZGET, &logicalSector) == 0 && logicalSector > 0) {
+                sectorSize = (uint32_t)logicalSector;
+            }
+            return true;
+        }
+
+        size = (uint64_t)st.st_size;
+        return true;
+    }
+
+    bool BlockDevice::ReadAt(uint64_t offset, void* buffer, size_t length) {
+        if (throttle) {
+            throttle->Read(length);
+        }
+        PhaseTimer timer(MetricPhase::Read, length);
+        char* p = static_cast<char*>(buffer);
+        while (length > 0) {
+            ssize_t n = ::pread(fd, p, length, (off_t)offset);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            p += n;
+            offset += (uint64_t)n;
+            length -= (size_t)n;
+        }
+        return true;
+    }
+
+    bool BlockDevice::WriteAt(uint64_t offset, const void* buffer, size_t length) {
+        if (throttle) {
+            throttle->Write(length);
+        }
+        PhaseTimer timer(MetricPhase::Write, length);
+        const char* p = static_cast<const char*>(buffer);
+        while (length > 0) {
+            ssize_t n = ::pwrite(fd, p, length, (off_t)offset);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            p += n;
+            offset += (uint64_t)n;
+            length -= (size_t)n;
+        }
+        if (!isDisk && offset > size) {
+            size = offset;
+        }
+        return true;
+    }
+
+    bool BlockDevice::Flush() {
+        return ::fsync(fd) == 0;
+    }
+
+    bool BlockDevice::Truncate(uint64_t length) {
+        if (isDisk || ::ftruncate(fd, (off_t)length) != 0) {
+            return false;
+        }
+        size = length;
+        return true;
+    }
+
+    bool BlockDevice::Discard(uint64_t offset, uint64_t length) {
+        if (isDisk) {
+            uint64_t range[2] = { offset, length };
+            return ioctl(fd, BLKDISCARD, &range) == 0;
+        }
+
+        // Extend first so the zeroed range exists, then release its blocks
+        if (offset + length > size) {
+            if (::ftruncate(fd, (off_t)(offset + length)) != 0) {
+                return false;
+            }
+            size = offset + length;
+        }
+        return ::fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t)offset, (off_t)length) == 0;
+    }
+
+#endif
+}
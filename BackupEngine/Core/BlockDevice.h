@@ -0,0 +1,72 @@
+// BlockDevice.h - Positional I/O over physical disks, partitions and image files
+// Shared by the Windows engine (\\.\PhysicalDriveN) and the Linux recovery tools (/dev/sdX)
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+namespace BackupCore {
+
+    class IoThrottle;
+
+    class BlockDevice {
+    public:
+        // Open an existing disk, partition or image file
+        static std::unique_ptr<BlockDevice> Open(
+            const std::filesystem::path& path,
+            bool writable,
+            std::string& error);
+
+        // Create (or truncate) a regular file for writing image streams
+        static std::unique_ptr<BlockDevice> Create(
+            const std::filesystem::path& path,
+            std::string& error);
+
+        ~BlockDevice();
+
+        BlockDevice(const BlockDevice&) = delete;
+        BlockDevice& operator=(const BlockDevice&) = delete;
+
+        uint64_t Size() const { return size; }
+        uint32_t SectorSize() const { return sectorSize; }
+        bool IsDisk() const { return isDisk; }
+        const std::filesystem::path& Path() const { return path; }
+
+        // Read/write exactly 'length' bytes at 'offset'; false on error or short transfer
+        bool ReadAt(uint64_t offset, void* buffer, size_t length);
+        bool WriteAt(uint64_t offset, const void* buffer, size_t length);
+
+        // Charge every ReadAt/WriteAt to 'throttle' (a job's I/O limits); nullptr stops it
+        void SetThrottle(IoThrottle* limits) { throttle = limits; }
+
+        bool Flush();
+
+        // Set the length of an image file; not supported on disks
+        bool Truncate(uint64_t length);
+
+        // Deallocate a range: TRIM/UNMAP on disks, hole punch on image files.
+        // Returns false if unsupported. Files read back as zero afterwards;
+        // disks only do if the device guarantees it, so callers must verify.
+        bool Discard(uint64_t offset, uint64_t length);
+
+    private:
+        BlockDevice() = default;
+        bool QueryGeometry();
+
+        std::filesystem::path path;
+        uint64_t size = 0;
+        uint32_t sectorSize = 512;
+        bool isDisk = false;
+        IoThrottle* throttle = nullptr;
+
+#ifdef _WIN32
+        void* handle = nullptr;
+#else
+        int fd = -1;
+#endif
+    };
+}
@@ -0,0 +1,351 @@
+// Catalog.cpp - Portable catalog of a file backup set
+#include "Catalog.h"
+#include <cstdio>
+#include <fstream>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace BackupCore {
+
+    const char* const CatalogFileName = "backup_catalog.dat";
+    const char* const ScrubStateFileName = "backup_scrub.dat";
+    const char* const SetLockFileName = "backup_lock";
+
+    namespace {
+        const char* CatalogHeader = "BACKUP_CATALOG_V1";
+        const char* ScrubHeader = "BACKUP_SCRUB_V1";
+        const size_t EntryFieldCount = 8;
+        const size_t DeltaEntryFieldCount = 9;
+
+        std::string OneLine(const std::string& text) {
+            std::string out = text;
+            for (char& c : out) {
+                if (c == '\n' || c == '\r') c = '_';
+            }
+            return out;
+        }
+
+        std::string ToHex(const std::vector<uint8_t>& bytes) {
+            static const char digits[] = "0123456789abcdef";
+            std::string hex;
+            for (uint8_t b : bytes) {
+                hex += digits[b >> 4];
+                hex += digits[b & 15];
+            }
+            return hex;
+        }
+
+        std::vector<uint8_t> FromHex(const std::string& hex) {
+            std::vector<uint8_t> bytes;
+            for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+                bytes.push_back((uint8_t)std::stoul(hex.substr(i, 2), nullptr, 16));
+            }
+            return bytes;
+        }
+
+        // Split the first count-1 fields on '|'; the remainder is the last field
+        bool SplitEntry(const std::string& line, std::vector<std::string>& fields, size_t count) {
+            fields.clear();
+            size_t start = 0;
+            while (fields.size() + 1 < count) {
+                size_t bar = line.find('|', start);
+                if (bar == std::string::npos) return false;
+                fields.push_back(line.substr(start, bar - start));
+                start = bar + 1;
+            }
+            fields.push_back(line.substr(start));
+            return true;
+        }
+
+        // A rewritten catalog has another creation time or file count
+        std::string ScrubIdentity(const BackupCatalog& catalog) {
+            return std::to_string(catalog.created) + "|" + std::to_string(catalog.entries.size());
+        }
+    }
+
+    bool HasCatalog(const fs::path& backupDir) {
+        std::error_code ec;
+        return fs::is_regular_file(backupDir / CatalogFileName, ec);
+    }
+
+    bool SaveCatalog(const fs::path& backupDir, const BackupCatalog& catalog, std::string& error) {
+        // Written aside and renamed, so a catalog on disk always describes a finished backup
+        fs::path finalPath = backupDir / CatalogFileName;
+        fs::path tempPath = backupDir / (std::string(CatalogFileName) + ".tmp");
+
+        {
+            std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+            if (!out.is_open()) {
+                error = "Cannot write catalog " + tempPath.u8string();
+                return false;
+            }
+
+            out << CatalogHeader << "\n";
+            for (const auto& source : catalog.sources) {
+                out << "Source:" << OneLine(source) << "\n";
+            }
+            out << "Platform:" << catalog.platform << "\n";
+            out << "Created:" << catalog.created << "\n";
+            if (catalog.encryption.cipher != CipherKind::None) {
+                out << "Cipher:" << CipherName(catalog.encryption.cipher) << "\n";
+                out << "KeySalt:" << ToHex(catalog.encryption.salt) << "\n";
+                out << "KeyIterations:" << catalog.encryption.iterations << "\n";
+                out << "KeyCheck:" << ToHex(catalog.encryption.check) << "\n";
+            }
+            if (catalog.parityShards > 0) {
+                out << "Parity:" << catalog.parityShards << "\n";
+            }
+            if (!catalog.dictionary.empty()) {
+                out << "Dictionary:" << ToHex(catalog.dictionary) << "\n";
+            }
+            out << "FileCount:" << catalog.entries.size() << "\n";
+            out << "---\n";
+
+            char hash[17];
+            for (const auto& entry : catalog.entries) {
+                std::snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)entry.hash);
+                bool same = entry.sameAs >= 0;
+                bool like = !same && entry.deltaOf >= 0;
+                out << (same ? "same|" : like ? "like|" : "file|") << entry.file.size << "|" << entry.file.modifiedTime << "|"
+                    << entry.file.attributes << "|" << hash << "|" << CodecName(entry.codec) << "|"
+                    << (same ? (uint64_t)entry.sameAs : entry.storedSize) << "|";
+                if (like) {
+                    out << entry.deltaOf << "|";
+                }
+                out << OneLine(entry.file.relativePath) << "\n";
+            }
+
+            out.flush();
+            if (!out.good()) {
+                error = "Failed to write catalog " + tempPath.u8string();
+                return false;
+            }
+        }
+
+        std::error_code ec;
+        fs::rename(tempPath, finalPath, ec);
+        if (ec) {
+            error = "Failed to finalize catalog " + finalPath.u8string() + ": " + ec.message();
+            return false;
+        }
+        return true;
+    }
+
+    bool LoadCatalog(const fs::path& backupDir, BackupCatalog& catalog, std::string& error) {
+        catalog = BackupCatalog();
+        fs::path path = backupDir / CatalogFileName;
+
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open()) {
+            error = "Cannot open catalog " + path.u8string();
+            return false;
+        }
+
+        std::string line;
+        if (!std::getline(in, line) || line != CatalogHeader) {
+            error = "Not a backup catalog: " + path.u8string();
+            return false;
+        }
+
+        try {
+            bool inBody = false;
+            std::vector<std::string> fields;
+            while (std::getline(in, line)) {
+                if (line.empty()) continue;
+
+                if (!inBody) {
+                    if (line == "---") {
+                        inBody = true;
+                        continue;
+                    }
+                    size_t colon = line.find(':');
+                    if (colon == std::string::npos) continue;
+                    std::string key = line.substr(0, colon);
+                    std::string value = line.substr(colon + 1);
+
+                    if (key == "Source") catalog.sources.push_back(value);
+                    else if (key == "Platform") catalog.platform = value;
+                    else if (key == "Created") catalog.created = std::stoll(value);
+                    else if (key == "Cipher") {
+                        catalog.encryption.cipher = ParseCipherName(value);
+                        if (catalog.encryption.cipher == CipherKind::None) {
+                            error = "Unsupported cipher " + value + " in " + path.u8string();
+                            return false;
+                        }
+                    }
+                    else if (key == "KeySalt") catalog.encryption.salt = FromHex(value);
+                    else if (key == "KeyIterations") catalog.encryption.iterations = (uint32_t)std::stoul(value);
+                    else if (key == "KeyCheck") catalog.encryption.check = FromHex(value);
+                    else if (key == "Parity") catalog.parityShards = (uint32_t)std::stoul(value);
+                    else if (key == "Dictionary") catalog.dictionary = FromHex(value);
+                    continue;
+                }
+
+                bool like = line.compare(0, 5, "like|") == 0;
+                if (!SplitEntry(line, fields, like ? DeltaEntryFieldCount : EntryFieldCount) ||
+                    (fields[0] != "file" && fields[0] != "same" && fields[0] != "like")) {
+                    continue;
+                }
+
+                CatalogEntry entry;
+                entry.file.size = std::stoull(fields[1]);
+                entry.file.modifiedTime = std::stoll(fields[2]);
+                entry.file.attributes = (uint32_t)std::stoul(fields[3]);
+                entry.hash = std::stoull(fields[4], nullptr, 16);
+                entry.codec = ParseCodecName(fields[5]);
+                entry.file.relativePath = fields.back();
+                if (like) {
+                    // Checked once every entry is known, since the base may come later
+                    entry.storedSize = std::stoull(fields[6]);
+                    entry.deltaOf = (int64_t)std::stoull(fields[7]);
+                }
+                else if (fields[0] == "same") {
+                    // Only ever an earlier entry with a stored file of its own
+                    uint64_t index = std::stoull(fields[6]);
+                    if (index >= catalog.entries.size() || catalog.entries[(size_t)index].sameAs >= 0) {
+                        error = "Corrupt backup catalog " + path.u8string();
+                        return false;
+                    }
+                    entry.sameAs = (int64_t)index;
+                }
+                else {
+                    entry.storedSize = std::stoull(fields[6]);
+                }
+                catalog.entries.push_back(entry);
+            }
+        }
+        catch (const std::exception&) {
+            error = "Corrupt backup catalog " + path.u8string();
+            return false;
+        }
+
+        // A delta's base is a file stored whole, never another delta or a reference
+        for (const auto& entry : catalog.entries) {
+            if (entry.deltaOf < 0) {
+                continue;
+            }
+            if ((size_t)entry.deltaOf >= catalog.entries.size() ||
+                catalog.entries[(size_t)entry.deltaOf].sameAs >= 0 || catalog.entries[(size_t)entry.deltaOf].deltaOf >= 0) {
+                error = "Corrupt backup catalog " + path.u8string();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool LoadScrubState(const fs::path& backupDir, const BackupCatalog& catalog, ScrubState& state) {
+        state = ScrubState();
+        std::ifstream in(backupDir / ScrubStateFileName, std::ios::binary);
+        std::string line;
+        if (!std::getline(in, line) || line != ScrubHeader) {
+            return false;
+        }
+
+        ScrubState loaded;
+        bool sameCatalog = false;
+        try {
+            while (std::getline(in, line)) {
+                size_t colon = line.find(':');
+                if (colon == std::string::npos) continue;
+                std::string key = line.substr(0, colon);
+                std::string value = line.substr(colon + 1);
+
+                if (key == "Catalog") sameCatalog = value == ScrubIdentity(catalog);
+                else if (key == "Pass") loaded.pass = std::stoull(value);
+                else if (key == "Next") loaded.next = std::stoull(value);
+                else if (key == "PassStarted") loaded.passStarted = std::stoll(value);
+                else if (key == "LastCompleted") loaded.lastCompleted = std::stoll(value);
+            }
+        }
+        catch (const std::exception&) {
+            return false;
+        }
+        if (!sameCatalog) {
+            return false;
+        }
+        state = loaded;
+        return true;
+    }
+
+    bool SaveScrubState(const fs::path& backupDir, const BackupCatalog& catalog,
+        const ScrubState& state, std::string& error) {
+
+        // Renamed into place like the catalog, so a crash leaves the old position
+        fs::path finalPath = backupDir / ScrubStateFileName;
+        fs::path tempPath = backupDir / (std::string(ScrubStateFileName) + ".tmp");
+        {
+            std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+            out << ScrubHeader << "\n";
+            out << "Catalog:" << ScrubIdentity(catalog) << "\n";
+            out << "Pass:" << state.pass << "\n";
+            out << "Next:" << state.next << "\n";
+            out << "PassStarted:" << state.passStarted << "\n";
+            out << "LastCompleted:" << state.lastCompleted << "\n";
+            out.flush();
+            if (!out.good()) {
+                error = "Cannot write scrub state " + tempPath.u8string();
+                return false;
+            }
+        }
+
+        std::error_code ec;
+        fs::rename(tempPath, finalPath, ec);
+        if (ec) {
+            error = "Failed to finalize scrub state " + finalPath.u8string() + ": " + ec.message();
+            return false;
+        }
+        return true;
+    }
+
+    SetLock::~SetLock() {
+#ifdef _WIN32
+        if (handle) {
+            CloseHandle(handle);
+        }
+#else
+        if (fd >= 0) {
+            close(fd);
+        }
+#endif
+    }
+
+    bool SetLock::Acquire(const fs::path& backupDir, std::string& error) {
+        fs::path path = backupDir / SetLockFileName;
+#ifdef _WIN32
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE,
+            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            error = "Cannot open " + path.u8string();
+            return false;
+        }
+        OVERLAPPED overlapped = {};
+        if (!LockFileEx(file, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, 1, 0, &overlapped)) {
+            CloseHandle(file);
+            error = "Backup set " + backupDir.u8string() + " is in use by another job";
+            return false;
+        }
+        handle = file;
+#else
+        int file = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (file < 0) {
+            error = "Cannot open " + path.u8string();
+            return false;
+        }
+        if (flock(file, LOCK_EX | LOCK_NB) != 0) {
+            close(file);
+            error = "Backup set " + backupDir.u8string() + " is in use by another job";
+            return false;
+        }
+        fd = file;
+#endif
+        return true;
+    }
+}
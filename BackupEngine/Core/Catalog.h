@@ -0,0 +1,106 @@
+// Catalog.h - Portable catalog of a file backup set
+//
+// backup_catalog.dat sits in the backup directory and is UTF-8 text:
+//   BACKUP_CATALOG_V1
+//   Source:<path that was backed up>        (one line per source)
+//   Platform:windows|posix
+//   Created:<unix seconds>
+//   Cipher:<name>, KeySalt:<hex>, KeyIterations:<n>, KeyCheck:<hex>
+//                                          (encrypted sets only, see Encryption.h)
+//   Parity:<parity shards>                 (sets with parity only, see Parity.h)
+//   Dictionary:<hex>                       (sets with "lzdict" files only, see Dictionary.h)
+//   FileCount:<n>
+//   ---
+//   file|size|modifiedNs|attributes|hash|codec|storedSize|relativePath
+//   same|size|modifiedNs|attributes|hash|codec|entry index|relativePath
+//   like|size|modifiedNs|attributes|hash|codec|storedSize|entry index|relativePath
+// The relative path is the last field so it may itself contain '|'. In a set
+// of several sources it starts with the source's folder (see SourceFolders).
+// A "same" file was identical to an earlier "file" entry, given by its index
+// in the list, and has no stored file of its own. A "like" file was stored
+// as a delta (Delta.h) against the contents of the "file" entry it names.
+// In an encrypted set the dictionary is sealed with the set's key, like the
+// files it helps compress.
+//
+// backup_scrub.dat, next to it, is where a scrub (ScrubFileSet) stands:
+//   BACKUP_SCRUB_V1
+//   Catalog:<created>|<file count>         the catalog the position refers to
+//   Pass:<n>, Next:<entry index>, PassStarted:<unix>, LastCompleted:<unix>
+//
+// backup_lock is held (an OS file lock, never its contents) by whatever
+// writes or deletes stored files: a backup into the set, or a compaction.
+
+#pragma once
+
+#include "Compression.h"
+#include "Encryption.h"
+#include "FileScanner.h"
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace BackupCore {
+
+    extern const char* const CatalogFileName;
+    extern const char* const ScrubStateFileName;
+    extern const char* const SetLockFileName;
+
+    struct CatalogEntry {
+        FileEntry file;
+        uint64_t hash = 0;          // XXH64 of the original contents
+        CompressionCodec codec = CompressionCodec::None;
+        uint64_t storedSize = 0;    // Bytes occupied in the backup set
+        int64_t sameAs = -1;        // Index of the entry whose stored file has these contents, or -1
+        int64_t deltaOf = -1;       // Index of the entry the stored file is a delta against, or -1
+    };
+
+    struct BackupCatalog {
+        std::vector<std::string> sources;
+        std::string platform;
+        int64_t created = 0;
+        KeyDerivation encryption;   // cipher None for a plain set
+        uint32_t parityShards = 0;  // 0 = no parity files
+        std::vector<uint8_t> dictionary;    // As stored, so sealed in an encrypted set; empty if none
+        std::vector<CatalogEntry> entries;
+    };
+
+    bool HasCatalog(const std::filesystem::path& backupDir);
+
+    bool SaveCatalog(const std::filesystem::path& backupDir, const BackupCatalog& catalog, std::string& error);
+
+    bool LoadCatalog(const std::filesystem::path& backupDir, BackupCatalog& catalog, std::string& error);
+
+    struct ScrubState {
+        uint64_t pass = 1;              // Passes over the set, counting the current one
+        uint64_t next = 0;              // First entry not yet scrubbed in this pass
+        int64_t passStarted = 0;        // Unix seconds
+        int64_t lastCompleted = 0;      // 0 until a pass has finished
+    };
+
+    // Fresh state (and false) if there is none, or it was saved for another catalog
+    bool LoadScrubState(const std::filesystem::path& backupDir, const BackupCatalog& catalog, ScrubState& state);
+
+    bool SaveScrubState(const std::filesystem::path& backupDir, const BackupCatalog& catalog,
+        const ScrubState& state, std::string& error);
+
+    // Exclusive use of a backup set. The OS drops the lock with the process,
+    // so a crashed job never leaves a set locked.
+    class SetLock {
+    public:
+        SetLock() = default;
+        ~SetLock();
+        SetLock(const SetLock&) = delete;
+        SetLock& operator=(const SetLock&) = delete;
+
+        // False, without waiting, if another job holds the set
+        bool Acquire(const std::filesystem::path& backupDir, std::string& error);
+
+    private:
+#ifdef _WIN32
+        void* handle = nullptr;
+#else
+        int fd = -1;
+#endif
+    };
+}
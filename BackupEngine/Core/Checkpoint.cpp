@@ -0,0 +1,179 @@
+// Checkpoint.cpp - Append-only checkpoint journal for resumable imaging and restore
+#include "Checkpoint.h"
+#include "Checksum.h"
+#include <cstdio>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace BackupCore {
+
+    namespace {
+        const char* JournalHeader = "DISK_CHECKPOINT_V1";
+
+        std::vector<std::string> Split(const std::string& line, char separator) {
+            std::vector<std::string> fields;
+            std::stringstream ss(line);
+            std::string field;
+            while (std::getline(ss, field, separator)) {
+                fields.push_back(field);
+            }
+            return fields;
+        }
+
+        std::string RecordCrc(const std::string& body) {
+            char hex[9];
+            std::snprintf(hex, sizeof(hex), "%08x", Crc32(body.data(), body.size()));
+            return hex;
+        }
+
+        // Identity goes on one header line
+        std::string OneLine(const std::string& text) {
+            std::string out = text;
+            for (char& c : out) {
+                if (c == '\n' || c == '\r') c = '_';
+            }
+            return out;
+        }
+
+        const std::vector<Checkpoint> NoCheckpoints;
+    }
+
+    bool CheckpointJournal::Open(const fs::path& journalPath, const std::string& identity, std::string& error) {
+        path = journalPath;
+        resumed = false;
+        checkpoints.clear();
+        pendingExtents.clear();
+        completed.clear();
+
+        std::ifstream in(path);
+        std::string line;
+        bool matches = in.is_open() && std::getline(in, line) && line == JournalHeader &&
+            std::getline(in, line) && line == "Identity:" + OneLine(identity) &&
+            std::getline(in, line) && line == "---";
+
+        if (matches) {
+            while (std::getline(in, line)) {
+                ParseRecord(line);
+            }
+            resumed = !checkpoints.empty() || !completed.empty();
+        }
+        in.close();
+
+        if (matches) {
+            out.open(path, std::ios::app);
+        }
+        else {
+            out.open(path, std::ios::trunc);
+            out << JournalHeader << "\n" << "Identity:" << OneLine(identity) << "\n" << "---\n";
+            out.flush();
+        }
+
+        if (!out.good()) {
+            error = "Cannot write checkpoint journal " + path.string();
+            return false;
+        }
+        return true;
+    }
+
+    void CheckpointJournal::ParseRecord(const std::string& line) {
+        size_t bar = line.rfind('|');
+        if (bar == std::string::npos || line.substr(bar + 1) != RecordCrc(line.substr(0, bar))) {
+            return;     // Torn or corrupt record
+        }
+
+        std::vector<std::string> fields = Split(line.substr(0, bar), '|');
+        try {
+            if (fields.size() >= 5 && fields[0] == "extent") {
+                ImageExtent extent;
+                extent.offset = std::stoull(fields[2]);
+                extent.length = std::stoull(fields[3]);
+                extent.kind = (ExtentKind)std::stoul(fields[4]);
+                pendingExtents[std::stoi(fields[1])].push_back(extent);
+            }
+            else if (fields.size() >= 8 && fields[0] == "checkpoint") {
+                int part = std::stoi(fields[1]);
+                Checkpoint checkpoint;
+                checkpoint.offset = std::stoull(fields[2]);
+                checkpoint.streamOffset = std::stoull(fields[3]);
+                checkpoint.blockCount = std::stoull(fields[4]);
+                checkpoint.verifyOffset = std::stoull(fields[5]);
+                checkpoint.verifyLength = std::stoull(fields[6]);
+                checkpoint.verifyHash = std::stoull(fields[7], nullptr, 16);
+                checkpoint.extents.swap(pendingExtents[part]);
+                checkpoints[part].push_back(checkpoint);
+            }
+            else if (fields.size() >= 3 && fields[0] == "resume") {
+                // A rerun rewound to this offset; later checkpoints describe data it overwrote
+                int part = std::stoi(fields[1]);
+                uint64_t offset = std::stoull(fields[2]);
+                auto& list = checkpoints[part];
+                while (!list.empty() && list.back().offset > offset) {
+                    list.pop_back();
+                }
+                pendingExtents[part].clear();
+                completed.erase(part);
+            }
+            else if (fields.size() >= 3 && fields[0] == "done") {
+                CompletedPartition partition;
+                partition.storedBytes = std::stoull(fields[2]);
+                partition.strategy = fields.size() > 3 ? fields[3] : "";
+                completed[std::stoi(fields[1])] = partition;
+            }
+        }
+        catch (const std::exception&) {
+            // Ignore records that do not parse
+        }
+    }
+
+    const std::vector<Checkpoint>& CheckpointJournal::Checkpoints(int partitionIndex) const {
+        auto it = checkpoints.find(partitionIndex);
+        return it != checkpoints.end() ? it->second : NoCheckpoints;
+    }
+
+    const CompletedPartition* CheckpointJournal::Completed(int partitionIndex) const {
+        auto it = completed.find(partitionIndex);
+        return it != completed.end() ? &it->second : nullptr;
+    }
+
+    bool CheckpointJournal::WriteRecord(const std::string& record) {
+        out << record << "|" << RecordCrc(record) << "\n";
+        out.flush();
+        return out.good();
+    }
+
+    bool CheckpointJournal::AppendCheckpoint(int partitionIndex, const Checkpoint& checkpoint) {
+        std::string part = std::to_string(partitionIndex);
+        for (const auto& extent : checkpoint.extents) {
+            if (!WriteRecord("extent|" + part + "|" + std::to_string(extent.offset) + "|" +
+                std::to_string(extent.length) + "|" + std::to_string((uint32_t)extent.kind))) {
+                return false;
+            }
+        }
+
+        char hash[17];
+        std::snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)checkpoint.verifyHash);
+        return WriteRecord("checkpoint|" + part + "|" + std::to_string(checkpoint.offset) + "|" +
+            std::to_string(checkpoint.streamOffset) + "|" + std::to_string(checkpoint.blockCount) + "|" +
+            std::to_string(checkpoint.verifyOffset) + "|" + std::to_string(checkpoint.verifyLength) + "|" + hash);
+    }
+
+    bool CheckpointJournal::AppendResume(int partitionIndex, uint64_t offset) {
+        return WriteRecord("resume|" + std::to_string(partitionIndex) + "|" + std::to_string(offset));
+    }
+
+    bool CheckpointJournal::AppendCompleted(int partitionIndex, const CompletedPartition& partition) {
+        std::string strategy = partition.strategy;
+        for (char& c : strategy) {
+            if (c == '|') c = '_';
+        }
+        return WriteRecord("done|" + std::to_string(partitionIndex) + "|" +
+            std::to_string(partition.storedBytes) + "|" + strategy);
+    }
+
+    void CheckpointJournal::Remove() {
+        out.close();
+        std::error_code ec;
+        fs::remove(path, ec);
+    }
+}
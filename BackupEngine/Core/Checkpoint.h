@@ -0,0 +1,71 @@
+// Checkpoint.h - Append-only checkpoint journal for resumable imaging and restore
+//
+// The journal is a text file kept next to the image while a job runs:
+//   DISK_CHECKPOINT_V1
+//   Identity:<source/target description the journal belongs to>
+//   ---
+//   extent|part|offset|length|kind|crc          runs completed since the previous checkpoint
+//   checkpoint|part|offset|stream|blocks|verifyOffset|verifyLength|verifyHash|crc
+//   resume|part|offset|crc                      a rerun continued from this offset
+//   done|part|storedBytes|strategy|crc
+// Every record ends with a CRC32 of the rest of the line, so a line torn by a
+// crash or power loss is ignored. The journal is deleted when the job succeeds.
+
+#pragma once
+
+#include "DiskImage.h"
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace BackupCore {
+
+    struct Checkpoint {
+        uint64_t offset = 0;            // Partition-relative; everything below is complete
+        uint64_t streamOffset = 0;      // Image stream bytes covering [0, offset)
+        uint64_t blockCount = 0;        // Stored blocks (hash records) covering [0, offset)
+        uint64_t verifyOffset = 0;      // Last data block written before the checkpoint,
+        uint64_t verifyLength = 0;      // re-read and hashed to validate it on resume
+        uint64_t verifyHash = 0;
+        std::vector<ImageExtent> extents;   // Imaging: runs completed since the previous checkpoint
+    };
+
+    struct CompletedPartition {
+        uint64_t storedBytes = 0;
+        std::string strategy;
+    };
+
+    class CheckpointJournal {
+    public:
+        // Load 'path' if it was written for the same identity, otherwise start it afresh
+        bool Open(const std::filesystem::path& path, const std::string& identity, std::string& error);
+
+        // True if Open found usable records from an earlier run
+        bool Resumed() const { return resumed; }
+
+        // Surviving checkpoints of a partition, oldest first
+        const std::vector<Checkpoint>& Checkpoints(int partitionIndex) const;
+        const CompletedPartition* Completed(int partitionIndex) const;
+
+        bool AppendCheckpoint(int partitionIndex, const Checkpoint& checkpoint);
+        bool AppendResume(int partitionIndex, uint64_t offset);
+        bool AppendCompleted(int partitionIndex, const CompletedPartition& partition);
+
+        // Delete the journal once the job has finished
+        void Remove();
+
+    private:
+        bool WriteRecord(const std::string& record);
+        void ParseRecord(const std::string& line);
+
+        std::filesystem::path path;
+        std::ofstream out;
+        bool resumed = false;
+        std::map<int, std::vector<Checkpoint>> checkpoints;
+        std::map<int, std::vector<ImageExtent>> pendingExtents;
+        std::map<int, CompletedPartition> completed;
+    };
+}
@@ -0,0 +1,165 @@
+// Checksum.cpp - Checksums used by the on-disk formats
+#include "Checksum.h"
+#include <cstring>
+
+namespace BackupCore {
+
+    namespace {
+        struct Crc32Table {
+            uint32_t entries[256];
+
+            Crc32Table() {
+                for (uint32_t i = 0; i < 256; i++) {
+                    uint32_t c = i;
+                    for (int k = 0; k < 8; k++) {
+                        c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+                    }
+                    entries[i] = c;
+                }
+            }
+        };
+
+        const Crc32Table crcTable;
+
+        const uint64_t Prime1 = 11400714785074694791ULL;
+        const uint64_t Prime2 = 14029467366897019727ULL;
+        const uint64_t Prime3 = 1609587929392839161ULL;
+        const uint64_t Prime4 = 9650029242287828579ULL;
+        const uint64_t Prime5 = 2870177450012600261ULL;
+
+        inline uint64_t Rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+        inline uint64_t Read64(const uint8_t* p) {
+            uint64_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        inline uint32_t Read32(const uint8_t* p) {
+            uint32_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        inline uint64_t Round(uint64_t acc, uint64_t input) {
+            acc += input * Prime2;
+            acc = Rotl(acc, 31);
+            return acc * Prime1;
+        }
+
+        inline uint64_t MergeRound(uint64_t acc, uint64_t value) {
+            acc ^= Round(0, value);
+            return acc * Prime1 + Prime4;
+        }
+
+        // Consume the final (< 32 byte) tail and avalanche
+        uint64_t Finalize(uint64_t h, const uint8_t* p, const uint8_t* end) {
+            while (p + 8 <= end) {
+                h ^= Round(0, Read64(p));
+                h = Rotl(h, 27) * Prime1 + Prime4;
+                p += 8;
+            }
+            if (p + 4 <= end) {
+                h ^= (uint64_t)Read32(p) * Prime1;
+                h = Rotl(h, 23) * Prime2 + Prime3;
+                p += 4;
+            }
+            while (p < end) {
+                h ^= (*p) * Prime5;
+                h = Rotl(h, 11) * Prime1;
+                p++;
+            }
+
+            h ^= h >> 33;
+            h *= Prime2;
+            h ^= h >> 29;
+            h *= Prime3;
+            h ^= h >> 32;
+            return h;
+        }
+
+        uint64_t Converge(const uint64_t v[4]) {
+            uint64_t h = Rotl(v[0], 1) + Rotl(v[1], 7) + Rotl(v[2], 12) + Rotl(v[3], 18);
+            for (int i = 0; i < 4; i++) {
+                h = MergeRound(h, v[i]);
+            }
+            return h;
+        }
+    }
+
+    uint32_t Crc32(const void* data, size_t length, uint32_t crc) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        crc = ~crc;
+        for (size_t i = 0; i < length; i++) {
+            crc = crcTable.entries[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    uint64_t Hash64(const void* data, size_t length, uint64_t seed) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        const uint8_t* end = p + length;
+        uint64_t h;
+
+        if (length >= 32) {
+            uint64_t v[4] = { seed + Prime1 + Prime2, seed + Prime2, seed, seed - Prime1 };
+
+            const uint8_t* limit = end - 32;
+            do {
+                v[0] = Round(v[0], Read64(p));
+                v[1] = Round(v[1], Read64(p + 8));
+                v[2] = Round(v[2], Read64(p + 16));
+                v[3] = Round(v[3], Read64(p + 24));
+                p += 32;
+            } while (p <= limit);
+
+            h = Converge(v);
+        }
+        else {
+            h = seed + Prime5;
+        }
+
+        return Finalize(h + (uint64_t)length, p, end);
+    }
+
+    Hash64Stream::Hash64Stream(uint64_t seed)
+        : seed(seed), acc{ seed + Prime1 + Prime2, seed + Prime2, seed, seed - Prime1 } {}
+
+    void Hash64Stream::Update(const void* data, size_t length) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        const uint8_t* end = p + length;
+        total += length;
+
+        if (pendingLength + length < sizeof(pending)) {
+            std::memcpy(pending + pendingLength, p, length);
+            pendingLength += length;
+            return;
+        }
+
+        if (pendingLength > 0) {
+            size_t fill = sizeof(pending) - pendingLength;
+            std::memcpy(pending + pendingLength, p, fill);
+            p += fill;
+            for (int i = 0; i < 4; i++) {
+                acc[i] = Round(acc[i], Read64(pending + i * 8));
+            }
+            pendingLength = 0;
+        }
+
+        while (p + 32 <= end) {
+            acc[0] = Round(acc[0], Read64(p));
+            acc[1] = Round(acc[1], Read64(p + 8));
+            acc[2] = Round(acc[2], Read64(p + 16));
+            acc[3] = Round(acc[3], Read64(p + 24));
+            p += 32;
+        }
+
+        pendingLength = (size_t)(end - p);
+        std::memcpy(pending, p, pendingLength);
+    }
+
+    uint64_t Hash64Stream::Digest() const {
+        uint64_t h = total >= 32 ? Converge(acc) : seed + Prime5;
+        return Finalize(h + total, pending, pending + pendingLength);
+    }
+}
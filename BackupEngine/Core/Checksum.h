@@ -0,0 +1,32 @@
+// Checksum.h - Checksums used by the on-disk formats (GPT headers, image streams)
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace BackupCore {
+
+    // CRC-32 (IEEE 802.3), as used by GPT headers and partition entry arrays
+    uint32_t Crc32(const void* data, size_t length, uint32_t crc = 0);
+
+    // XXH64 - fast 64-bit block hash for image streams and compare-before-write
+    uint64_t Hash64(const void* data, size_t length, uint64_t seed = 0);
+
+    // Incremental XXH64 for data that arrives in pieces (whole-file hashes);
+    // gives the same value as Hash64 over the concatenated input
+    class Hash64Stream {
+    public:
+        explicit Hash64Stream(uint64_t seed = 0);
+
+        void Update(const void* data, size_t length);
+        uint64_t Digest() const;
+
+    private:
+        uint64_t seed;
+        uint64_t acc[4];
+        uint64_t total = 0;
+        uint8_t pending[32];
+        size_t pendingLength = 0;
+    };
+}
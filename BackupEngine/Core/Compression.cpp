@@ -0,0 +1,451 @@
+// Compression.cpp - Block compression for file backups
+#include "Compression.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace BackupCore {
+
+    namespace {
+        const int HashBits = 14;
+        const size_t MinMatch = 4;
+        const size_t LastLiterals = 5;      // The block always ends with literals
+        const size_t MatchSearchLimit = 12; // No match may start this close to the end
+        const size_t MaxOffset = 65535;
+
+        // The strong effort hashes more bits and tries this many earlier
+        // positions per match; the chain holds the last MaxOffset + 1 of them
+        const int StrongHashBits = 16;
+        const int StrongAttempts = 16;
+        const size_t ChainSize = 65536;
+
+        // The entropy estimate looks at this many evenly spaced stretches per block
+        const size_t EntropyStretches = 16;
+        const size_t EntropyStretchBytes = 512;
+
+        // Random 512-byte stretches average about 7.6 bits per byte (a short
+        // sample never sees all 256 values evenly); blocks averaging more
+        // than this give LZ too little to pay for trying
+        const double RawEntropy = 7.4;
+
+        // Windows of I/O and CPU time, as in Concurrency.cpp
+        const uint64_t WindowNanoseconds = 100 * 1000 * 1000;
+        const uint64_t MinimumSamples = 8;
+
+        // Strong costs several times what Fast does, so it is only turned on
+        // with that much room behind I/O, and off once compressing catches up
+        const uint64_t StrongHeadroom = 4;
+
+        inline uint32_t Read32(const uint8_t* p) {
+            uint32_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        inline uint32_t HashSequence(uint32_t sequence, int bits = HashBits) {
+            return (sequence * 2654435761u) >> (32 - bits);
+        }
+
+        bool PutLength(uint8_t*& op, const uint8_t* end, size_t length) {
+            while (length >= 255) {
+                if (op >= end) return false;
+                *op++ = 255;
+                length -= 255;
+            }
+            if (op >= end) return false;
+            *op++ = (uint8_t)length;
+            return true;
+        }
+
+        bool GetLength(const uint8_t*& ip, const uint8_t* end, size_t& length) {
+            uint8_t byte;
+            do {
+                if (ip >= end) return false;
+                byte = *ip++;
+                length += byte;
+            } while (byte == 255);
+            return true;
+        }
+
+        // With a dictionary, the block is copied in after the part of it that
+        // matches can reach; returns where the block starts in 'joined' (0,
+        // and nothing copied, without one)
+        size_t JoinDictionary(const CompressionDictionary* dictionary, const uint8_t* src, size_t length,
+            std::vector<uint8_t>& joined) {
+            if (!dictionary || dictionary->bytes.empty()) {
+                return 0;
+            }
+            const std::vector<uint8_t>& bytes = dictionary->bytes;
+            size_t reach = std::min(bytes.size(), MaxOffset);
+            joined.resize(reach + length);
+            std::memcpy(joined.data(), bytes.data() + bytes.size() - reach, reach);
+            std::memcpy(joined.data() + reach, src, length);
+            return reach;
+        }
+
+        // One sequence: literals followed by a match (matchLength 0 for the final literals)
+        bool PutSequence(uint8_t*& op, const uint8_t* end, const uint8_t* literals, size_t literalLength,
+            size_t offset, size_t matchLength) {
+
+            if (op >= end) return false;
+            uint8_t* token = op++;
+            *token = (uint8_t)((literalLength >= 15 ? 15 : literalLength) << 4);
+            if (literalLength >= 15 && !PutLength(op, end, literalLength - 15)) {
+                return false;
+            }
+
+            if ((size_t)(end - op) < literalLength) return false;
+            if (literalLength > 0) {
+                std::memcpy(op, literals, literalLength);
+                op += literalLength;
+            }
+
+            if (matchLength == 0) {
+                return true;
+            }
+
+            if (end - op < 2) return false;
+            *op++ = (uint8_t)offset;
+            *op++ = (uint8_t)(offset >> 8);
+
+            size_t extra = matchLength - MinMatch;
+            *token |= (uint8_t)(extra >= 15 ? 15 : extra);
+            return extra < 15 || PutLength(op, end, extra - 15);
+        }
+    }
+
+    const char* CodecName(CompressionCodec codec) {
+        switch (codec) {
+        case CompressionCodec::Lz: return "lz";
+        case CompressionCodec::LzDictionary: return "lzdict";
+        default: return "none";
+        }
+    }
+
+    CompressionCodec ParseCodecName(const std::string& name) {
+        if (name == "lz") return CompressionCodec::Lz;
+        if (name == "lzdict") return CompressionCodec::LzDictionary;
+        return CompressionCodec::None;
+    }
+
+    CompressionDictionary::CompressionDictionary(std::vector<uint8_t> contents)
+        : bytes(std::move(contents)), table((size_t)1 << HashBits, 0) {
+        // Positions in the window LzCompress joins: the reachable tail, then
+        // the block. The last three need the block's first bytes, so they
+        // are left out.
+        size_t reach = std::min(bytes.size(), MaxOffset);
+        const uint8_t* window = bytes.data() + bytes.size() - reach;
+        for (size_t p = 0; p + 4 <= reach; p++) {
+            table[HashSequence(Read32(window + p))] = (uint32_t)p;
+        }
+    }
+
+    size_t LzCompress(const uint8_t* src, size_t length, uint8_t* dst, size_t capacity,
+        const CompressionDictionary* dictionary) {
+
+        std::vector<uint8_t> joined;
+        size_t start = JoinDictionary(dictionary, src, length, joined);
+        const uint8_t* window = start > 0 ? joined.data() : src;
+        const uint8_t* ip = window + start;
+        const uint8_t* anchor = ip;
+        const uint8_t* end = ip + length;
+        uint8_t* op = dst;
+        const uint8_t* outEnd = dst + capacity;
+
+        if (length > MatchSearchLimit) {
+            // A dictionary's positions are in the table before the block starts
+            std::vector<uint32_t> table = start > 0 ? dictionary->table : std::vector<uint32_t>((size_t)1 << HashBits, 0);
+            const uint8_t* searchEnd = end - MatchSearchLimit;
+            const uint8_t* matchEnd = end - LastLiterals;
+
+            while (ip < searchEnd) {
+                uint32_t sequence = Read32(ip);
+                uint32_t& slot = table[HashSequence(sequence)];
+                const uint8_t* ref = window + slot;
+                slot = (uint32_t)(ip - window);
+
+                if (ref >= ip || (size_t)(ip - ref) > MaxOffset || Read32(ref) != sequence) {
+                    ip++;
+                    continue;
+                }
+
+                // Grow the match backwards into pending literals, then forwards
+                while (ip > anchor && ref > window && ip[-1] == ref[-1]) {
+                    ip--;
+                    ref--;
+                }
+
+                size_t matchLength = MinMatch;
+                while (ip + matchLength < matchEnd && ip[matchLength] == ref[matchLength]) {
+                    matchLength++;
+                }
+
+                if (!PutSequence(op, outEnd, anchor, (size_t)(ip - anchor), (size_t)(ip - ref), matchLength)) {
+                    return 0;
+                }
+                ip += matchLength;
+                anchor = ip;
+            }
+        }
+
+        if (!PutSequence(op, outEnd, anchor, (size_t)(end - anchor), 0, 0)) {
+            return 0;
+        }
+        return (size_t)(op - dst);
+    }
+
+    bool LzDecompress(const uint8_t* src, size_t srcLength, uint8_t* dst, size_t length,
+        const CompressionDictionary* dictionary) {
+
+        // Only the last MaxOffset bytes of a dictionary are in reach
+        size_t dictionaryLength = dictionary ? std::min(dictionary->bytes.size(), MaxOffset) : 0;
+        const uint8_t* dictionaryEnd = dictionary ? dictionary->bytes.data() + dictionary->bytes.size() : nullptr;
+        const uint8_t* ip = src;
+        const uint8_t* end = src + srcLength;
+        uint8_t* op = dst;
+        uint8_t* outEnd = dst + length;
+
+        while (ip < end) {
+            uint8_t token = *ip++;
+
+            size_t literalLength = token >> 4;
+            if (literalLength == 15 && !GetLength(ip, end, literalLength)) {
+                return false;
+            }
+            if ((size_t)(end - ip) < literalLength || (size_t)(outEnd - op) < literalLength) {
+                return false;
+            }
+            if (literalLength > 0) {
+                std::memcpy(op, ip, literalLength);
+                ip += literalLength;
+                op += literalLength;
+            }
+
+            if (ip == end) {
+                break;      // Final literal-only sequence
+            }
+
+            if (end - ip < 2) return false;
+            size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+            ip += 2;
+            size_t produced = (size_t)(op - dst);
+            if (offset == 0 || offset > produced + dictionaryLength) {
+                return false;
+            }
+
+            size_t matchLength = token & 15;
+            if (matchLength == 15 && !GetLength(ip, end, matchLength)) {
+                return false;
+            }
+            matchLength += MinMatch;
+            if ((size_t)(outEnd - op) < matchLength) {
+                return false;
+            }
+
+            // A match reaching back past the block starts in the dictionary,
+            // and may run on into the block
+            if (offset > produced) {
+                size_t fromDictionary = std::min(offset - produced, matchLength);
+                std::memcpy(op, dictionaryEnd - (offset - produced), fromDictionary);
+                op += fromDictionary;
+                matchLength -= fromDictionary;
+            }
+
+            const uint8_t* ref = op - offset;
+            if (offset >= matchLength) {
+                std::memcpy(op, ref, matchLength);
+                op += matchLength;
+            }
+            else {
+                // Overlapping copy repeats the last 'offset' bytes
+                for (size_t i = 0; i < matchLength; i++) {
+                    *op++ = *ref++;
+                }
+            }
+        }
+
+        return op == outEnd;
+    }
+
+    size_t LzCompressStrong(const uint8_t* src, size_t length, uint8_t* dst, size_t capacity,
+        const CompressionDictionary* dictionary) {
+
+        std::vector<uint8_t> joined;
+        size_t start = JoinDictionary(dictionary, src, length, joined);
+        const uint8_t* window = start > 0 ? joined.data() : src;
+        size_t end = start + length;
+        size_t anchor = start;
+        uint8_t* op = dst;
+        const uint8_t* outEnd = dst + capacity;
+
+        if (length > MatchSearchLimit) {
+            // head: last position + 1 per hash; chain: distance back to the
+            // previous position with the same hash (0 ends the chain)
+            std::vector<uint32_t> head((size_t)1 << StrongHashBits, 0);
+            std::vector<uint16_t> chain(ChainSize, 0);
+            const size_t searchEnd = end - MatchSearchLimit;
+            const size_t matchEnd = end - LastLiterals;
+            size_t inserted = 0;
+
+            // Longest match for the bytes at 'pos' among earlier positions; 0 if none
+            auto findMatch = [&](size_t pos, size_t& ref) -> size_t {
+                for (; inserted < pos; inserted++) {
+                    uint32_t& slot = head[HashSequence(Read32(window + inserted), StrongHashBits)];
+                    size_t distance = inserted + 1 - slot;
+                    chain[inserted % ChainSize] = (uint16_t)(slot != 0 && distance <= MaxOffset ? distance : 0);
+                    slot = (uint32_t)(inserted + 1);
+                }
+
+                uint32_t sequence = Read32(window + pos);
+                uint32_t candidate = head[HashSequence(sequence, StrongHashBits)];
+                size_t best = 0;
+                for (int attempt = 0; attempt < StrongAttempts && candidate != 0; attempt++) {
+                    size_t at = candidate - 1;
+                    if (pos - at > MaxOffset) break;
+                    if (Read32(window + at) == sequence && window[at + best] == window[pos + best]) {
+                        size_t matchLength = MinMatch;
+                        while (pos + matchLength < matchEnd && window[pos + matchLength] == window[at + matchLength]) {
+                            matchLength++;
+                        }
+                        if (matchLength > best) {
+                            best = matchLength;
+                            ref = at;
+                        }
+                    }
+                    uint16_t step = chain[at % ChainSize];
+                    if (step == 0) break;
+                    candidate -= step;
+                }
+                return best >= MinMatch ? best : 0;
+            };
+
+            size_t ip = start;
+            while (ip < searchEnd) {
+                size_t ref = 0;
+                size_t matchLength = findMatch(ip, ref);
+                if (matchLength == 0) {
+                    ip++;
+                    continue;
+                }
+
+                // A longer match one byte on is worth a literal
+                size_t nextRef = 0;
+                size_t nextLength = 0;
+                while (ip + 1 < searchEnd && (nextLength = findMatch(ip + 1, nextRef)) > matchLength) {
+                    ip++;
+                    ref = nextRef;
+                    matchLength = nextLength;
+                }
+
+                while (ip > anchor && ref > 0 && window[ip - 1] == window[ref - 1]) {
+                    ip--;
+                    ref--;
+                    matchLength++;
+                }
+
+                if (!PutSequence(op, outEnd, window + anchor, ip - anchor, ip - ref, matchLength)) {
+                    return 0;
+                }
+                ip += matchLength;
+                anchor = ip;
+            }
+        }
+
+        if (!PutSequence(op, outEnd, window + anchor, end - anchor, 0, 0)) {
+            return 0;
+        }
+        return (size_t)(op - dst);
+    }
+
+    double SampledEntropy(const uint8_t* data, size_t length) {
+        size_t stretch = std::min(length, EntropyStretchBytes);
+        if (stretch == 0) {
+            return 0;
+        }
+        size_t stretches = std::max<size_t>(1, std::min(EntropyStretches, length / EntropyStretchBytes));
+        size_t step = length / stretches;
+
+        double sum = 0;
+        for (size_t s = 0; s < stretches; s++) {
+            // Four sets of counters, so that neighbouring bytes with the same
+            // value do not wait on each other's increments
+            uint16_t counts[4][256] = {};
+            const uint8_t* p = data + s * step;
+            size_t i = 0;
+            for (; i + 4 <= stretch; i += 4) {
+                counts[0][p[i]]++;
+                counts[1][p[i + 1]]++;
+                counts[2][p[i + 2]]++;
+                counts[3][p[i + 3]]++;
+            }
+            for (; i < stretch; i++) {
+                counts[0][p[i]]++;
+            }
+
+            double weighted = 0;
+            for (int b = 0; b < 256; b++) {
+                uint32_t count = (uint32_t)counts[0][b] + counts[1][b] + counts[2][b] + counts[3][b];
+                if (count > 0) {
+                    weighted += count * std::log2((double)count);
+                }
+            }
+            sum += std::log2((double)stretch) - weighted / (double)stretch;
+        }
+        return sum / (double)stretches;
+    }
+
+    AdaptiveCompression::AdaptiveCompression() : windowStart(MonotonicNanoseconds()) {}
+
+    BlockEffort AdaptiveCompression::Choose(const uint8_t* data, size_t length) {
+        BlockEffort effort = BlockEffort::Fast;
+        if (SampledEntropy(data, length) >= RawEntropy) {
+            effort = BlockEffort::Raw;
+        }
+        else if (Strong()) {
+            effort = BlockEffort::Strong;
+        }
+        blocks[(int)effort].fetch_add(1, std::memory_order_relaxed);
+        return effort;
+    }
+
+    void AdaptiveCompression::SampleIo(uint64_t nanoseconds) {
+        Sample(ioNanoseconds, nanoseconds);
+    }
+
+    void AdaptiveCompression::SampleCpu(uint64_t nanoseconds) {
+        Sample(cpuNanoseconds, nanoseconds);
+    }
+
+    void AdaptiveCompression::Sample(std::atomic<uint64_t>& total, uint64_t nanoseconds) {
+        samples.fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+        uint64_t now = MonotonicNanoseconds();
+        if (now - windowStart.load(std::memory_order_relaxed) < WindowNanoseconds ||
+            samples.load(std::memory_order_relaxed) < MinimumSamples) {
+            return;
+        }
+        if (!adjusting.exchange(true, std::memory_order_acquire)) {
+            Adjust(now);
+            adjusting.store(false, std::memory_order_release);
+        }
+    }
+
+    void AdaptiveCompression::Adjust(uint64_t now) {
+        windowStart.store(now, std::memory_order_relaxed);
+        samples.store(0, std::memory_order_relaxed);
+        uint64_t io = ioNanoseconds.exchange(0, std::memory_order_relaxed);
+        uint64_t cpu = cpuNanoseconds.exchange(0, std::memory_order_relaxed);
+
+        if (!Strong()) {
+            if (io > cpu * StrongHeadroom) {
+                strong.store(true, std::memory_order_relaxed);
+            }
+        }
+        else if (cpu > io) {
+            strong.store(false, std::memory_order_relaxed);
+        }
+    }
+}
@@ -0,0 +1,110 @@
+// Compression.h - Block compression for file backups
+//
+// The Lz codec is a byte-oriented LZ77 using the LZ4 block layout: each
+// sequence is a token (literal length / match length nibbles), optional
+// length extension bytes, the literals, and a 16-bit little-endian offset.
+// It favours speed over ratio so backups stay I/O bound.
+//
+// LzCompressStrong writes the same layout, so restore never needs to know
+// which was used. It follows a chain of earlier positions with the same
+// hash instead of looking at one, and defers a match by a byte when the
+// next position has a longer one: about five times slower, and a tenth to
+// a quarter smaller on text and executables.
+//
+// AdaptiveCompression picks, per block of a job, between storing it as is,
+// Lz and LzCompressStrong. A block whose sampled stretches look random is
+// already compressed (JPEG, ZIP, MP4, most VHDX payloads) and is not tried
+// at all. The others get the strong effort only while the job spends much
+// longer waiting on reads, writes and its throttle than on compressing, so
+// that the extra CPU time is hidden behind I/O; as soon as compressing
+// catches up with I/O, blocks go back to the fast one.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace BackupCore {
+
+    enum class CompressionCodec : uint32_t {
+        None = 0,
+        Lz = 1,
+        LzDictionary = 2        // Lz against the set's dictionary (Dictionary.h)
+    };
+
+    const char* CodecName(CompressionCodec codec);
+    CompressionCodec ParseCodecName(const std::string& name);
+
+    // Bytes a block may refer to as if they came just before it; only the
+    // last 64 KB are in reach. The compressor's hash table over them is
+    // built once here, not for every block.
+    struct CompressionDictionary {
+        CompressionDictionary() = default;
+        explicit CompressionDictionary(std::vector<uint8_t> contents);
+
+        std::vector<uint8_t> bytes;
+        std::vector<uint32_t> table;
+    };
+
+    // Compress one block into dst. Returns the compressed size, or 0 if the
+    // result would not fit in 'capacity' (callers then store the block raw).
+    // A block compressed with a dictionary needs the same one to decode.
+    size_t LzCompress(const uint8_t* src, size_t length, uint8_t* dst, size_t capacity,
+        const CompressionDictionary* dictionary = nullptr);
+
+    // Decode a block that expands to exactly 'length' bytes; false if malformed
+    bool LzDecompress(const uint8_t* src, size_t srcLength, uint8_t* dst, size_t length,
+        const CompressionDictionary* dictionary = nullptr);
+
+    // Same contract as LzCompress; slower, and usually smaller
+    size_t LzCompressStrong(const uint8_t* src, size_t length, uint8_t* dst, size_t capacity,
+        const CompressionDictionary* dictionary = nullptr);
+
+    // Average order-0 entropy, in bits per byte, of sixteen evenly spaced
+    // 512-byte stretches of a block. Judged stretch by stretch, a block that
+    // mixes compressed data with text still shows the text.
+    double SampledEntropy(const uint8_t* data, size_t length);
+
+    enum class BlockEffort {
+        Raw,        // Looks incompressible; stored without trying
+        Fast,       // LzCompress
+        Strong      // LzCompressStrong
+    };
+
+    // Shared by the file threads of one job; every call is lock-free
+    class AdaptiveCompression {
+    public:
+        AdaptiveCompression();
+
+        BlockEffort Choose(const uint8_t* data, size_t length);
+
+        // Time a thread spent on one read, write or throttle wait, and on
+        // one block's hashing, compressing and sealing
+        void SampleIo(uint64_t nanoseconds);
+        void SampleCpu(uint64_t nanoseconds);
+
+        bool Strong() const { return strong.load(std::memory_order_relaxed); }
+
+        // Blocks Choose has given each effort so far
+        uint64_t Blocks(BlockEffort effort) const {
+            return blocks[(int)effort].load(std::memory_order_relaxed);
+        }
+
+    private:
+        void Sample(std::atomic<uint64_t>& total, uint64_t nanoseconds);
+        void Adjust(uint64_t now);
+
+        std::atomic<bool> strong{ false };
+        std::atomic<uint64_t> blocks[3] = {};
+
+        // Current window, filled by every file thread
+        std::atomic<uint64_t> windowStart;
+        std::atomic<uint64_t> samples{ 0 };
+        std::atomic<uint64_t> ioNanoseconds{ 0 };
+        std::atomic<uint64_t> cpuNanoseconds{ 0 };
+        std::atomic<bool> adjusting{ false };
+    };
+}
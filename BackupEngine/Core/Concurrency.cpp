@@ -0,0 +1,79 @@
+// Concurrency.cpp - Latency-adaptive limit on files in flight
+#include "Concurrency.h"
+#include "Metrics.h"
+#include <algorithm>
+
+namespace BackupCore {
+
+    namespace {
+        // A window closes after this long, once it holds enough samples to judge
+        const uint64_t WindowNanoseconds = 100 * 1000 * 1000;
+        const uint64_t MinimumSamples = 8;
+
+        // Each operation counts as this many extra bytes, so windows of small
+        // files and windows of large ones give comparable costs
+        const uint64_t OperationWeight = 64 * 1024;
+
+        // Cost above floor * tolerance means the device is queueing
+        const double LatencyTolerance = 1.5;
+
+        // The floor creeps up by this factor per window (about 2% a second) so
+        // that a device that got slower for good becomes the new normal
+        const double FloorDrift = 1.002;
+
+        // Growing the limit is only worth it while throughput holds up
+        const double ThroughputKeptUp = 0.9;
+    }
+
+    AdaptiveConcurrency::AdaptiveConcurrency(uint32_t minimum, uint32_t maximum, uint32_t initial)
+        : minimum(std::max<uint32_t>(minimum, 1)),
+          maximum(std::max(maximum, std::max<uint32_t>(minimum, 1))),
+          limit(std::min(std::max(initial, this->minimum), this->maximum)),
+          windowStart(MonotonicNanoseconds()) {}
+
+    void AdaptiveConcurrency::Sample(uint64_t nanoseconds, uint64_t length) {
+        samples.fetch_add(1, std::memory_order_relaxed);
+        latency.fetch_add(nanoseconds, std::memory_order_relaxed);
+        bytes.fetch_add(length, std::memory_order_relaxed);
+
+        uint64_t now = MonotonicNanoseconds();
+        if (now - windowStart.load(std::memory_order_relaxed) < WindowNanoseconds ||
+            samples.load(std::memory_order_relaxed) < MinimumSamples) {
+            return;
+        }
+        if (!adjusting.exchange(true, std::memory_order_acquire)) {
+            Adjust(now);
+            adjusting.store(false, std::memory_order_release);
+        }
+    }
+
+    void AdaptiveConcurrency::Adjust(uint64_t now) {
+        // Samples that land while the window is being taken apart go to the next one
+        uint64_t elapsed = now - windowStart.exchange(now, std::memory_order_relaxed);
+        uint64_t count = samples.exchange(0, std::memory_order_relaxed);
+        uint64_t nanoseconds = latency.exchange(0, std::memory_order_relaxed);
+        uint64_t moved = bytes.exchange(0, std::memory_order_relaxed);
+        if (count == 0 || elapsed == 0) {
+            return;
+        }
+
+        double cost = (double)nanoseconds / (double)(moved + count * OperationWeight);
+        double throughput = (double)moved * 1e9 / (double)elapsed;
+        floorCost = floorCost == 0 ? cost : std::min(cost, floorCost * FloorDrift);
+
+        uint32_t current = limit.load(std::memory_order_relaxed);
+        uint32_t next = current;
+        if (cost > floorCost * LatencyTolerance) {
+            next = std::max(minimum, std::min(current - 1, current * 3 / 4));
+        }
+        else if (throughput >= lastThroughput * ThroughputKeptUp) {
+            // Doubling until the first sign of queueing finds the range quickly
+            next = std::min(maximum, slowStart ? current * 2 : current + 1);
+        }
+        if (next < current) {
+            slowStart = false;
+        }
+        lastThroughput = throughput;
+        limit.store(next, std::memory_order_relaxed);
+    }
+}
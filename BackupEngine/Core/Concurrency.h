@@ -0,0 +1,50 @@
+// Concurrency.h - Latency-adaptive limit on files in flight
+//
+// The best number of parallel copies depends on the device: a local NVMe
+// wants many, a RAID of spinning disks a few, a busy SMB share fewer still.
+// AdaptiveConcurrency picks it as it goes, AIMD style. The file threads
+// report every read and write; once per window the controller compares the
+// window's latency with the lowest it has seen. Latency well above that
+// floor means requests are queueing at the device, so the limit is cut by a
+// quarter. Otherwise, and as long as throughput keeps pace, it grows by one;
+// until the first cut it doubles instead. Jobs start low so that the floor
+// is learnt before the device is loaded.
+//
+// Sample is lock-free; the window is evaluated by whichever thread closes it.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace BackupCore {
+
+    class AdaptiveConcurrency {
+    public:
+        AdaptiveConcurrency(uint32_t minimum, uint32_t maximum, uint32_t initial);
+
+        uint32_t Limit() const { return limit.load(std::memory_order_relaxed); }
+
+        // One completed read or write
+        void Sample(uint64_t nanoseconds, uint64_t bytes);
+
+    private:
+        void Adjust(uint64_t now);
+
+        const uint32_t minimum;
+        const uint32_t maximum;
+        std::atomic<uint32_t> limit;
+
+        // Current window, filled by every file thread
+        std::atomic<uint64_t> windowStart;
+        std::atomic<uint64_t> samples{ 0 };
+        std::atomic<uint64_t> latency{ 0 };     // Sum of nanoseconds
+        std::atomic<uint64_t> bytes{ 0 };
+        std::atomic<bool> adjusting{ false };
+
+        // Controller state, touched only by the thread that holds 'adjusting'
+        double floorCost = 0;                   // Lowest nanoseconds per weighted byte seen
+        double lastThroughput = 0;              // Bytes per second of the previous window
+        bool slowStart = true;                  // No queueing seen yet
+    };
+}
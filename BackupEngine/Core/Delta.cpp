@@ -0,0 +1,298 @@
+// Delta.cpp - Similarity sketches and delta encoding of near-identical files
+#include "Delta.h"
+#include "Checksum.h"
+#include <algorithm>
+#include <cstring>
+
+namespace BackupCore {
+
+    namespace {
+        const char DeltaMagic[4] = { 'B', 'K', 'D', '1' };
+        const size_t FeaturesPerSuperFeature = SketchFeatures / SketchSuperFeatures;
+
+        const size_t GearWindow = 64;
+
+        // The top bits of the gear hash depend on the last 64 bytes; seven of
+        // them clear picks about one position in 128, which still leaves a
+        // 64 KB file hundreds of samples
+        const uint64_t SampleMask = 0xfe00000000000000ull;
+
+        const size_t MinMatch = 32;
+        const size_t MatchStride = 16;
+
+        // Pieces handed to the sink, so a long copy still checks for cancel
+        const size_t SinkPiece = 1024 * 1024;
+
+        uint64_t SplitMix(uint64_t& state) {
+            uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            return z ^ (z >> 31);
+        }
+
+        struct SketchTables {
+            uint64_t gear[256];
+            uint64_t multipliers[SketchFeatures];
+            uint64_t offsets[SketchFeatures];
+
+            SketchTables() {
+                // Fixed seed, so a file's sketch is the same on every run
+                uint64_t state = 0x4241434b55505348ull;
+                for (auto& value : gear) value = SplitMix(state);
+                for (size_t f = 0; f < SketchFeatures; f++) {
+                    multipliers[f] = SplitMix(state) | 1;
+                    offsets[f] = SplitMix(state);
+                }
+            }
+        };
+
+        const SketchTables& Tables() {
+            static const SketchTables tables;
+            return tables;
+        }
+
+        uint64_t Load64(const uint8_t* p) {
+            uint64_t value;
+            std::memcpy(&value, p, sizeof(value));
+            return value;
+        }
+
+        uint64_t Rotate(uint64_t value, int bits) {
+            return (value << bits) | (value >> (64 - bits));
+        }
+
+        // Hash of the MinMatch bytes at p
+        uint64_t WindowKey(const uint8_t* p) {
+            const uint64_t prime = 0x9e3779b97f4a7c15ull;
+            uint64_t h = Load64(p) * prime;
+            h = Rotate(h ^ Load64(p + 8), 29) * prime;
+            h = Rotate(h ^ Load64(p + 16), 31) * prime;
+            h = Rotate(h ^ Load64(p + 24), 27) * prime;
+            return h ^ (h >> 32);
+        }
+
+        void PutVarint(std::vector<uint8_t>& out, uint64_t value) {
+            while (value >= 0x80) {
+                out.push_back((uint8_t)(value | 0x80));
+                value >>= 7;
+            }
+            out.push_back((uint8_t)value);
+        }
+
+        bool GetVarint(const uint8_t*& p, const uint8_t* end, uint64_t& value) {
+            value = 0;
+            for (int shift = 0; shift < 64; shift += 7) {
+                if (p == end) return false;
+                uint8_t byte = *p++;
+                value |= (uint64_t)(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) return true;
+            }
+            return false;
+        }
+
+        bool SinkInPieces(const DeltaSink& sink, const uint8_t* data, size_t length) {
+            while (length > 0) {
+                size_t piece = std::min(length, SinkPiece);
+                if (!sink(data, piece)) return false;
+                data += piece;
+                length -= piece;
+            }
+            return true;
+        }
+    }
+
+    SketchBuilder::SketchBuilder() {
+        std::fill(features, features + SketchFeatures, 0);
+    }
+
+    void SketchBuilder::Update(const uint8_t* data, size_t length) {
+        const SketchTables& tables = Tables();
+        auto sample = [&](uint64_t h) {
+            sampled = true;
+            for (size_t f = 0; f < SketchFeatures; f++) {
+                features[f] = std::max(features[f], h * tables.multipliers[f] + tables.offsets[f]);
+            }
+        };
+
+        // One gear hash is a chain of dependent adds. It only depends on the
+        // last 64 bytes, though, so the second half of a long piece is hashed
+        // alongside the first, starting 64 bytes early, and the two chains
+        // overlap in the CPU.
+        uint64_t h = gear;
+        size_t i = 0;
+        if (length >= 4 * GearWindow) {
+            size_t half = length / 2;
+            uint64_t h2 = 0;
+            for (size_t k = half - GearWindow; k < half; k++) {
+                h2 = (h2 << 1) + tables.gear[data[k]];
+            }
+            for (; i < half; i++) {
+                h = (h << 1) + tables.gear[data[i]];
+                h2 = (h2 << 1) + tables.gear[data[half + i]];
+                if ((h & SampleMask) == 0 && position + i >= GearWindow - 1) {
+                    sample(h);
+                }
+                if ((h2 & SampleMask) == 0) {
+                    sample(h2);
+                }
+            }
+            h = h2;
+            i = 2 * half;
+        }
+        for (; i < length; i++) {
+            h = (h << 1) + tables.gear[data[i]];
+            if ((h & SampleMask) == 0 && position + i >= GearWindow - 1) {
+                sample(h);
+            }
+        }
+        gear = h;
+        position += length;
+    }
+
+    SimilaritySketch SketchBuilder::Finish() const {
+        SimilaritySketch sketch;
+        if (!sampled) {
+            return sketch;
+        }
+        for (size_t s = 0; s < SketchSuperFeatures; s++) {
+            sketch.superFeatures[s] = Hash64(features + s * FeaturesPerSuperFeature,
+                FeaturesPerSuperFeature * sizeof(uint64_t), s);
+        }
+        sketch.empty = false;
+        return sketch;
+    }
+
+    SimilaritySketch SketchOf(const uint8_t* data, size_t length) {
+        SketchBuilder builder;
+        builder.Update(data, length);
+        return builder.Finish();
+    }
+
+    void SimilarityIndex::Add(const SimilaritySketch& sketch, size_t id) {
+        if (sketch.empty) {
+            return;
+        }
+        // The first file with a feature keeps it; later look-alikes delta against that one
+        for (size_t s = 0; s < SketchSuperFeatures; s++) {
+            byFeature[s].emplace(sketch.superFeatures[s], id);
+        }
+    }
+
+    bool SimilarityIndex::Find(const SimilaritySketch& sketch, size_t& id) const {
+        if (sketch.empty) {
+            return false;
+        }
+        size_t candidates[SketchSuperFeatures];
+        size_t votes[SketchSuperFeatures] = {};
+        size_t count = 0;
+        for (size_t s = 0; s < SketchSuperFeatures; s++) {
+            auto it = byFeature[s].find(sketch.superFeatures[s]);
+            if (it == byFeature[s].end()) continue;
+            size_t k = std::find(candidates, candidates + count, it->second) - candidates;
+            if (k == count) {
+                candidates[count++] = it->second;
+            }
+            votes[k]++;
+        }
+        if (count == 0) {
+            return false;
+        }
+        id = candidates[std::max_element(votes, votes + count) - votes];
+        return true;
+    }
+
+    void EncodeDelta(const uint8_t* base, size_t baseLength, const uint8_t* target, size_t targetLength,
+        std::vector<uint8_t>& delta) {
+
+        delta.assign(DeltaMagic, DeltaMagic + sizeof(DeltaMagic));
+        PutVarint(delta, targetLength);
+
+        size_t literal = 0;
+        auto insert = [&](size_t end) {
+            if (end > literal) {
+                PutVarint(delta, (uint64_t)(end - literal) << 1);
+                delta.insert(delta.end(), target + literal, target + end);
+            }
+        };
+
+        if (baseLength >= MinMatch && targetLength >= MinMatch) {
+            int bits = 10;
+            while (((size_t)1 << bits) < 2 * (baseLength / MatchStride + 1)) bits++;
+            std::vector<uint32_t> table((size_t)1 << bits, 0);
+            for (size_t p = 0; p + MinMatch <= baseLength; p += MatchStride) {
+                table[WindowKey(base + p) >> (64 - bits)] = (uint32_t)(p + 1);
+            }
+
+            size_t i = 0;
+            while (i + MinMatch <= targetLength) {
+                uint32_t slot = table[WindowKey(target + i) >> (64 - bits)];
+                if (slot == 0 || std::memcmp(base + slot - 1, target + i, MinMatch) != 0) {
+                    i++;
+                    continue;
+                }
+                size_t from = slot - 1, start = i;
+                while (start > literal && from > 0 && base[from - 1] == target[start - 1]) {
+                    start--;
+                    from--;
+                }
+                size_t end = i + MinMatch, baseEnd = slot - 1 + MinMatch;
+                while (end < targetLength && baseEnd < baseLength && base[baseEnd] == target[end]) {
+                    end++;
+                    baseEnd++;
+                }
+                insert(start);
+                PutVarint(delta, ((uint64_t)(end - start) << 1) | 1);
+                PutVarint(delta, from);
+                i = literal = end;
+            }
+        }
+        insert(targetLength);
+    }
+
+    bool ApplyDelta(const uint8_t* base, size_t baseLength, const uint8_t* delta, size_t deltaLength,
+        const DeltaSink& sink) {
+
+        const uint8_t* p = delta;
+        const uint8_t* end = delta + deltaLength;
+        uint64_t targetLength = 0;
+        if (deltaLength < sizeof(DeltaMagic) || std::memcmp(p, DeltaMagic, sizeof(DeltaMagic)) != 0) {
+            return false;
+        }
+        p += sizeof(DeltaMagic);
+        if (!GetVarint(p, end, targetLength)) {
+            return false;
+        }
+
+        uint64_t produced = 0;
+        while (p < end) {
+            uint64_t op = 0;
+            if (!GetVarint(p, end, op)) {
+                return false;
+            }
+            uint64_t length = op >> 1;
+            if (length > targetLength - produced) {
+                return false;
+            }
+            if (op & 1) {
+                uint64_t offset = 0;
+                if (!GetVarint(p, end, offset) || offset > baseLength || length > baseLength - offset) {
+                    return false;
+                }
+                if (!SinkInPieces(sink, base + offset, (size_t)length)) {
+                    return false;
+                }
+            }
+            else {
+                if (length > (uint64_t)(end - p)) {
+                    return false;
+                }
+                if (!SinkInPieces(sink, p, (size_t)length)) {
+                    return false;
+                }
+                p += length;
+            }
+            produced += length;
+        }
+        return produced == targetLength;
+    }
+}
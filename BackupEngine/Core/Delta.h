@@ -0,0 +1,73 @@
+// Delta.h - Similarity sketches and delta encoding of near-identical files
+//
+// A sketch samples a file at content-defined points (a gear hash over the
+// last 64 bytes has its top bits clear) and keeps, for each of twelve
+// transforms of the hash, its largest value. Files that share most of
+// their content share most of these features, however the edits moved the
+// rest around. The features are folded four at a time into three
+// super-features, and two files that have any super-feature in common are
+// worth a delta.
+//
+// A delta rebuilds a target from a base with copy and insert instructions:
+//   "BKD1", varint targetLength, then per instruction:
+//   varint (length << 1 | 1), varint base offset    copy from the base
+//   varint (length << 1), length literal bytes       insert
+// Copies are found through a hash of every 16th 32-byte window of the base,
+// and extended both ways byte by byte.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+namespace BackupCore {
+
+    const size_t SketchFeatures = 12;
+    const size_t SketchSuperFeatures = 3;
+
+    struct SimilaritySketch {
+        uint64_t superFeatures[SketchSuperFeatures] = {};
+        bool empty = true;          // Too short or too uniform to have sample points
+    };
+
+    // Builds a sketch from a file read in pieces of any size
+    class SketchBuilder {
+    public:
+        SketchBuilder();
+        void Update(const uint8_t* data, size_t length);
+        SimilaritySketch Finish() const;
+
+    private:
+        uint64_t features[SketchFeatures];
+        uint64_t gear = 0;
+        uint64_t position = 0;
+        bool sampled = false;
+    };
+
+    SimilaritySketch SketchOf(const uint8_t* data, size_t length);
+
+    // Sketches of the files that may serve as bases. Not thread-safe.
+    class SimilarityIndex {
+    public:
+        void Add(const SimilaritySketch& sketch, size_t id);
+
+        // The file sharing the most super-features with 'sketch'; false if none shares any
+        bool Find(const SimilaritySketch& sketch, size_t& id) const;
+
+    private:
+        std::unordered_map<uint64_t, size_t> byFeature[SketchSuperFeatures];
+    };
+
+    void EncodeDelta(const uint8_t* base, size_t baseLength, const uint8_t* target, size_t targetLength,
+        std::vector<uint8_t>& delta);
+
+    // Receives the rebuilt target in order; returns false to stop
+    typedef std::function<bool(const uint8_t* data, size_t length)> DeltaSink;
+
+    // False if the delta is malformed, does not fit the base, or the sink stopped it
+    bool ApplyDelta(const uint8_t* base, size_t baseLength, const uint8_t* delta, size_t deltaLength,
+        const DeltaSink& sink);
+}
@@ -0,0 +1,105 @@
+// Dictionary.cpp - Training a shared LZ dictionary for the small files of a set
+#include "Dictionary.h"
+#include <algorithm>
+#include <cstring>
+#include <queue>
+
+namespace BackupCore {
+
+    namespace {
+        const size_t SequenceBytes = 8;
+        const size_t SegmentBytes = 64;
+
+        // Sequences are counted by hash, in a table this large; the odd
+        // collision only misjudges a segment's worth
+        const int CountBits = 20;
+
+        size_t SequenceSlot(const uint8_t* p) {
+            uint64_t value;
+            std::memcpy(&value, p, sizeof(value));
+            return (size_t)((value * 0x9e3779b97f4a7c15ull) >> (64 - CountBits));
+        }
+
+        struct Segment {
+            uint64_t score;
+            uint32_t sample;
+            uint32_t offset;
+
+            // Best score first; ties go to the earlier segment, so training is repeatable
+            bool operator<(const Segment& other) const {
+                if (score != other.score) return score < other.score;
+                if (sample != other.sample) return sample > other.sample;
+                return offset > other.offset;
+            }
+        };
+    }
+
+    std::vector<uint8_t> TrainDictionary(const std::vector<std::vector<uint8_t>>& samples, size_t capacity) {
+        // How many samples contain each sequence; lastSample keeps one sample
+        // from counting the same sequence twice
+        std::vector<uint32_t> sharedBy((size_t)1 << CountBits, 0);
+        std::vector<uint32_t> lastSample((size_t)1 << CountBits, 0);
+        for (size_t s = 0; s < samples.size(); s++) {
+            const std::vector<uint8_t>& sample = samples[s];
+            for (size_t i = 0; i + SequenceBytes <= sample.size(); i++) {
+                size_t slot = SequenceSlot(sample.data() + i);
+                if (lastSample[slot] != s + 1) {
+                    lastSample[slot] = (uint32_t)(s + 1);
+                    sharedBy[slot]++;
+                }
+            }
+        }
+
+        // A sequence only one file has is no use to the others
+        auto score = [&](const Segment& segment) {
+            const uint8_t* p = samples[segment.sample].data() + segment.offset;
+            uint64_t total = 0;
+            for (size_t i = 0; i + SequenceBytes <= SegmentBytes; i++) {
+                uint32_t count = sharedBy[SequenceSlot(p + i)];
+                if (count > 1) total += count;
+            }
+            return total;
+        };
+
+        std::priority_queue<Segment> candidates;
+        for (size_t s = 0; s < samples.size(); s++) {
+            for (size_t offset = 0; offset + SegmentBytes <= samples[s].size(); offset += SegmentBytes) {
+                Segment segment = { 0, (uint32_t)s, (uint32_t)offset };
+                segment.score = score(segment);
+                if (segment.score > 0) candidates.push(segment);
+            }
+        }
+
+        // Scores only fall as sequences are used up, so a segment whose
+        // score still holds when it comes out on top is the best one left
+        std::vector<Segment> chosen;
+        while (!candidates.empty() && (chosen.size() + 1) * SegmentBytes <= capacity) {
+            Segment best = candidates.top();
+            candidates.pop();
+            uint64_t current = score(best);
+            if (current < best.score) {
+                if (current > 0) {
+                    best.score = current;
+                    candidates.push(best);
+                }
+                continue;
+            }
+            chosen.push_back(best);
+            const uint8_t* p = samples[best.sample].data() + best.offset;
+            for (size_t i = 0; i + SequenceBytes <= SegmentBytes; i++) {
+                sharedBy[SequenceSlot(p + i)] = 0;
+            }
+        }
+
+        std::sort(chosen.begin(), chosen.end(), [](const Segment& a, const Segment& b) {
+            return a.sample != b.sample ? a.sample < b.sample : a.offset < b.offset;
+        });
+        std::vector<uint8_t> dictionary;
+        dictionary.reserve(chosen.size() * SegmentBytes);
+        for (const Segment& segment : chosen) {
+            const uint8_t* p = samples[segment.sample].data() + segment.offset;
+            dictionary.insert(dictionary.end(), p, p + SegmentBytes);
+        }
+        return dictionary;
+    }
+}
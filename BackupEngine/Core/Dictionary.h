@@ -0,0 +1,30 @@
+// Dictionary.h - Training a shared LZ dictionary for the small files of a set
+//
+// A small file gives LZ little to match within itself, but the configs,
+// sources and logs of one tree have a lot in common with each other. The
+// set's small files are compressed against one dictionary (see
+// CompressionDictionary), which TrainDictionary builds from a sample of
+// them in the manner of zstd's COVER trainer:
+//   - every 8-byte sequence is scored by how many sample files contain it;
+//   - the samples are cut into 64-byte segments, scored by the sequences
+//     in them that more than one file shares;
+//   - the best segment is taken, its sequences then count for nothing (so
+//     the next one adds something new), and so on until the dictionary is
+//     full.
+// The chosen segments are laid out in sample order, so that neighbours in a
+// sample stay neighbours and a match can run on from one into the next.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace BackupCore {
+
+    const size_t DictionarySize = 32 * 1024;
+
+    // Empty if no sequence is shared by two samples
+    std::vector<uint8_t> TrainDictionary(const std::vector<std::vector<uint8_t>>& samples,
+        size_t capacity = DictionarySize);
+}
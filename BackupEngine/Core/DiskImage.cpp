@@ -0,0 +1,1258 @@
+// DiskImage.cpp - Partition-aware disk imaging, restore and disk-to-disk clone
+#include "DiskImage.h"
+#include "AllocationMap.h"
+#include "Checkpoint.h"
+#include "Checksum.h"
+#include "Metrics.h"
+#include "Throttle.h"
+#include "Trace.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace BackupCore {
+
+    namespace {
+        // Applies a job's I/O limits to a caller's device for one call
+        class DeviceThrottle {
+        public:
+            DeviceThrottle(BlockDevice& device, IoThrottle* throttle) : device(device) {
+                device.SetThrottle(throttle);
+            }
+            ~DeviceThrottle() { device.SetThrottle(nullptr); }
+
+            DeviceThrottle(const DeviceThrottle&) = delete;
+            DeviceThrottle& operator=(const DeviceThrottle&) = delete;
+
+        private:
+            BlockDevice& device;
+        };
+
+        const char* LayoutHeader = "DISK_LAYOUT_V1";
+        const char MapMagic[8] = { 'D', 'I', 'S', 'K', 'M', 'A', 'P', '1' };
+        const char HashMagic[8] = { 'B', 'L', 'K', 'H', 'A', 'S', 'H', '1' };
+        const size_t MapRecordSize = 24;
+
+        void PutLe(uint8_t* p, uint64_t value, int bytes) {
+            for (int i = 0; i < bytes; i++) {
+                p[i] = (uint8_t)(value >> (8 * i));
+            }
+        }
+
+        uint64_t GetLe(const uint8_t* p, int bytes) {
+            uint64_t value = 0;
+            for (int i = 0; i < bytes; i++) {
+                value |= (uint64_t)p[i] << (8 * i);
+            }
+            return value;
+        }
+
+        // Manifest fields are '|' separated; keep free-text fields on one field/line
+        std::string Sanitize(const std::string& text) {
+            std::string out = text;
+            for (char& c : out) {
+                if (c == '|' || c == '\n' || c == '\r') c = '_';
+            }
+            return out;
+        }
+
+        std::vector<std::string> Split(const std::string& line, char separator) {
+            std::vector<std::string> fields;
+            std::stringstream ss(line);
+            std::string field;
+            while (std::getline(ss, field, separator)) {
+                fields.push_back(field);
+            }
+            return fields;
+        }
+
+        // Reports only when the integer percentage changes
+        class ProgressTracker {
+        public:
+            ProgressTracker(const ImageProgress& callback, uint64_t total)
+                : callback(callback), total(total) {}
+
+            void Advance(uint64_t bytes, const std::string& message) {
+                done += bytes;
+                int percent = total > 0 ? (int)((done * 100) / total) : 100;
+                if (callback && percent != lastPercent) {
+                    lastPercent = percent;
+                    callback(percent, message);
+                }
+            }
+
+        private:
+            const ImageProgress& callback;
+            uint64_t total;
+            uint64_t done = 0;
+            int lastPercent = -1;
+        };
+
+        void AppendExtent(std::vector<ImageExtent>& extents, uint64_t offset, uint64_t length, ExtentKind kind) {
+            if (!extents.empty() && extents.back().kind == kind &&
+                extents.back().offset + extents.back().length == offset) {
+                extents.back().length += length;
+                return;
+            }
+            ImageExtent extent;
+            extent.offset = offset;
+            extent.length = length;
+            extent.kind = kind;
+            extents.push_back(extent);
+        }
+
+        bool SaveExtentMap(const fs::path& mapFile, const std::vector<ImageExtent>& extents) {
+            PhaseTimer timer(MetricPhase::Metadata);
+            std::ofstream out(mapFile, std::ios::binary | std::ios::trunc);
+            if (!out.is_open()) {
+                return false;
+            }
+
+            out.write(MapMagic, sizeof(MapMagic));
+            uint8_t record[MapRecordSize];
+            for (const auto& extent : extents) {
+                PutLe(record, extent.offset, 8);
+                PutLe(record + 8, extent.length, 8);
+                PutLe(record + 16, (uint64_t)extent.kind, 4);
+                PutLe(record + 20, 0, 4);
+                out.write(reinterpret_cast<const char*>(record), sizeof(record));
+            }
+            return out.good();
+        }
+
+        bool SaveBlockHashes(const fs::path& hashFile, uint32_t blockSize, const std::vector<uint64_t>& hashes) {
+            std::ofstream out(hashFile, std::ios::binary | std::ios::trunc);
+            if (!out.is_open()) {
+                return false;
+            }
+
+            uint8_t header[8];
+            PutLe(header, blockSize, 4);
+            PutLe(header + 4, 0, 4);
+            out.write(HashMagic, sizeof(HashMagic));
+            out.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+            uint8_t record[8];
+            for (uint64_t hash : hashes) {
+                PutLe(record, hash, 8);
+                out.write(reinterpret_cast<const char*>(record), sizeof(record));
+            }
+            return out.good();
+        }
+
+        bool SaveManifest(const DiskImageManifest& manifest) {
+            PhaseTimer timer(MetricPhase::Metadata);
+            std::ofstream out(manifest.LayoutPath(), std::ios::trunc);
+            if (!out.is_open()) {
+                return false;
+            }
+
+            const DiskLayout& layout = manifest.layout;
+            out << LayoutHeader << "\n";
+            out << "Scheme:" << SchemeName(layout.scheme) << "\n";
+            out << "SectorSize:" << layout.sectorSize << "\n";
+            out << "DiskSize:" << layout.diskSize << "\n";
+            out << "DiskId:" << layout.diskId << "\n";
+            out << "BlockSize:" << manifest.blockSize << "\n";
+            out << "Partitions:" << manifest.partitions.size() << "\n";
+            out << "---\n";
+
+            for (const auto& range : layout.reservedRanges) {
+                out << "reserved|" << range.offset << "|" << range.length << "\n";
+            }
+
+            // partition|index|offset|length|filesystem|type|uniqueId|bootable|strategy|storedBytes|name
+            for (const auto& image : manifest.partitions) {
+                const PartitionInfo& p = image.partition;
+                out << "partition|" << p.index << "|" << p.offset << "|" << p.length << "|"
+                    << FileSystemName(p.fileSystem) << "|" << p.typeId << "|" << p.uniqueId << "|"
+                    << (p.bootable ? 1 : 0) << "|" << image.strategy << "|" << image.storedBytes << "|"
+                    << Sanitize(p.name) << "\n";
+            }
+            return out.good();
+        }
+
+        // Read the source partition table; a disk without one becomes a single raw partition
+        bool ReadSourceLayout(BlockDevice& disk, DiskLayout& layout, std::string& error) {
+            if (!ReadDiskLayout(disk, layout, error)) {
+                return false;
+            }
+
+            if (layout.scheme == PartitionScheme::None) {
+                PartitionInfo whole;
+                whole.index = 1;
+                whole.offset = 0;
+                whole.length = disk.Size();
+                whole.fileSystem = DetectFileSystem(disk, 0, disk.Size());
+                layout.partitions.push_back(whole);
+            }
+            return true;
+        }
+
+        const PartitionImage* FindPartition(const DiskImageManifest& manifest, int partitionIndex) {
+            for (const auto& image : manifest.partitions) {
+                if (image.partition.index == partitionIndex) return &image;
+            }
+            return nullptr;
+        }
+
+        void AppendHashRecord(std::ofstream& out, uint64_t hash) {
+            uint8_t record[8];
+            PutLe(record, hash, 8);
+            out.write(reinterpret_cast<const char*>(record), sizeof(record));
+        }
+
+        // An imaging checkpoint is usable if the stream and hash list still cover it
+        // and the last block it recorded reads back with the journaled hash
+        bool VerifyImageCheckpoint(BlockDevice& stream, const std::vector<uint64_t>& hashes,
+            const Checkpoint& checkpoint, std::vector<uint8_t>& buffer) {
+
+            if (stream.Size() < checkpoint.streamOffset || hashes.size() < checkpoint.blockCount) {
+                return false;
+            }
+            if (checkpoint.verifyLength == 0) {
+                return true;
+            }
+            return checkpoint.blockCount > 0 && checkpoint.verifyLength <= buffer.size() &&
+                hashes[(size_t)checkpoint.blockCount - 1] == checkpoint.verifyHash &&
+                stream.ReadAt(checkpoint.verifyOffset, buffer.data(), (size_t)checkpoint.verifyLength) &&
+                Hash64(buffer.data(), (size_t)checkpoint.verifyLength) == checkpoint.verifyHash;
+        }
+
+        int ImagePartition(
+            BlockDevice& disk,
+            const DiskImageManifest& manifest,
+            PartitionImage& image,
+            const DiskImageOptions& options,
+            std::vector<uint8_t>& buffer,
+            ProgressTracker& tracker,
+            CheckpointJournal* journal,
+            std::string& error) {
+
+            const PartitionInfo& part = image.partition;
+            TraceSpan span("partition", "image partition", std::to_string(part.index));
+            std::unique_ptr<AllocationMap> allocation = options.useAllocationMaps
+                ? AllocationMap::ForPartition(disk, part)
+                : nullptr;
+            image.strategy = allocation ? allocation->StrategyName() : "zero-skip";
+
+            std::vector<ImageExtent> extents;
+            std::unique_ptr<BlockDevice> stream;
+            const Checkpoint* resumeFrom = nullptr;
+
+            // Continue from the newest checkpoint whose data is verifiably in the stream
+            if (journal && !journal->Checkpoints(part.index).empty()) {
+                const std::vector<Checkpoint>& saved = journal->Checkpoints(part.index);
+                std::vector<uint64_t> hashes;
+                std::string ignored;
+                stream = BlockDevice::Open(manifest.StreamPath(part.index), true, ignored);
+                LoadBlockHashes(manifest.HashPath(part.index), options.blockSize, hashes);
+
+                for (size_t i = saved.size(); stream && i-- > 0; ) {
+                    if (VerifyImageCheckpoint(*stream, hashes, saved[i], buffer)) {
+                        resumeFrom = &saved[i];
+                        for (size_t j = 0; j <= i; j++) {
+                            for (const auto& extent : saved[j].extents) {
+                                AppendExtent(extents, extent.offset, extent.length, extent.kind);
+                            }
+                        }
+                        hashes.resize((size_t)resumeFrom->blockCount);
+                        break;
+                    }
+                }
+
+                if (resumeFrom && (!stream->Truncate(resumeFrom->streamOffset) ||
+                    !SaveBlockHashes(manifest.HashPath(part.index), options.blockSize, hashes) ||
+                    !journal->AppendResume(part.index, resumeFrom->offset))) {
+                    resumeFrom = nullptr;
+                    extents.clear();
+                }
+            }
+
+            if (!resumeFrom) {
+                stream = BlockDevice::Create(manifest.StreamPath(part.index), error);
+                if (!stream) {
+                    return -4;
+                }
+                if (!SaveBlockHashes(manifest.HashPath(part.index), options.blockSize, std::vector<uint64_t>())) {
+                    error = "Failed to create " + manifest.HashPath(part.index).string();
+                    return -6;
+                }
+                if (journal) {
+                    journal->AppendResume(part.index, 0);
+                }
+            }
+            stream->SetThrottle(options.throttle);
+
+            std::ofstream hashOut(manifest.HashPath(part.index), std::ios::binary | std::ios::app);
+            if (!hashOut.is_open()) {
+                error = "Failed to open " + manifest.HashPath(part.index).string();
+                return -6;
+            }
+
+            std::string message = "Imaging partition " + std::to_string(part.index) +
+                " (" + FileSystemName(part.fileSystem) + ")...";
+
+            Checkpoint next;
+            uint64_t start = 0;
+            if (resumeFrom) {
+                next = *resumeFrom;
+                next.extents.clear();
+                start = resumeFrom->offset;
+                tracker.Advance(start, "Resuming partition " + std::to_string(part.index) + "...");
+            }
+            uint64_t streamOffset = next.streamOffset;
+            uint64_t blockCount = next.blockCount;
+            uint64_t lastCheckpoint = start;
+
+            for (uint64_t offset = start; offset < part.length; offset += options.blockSize) {
+                size_t length = (size_t)std::min<uint64_t>(options.blockSize, part.length - offset);
+                ExtentKind kind = ExtentKind::Data;
+
+                if (allocation && !allocation->IsAllocated(offset, length)) {
+                    kind = ExtentKind::Unallocated;
+                }
+                else {
+                    if (!disk.ReadAt(part.offset + offset, buffer.data(), length)) {
+                        error = "Failed to read disk at offset " + std::to_string(part.offset + offset);
+                        return -5;
+                    }
+
+                    if (options.skipZeroBlocks && IsZeroBlock(buffer.data(), length)) {
+                        kind = ExtentKind::Zero;
+                    }
+                    else {
+                        if (!stream->WriteAt(streamOffset, buffer.data(), length)) {
+                            error = "Failed to write image stream " + manifest.StreamPath(part.index).string();
+                            return -6;
+                        }
+                        next.verifyOffset = streamOffset;
+                        next.verifyLength = length;
+                        {
+                            PhaseTimer timer(MetricPhase::Hash, length);
+                            next.verifyHash = Hash64(buffer.data(), length);
+                        }
+                        AppendHashRecord(hashOut, next.verifyHash);
+                        streamOffset += length;
+                        blockCount++;
+                    }
+                }
+
+                AppendExtent(extents, offset, length, kind);
+                AppendExtent(next.extents, offset, length, kind);
+                tracker.Advance(length, message);
+
+                // Data first, then the journal record that vouches for it
+                if (journal && options.checkpointInterval > 0 &&
+                    offset + length - lastCheckpoint >= options.checkpointInterval && offset + length < part.length) {
+                    hashOut.flush();
+                    if (!stream->Flush() || !hashOut.good()) {
+                        error = "Failed to flush image stream for partition " + std::to_string(part.index);
+                        return -6;
+                    }
+                    next.offset = offset + length;
+                    next.streamOffset = streamOffset;
+                    next.blockCount = blockCount;
+                    journal->AppendCheckpoint(part.index, next);
+                    next.extents.clear();
+                    lastCheckpoint = next.offset;
+                }
+            }
+
+            image.storedBytes = streamOffset;
+            hashOut.close();
+
+            if (!stream->Flush() || hashOut.fail() || !SaveExtentMap(manifest.MapPath(part.index), extents)) {
+                error = "Failed to finalize image stream for partition " + std::to_string(part.index);
+                return -6;
+            }
+
+            if (journal) {
+                CompletedPartition completed;
+                completed.storedBytes = image.storedBytes;
+                completed.strategy = image.strategy;
+                journal->AppendCompleted(part.index, completed);
+            }
+            return 0;
+        }
+
+        struct RestoreCounters {
+            uint64_t written = 0;
+            uint64_t unchanged = 0;
+            uint64_t discarded = 0;
+
+            std::string Summary() const {
+                return std::to_string(written / (1024 * 1024)) + " MB written, " +
+                    std::to_string(unchanged / (1024 * 1024)) + " MB unchanged, " +
+                    std::to_string(discarded / (1024 * 1024)) + " MB discarded";
+            }
+        };
+
+        // Write one block, optionally reading it back to confirm the device stored it
+        int WriteBlock(BlockDevice& target, uint64_t offset, const uint8_t* data, size_t length,
+            const DiskRestoreOptions& options, std::vector<uint8_t>& scratch,
+            RestoreCounters& counters, std::string& error) {
+
+            if (!target.WriteAt(offset, data, length)) {
+                error = "Failed to write to target at offset " + std::to_string(offset);
+                return -7;
+            }
+
+            if (options.verifyWrites &&
+                (!target.ReadAt(offset, scratch.data(), length) || std::memcmp(scratch.data(), data, length) != 0)) {
+                error = "Verification failed at target offset " + std::to_string(offset);
+                return -9;
+            }
+
+            counters.written += length;
+            return 0;
+        }
+
+        // Zero range: skip if already zero, else discard (verified on disks), else write zeros
+        int RestoreZeroBlock(BlockDevice& target, uint64_t offset, size_t length,
+            const DiskRestoreOptions& options, std::vector<uint8_t>& scratch,
+            const std::vector<uint8_t>& zeros, RestoreCounters& counters, std::string& error) {
+
+            if (options.compareBeforeWrite &&
+                target.ReadAt(offset, scratch.data(), length) && IsZeroBlock(scratch.data(), length)) {
+                counters.unchanged += length;
+                return 0;
+            }
+
+            if (options.discardZeroRanges && target.Discard(offset, length) &&
+                (!target.IsDisk() ||
+                    (target.ReadAt(offset, scratch.data(), length) && IsZeroBlock(scratch.data(), length)))) {
+                counters.discarded += length;
+                return 0;
+            }
+
+            return WriteBlock(target, offset, zeros.data(), length, options, scratch, counters, error);
+        }
+
+        // The journal sits next to the image; a read-only image medium simply restores without one
+        std::unique_ptr<CheckpointJournal> OpenRestoreJournal(const DiskImageManifest& manifest,
+            const BlockDevice& target, const DiskRestoreOptions& options, const std::string& scope) {
+
+            if (options.checkpointInterval == 0) {
+                return nullptr;
+            }
+
+            std::string identity = "restore|" + scope + "|" + manifest.layout.diskId + "|" +
+                std::to_string(manifest.blockSize) + "|" + target.Path().string() + "|" +
+                std::to_string(target.Size());
+
+            std::unique_ptr<CheckpointJournal> journal(new CheckpointJournal());
+            std::string ignored;
+            if (!journal->Open(manifest.directory / (manifest.baseName + ".restore.journal"), identity, ignored)) {
+                return nullptr;
+            }
+            return journal;
+        }
+
+        int RestorePartitionStream(
+            const DiskImageManifest& manifest,
+            int partitionIndex,
+            BlockDevice& target,
+            uint64_t targetOffset,
+            const DiskRestoreOptions& options,
+            const ImageProgress& progress,
+            RestoreCounters& counters,
+            CheckpointJournal* journal,
+            std::string& error) {
+
+            TraceSpan span("partition", "restore partition", std::to_string(partitionIndex));
+            const PartitionImage* image = FindPartition(manifest, partitionIndex);
+            if (!image) {
+                error = "Partition " + std::to_string(partitionIndex) + " is not in the image";
+                return -2;
+            }
+
+            const PartitionInfo& part = image->partition;
+            if (target.IsDisk() && target.Size() < targetOffset + part.length) {
+                error = "Target is too small for partition " + std::to_string(partitionIndex);
+                return -2;
+            }
+
+            std::vector<ImageExtent> extents;
+            if (!LoadExtentMap(manifest.MapPath(partitionIndex), extents, error)) {
+                return -3;
+            }
+
+            // Without stored hashes, compare mode falls back to comparing the bytes directly
+            std::vector<uint64_t> hashes;
+            if (options.compareBeforeWrite) {
+                LoadBlockHashes(manifest.HashPath(partitionIndex), manifest.blockSize, hashes);
+            }
+
+            std::unique_ptr<BlockDevice> stream = BlockDevice::Open(manifest.StreamPath(partitionIndex), false, error);
+            if (!stream) {
+                return -4;
+            }
+            stream->SetThrottle(options.throttle);
+
+            std::vector<uint8_t> buffer(manifest.blockSize);
+            std::vector<uint8_t> scratch(manifest.blockSize);
+            std::vector<uint8_t> zeros(manifest.blockSize, 0);
+            ProgressTracker tracker(progress, part.length);
+            std::string message = "Restoring partition " + std::to_string(partitionIndex) +
+                " (" + FileSystemName(part.fileSystem) + ")...";
+            // Continue after the newest checkpoint whose last written block is still on the target
+            Checkpoint next;
+            if (journal) {
+                const std::vector<Checkpoint>& saved = journal->Checkpoints(partitionIndex);
+                for (size_t i = saved.size(); i-- > 0; ) {
+                    const Checkpoint& checkpoint = saved[i];
+                    if (checkpoint.verifyLength == 0 ||
+                        (checkpoint.verifyLength <= scratch.size() &&
+                            target.ReadAt(checkpoint.verifyOffset, scratch.data(), (size_t)checkpoint.verifyLength) &&
+                            Hash64(scratch.data(), (size_t)checkpoint.verifyLength) == checkpoint.verifyHash)) {
+                        next = checkpoint;
+                        break;
+                    }
+                }
+                journal->AppendResume(partitionIndex, next.offset);
+                if (next.offset > 0) {
+                    tracker.Advance(next.offset, "Resuming partition " + std::to_string(partitionIndex) + "...");
+                }
+            }
+
+            uint64_t resumeOffset = next.offset;
+            uint64_t lastCheckpoint = next.offset;
+            uint64_t streamOffset = next.streamOffset;
+
+            for (const auto& extent : extents) {
+                if (extent.offset + extent.length > part.length) {
+                    error = "Extent map of partition " + std::to_string(partitionIndex) + " is out of range";
+                    return -3;
+                }
+
+                if (extent.offset + extent.length <= resumeOffset) {
+                    continue;
+                }
+
+                uint64_t first = resumeOffset > extent.offset ? resumeOffset - extent.offset : 0;
+                if (extent.kind == ExtentKind::Unallocated) {
+                    tracker.Advance(extent.length - first, message);
+                    continue;
+                }
+
+                for (uint64_t done = first; done < extent.length; ) {
+                    size_t length = (size_t)std::min<uint64_t>(buffer.size(), extent.length - done);
+                    uint64_t offset = targetOffset + extent.offset + done;
+
+                    if (extent.kind == ExtentKind::Zero) {
+                        int result = RestoreZeroBlock(target, offset, length, options, scratch, zeros, counters, error);
+                        if (result != 0) {
+                            return result;
+                        }
+                    }
+                    else {
+                        // Stored blocks are block-aligned, so the stream offset indexes the hash list
+                        size_t blockIndex = (size_t)(streamOffset / manifest.blockSize);
+                        bool haveTarget = options.compareBeforeWrite && target.ReadAt(offset, scratch.data(), length);
+
+                        if (haveTarget && blockIndex < hashes.size() &&
+                            Hash64(scratch.data(), length) == hashes[blockIndex]) {
+                            counters.unchanged += length;
+                            next.verifyHash = hashes[blockIndex];
+                        }
+                        else {
+                            if (!stream->ReadAt(streamOffset, buffer.data(), length)) {
+                                error = "Failed to read image stream for partition " + std::to_string(partitionIndex);
+                                return -6;
+                            }
+
+                            if (haveTarget && hashes.empty() && std::memcmp(scratch.data(), buffer.data(), length) == 0) {
+                                counters.unchanged += length;
+                            }
+                            else {
+                                int result = WriteBlock(target, offset, buffer.data(), length, options, scratch, counters, error);
+                                if (result != 0) {
+                                    return result;
+                                }
+                            }
+                            next.verifyHash = journal ? Hash64(buffer.data(), length) : 0;
+                        }
+                        next.verifyOffset = offset;
+                        next.verifyLength = length;
+                        streamOffset += length;
+                    }
+
+                    done += length;
+                    tracker.Advance(length, message);
+
+                    // Flush the target before the journal claims the range is complete
+                    uint64_t completedTo = extent.offset + done;
+                    if (journal && options.checkpointInterval > 0 &&
+                        completedTo - lastCheckpoint >= options.checkpointInterval) {
+                        if (!target.Flush()) {
+                            error = "Failed to flush target";
+                            return -8;
+                        }
+                        next.offset = completedTo;
+                        next.streamOffset = streamOffset;
+                        journal->AppendCheckpoint(partitionIndex, next);
+                        lastCheckpoint = completedTo;
+                    }
+                }
+            }
+
+            if (!target.Flush()) {
+                error = "Failed to flush target";
+                return -8;
+            }
+
+            if (journal) {
+                journal->AppendCompleted(partitionIndex, CompletedPartition());
+            }
+            return 0;
+        }
+
+        struct CloneBlock {
+            uint64_t offset = 0;        // Absolute disk offset
+            size_t length = 0;
+            ExtentKind kind = ExtentKind::Data;
+            int partitionIndex = 0;     // 0 for partition table structures
+            std::vector<uint8_t> data;
+        };
+
+        // Bounded hand-off between the source reader and the target writer;
+        // block buffers cycle back to the reader instead of being reallocated
+        class CloneQueue {
+        public:
+            explicit CloneQueue(size_t depth) : depth(depth) {}
+
+            bool Push(CloneBlock&& block) {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [this] { return aborted || blocks.size() < depth; });
+                if (aborted) return false;
+                blocks.push_back(std::move(block));
+                changed.notify_all();
+                return true;
+            }
+
+            bool Pop(CloneBlock& block) {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [this] { return closed || !blocks.empty(); });
+                if (blocks.empty()) return false;
+                block = std::move(blocks.front());
+                blocks.pop_front();
+                changed.notify_all();
+                return true;
+            }
+
+            std::vector<uint8_t> TakeBuffer(size_t size) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (spare.empty()) {
+                    return std::vector<uint8_t>(size);
+                }
+                std::vector<uint8_t> buffer = std::move(spare.back());
+                spare.pop_back();
+                buffer.resize(size);
+                return buffer;
+            }
+
+            void Recycle(std::vector<uint8_t>&& buffer) {
+                if (buffer.empty()) return;
+                std::lock_guard<std::mutex> lock(mutex);
+                spare.push_back(std::move(buffer));
+            }
+
+            // Reader finished (successfully or not)
+            void Close() {
+                std::lock_guard<std::mutex> lock(mutex);
+                closed = true;
+                changed.notify_all();
+            }
+
+            // Writer failed; unblock and stop the reader
+            void Abort() {
+                std::lock_guard<std::mutex> lock(mutex);
+                aborted = true;
+                changed.notify_all();
+            }
+
+        private:
+            std::mutex mutex;
+            std::condition_variable changed;
+            std::deque<CloneBlock> blocks;
+            std::vector<std::vector<uint8_t>> spare;
+            size_t depth;
+            bool closed = false;
+            bool aborted = false;
+        };
+
+        // Source side of a clone: classify every block and queue it for the writer
+        int ReadCloneSource(BlockDevice& source, const DiskLayout& layout,
+            const DiskImageOptions& options, CloneQueue& queue, std::string& error) {
+
+            for (const auto& range : layout.reservedRanges) {
+                for (uint64_t done = 0; done < range.length; done += options.blockSize) {
+                    CloneBlock block;
+                    block.offset = range.offset + done;
+                    block.length = (size_t)std::min<uint64_t>(options.blockSize, range.length - done);
+                    block.data = queue.TakeBuffer(block.length);
+                    if (!source.ReadAt(block.offset, block.data.data(), block.length)) {
+                        error = "Failed to read partition table area";
+                        return -5;
+                    }
+                    if (!queue.Push(std::move(block))) return 0;
+                }
+            }
+
+            for (const auto& part : layout.partitions) {
+                std::unique_ptr<AllocationMap> allocation = options.useAllocationMaps
+                    ? AllocationMap::ForPartition(source, part)
+                    : nullptr;
+
+                for (uint64_t offset = 0; offset < part.length; offset += options.blockSize) {
+                    CloneBlock block;
+                    block.offset = part.offset + offset;
+                    block.length = (size_t)std::min<uint64_t>(options.blockSize, part.length - offset);
+                    block.partitionIndex = part.index;
+
+                    if (allocation && !allocation->IsAllocated(offset, block.length)) {
+                        block.kind = ExtentKind::Unallocated;
+                    }
+                    else {
+                        block.data = queue.TakeBuffer(block.length);
+                        if (!source.ReadAt(block.offset, block.data.data(), block.length)) {
+                            error = "Failed to read source disk at offset " + std::to_string(block.offset);
+                            return -5;
+                        }
+                        if (options.skipZeroBlocks && IsZeroBlock(block.data.data(), block.length)) {
+                            block.kind = ExtentKind::Zero;
+                            queue.Recycle(std::move(block.data));
+                            block.data.clear();
+                        }
+                    }
+
+                    if (!queue.Push(std::move(block))) return 0;
+                }
+            }
+            return 0;
+        }
+    }
+
+    fs::path DiskImageManifest::LayoutPath() const {
+        return directory / (baseName + ".layout");
+    }
+
+    fs::path DiskImageManifest::TablePath() const {
+        return directory / (baseName + "_table.img");
+    }
+
+    fs::path DiskImageManifest::StreamPath(int partitionIndex) const {
+        return directory / (baseName + "_p" + std::to_string(partitionIndex) + ".img");
+    }
+
+    fs::path DiskImageManifest::MapPath(int partitionIndex) const {
+        return directory / (baseName + "_p" + std::to_string(partitionIndex) + ".map");
+    }
+
+    fs::path DiskImageManifest::HashPath(int partitionIndex) const {
+        return directory / (baseName + "_p" + std::to_string(partitionIndex) + ".hash");
+    }
+
+    bool IsZeroBlock(const void* data, size_t length) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+            uint64_t word;
+            std::memcpy(&word, p + i, sizeof(word));
+            if (word != 0) return false;
+        }
+        for (; i < length; i++) {
+            if (p[i] != 0) return false;
+        }
+        return true;
+    }
+
+    int ImageDisk(
+        BlockDevice& disk,
+        const fs::path& destDir,
+        const std::string& baseName,
+        const DiskImageOptions& options,
+        const ImageProgress& progress,
+        std::string& error) {
+
+        TraceSpan jobSpan("job", "ImageDisk", disk.Path().u8string());
+        DeviceThrottle throttle(disk, options.throttle);
+        if (options.blockSize == 0 || options.blockSize % 512 != 0) {
+            error = "Block size must be a non-zero multiple of 512";
+            return -1;
+        }
+
+        DiskImageManifest manifest;
+        manifest.directory = destDir;
+        manifest.baseName = baseName;
+        manifest.blockSize = options.blockSize;
+
+        if (progress) {
+            progress(0, "Reading partition table...");
+        }
+
+        if (!ReadSourceLayout(disk, manifest.layout, error)) {
+            return -3;
+        }
+
+        uint64_t totalBytes = 0;
+        for (const auto& range : manifest.layout.reservedRanges) totalBytes += range.length;
+        for (const auto& part : manifest.layout.partitions) totalBytes += part.length;
+        ProgressTracker tracker(progress, totalBytes);
+
+        std::error_code ec;
+        fs::create_directories(destDir, ec);
+
+        // The journal only resumes a run over the same disk layout with the same settings
+        std::unique_ptr<CheckpointJournal> journal;
+        if (options.checkpointInterval > 0) {
+            std::string identity = "image|" + manifest.layout.diskId + "|" +
+                std::to_string(manifest.layout.diskSize) + "|" + std::to_string(options.blockSize) + "|" +
+                (options.skipZeroBlocks ? "1" : "0") + (options.useAllocationMaps ? "1" : "0");
+            for (const auto& part : manifest.layout.partitions) {
+                identity += "|" + std::to_string(part.index) + ":" + std::to_string(part.offset) +
+                    ":" + std::to_string(part.length);
+            }
+
+            journal.reset(new CheckpointJournal());
+            if (!journal->Open(destDir / (baseName + ".journal"), identity, error)) {
+                return -4;
+            }
+        }
+
+        std::vector<uint8_t> buffer(options.blockSize);
+
+        // Partition table structures and boot code are stored verbatim
+        std::unique_ptr<BlockDevice> table = BlockDevice::Create(manifest.TablePath(), error);
+        if (!table) {
+            return -4;
+        }
+
+        uint64_t tableOffset = 0;
+        for (const auto& range : manifest.layout.reservedRanges) {
+            for (uint64_t done = 0; done < range.length; ) {
+                size_t length = (size_t)std::min<uint64_t>(buffer.size(), range.length - done);
+                if (!disk.ReadAt(range.offset + done, buffer.data(), length)) {
+                    error = "Failed to read partition table area";
+                    return -5;
+                }
+                if (!table->WriteAt(tableOffset, buffer.data(), length)) {
+                    error = "Failed to write partition table image";
+                    return -6;
+                }
+                done += length;
+                tableOffset += length;
+                tracker.Advance(length, "Saving partition table...");
+            }
+        }
+        table->Flush();
+
+        for (const auto& part : manifest.layout.partitions) {
+            PartitionImage image;
+            image.partition = part;
+
+            const CompletedPartition* completed = journal ? journal->Completed(part.index) : nullptr;
+            if (completed && fs::exists(manifest.StreamPath(part.index), ec) &&
+                fs::exists(manifest.MapPath(part.index), ec) && fs::exists(manifest.HashPath(part.index), ec)) {
+                image.strategy = completed->strategy;
+                image.storedBytes = completed->storedBytes;
+                tracker.Advance(part.length, "Partition " + std::to_string(part.index) + " already imaged");
+            }
+            else {
+                int result = ImagePartition(disk, manifest, image, options, buffer, tracker, journal.get(), error);
+                if (result != 0) {
+                    return result;
+                }
+            }
+            manifest.partitions.push_back(image);
+        }
+
+        if (!SaveManifest(manifest)) {
+            error = "Failed to write image manifest " + manifest.LayoutPath().string();
+            return -7;
+        }
+
+        if (journal) {
+            journal->Remove();
+        }
+
+        if (progress) {
+            progress(100, "Disk image completed");
+        }
+        return 0;
+    }
+
+    bool LoadDiskImageManifest(const fs::path& layoutFile, DiskImageManifest& manifest, std::string& error) {
+        manifest = DiskImageManifest();
+        manifest.directory = layoutFile.parent_path();
+        manifest.baseName = layoutFile.stem().string();
+
+        std::ifstream in(layoutFile);
+        if (!in.is_open()) {
+            error = "Cannot open image manifest " + layoutFile.string();
+            return false;
+        }
+
+        std::string line;
+        if (!std::getline(in, line) || line != LayoutHeader) {
+            error = "Not a disk image manifest: " + layoutFile.string();
+            return false;
+        }
+
+        try {
+            bool inBody = false;
+            while (std::getline(in, line)) {
+                if (line.empty()) continue;
+
+                if (!inBody) {
+                    if (line == "---") {
+                        inBody = true;
+                        continue;
+                    }
+                    size_t colon = line.find(':');
+                    if (colon == std::string::npos) continue;
+                    std::string key = line.substr(0, colon);
+                    std::string value = line.substr(colon + 1);
+
+                    if (key == "Scheme") manifest.layout.scheme = ParseSchemeName(value);
+                    else if (key == "SectorSize") manifest.layout.sectorSize = (uint32_t)std::stoul(value);
+                    else if (key == "DiskSize") manifest.layout.diskSize = std::stoull(value);
+                    else if (key == "DiskId") manifest.layout.diskId = value;
+                    else if (key == "BlockSize") manifest.blockSize = (uint32_t)std::stoul(value);
+                    continue;
+                }
+
+                std::vector<std::string> fields = Split(line, '|');
+                if (fields.size() >= 3 && fields[0] == "reserved") {
+                    manifest.layout.reservedRanges.push_back({ std::stoull(fields[1]), std::stoull(fields[2]) });
+                }
+                else if (fields.size() >= 10 && fields[0] == "partition") {
+                    PartitionImage image;
+                    image.partition.index = std::stoi(fields[1]);
+                    image.partition.offset = std::stoull(fields[2]);
+                    image.partition.length = std::stoull(fields[3]);
+                    image.partition.fileSystem = ParseFileSystemName(fields[4]);
+                    image.partition.typeId = fields[5];
+                    image.partition.uniqueId = fields[6];
+                    image.partition.bootable = fields[7] == "1";
+                    image.strategy = fields[8];
+                    image.storedBytes = std::stoull(fields[9]);
+                    image.partition.name = fields.size() > 10 ? fields[10] : "";
+                    manifest.partitions.push_back(image);
+                    manifest.layout.partitions.push_back(image.partition);
+                }
+            }
+        }
+        catch (const std::exception&) {
+            error = "Corrupt image manifest " + layoutFile.string();
+            return false;
+        }
+
+        if (manifest.blockSize == 0 || manifest.layout.diskSize == 0) {
+            error = "Incomplete image manifest " + layoutFile.string();
+            return false;
+        }
+        return true;
+    }
+
+    bool LoadExtentMap(const fs::path& mapFile, std::vector<ImageExtent>& extents, std::string& error) {
+        extents.clear();
+
+        std::ifstream in(mapFile, std::ios::binary);
+        char magic[sizeof(MapMagic)];
+        if (!in.is_open() || !in.read(magic, sizeof(magic)) || std::memcmp(magic, MapMagic, sizeof(MapMagic)) != 0) {
+            error = "Invalid extent map " + mapFile.string();
+            return false;
+        }
+
+        uint8_t record[MapRecordSize];
+        while (in.read(reinterpret_cast<char*>(record), sizeof(record))) {
+            ImageExtent extent;
+            extent.offset = GetLe(record, 8);
+            extent.length = GetLe(record + 8, 8);
+            extent.kind = (ExtentKind)GetLe(record + 16, 4);
+            extents.push_back(extent);
+        }
+
+        if (in.gcount() != 0) {
+            error = "Truncated extent map " + mapFile.string();
+            return false;
+        }
+        return true;
+    }
+
+    bool LoadBlockHashes(const fs::path& hashFile, uint32_t blockSize, std::vector<uint64_t>& hashes) {
+        hashes.clear();
+
+        std::ifstream in(hashFile, std::ios::binary);
+        char magic[sizeof(HashMagic)];
+        uint8_t header[8];
+        if (!in.is_open() || !in.read(magic, sizeof(magic)) ||
+            std::memcmp(magic, HashMagic, sizeof(HashMagic)) != 0 ||
+            !in.read(reinterpret_cast<char*>(header), sizeof(header)) ||
+            GetLe(header, 4) != blockSize) {
+            return false;
+        }
+
+        uint8_t record[8];
+        while (in.read(reinterpret_cast<char*>(record), sizeof(record))) {
+            hashes.push_back(GetLe(record, 8));
+        }
+        return in.gcount() == 0;
+    }
+
+    fs::path FindDiskImageLayout(const fs::path& backupDir, const std::string& preferredBaseName) {
+        std::error_code ec;
+        if (!preferredBaseName.empty()) {
+            fs::path preferred = backupDir / (preferredBaseName + ".layout");
+            if (fs::exists(preferred, ec)) {
+                return preferred;
+            }
+        }
+
+        for (const auto& entry : fs::directory_iterator(backupDir, ec)) {
+            if (entry.path().extension() == ".layout") {
+                return entry.path();
+            }
+        }
+        return fs::path();
+    }
+
+    int RestoreDiskImage(
+        const DiskImageManifest& manifest,
+        BlockDevice& target,
+        const DiskRestoreOptions& options,
+        const ImageProgress& progress,
+        std::string& error) {
+
+        TraceSpan jobSpan("job", "RestoreDiskImage", target.Path().u8string());
+        DeviceThrottle throttle(target, options.throttle);
+        if (target.IsDisk() && target.Size() < manifest.layout.diskSize) {
+            error = "Target disk is smaller than the source disk (" +
+                std::to_string(target.Size()) + " < " + std::to_string(manifest.layout.diskSize) + " bytes)";
+            return -2;
+        }
+
+        if (progress) {
+            progress(0, "Restoring partition table...");
+        }
+
+        std::unique_ptr<BlockDevice> table = BlockDevice::Open(manifest.TablePath(), false, error);
+        if (!table) {
+            return -4;
+        }
+
+        std::vector<uint8_t> buffer(manifest.blockSize);
+        uint64_t tableOffset = 0;
+        for (const auto& range : manifest.layout.reservedRanges) {
+            for (uint64_t done = 0; done < range.length; ) {
+                size_t length = (size_t)std::min<uint64_t>(buffer.size(), range.length - done);
+                if (!table->ReadAt(tableOffset, buffer.data(), length)) {
+                    error = "Failed to read partition table image";
+                    return -6;
+                }
+                if (!target.WriteAt(range.offset + done, buffer.data(), length)) {
+                    error = "Failed to write partition table to target";
+                    return -7;
+                }
+                done += length;
+                tableOffset += length;
+            }
+        }
+
+        std::unique_ptr<CheckpointJournal> journal = OpenRestoreJournal(manifest, target, options, "disk");
+
+        RestoreCounters counters;
+        size_t count = manifest.partitions.size();
+        for (size_t i = 0; i < count; i++) {
+            const PartitionInfo& part = manifest.partitions[i].partition;
+            int base = (int)((i * 100) / count);
+            int span = (int)(((i + 1) * 100) / count) - base;
+
+            if (journal && journal->Completed(part.index)) {
+                if (progress) progress(base + span, "Partition " + std::to_string(part.index) + " already restored");
+                continue;
+            }
+
+            ImageProgress scaled = [&](int percentage, const std::string& message) {
+                if (progress) progress(base + (percentage * span) / 100, message);
+            };
+
+            int result = RestorePartitionStream(manifest, part.index, target, part.offset,
+                options, scaled, counters, journal.get(), error);
+            if (result != 0) {
+                return result;
+            }
+        }
+
+        if (!target.Flush()) {
+            error = "Failed to flush target disk";
+            return -8;
+        }
+
+        if (journal) {
+            journal->Remove();
+        }
+
+        if (progress) {
+            progress(100, "Disk restore completed: " + counters.Summary());
+        }
+        return 0;
+    }
+
+    int RestorePartitionImage(
+        const DiskImageManifest& manifest,
+        int partitionIndex,
+        BlockDevice& target,
+        uint64_t targetOffset,
+        const DiskRestoreOptions& options,
+        const ImageProgress& progress,
+        std::string& error) {
+
+        TraceSpan jobSpan("job", "RestorePartitionImage", target.Path().u8string());
+        DeviceThrottle throttle(target, options.throttle);
+        std::unique_ptr<CheckpointJournal> journal = OpenRestoreJournal(manifest, target, options,
+            "partition:" + std::to_string(partitionIndex) + ":" + std::to_string(targetOffset));
+
+        RestoreCounters counters;
+        int result = RestorePartitionStream(manifest, partitionIndex, target, targetOffset,
+            options, progress, counters, journal.get(), error);
+
+        if (result == 0) {
+            if (journal) {
+                journal->Remove();
+            }
+            if (progress) {
+                progress(100, "Partition " + std::to_string(partitionIndex) + " restored: " + counters.Summary());
+            }
+        }
+        return result;
+    }
+
+    int CloneDisk(
+        BlockDevice& source,
+        BlockDevice& target,
+        const DiskImageOptions& imageOptions,
+        const DiskRestoreOptions& restoreOptions,
+        const ImageProgress& progress,
+        std::string& error) {
+
+        TraceSpan jobSpan("job", "CloneDisk", source.Path().u8string() + " -> " + target.Path().u8string());
+        DeviceThrottle sourceThrottle(source, imageOptions.throttle);
+        DeviceThrottle targetThrottle(target, restoreOptions.throttle);
+        if (imageOptions.blockSize == 0 || imageOptions.blockSize % 512 != 0) {
+            error = "Block size must be a non-zero multiple of 512";
+            return -1;
+        }
+
+        if (progress) {
+            progress(0, "Reading source partition table...");
+        }
+
+        DiskLayout layout;
+        if (!ReadSourceLayout(source, layout, error)) {
+            return -3;
+        }
+
+        if (target.IsDisk() && target.Size() < layout.diskSize) {
+            error = "Target disk is smaller than the source disk (" +
+                std::to_string(target.Size()) + " < " + std::to_string(layout.diskSize) + " bytes)";
+            return -2;
+        }
+
+        uint64_t totalBytes = 0;
+        for (const auto& range : layout.reservedRanges) totalBytes += range.length;
+        for (const auto& part : layout.partitions) totalBytes += part.length;
+        ProgressTracker tracker(progress, totalBytes);
+
+        CloneQueue queue(8);
+        std::string readError;
+        int readResult = 0;
+        std::thread reader([&] {
+            TraceThreadName("clone reader");
+            TraceSpan readerSpan("thread", "clone reader");
+            readResult = ReadCloneSource(source, layout, imageOptions, queue, readError);
+            queue.Close();
+        });
+
+        std::vector<uint8_t> scratch(imageOptions.blockSize);
+        std::vector<uint8_t> zeros(imageOptions.blockSize, 0);
+        RestoreCounters counters;
+        int writeResult = 0;
+        int currentPartition = -1;
+        std::string message;
+
+        // Time spent waiting on the reader shows up as "queue wait" spans
+        CloneBlock block;
+        uint64_t waitStart = TraceEnabled() ? TraceClock() : 0;
+        while (queue.Pop(block)) {
+            if (waitStart) {
+                TraceComplete("stage", "queue wait", waitStart, TraceClock());
+            }
+
+            if (block.partitionIndex != currentPartition) {
+                currentPartition = block.partitionIndex;
+                message = currentPartition == 0
+                    ? std::string("Cloning partition table...")
+                    : "Cloning partition " + std::to_string(currentPartition) + "...";
+            }
+
+            if (block.kind == ExtentKind::Unallocated) {
+                // Free space needs no copy; on SSD targets it may as well be released
+                if (restoreOptions.discardZeroRanges && target.Discard(block.offset, block.length)) {
+                    counters.discarded += block.length;
+                }
+            }
+            else if (block.kind == ExtentKind::Zero) {
+                writeResult = RestoreZeroBlock(target, block.offset, block.length,
+                    restoreOptions, scratch, zeros, counters, error);
+            }
+            else if (restoreOptions.compareBeforeWrite &&
+                target.ReadAt(block.offset, scratch.data(), block.length) &&
+                std::memcmp(scratch.data(), block.data.data(), block.length) == 0) {
+                counters.unchanged += block.length;
+            }
+            else {
+                writeResult = WriteBlock(target, block.offset, block.data.data(), block.length,
+                    restoreOptions, scratch, counters, error);
+            }
+
+            if (writeResult != 0) {
+                queue.Abort();
+                break;
+            }
+
+            tracker.Advance(block.length, message);
+            queue.Recycle(std::move(block.data));
+            waitStart = TraceEnabled() ? TraceClock() : 0;
+        }
+
+        reader.join();
+
+        if (writeResult != 0) {
+            return writeResult;
+        }
+        if (readResult != 0) {
+            error = readError;
+            return readResult;
+        }
+
+        if (!target.Flush()) {
+            error = "Failed to flush target disk";
+            return -8;
+        }
+
+        if (progress) {
+            progress(100, "Disk clone completed: " + counters.Summary());
+        }
+        return 0;
+    }
+}
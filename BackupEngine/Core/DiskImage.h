@@ -0,0 +1,152 @@
+// DiskImage.h - Partition-aware disk imaging, restore and disk-to-disk clone
+//
+// A disk image is a directory entry set sharing one base name (e.g. "disk_0"):
+//   disk_0.layout     - text manifest: partition table, reserved ranges, streams
+//   disk_0_table.img  - reserved ranges (MBR/GPT structures, boot code) back to back
+//   disk_0_pN.img     - data blocks of partition N, back to back
+//   disk_0_pN.map     - extent map of partition N (data / zero / unallocated runs)
+//   disk_0_pN.hash    - XXH64 of every stored block, used by compare-before-write
+//   disk_0.journal    - checkpoint journal while imaging runs (see Checkpoint.h)
+// Unpartitioned gaps are not imaged at all. An interrupted ImageDisk or
+// RestoreDiskImage continues from its last verified checkpoint when rerun.
+
+#pragma once
+
+#include "BlockDevice.h"
+#include "PartitionTable.h"
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace BackupCore {
+
+    typedef std::function<void(int percentage, const std::string& message)> ImageProgress;
+
+    enum class ExtentKind : uint32_t {
+        Data = 0,           // Stored in the partition's .img stream
+        Zero = 1,           // All zero bytes on the source
+        Unallocated = 2     // Free space according to the filesystem
+    };
+
+    struct ImageExtent {
+        uint64_t offset = 0;    // Relative to the partition start
+        uint64_t length = 0;
+        ExtentKind kind = ExtentKind::Data;
+    };
+
+    struct PartitionImage {
+        PartitionInfo partition;
+        std::string strategy;       // Allocation strategy used when imaging
+        uint64_t storedBytes = 0;   // Bytes in the .img stream
+    };
+
+    struct DiskImageManifest {
+        std::filesystem::path directory;
+        std::string baseName;
+        DiskLayout layout;
+        uint32_t blockSize = 0;
+        std::vector<PartitionImage> partitions;
+
+        std::filesystem::path LayoutPath() const;
+        std::filesystem::path TablePath() const;
+        std::filesystem::path StreamPath(int partitionIndex) const;
+        std::filesystem::path MapPath(int partitionIndex) const;
+        std::filesystem::path HashPath(int partitionIndex) const;
+    };
+
+    struct DiskImageOptions {
+        uint32_t blockSize = 1024 * 1024;
+        bool skipZeroBlocks = true;
+        bool useAllocationMaps = true;
+
+        // Journal completed ranges every this many bytes so a rerun resumes; 0 disables
+        uint64_t checkpointInterval = 256ULL * 1024 * 1024;
+
+        // Optional limits on source reads and stream writes (see Throttle.h)
+        IoThrottle* throttle = nullptr;
+    };
+
+    struct DiskRestoreOptions {
+        // Read each target block first and skip the write when it already matches
+        bool compareBeforeWrite = false;
+
+        // Issue TRIM/BLKDISCARD for zero ranges instead of writing zeros
+        bool discardZeroRanges = false;
+
+        // Read every written block back and compare it with what was written
+        bool verifyWrites = false;
+
+        // Journal completed ranges every this many bytes so a rerun resumes; 0 disables.
+        // The journal lives next to the image; a read-only image just restores without it.
+        uint64_t checkpointInterval = 256ULL * 1024 * 1024;
+
+        // Optional limits on stream reads and target I/O (see Throttle.h)
+        IoThrottle* throttle = nullptr;
+    };
+
+    // True if every byte of the buffer is zero
+    bool IsZeroBlock(const void* data, size_t length);
+
+    // Image every partition of 'disk' as its own stream into destDir/<baseName>*
+    int ImageDisk(
+        BlockDevice& disk,
+        const std::filesystem::path& destDir,
+        const std::string& baseName,
+        const DiskImageOptions& options,
+        const ImageProgress& progress,
+        std::string& error);
+
+    bool LoadDiskImageManifest(
+        const std::filesystem::path& layoutFile,
+        DiskImageManifest& manifest,
+        std::string& error);
+
+    bool LoadExtentMap(
+        const std::filesystem::path& mapFile,
+        std::vector<ImageExtent>& extents,
+        std::string& error);
+
+    // Per-block hashes of a partition stream; false if the image predates them
+    bool LoadBlockHashes(
+        const std::filesystem::path& hashFile,
+        uint32_t blockSize,
+        std::vector<uint64_t>& hashes);
+
+    // Find the .layout manifest in a backup directory (preferring baseName if given)
+    std::filesystem::path FindDiskImageLayout(
+        const std::filesystem::path& backupDir,
+        const std::string& preferredBaseName);
+
+    // Restore reserved ranges and all partitions onto a whole disk
+    int RestoreDiskImage(
+        const DiskImageManifest& manifest,
+        BlockDevice& target,
+        const DiskRestoreOptions& options,
+        const ImageProgress& progress,
+        std::string& error);
+
+    // Restore one partition stream to 'targetOffset' on 'target'
+    // (0 for a partition device, partition.offset for a whole disk)
+    int RestorePartitionImage(
+        const DiskImageManifest& manifest,
+        int partitionIndex,
+        BlockDevice& target,
+        uint64_t targetOffset,
+        const DiskRestoreOptions& options,
+        const ImageProgress& progress,
+        std::string& error);
+
+    // Copy 'source' straight onto 'target' without an intermediate image.
+    // Source reads run on their own thread, overlapped with target writes.
+    // imageOptions pick zero-skip/allocation maps for the source side,
+    // restoreOptions pick compare/discard/verify for the target side.
+    int CloneDisk(
+        BlockDevice& source,
+        BlockDevice& target,
+        const DiskImageOptions& imageOptions,
+        const DiskRestoreOptions& restoreOptions,
+        const ImageProgress& progress,
+        std::string& error);
+}
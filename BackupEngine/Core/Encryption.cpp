@@ -0,0 +1,324 @@
+// Encryption.cpp - Authenticated block encryption for file backups
+#include "Encryption.h"
+#include <cstring>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <bcrypt.h>
+#include <intrin.h>
+#pragma comment(lib, "bcrypt.lib")
+#ifndef BCRYPT_CHACHA20_POLY1305_ALGORITHM
+#define BCRYPT_CHACHA20_POLY1305_ALGORITHM L"CHACHA20_POLY1305"
+#endif
+#ifndef STATUS_AUTH_TAG_MISMATCH
+#define STATUS_AUTH_TAG_MISMATCH ((NTSTATUS)0xC000A002L)
+#endif
+#else
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#if defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+namespace BackupCore {
+
+    namespace {
+        // PBKDF2 rounds for new sets; existing sets keep the count in their catalog
+        const uint32_t KeyIterations = 600000;
+        const size_t SaltSize = 16;
+
+        // Sealed under nonce 0, which no file block uses (file ids are never 0)
+        const uint8_t KeyCheckText[16] = { 'B', 'K', 'E', '1', ' ', 'k', 'e', 'y', ' ', 'c', 'h', 'e', 'c', 'k', 0, 0 };
+
+        bool DeriveKey(const std::string& password, const std::vector<uint8_t>& salt, uint32_t iterations,
+            uint8_t* key, std::string& error);
+    }
+
+    const char* CipherName(CipherKind cipher) {
+        switch (cipher) {
+        case CipherKind::Aes256Gcm: return "aes-256-gcm";
+        case CipherKind::ChaCha20Poly1305: return "chacha20-poly1305";
+        default: return "none";
+        }
+    }
+
+    CipherKind ParseCipherName(const std::string& name) {
+        if (name == "aes-256-gcm") return CipherKind::Aes256Gcm;
+        if (name == "chacha20-poly1305") return CipherKind::ChaCha20Poly1305;
+        return CipherKind::None;
+    }
+
+    CipherKind PreferredCipher() {
+        return HardwareAesAvailable() ? CipherKind::Aes256Gcm : CipherKind::ChaCha20Poly1305;
+    }
+
+    bool CreateSetKey(const std::string& password, CipherKind cipher, KeyDerivation& derivation,
+        EncryptionKey& key, std::string& error) {
+
+        if (password.empty() || cipher == CipherKind::None) {
+            error = "An encryption password is required";
+            return false;
+        }
+
+        derivation = KeyDerivation();
+        derivation.cipher = cipher;
+        derivation.iterations = KeyIterations;
+        derivation.salt.resize(SaltSize);
+        if (!RandomBytes(derivation.salt.data(), SaltSize)) {
+            error = "Cannot generate an encryption salt";
+            return false;
+        }
+
+        key.cipher = cipher;
+        if (!DeriveKey(password, derivation.salt, derivation.iterations, key.bytes, error)) {
+            return false;
+        }
+
+        BlockCipher sealer;
+        uint8_t nonce[CipherNonceSize] = {};
+        derivation.check.assign(KeyCheckText, KeyCheckText + sizeof(KeyCheckText));
+        derivation.check.resize(sizeof(KeyCheckText) + CipherTagSize);
+        if (!sealer.Init(key, error) ||
+            !sealer.Seal(nonce, nullptr, 0, derivation.check.data(), sizeof(KeyCheckText),
+                derivation.check.data() + sizeof(KeyCheckText))) {
+            if (error.empty()) error = "Cannot encrypt with " + std::string(CipherName(cipher));
+            return false;
+        }
+        return true;
+    }
+
+    bool OpenSetKey(const std::string& password, const KeyDerivation& derivation,
+        EncryptionKey& key, std::string& error) {
+
+        if (password.empty()) {
+            error = "Backup set is encrypted; a password is required";
+            return false;
+        }
+        if (derivation.cipher == CipherKind::None || derivation.iterations == 0 ||
+            derivation.check.size() != sizeof(KeyCheckText) + CipherTagSize) {
+            error = "Unsupported encryption settings in catalog";
+            return false;
+        }
+
+        key.cipher = derivation.cipher;
+        if (!DeriveKey(password, derivation.salt, derivation.iterations, key.bytes, error)) {
+            return false;
+        }
+
+        BlockCipher opener;
+        if (!opener.Init(key, error)) {
+            return false;
+        }
+        uint8_t nonce[CipherNonceSize] = {};
+        std::vector<uint8_t> check = derivation.check;
+        if (!opener.Open(nonce, nullptr, 0, check.data(), sizeof(KeyCheckText), check.data() + sizeof(KeyCheckText)) ||
+            std::memcmp(check.data(), KeyCheckText, sizeof(KeyCheckText)) != 0) {
+            error = "Wrong password for encrypted backup set";
+            return false;
+        }
+        return true;
+    }
+
+#ifdef _WIN32
+
+    bool HardwareAesAvailable() {
+#if defined(_M_X64) || defined(_M_IX86)
+        int info[4];
+        __cpuid(info, 1);
+        bool aes = (info[2] & (1 << 25)) != 0;
+        bool pclmul = (info[2] & (1 << 1)) != 0;
+        return aes && pclmul;
+#elif defined(_M_ARM64)
+        return IsProcessorFeaturePresent(PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE) != 0;
+#else
+        return false;
+#endif
+    }
+
+    bool RandomBytes(void* data, size_t length) {
+        return BCryptGenRandom(NULL, (PUCHAR)data, (ULONG)length, BCRYPT_USE_SYSTEM_PREFERRED_RNG) == 0;
+    }
+
+    namespace {
+        bool DeriveKey(const std::string& password, const std::vector<uint8_t>& salt, uint32_t iterations,
+            uint8_t* key, std::string& error) {
+
+            BCRYPT_ALG_HANDLE hmac = NULL;
+            if (BCryptOpenAlgorithmProvider(&hmac, BCRYPT_SHA256_ALGORITHM, NULL, BCRYPT_ALG_HANDLE_HMAC_FLAG) != 0) {
+                error = "SHA-256 is not available";
+                return false;
+            }
+            NTSTATUS status = BCryptDeriveKeyPBKDF2(hmac, (PUCHAR)password.data(), (ULONG)password.size(),
+                (PUCHAR)salt.data(), (ULONG)salt.size(), iterations, key, (ULONG)CipherKeySize, 0);
+            BCryptCloseAlgorithmProvider(hmac, 0);
+            if (status != 0) {
+                error = "Key derivation failed";
+                return false;
+            }
+            return true;
+        }
+    }
+
+    struct BlockCipher::Context {
+        BCRYPT_ALG_HANDLE algorithm = NULL;
+        BCRYPT_KEY_HANDLE key = NULL;
+
+        ~Context() {
+            if (key) BCryptDestroyKey(key);
+            if (algorithm) BCryptCloseAlgorithmProvider(algorithm, 0);
+        }
+    };
+
+    BlockCipher::BlockCipher() {}
+    BlockCipher::~BlockCipher() {}
+
+    bool BlockCipher::Init(const EncryptionKey& key, std::string& error) {
+        context.reset(new Context);
+        bool aes = key.cipher == CipherKind::Aes256Gcm;
+        if (key.cipher == CipherKind::None ||
+            BCryptOpenAlgorithmProvider(&context->algorithm,
+                aes ? BCRYPT_AES_ALGORITHM : BCRYPT_CHACHA20_POLY1305_ALGORITHM, NULL, 0) != 0) {
+            error = std::string(CipherName(key.cipher)) + " is not available on this system";
+            context.reset();
+            return false;
+        }
+        if (aes && BCryptSetProperty(context->algorithm, BCRYPT_CHAINING_MODE, (PUCHAR)BCRYPT_CHAIN_MODE_GCM,
+                sizeof(BCRYPT_CHAIN_MODE_GCM), 0) != 0) {
+            error = "AES-GCM is not available on this system";
+            context.reset();
+            return false;
+        }
+        if (BCryptGenerateSymmetricKey(context->algorithm, &context->key, NULL, 0,
+                (PUCHAR)key.bytes, (ULONG)CipherKeySize, 0) != 0) {
+            error = "Cannot set up the encryption key";
+            context.reset();
+            return false;
+        }
+        return true;
+    }
+
+    bool BlockCipher::Seal(const uint8_t* nonce, const uint8_t* aad, size_t aadLength,
+        uint8_t* data, size_t length, uint8_t* tag) {
+
+        BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO info;
+        BCRYPT_INIT_AUTH_MODE_INFO(info);
+        info.pbNonce = (PUCHAR)nonce;
+        info.cbNonce = (ULONG)CipherNonceSize;
+        info.pbAuthData = (PUCHAR)aad;
+        info.cbAuthData = (ULONG)aadLength;
+        info.pbTag = tag;
+        info.cbTag = (ULONG)CipherTagSize;
+
+        ULONG written = 0;
+        return context && BCryptEncrypt(context->key, data, (ULONG)length, &info, NULL, 0,
+            data, (ULONG)length, &written, 0) == 0;
+    }
+
+    bool BlockCipher::Open(const uint8_t* nonce, const uint8_t* aad, size_t aadLength,
+        uint8_t* data, size_t length, const uint8_t* tag) {
+
+        BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO info;
+        BCRYPT_INIT_AUTH_MODE_INFO(info);
+        info.pbNonce = (PUCHAR)nonce;
+        info.cbNonce = (ULONG)CipherNonceSize;
+        info.pbAuthData = (PUCHAR)aad;
+        info.cbAuthData = (ULONG)aadLength;
+        info.pbTag = (PUCHAR)tag;
+        info.cbTag = (ULONG)CipherTagSize;
+
+        ULONG written = 0;
+        return context && BCryptDecrypt(context->key, data, (ULONG)length, &info, NULL, 0,
+            data, (ULONG)length, &written, 0) == 0;
+    }
+
+#else
+
+    bool HardwareAesAvailable() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __builtin_cpu_supports("aes") && __builtin_cpu_supports("pclmul");
+#elif defined(__aarch64__)
+        return (getauxval(AT_HWCAP) & HWCAP_AES) && (getauxval(AT_HWCAP) & HWCAP_PMULL);
+#else
+        return false;
+#endif
+    }
+
+    bool RandomBytes(void* data, size_t length) {
+        return RAND_bytes((unsigned char*)data, (int)length) == 1;
+    }
+
+    namespace {
+        bool DeriveKey(const std::string& password, const std::vector<uint8_t>& salt, uint32_t iterations,
+            uint8_t* key, std::string& error) {
+
+            if (PKCS5_PBKDF2_HMAC(password.data(), (int)password.size(), salt.data(), (int)salt.size(),
+                    (int)iterations, EVP_sha256(), (int)CipherKeySize, key) != 1) {
+                error = "Key derivation failed";
+                return false;
+            }
+            return true;
+        }
+    }
+
+    // Separate contexts for sealing and opening, each keeping its key schedule;
+    // only the nonce changes from block to block
+    struct BlockCipher::Context {
+        EVP_CIPHER_CTX* seal = nullptr;
+        EVP_CIPHER_CTX* open = nullptr;
+
+        ~Context() {
+            EVP_CIPHER_CTX_free(seal);
+            EVP_CIPHER_CTX_free(open);
+        }
+    };
+
+    BlockCipher::BlockCipher() {}
+    BlockCipher::~BlockCipher() {}
+
+    bool BlockCipher::Init(const EncryptionKey& key, std::string& error) {
+        const EVP_CIPHER* cipher = key.cipher == CipherKind::Aes256Gcm ? EVP_aes_256_gcm()
+            : key.cipher == CipherKind::ChaCha20Poly1305 ? EVP_chacha20_poly1305() : nullptr;
+
+        context.reset(new Context);
+        context->seal = EVP_CIPHER_CTX_new();
+        context->open = EVP_CIPHER_CTX_new();
+        if (!cipher || !context->seal || !context->open ||
+            EVP_EncryptInit_ex(context->seal, cipher, NULL, key.bytes, NULL) != 1 ||
+            EVP_DecryptInit_ex(context->open, cipher, NULL, key.bytes, NULL) != 1) {
+            error = std::string(CipherName(key.cipher)) + " is not available on this system";
+            context.reset();
+            return false;
+        }
+        return true;
+    }
+
+    bool BlockCipher::Seal(const uint8_t* nonce, const uint8_t* aad, size_t aadLength,
+        uint8_t* data, size_t length, uint8_t* tag) {
+
+        if (!context) return false;
+        EVP_CIPHER_CTX* ctx = context->seal;
+        int out = 0;
+        return EVP_EncryptInit_ex(ctx, NULL, NULL, NULL, nonce) == 1 &&
+            (aadLength == 0 || EVP_EncryptUpdate(ctx, NULL, &out, aad, (int)aadLength) == 1) &&
+            EVP_EncryptUpdate(ctx, data, &out, data, (int)length) == 1 &&
+            EVP_EncryptFinal_ex(ctx, data + out, &out) == 1 &&
+            EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, (int)CipherTagSize, tag) == 1;
+    }
+
+    bool BlockCipher::Open(const uint8_t* nonce, const uint8_t* aad, size_t aadLength,
+        uint8_t* data, size_t length, const uint8_t* tag) {
+
+        if (!context) return false;
+        EVP_CIPHER_CTX* ctx = context->open;
+        int out = 0;
+        return EVP_DecryptInit_ex(ctx, NULL, NULL, NULL, nonce) == 1 &&
+            (aadLength == 0 || EVP_DecryptUpdate(ctx, NULL, &out, aad, (int)aadLength) == 1) &&
+            EVP_DecryptUpdate(ctx, data, &out, data, (int)length) == 1 &&
+            EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, (int)CipherTagSize, (void*)tag) == 1 &&
+            EVP_DecryptFinal_ex(ctx, data + out, &out) == 1;
+    }
+
+#endif
+}
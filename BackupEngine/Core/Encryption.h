@@ -0,0 +1,86 @@
+// Encryption.h - Authenticated block encryption for file backups
+//
+// An encrypted set has one key, derived from the user's password with
+// PBKDF2-HMAC-SHA256 and a random salt kept in the catalog. Every stored
+// block is sealed with AES-256-GCM, or with ChaCha20-Poly1305 on CPUs
+// without AES instructions, under a nonce made of a random per-file id and
+// the block's index. The platform libraries do the work (CNG on Windows,
+// OpenSSL's libcrypto elsewhere); both use AES-NI/VAES where the CPU has it.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace BackupCore {
+
+    enum class CipherKind : uint32_t {
+        None = 0,
+        Aes256Gcm = 1,
+        ChaCha20Poly1305 = 2
+    };
+
+    const char* CipherName(CipherKind cipher);
+    CipherKind ParseCipherName(const std::string& name);
+
+    const size_t CipherKeySize = 32;
+    const size_t CipherNonceSize = 12;
+    const size_t CipherTagSize = 16;
+
+    // True if the CPU encrypts AES and multiplies GHASH in hardware
+    bool HardwareAesAvailable();
+
+    // AES-256-GCM with hardware AES, ChaCha20-Poly1305 without
+    CipherKind PreferredCipher();
+
+    bool RandomBytes(void* data, size_t length);
+
+    // How a set's key comes from its password; stored in the catalog
+    struct KeyDerivation {
+        CipherKind cipher = CipherKind::None;
+        std::vector<uint8_t> salt;
+        uint32_t iterations = 0;
+        std::vector<uint8_t> check;     // A known block sealed with the key, to spot a wrong password
+    };
+
+    struct EncryptionKey {
+        CipherKind cipher = CipherKind::None;
+        uint8_t bytes[CipherKeySize] = {};
+    };
+
+    // Key for a new set: picks a salt and fills 'derivation' for the catalog
+    bool CreateSetKey(const std::string& password, CipherKind cipher, KeyDerivation& derivation,
+        EncryptionKey& key, std::string& error);
+
+    // Key of an existing set; fails if the password is wrong
+    bool OpenSetKey(const std::string& password, const KeyDerivation& derivation,
+        EncryptionKey& key, std::string& error);
+
+    // Seals and opens blocks in place with one key. Keeps the platform's key
+    // schedule, so each file thread makes its own and reuses it.
+    class BlockCipher {
+    public:
+        BlockCipher();
+        ~BlockCipher();
+
+        BlockCipher(const BlockCipher&) = delete;
+        BlockCipher& operator=(const BlockCipher&) = delete;
+
+        bool Init(const EncryptionKey& key, std::string& error);
+
+        // Encrypts data and writes its tag; aad is authenticated but not encrypted
+        bool Seal(const uint8_t* nonce, const uint8_t* aad, size_t aadLength,
+            uint8_t* data, size_t length, uint8_t* tag);
+
+        // Decrypts data; false if it or the aad was altered
+        bool Open(const uint8_t* nonce, const uint8_t* aad, size_t aadLength,
+            uint8_t* data, size_t length, const uint8_t* tag);
+
+    private:
+        struct Context;
+        std::unique_ptr<Context> context;
+    };
+}
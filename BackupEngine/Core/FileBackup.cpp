@@ -0,0 +1,2155 @@
+// FileBackup.cpp - Portable file backup, verification and restore
+#include "FileBackup.h"
+#include "Checksum.h"
+#include "Concurrency.h"
+#include "Delta.h"
+#include "Dictionary.h"
+#include "Metrics.h"
+#include "Parity.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <cwctype>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace BackupCore {
+
+    namespace {
+        const char FrameMagic[4] = { 'B', 'K', 'Z', '1' };
+        const char SealedMagic[4] = { 'B', 'K', 'E', '1' };
+        const uint32_t MaxFrameBlock = 64 * 1024 * 1024;
+
+        // Files in flight when an adaptive job starts, before it has measured anything
+        const uint32_t InitialFileThreads = 2;
+
+        // Duplicate candidates are hashed this far from each end before they are hashed whole
+        const size_t PartialHashBytes = 16 * 1024;
+
+        // The dictionary for small files is trained from about this much of
+        // them, spread over the set, and only with this many files at least
+        const uint64_t DictionarySampleBytes = 4 * 1024 * 1024;
+        const size_t MinDictionarySamples = 16;
+
+        // How often a scrub writes down where it stands
+        const uint64_t ScrubSaveIntervalNanoseconds = 30ull * 1000 * 1000 * 1000;
+
+        void PutLe32(uint8_t* p, uint32_t value) {
+            for (int i = 0; i < 4; i++) {
+                p[i] = (uint8_t)(value >> (8 * i));
+            }
+        }
+
+        uint32_t GetLe32(const uint8_t* p) {
+            return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+        }
+
+        // Block nonce: the file's id, then the block's index
+        void BlockNonce(uint8_t* nonce, const uint8_t* fileId, uint32_t block) {
+            std::copy(fileId, fileId + 8, nonce);
+            PutLe32(nonce + 8, block);
+        }
+
+        // One per file thread, or none for a set that is not encrypted. The key
+        // was already tried when the set was opened; a cipher that still fails
+        // to set up refuses every block, which fails the files one by one.
+        std::unique_ptr<BlockCipher> ThreadCipher(const EncryptionKey* key) {
+            if (!key) {
+                return nullptr;
+            }
+            std::unique_ptr<BlockCipher> cipher(new BlockCipher);
+            std::string ignored;
+            cipher->Init(*key, ignored);
+            return cipher;
+        }
+
+        // Feeds the progress channel per block and the percentage callback per file,
+        // and is where the loops honour pause and cancel. The callback only fires,
+        // and its message is only built, when the integer percentage changes.
+        // AddBlock and Continue may be called from any file thread; Advance is
+        // called under the run's result lock, which also serializes the callback.
+        class ProgressTracker {
+        public:
+            ProgressTracker(const BackupProgress& callback, ProgressChannel* channel, JobControl* control,
+                int first, int span, uint64_t total)
+                : callback(callback), channel(channel), control(control), first(first), span(span), total(total) {}
+
+            // Returns false if the job was cancelled
+            bool AddBlock(size_t bytes) {
+                if (channel) {
+                    channel->AddBytes(bytes);
+                }
+                return Checkpoint(control);
+            }
+
+            // Called before each file; returns false if the job was cancelled
+            bool Continue() { return Checkpoint(control); }
+
+            bool Cancelled() const { return control && control->Cancelled(); }
+
+            IoThrottle* Throttle() const { return control ? &control->Throttle() : nullptr; }
+
+            // 'counted' is what AddBlock already reported for this file
+            template <typename Message>
+            void Advance(uint64_t bytes, uint64_t counted, bool succeeded, Message message) {
+                if (channel) {
+                    // Skipped and failed files still count towards the total
+                    if (bytes > counted) {
+                        channel->AddBytes(bytes - counted);
+                    }
+                    channel->AddFile(succeeded);
+                }
+
+                done += bytes;
+                int percent = first + (total > 0 ? (int)((done * span) / total) : span);
+                if (callback && percent != lastPercent) {
+                    lastPercent = percent;
+                    callback(percent, message());
+                }
+            }
+
+        private:
+            const BackupProgress& callback;
+            ProgressChannel* channel;
+            JobControl* control;
+            int first;
+            int span;
+            uint64_t total;
+            uint64_t done = 0;
+            int lastPercent = -1;
+        };
+
+        // Block progress of the one file a thread is working on, and where its
+        // I/O latency goes when the file thread count or the compression
+        // effort is adaptive
+        class FileProgress {
+        public:
+            FileProgress(ProgressTracker& tracker, AdaptiveConcurrency* concurrency,
+                AdaptiveCompression* compression = nullptr)
+                : tracker(tracker), concurrency(concurrency), compression(compression) {}
+
+            bool AddBlock(size_t bytes) {
+                if (replay) {
+                    return tracker.Continue();
+                }
+                counted += bytes;
+                return tracker.AddBlock(bytes);
+            }
+
+            uint64_t Counted() const { return counted; }
+
+            // The file is read again after a parity repair; that is not progress
+            void Replay() { replay = true; }
+
+            // For reads on the file's behalf that are not the file itself,
+            // such as a delta's base; they still honour cancel and the throttle
+            FileProgress Quiet() const {
+                FileProgress quiet(tracker, nullptr, compression);
+                quiet.replay = true;
+                return quiet;
+            }
+
+            IoThrottle* Throttle() const { return tracker.Throttle(); }
+
+            AdaptiveCompression* Compression() const { return compression; }
+
+            void Sample(uint64_t nanoseconds, size_t bytes) {
+                if (concurrency) {
+                    concurrency->Sample(nanoseconds, bytes);
+                }
+                if (compression) {
+                    compression->SampleIo(nanoseconds);
+                }
+            }
+
+            // Time asleep on the job's throttle: not latency, but the CPU was free
+            void Waited(uint64_t nanoseconds) {
+                if (compression) {
+                    compression->SampleIo(nanoseconds);
+                }
+            }
+
+        private:
+            ProgressTracker& tracker;
+            AdaptiveConcurrency* concurrency;
+            AdaptiveCompression* compression;
+            uint64_t counted = 0;
+            bool replay = false;
+        };
+
+        // Reports Completed or Failed on the channel however the run ends
+        class ProgressFinish {
+        public:
+            explicit ProgressFinish(ProgressChannel* channel) : channel(channel) {}
+            ~ProgressFinish() {
+                if (channel) {
+                    channel->Finish(succeeded);
+                }
+            }
+
+            void Succeeded() { succeeded = true; }
+
+            ProgressFinish(const ProgressFinish&) = delete;
+            ProgressFinish& operator=(const ProgressFinish&) = delete;
+
+        private:
+            ProgressChannel* channel;
+            bool succeeded = false;
+        };
+
+        void SetPhase(ProgressChannel* channel, ProgressPhase phase) {
+            if (channel) {
+                channel->SetPhase(phase);
+            }
+        }
+
+        // Stream I/O with the time and bytes charged to the read/write phases.
+        // With a file, the latency is reported to it and the bytes charged to
+        // the throttle; reads are charged afterwards, once their size is known,
+        // and time spent throttled never counts as latency.
+        size_t TimedRead(std::ifstream& in, uint8_t* data, size_t capacity, FileProgress* file) {
+            size_t length;
+            uint64_t start = MonotonicNanoseconds();
+            {
+                PhaseTimer timer(MetricPhase::Read);
+                in.read(reinterpret_cast<char*>(data), (std::streamsize)capacity);
+                length = (size_t)in.gcount();
+                timer.SetBytes(length);
+            }
+            if (file && length > 0) {
+                uint64_t end = MonotonicNanoseconds();
+                file->Sample(end - start, length);
+                if (IoThrottle* throttle = file->Throttle()) {
+                    throttle->Read(length);
+                    file->Waited(MonotonicNanoseconds() - end);
+                }
+            }
+            return length;
+        }
+
+        void TimedWrite(std::ofstream& out, const void* data, size_t length, FileProgress* file = nullptr) {
+            IoThrottle* throttle = file ? file->Throttle() : nullptr;
+            uint64_t start = MonotonicNanoseconds();
+            if (throttle) {
+                throttle->Write(length);
+                uint64_t end = MonotonicNanoseconds();
+                file->Waited(end - start);
+                start = end;
+            }
+            {
+                PhaseTimer timer(MetricPhase::Write, length);
+                out.write(reinterpret_cast<const char*>(data), (std::streamsize)length);
+            }
+            if (file) {
+                file->Sample(MonotonicNanoseconds() - start, length);
+            }
+        }
+
+        void TimedHash(Hash64Stream& hash, const uint8_t* data, size_t length) {
+            PhaseTimer timer(MetricPhase::Hash, length);
+            hash.Update(data, length);
+        }
+
+        // Each run of files is processed in scan order, so consecutive files from
+        // one directory become one "directory" span in the trace
+        class DirectorySpans {
+        public:
+            ~DirectorySpans() { Close(); }
+
+            void Enter(const std::string& relativePath) {
+                if (!TraceEnabled()) return;
+                size_t slash = relativePath.rfind('/');
+                std::string dir = slash == std::string::npos ? "." : relativePath.substr(0, slash);
+                if (start && dir == current) return;
+                Close();
+                current = dir;
+                start = TraceClock();
+            }
+
+        private:
+            void Close() {
+                if (start) {
+                    TraceComplete("directory", "directory", start, TraceClock(), current);
+                    start = 0;
+                }
+            }
+
+            std::string current;
+            uint64_t start = 0;
+        };
+
+        // Splits [0, count) into runs of consecutive files and processes them on
+        // up to 'threads' threads: the caller plus threads - 1 from the engine
+        // pool. Keeping runs in scan order keeps reads within a directory
+        // sequential. processRun(begin, end) must be safe to call concurrently.
+        // With a controller, the thread count follows its limit, re-read as each
+        // run finishes; runs are kept short so a change takes effect quickly.
+        template <typename ProcessRun>
+        void ForEachRun(size_t count, uint32_t threads, TaskPriority priority, AdaptiveConcurrency* concurrency,
+            ProcessRun processRun) {
+            if (threads <= 1 || count < 2) {
+                processRun((size_t)0, count);
+                return;
+            }
+
+            size_t longest = concurrency ? 16 : 64;
+            size_t runLength = std::min<size_t>(longest, std::max<size_t>(1, count / ((size_t)threads * 4)));
+            TaskGroup group((concurrency ? concurrency->Limit() : threads) - 1, priority);
+            for (size_t begin = 0; begin < count; begin += runLength) {
+                size_t end = std::min(count, begin + runLength);
+                group.Run([&processRun, &group, concurrency, begin, end] {
+                    processRun(begin, end);
+                    if (concurrency) {
+                        group.SetMaxWorkers(concurrency->Limit() - 1);
+                    }
+                });
+            }
+            group.Wait();
+        }
+
+        bool Fail(FileError& error, FileErrorCode code, std::string message, int osError = 0) {
+            error.code = code;
+            error.osError = osError;
+            error.message = std::move(message);
+            return false;
+        }
+
+        void NoteFailure(FileSetResult& result, FileError error) {
+            if (result.failed++ == 0) {
+                result.firstFailure = error.message;
+            }
+            if (result.errors.size() < MaxRecordedFileErrors) {
+                result.errors.push_back(std::move(error));
+            }
+        }
+
+        FileError InvalidPath(const std::string& relativePath) {
+            FileError error;
+            error.path = relativePath;
+            error.code = FileErrorCode::InvalidPath;
+            error.message = "Invalid path in catalog: " + relativePath;
+            return error;
+        }
+
+        // Catalog paths come from disk; never let one escape the restore root
+        bool IsSafeRelativePath(const std::string& relativePath) {
+            fs::path path = fs::u8path(relativePath);
+            if (relativePath.empty() || path.is_absolute() || path.has_root_name()) {
+                return false;
+            }
+            for (const auto& part : path) {
+                if (part == "..") return false;
+            }
+            return true;
+        }
+
+        // How compaction matches stored files against the catalog. NTFS ignores
+        // case, so after a case-only rename of a source file the stored file
+        // keeps its old spelling while the catalog lists the new one.
+        std::string LiveKey(const std::string& relativePath) {
+#ifdef _WIN32
+            std::wstring folded = fs::u8path(relativePath).wstring();
+            for (auto& c : folded) {
+                c = static_cast<wchar_t>(std::towupper(c));
+            }
+            return fs::path(folded).u8string();
+#else
+            return relativePath;
+#endif
+        }
+
+        // Copy one source file into the backup set, hashing the original bytes on the way.
+        // With 'content' those bytes come from memory instead of sourcePath.
+        bool StoreFile(const fs::path& sourcePath, const fs::path& storedPath, const FileBackupOptions& options,
+            BlockCipher* cipher, const CompressionDictionary* dictionary, ParityWriter* parity,
+            std::vector<uint8_t>& buffer, std::vector<uint8_t>& packed, CatalogEntry& entry, FileProgress& tracker,
+            FileError& error, const std::vector<uint8_t>* content, SketchBuilder* sketch) {
+
+            EngineMetrics& metrics = EngineMetrics::Global();
+            LatencyTimer copyTimer(metrics.fileCopy);
+            uint64_t openStart = MonotonicNanoseconds();
+
+            std::ifstream in;
+            if (!content) {
+                in.open(sourcePath, std::ios::binary);
+                if (!in.is_open()) {
+                    return Fail(error, FileErrorCode::OpenFailed, "Cannot open " + sourcePath.u8string(), errno);
+                }
+            }
+
+            std::error_code ec;
+            fs::create_directories(storedPath.parent_path(), ec);
+            std::ofstream out(storedPath, std::ios::binary | std::ios::trunc);
+            if (!out.is_open()) {
+                return Fail(error, FileErrorCode::CreateFailed, "Cannot create " + storedPath.u8string(), errno);
+            }
+
+            metrics.fileOpen.Record(MonotonicNanoseconds() - openStart);
+
+            // Everything that goes into the stored file goes through its parity too
+            auto put = [&](const void* data, size_t length, FileProgress* file) {
+                TimedWrite(out, data, length, file);
+                if (parity) {
+                    parity->Add(data, length);
+                }
+            };
+
+            bool compress = options.codec != CompressionCodec::None;
+            bool framed = compress || cipher;
+            entry.codec = !compress ? CompressionCodec::None :
+                dictionary ? CompressionCodec::LzDictionary : CompressionCodec::Lz;
+            entry.storedSize = 0;
+            uint8_t fileId[8] = {};
+            if (cipher) {
+                // A random id keeps nonces unique across files without any shared counter
+                do {
+                    if (!RandomBytes(fileId, sizeof(fileId))) {
+                        return Fail(error, FileErrorCode::WriteFailed, "Cannot generate a file id for " + storedPath.u8string());
+                    }
+                } while (std::all_of(fileId, fileId + sizeof(fileId), [](uint8_t b) { return b == 0; }));
+                put(SealedMagic, sizeof(SealedMagic), nullptr);
+                put(fileId, sizeof(fileId), nullptr);
+                entry.storedSize = sizeof(SealedMagic) + sizeof(fileId);
+            }
+            else if (framed) {
+                put(FrameMagic, sizeof(FrameMagic), nullptr);
+                entry.storedSize = sizeof(FrameMagic);
+            }
+
+            // Frame headers are too small to count against the limits or as samples
+            size_t offset = 0;
+            auto next = [&]() -> size_t {
+                if (!content) {
+                    return TimedRead(in, buffer.data(), buffer.size(), &tracker);
+                }
+                size_t length = std::min(buffer.size(), content->size() - offset);
+                std::memcpy(buffer.data(), content->data() + offset, length);
+                offset += length;
+                return length;
+            };
+
+            Hash64Stream hash;
+            uint64_t total = 0;
+            uint32_t block = 0;
+            AdaptiveCompression* compression = tracker.Compression();
+            for (;;) {
+                size_t length = next();
+                if (length == 0) break;
+
+                uint64_t cpuStart = MonotonicNanoseconds();
+                TimedHash(hash, buffer.data(), length);
+                if (sketch) {
+                    PhaseTimer timer(MetricPhase::Hash, length);
+                    sketch->Update(buffer.data(), length);
+                }
+                total += length;
+                if (!tracker.AddBlock(length)) {
+                    return Fail(error, FileErrorCode::Cancelled, "Cancelled");
+                }
+
+                if (!framed) {
+                    put(buffer.data(), length, &tracker);
+                    entry.storedSize += length;
+                    continue;
+                }
+
+                // Keep the block raw unless compression actually saves space
+                size_t packedLength = 0;
+                BlockEffort effort = compression ? compression->Choose(buffer.data(), length) : BlockEffort::Fast;
+                if (compress && effort != BlockEffort::Raw) {
+                    PhaseTimer timer(MetricPhase::Compress, length);
+                    packedLength = effort == BlockEffort::Strong ?
+                        LzCompressStrong(buffer.data(), length, packed.data(), length - 1, dictionary) :
+                        LzCompress(buffer.data(), length, packed.data(), length - 1, dictionary);
+                }
+                uint8_t* data = packedLength > 0 ? packed.data() : buffer.data();
+                uint32_t storedLength = (uint32_t)(packedLength > 0 ? packedLength : length);
+
+                uint8_t header[8];
+                PutLe32(header, (uint32_t)length);
+                PutLe32(header + 4, storedLength);
+
+                // Sealed after compressing, since ciphertext does not compress
+                uint8_t tag[CipherTagSize];
+                if (cipher) {
+                    uint8_t nonce[CipherNonceSize];
+                    BlockNonce(nonce, fileId, block++);
+                    PhaseTimer timer(MetricPhase::Encrypt, storedLength);
+                    if (!cipher->Seal(nonce, header, sizeof(header), data, storedLength, tag)) {
+                        return Fail(error, FileErrorCode::WriteFailed, "Cannot encrypt " + sourcePath.u8string());
+                    }
+                }
+                if (compression) {
+                    compression->SampleCpu(MonotonicNanoseconds() - cpuStart);
+                }
+
+                put(header, sizeof(header), nullptr);
+                put(data, storedLength, &tracker);
+                entry.storedSize += sizeof(header) + storedLength;
+                if (cipher) {
+                    put(tag, sizeof(tag), nullptr);
+                    entry.storedSize += sizeof(tag);
+                }
+            }
+
+            if (!content && in.bad()) {
+                return Fail(error, FileErrorCode::ReadFailed, "Failed to read " + sourcePath.u8string());
+            }
+
+            out.flush();
+            if (!out.good()) {
+                return Fail(error, FileErrorCode::WriteFailed, "Failed to write " + storedPath.u8string());
+            }
+
+            entry.file.size = total;
+            entry.hash = hash.Digest();
+            return true;
+        }
+
+        // StoreFile, plus the file's parity when the set has any
+        bool StoreWithParity(const fs::path& sourcePath, const fs::path& storedPath, const fs::path& destDir,
+            const FileBackupOptions& options, BlockCipher* cipher, const CompressionDictionary* dictionary,
+            std::vector<uint8_t>& buffer, std::vector<uint8_t>& packed, CatalogEntry& entry, FileProgress& tracker,
+            FileError& error, const std::vector<uint8_t>* content = nullptr, SketchBuilder* sketch = nullptr) {
+
+            if (options.parityShards == 0) {
+                return StoreFile(sourcePath, storedPath, options, cipher, dictionary, nullptr, buffer, packed, entry, tracker,
+                    error, content, sketch);
+            }
+
+            ParityWriter parity(options.parityShards, entry.file.size);
+            std::string message;
+            if (!parity.Open(ParityPath(destDir, entry.file.relativePath), message)) {
+                return Fail(error, FileErrorCode::CreateFailed, message);
+            }
+            if (!StoreFile(sourcePath, storedPath, options, cipher, dictionary, &parity, buffer, packed, entry, tracker,
+                    error, content, sketch)) {
+                return false;
+            }
+            if (!parity.Finish(message)) {
+                return Fail(error, FileErrorCode::WriteFailed, message);
+            }
+            return true;
+        }
+
+        // A whole source file in memory, for sketching and delta encoding
+        bool ReadSource(const fs::path& path, std::vector<uint8_t>& content, FileProgress& tracker, FileError& error) {
+            std::ifstream in(path, std::ios::binary);
+            if (!in.is_open()) {
+                return Fail(error, FileErrorCode::OpenFailed, "Cannot open " + path.u8string(), errno);
+            }
+            const size_t piece = 1024 * 1024;
+            content.clear();
+            for (;;) {
+                size_t used = content.size();
+                content.resize(used + piece);
+                size_t length = TimedRead(in, content.data() + used, piece, &tracker);
+                content.resize(used + length);
+                if (length == 0) break;
+                if (!tracker.AddBlock(length)) {
+                    return Fail(error, FileErrorCode::Cancelled, "Cancelled");
+                }
+            }
+            if (in.bad()) {
+                return Fail(error, FileErrorCode::ReadFailed, "Failed to read " + path.u8string());
+            }
+            return true;
+        }
+
+        uint64_t ContentHash(const std::vector<uint8_t>& content) {
+            Hash64Stream hash;
+            TimedHash(hash, content.data(), content.size());
+            return hash.Digest();
+        }
+
+        // Decode a stored file, optionally writing the original bytes to destPath
+        // or appending them to 'content', and check its hash. The stored file of
+        // a "like" entry is a delta, applied to 'deltaBase'; an "lzdict" file
+        // needs the set's dictionary.
+        bool ExtractFile(const fs::path& storedPath, const CatalogEntry& entry, const fs::path* destPath,
+            BlockCipher* cipher, const CompressionDictionary* dictionary, std::vector<uint8_t>& buffer,
+            std::vector<uint8_t>& packed, FileProgress& tracker, FileError& error, std::vector<uint8_t>* content = nullptr,
+            const std::vector<uint8_t>* deltaBase = nullptr) {
+
+            EngineMetrics& metrics = EngineMetrics::Global();
+            LatencyTimer copyTimer(metrics.fileCopy);
+            uint64_t openStart = MonotonicNanoseconds();
+
+            std::ifstream in(storedPath, std::ios::binary);
+            if (!in.is_open()) {
+                return Fail(error, FileErrorCode::MissingFromBackup, "Missing from backup: " + entry.file.relativePath, errno);
+            }
+
+            std::ofstream out;
+            if (destPath) {
+                std::error_code ec;
+                fs::create_directories(destPath->parent_path(), ec);
+                out.open(*destPath, std::ios::binary | std::ios::trunc);
+                if (!out.is_open()) {
+                    return Fail(error, FileErrorCode::CreateFailed, "Cannot create " + destPath->u8string(), errno);
+                }
+            }
+
+            metrics.fileOpen.Record(MonotonicNanoseconds() - openStart);
+
+            if (entry.codec != CompressionCodec::LzDictionary) {
+                dictionary = nullptr;
+            }
+            else if (!dictionary || dictionary->bytes.empty()) {
+                return Fail(error, FileErrorCode::Corrupt, "The catalog has no dictionary for " + entry.file.relativePath);
+            }
+
+            Hash64Stream hash;
+            uint64_t total = 0;
+            auto deliver = [&](const uint8_t* data, size_t length) {
+                TimedHash(hash, data, length);
+                total += length;
+                if (destPath) {
+                    TimedWrite(out, data, length, &tracker);
+                }
+                if (content) {
+                    content->insert(content->end(), data, data + length);
+                }
+                return tracker.AddBlock(length);
+            };
+            std::vector<uint8_t> delta;
+            auto emit = [&](const uint8_t* data, size_t length) {
+                if (!deltaBase) {
+                    return deliver(data, length);
+                }
+                delta.insert(delta.end(), data, data + length);
+                return true;
+            };
+
+            if (entry.codec == CompressionCodec::None && !cipher) {
+                while (in) {
+                    size_t length = TimedRead(in, buffer.data(), buffer.size(), &tracker);
+                    if (length == 0) break;
+                    if (!emit(buffer.data(), length)) {
+                        return Fail(error, FileErrorCode::Cancelled, "Cancelled");
+                    }
+                }
+            }
+            else {
+                std::string corrupt = std::string("Corrupt ") + (cipher ? "encrypted" : "compressed") +
+                    " file in backup: " + entry.file.relativePath;
+                const char* expected = cipher ? SealedMagic : FrameMagic;
+                char magic[sizeof(FrameMagic)];
+                uint8_t fileId[8] = {};
+                if (!in.read(magic, sizeof(magic)) || std::string(magic, sizeof(magic)) != std::string(expected, sizeof(FrameMagic)) ||
+                    (cipher && !in.read(reinterpret_cast<char*>(fileId), sizeof(fileId)))) {
+                    return Fail(error, FileErrorCode::Corrupt, corrupt);
+                }
+
+                uint8_t header[8];
+                uint32_t block = 0;
+                while (in.read(reinterpret_cast<char*>(header), sizeof(header))) {
+                    uint32_t rawLength = GetLe32(header);
+                    uint32_t storedLength = GetLe32(header + 4);
+                    if (rawLength > MaxFrameBlock || storedLength > rawLength) {
+                        return Fail(error, FileErrorCode::Corrupt, corrupt);
+                    }
+                    if (buffer.size() < rawLength) buffer.resize(rawLength);
+                    if (packed.size() < storedLength) packed.resize(storedLength);
+
+                    bool raw = storedLength == rawLength;
+                    uint8_t* target = raw ? buffer.data() : packed.data();
+                    if (TimedRead(in, target, storedLength, &tracker) != storedLength) {
+                        return Fail(error, FileErrorCode::Corrupt, corrupt);
+                    }
+                    if (cipher) {
+                        uint8_t tag[CipherTagSize];
+                        uint8_t nonce[CipherNonceSize];
+                        BlockNonce(nonce, fileId, block++);
+                        if (!in.read(reinterpret_cast<char*>(tag), sizeof(tag))) {
+                            return Fail(error, FileErrorCode::Corrupt, corrupt);
+                        }
+                        PhaseTimer timer(MetricPhase::Encrypt, storedLength);
+                        if (!cipher->Open(nonce, header, sizeof(header), target, storedLength, tag)) {
+                            return Fail(error, FileErrorCode::Corrupt, "Authentication failed for " + entry.file.relativePath);
+                        }
+                    }
+                    if (!raw) {
+                        PhaseTimer timer(MetricPhase::Compress, rawLength);
+                        if (!LzDecompress(packed.data(), storedLength, buffer.data(), rawLength, dictionary)) {
+                            return Fail(error, FileErrorCode::Corrupt, corrupt);
+                        }
+                    }
+                    if (!emit(buffer.data(), rawLength)) {
+                        return Fail(error, FileErrorCode::Cancelled, "Cancelled");
+                    }
+                }
+
+                if (in.gcount() != 0) {
+                    return Fail(error, FileErrorCode::Corrupt, std::string("Truncated ") + (cipher ? "encrypted" : "compressed") +
+                        " file in backup: " + entry.file.relativePath);
+                }
+            }
+
+            if (in.bad()) {
+                return Fail(error, FileErrorCode::ReadFailed, "Failed to read " + storedPath.u8string());
+            }
+
+            if (deltaBase) {
+                bool stopped = false;
+                bool applied = ApplyDelta(deltaBase->data(), deltaBase->size(), delta.data(), delta.size(),
+                    [&](const uint8_t* data, size_t length) {
+                        stopped = !deliver(data, length);
+                        return !stopped;
+                    });
+                if (stopped) {
+                    return Fail(error, FileErrorCode::Cancelled, "Cancelled");
+                }
+                if (!applied) {
+                    return Fail(error, FileErrorCode::Corrupt, "Corrupt delta in backup: " + entry.file.relativePath);
+                }
+            }
+
+            if (destPath) {
+                out.flush();
+                if (!out.good()) {
+                    return Fail(error, FileErrorCode::WriteFailed, "Failed to write " + destPath->u8string());
+                }
+            }
+
+            if (total != entry.file.size || hash.Digest() != entry.hash) {
+                return Fail(error, FileErrorCode::ChecksumMismatch, "Checksum mismatch: " + entry.file.relativePath);
+            }
+            return true;
+        }
+
+        // The entry whose stored file holds an entry's contents
+        const CatalogEntry& StoredEntry(const BackupCatalog& catalog, const CatalogEntry& entry) {
+            return entry.sameAs >= 0 ? catalog.entries[(size_t)entry.sameAs] : entry;
+        }
+
+        // Repairs rewrite stored files in place, so they take the set's lock
+        // like a backup or compaction does, one repair at a time in this
+        // process (a second lock from the same process would be refused). A
+        // set that another job holds is left alone and the file reported.
+        ParityResult RepairWithLock(const fs::path& backupDir, const fs::path& storedPath, const fs::path& parityPath,
+            uint64_t& shards, std::string& error, IoThrottle* throttle) {
+
+            static std::mutex repairs;
+            std::lock_guard<std::mutex> guard(repairs);
+            SetLock lock;
+            std::string lockError;
+            if (!lock.Acquire(backupDir, lockError)) {
+                error = (error.empty() ? "" : error + "; ") + "not repaired: " + lockError;
+                return ParityResult::Unrepairable;
+            }
+            return RepairStoredFile(storedPath, parityPath, shards, error, throttle);
+        }
+
+        bool ExtractOrRepair(const fs::path& backupDir, const BackupCatalog& catalog, const CatalogEntry& entry,
+            const fs::path* destPath, BlockCipher* cipher, const CompressionDictionary* dictionary,
+            std::vector<uint8_t>& buffer, std::vector<uint8_t>& packed, FileProgress& tracker, FileError& error,
+            bool& repaired, std::vector<uint8_t>* content = nullptr);
+
+        // The original contents of the file 'entry' was stored as a delta against
+        bool ReadDeltaBase(const fs::path& backupDir, const BackupCatalog& catalog, const CatalogEntry& entry,
+            BlockCipher* cipher, const CompressionDictionary* dictionary, std::vector<uint8_t>& buffer,
+            std::vector<uint8_t>& packed, FileProgress& tracker, std::vector<uint8_t>& base, FileError& error) {
+
+            const CatalogEntry& baseEntry = catalog.entries[(size_t)entry.deltaOf];
+            FileProgress quiet = tracker.Quiet();
+            FileError baseError;
+            baseError.path = baseEntry.file.relativePath;
+            bool repaired = false;
+            base.clear();
+            if (ExtractOrRepair(backupDir, catalog, baseEntry, nullptr, cipher, dictionary, buffer, packed, quiet, baseError,
+                    repaired, &base)) {
+                return true;
+            }
+            return Fail(error, baseError.code, "Cannot read " + baseEntry.file.relativePath + ", which " +
+                entry.file.relativePath + " is stored against: " + baseError.message, baseError.osError);
+        }
+
+        // ExtractFile, and if the stored file turns out damaged, the same again
+        // after rebuilding it from the set's parity
+        bool ExtractOrRepair(const fs::path& backupDir, const BackupCatalog& catalog, const CatalogEntry& entry,
+            const fs::path* destPath, BlockCipher* cipher, const CompressionDictionary* dictionary,
+            std::vector<uint8_t>& buffer, std::vector<uint8_t>& packed, FileProgress& tracker, FileError& error,
+            bool& repaired, std::vector<uint8_t>* content) {
+
+            repaired = false;
+            const CatalogEntry& stored = StoredEntry(catalog, entry);
+            if (!IsSafeRelativePath(stored.file.relativePath)) {
+                error = InvalidPath(stored.file.relativePath);
+                return false;
+            }
+            std::vector<uint8_t> base;
+            const std::vector<uint8_t>* deltaBase = nullptr;
+            if (stored.deltaOf >= 0) {
+                if (!ReadDeltaBase(backupDir, catalog, stored, cipher, dictionary, buffer, packed, tracker, base, error)) {
+                    return false;
+                }
+                deltaBase = &base;
+            }
+            fs::path storedPath = EntryPath(backupDir, stored.file.relativePath);
+            if (ExtractFile(storedPath, entry, destPath, cipher, dictionary, buffer, packed, tracker, error, content,
+                    deltaBase)) {
+                return true;
+            }
+
+            bool damaged = error.code == FileErrorCode::Corrupt || error.code == FileErrorCode::ChecksumMismatch ||
+                error.code == FileErrorCode::ReadFailed || error.code == FileErrorCode::MissingFromBackup;
+            if (catalog.parityShards == 0 || !damaged) {
+                return false;
+            }
+
+            uint64_t shards = 0;
+            std::string message;
+            ParityResult result = RepairWithLock(backupDir, storedPath, ParityPath(backupDir, stored.file.relativePath),
+                shards, message, nullptr);
+            // Clean after a failed read means an entry sharing the stored file
+            // had it rebuilt meanwhile; it is read again like a repaired one
+            if (result != ParityResult::Repaired && result != ParityResult::Clean) {
+                if (result == ParityResult::Unrepairable) {
+                    error.message += " (" + message + ")";
+                }
+                return false;
+            }
+            if (result == ParityResult::Repaired) {
+                ApplyFileMetadata(storedPath, stored.file, true);
+            }
+
+            tracker.Replay();
+            if (content) {
+                content->clear();
+            }
+            FileError retry;
+            retry.path = error.path;
+            if (!ExtractFile(storedPath, entry, destPath, cipher, dictionary, buffer, packed, tracker, retry, content,
+                    deltaBase)) {
+                error = std::move(retry);
+                return false;
+            }
+            repaired = result == ParityResult::Repaired;
+            return true;
+        }
+
+        // One stored file of a scrub. With parity its shards are checked
+        // against their hashes and damage is rebuilt in place, which needs
+        // neither decoding nor the password; without, it is decoded and
+        // checked against the catalog hash.
+        bool ScrubEntry(const fs::path& backupDir, const BackupCatalog& catalog, const CatalogEntry& entry,
+            BlockCipher* cipher, const CompressionDictionary* dictionary, std::vector<uint8_t>& buffer,
+            std::vector<uint8_t>& packed, FileProgress& tracker, FileError& error, bool& repaired) {
+
+            repaired = false;
+            if (entry.sameAs >= 0) {
+                // Scrubbed with the entry that owns the stored file
+                return true;
+            }
+            fs::path storedPath = EntryPath(backupDir, entry.file.relativePath);
+            if (catalog.parityShards > 0) {
+                uint64_t shards = 0;
+                std::string message;
+                fs::path parityPath = ParityPath(backupDir, entry.file.relativePath);
+                ParityResult result = CheckStoredFile(storedPath, parityPath, message, tracker.Throttle());
+                if (result == ParityResult::Damaged) {
+                    result = RepairWithLock(backupDir, storedPath, parityPath, shards, message, tracker.Throttle());
+                }
+                if (result == ParityResult::Clean) {
+                    return true;
+                }
+                if (result == ParityResult::Repaired) {
+                    ApplyFileMetadata(storedPath, entry.file, true);
+                    repaired = true;
+                    return true;
+                }
+                if (result == ParityResult::Unrepairable) {
+                    return Fail(error, FileErrorCode::Corrupt, message);
+                }
+                // No usable parity file; fall back to decoding
+            }
+
+            if (catalog.encryption.cipher != CipherKind::None && !cipher) {
+                return Fail(error, FileErrorCode::MissingFromBackup,
+                    "No parity for " + entry.file.relativePath + ", and checking it without needs the password");
+            }
+            std::vector<uint8_t> base;
+            if (entry.deltaOf >= 0 &&
+                !ReadDeltaBase(backupDir, catalog, entry, cipher, dictionary, buffer, packed, tracker, base, error)) {
+                return false;
+            }
+            return ExtractFile(storedPath, entry, nullptr, cipher, dictionary, buffer, packed, tracker, error, nullptr,
+                entry.deltaOf >= 0 ? &base : nullptr);
+        }
+
+        // Hash of the first and last PartialHashBytes of a file, or of all of
+        // it if it is no longer than that; false if it cannot be read
+        bool HashForDuplicates(const fs::path& path, uint64_t size, bool whole, IoThrottle* throttle,
+            std::vector<uint8_t>& buffer, uint64_t& digest) {
+
+            std::ifstream in(path, std::ios::binary);
+            if (!in.is_open()) {
+                return false;
+            }
+            Hash64Stream hash;
+            auto hashRange = [&](uint64_t length) {
+                while (length > 0) {
+                    size_t length32 = (size_t)std::min<uint64_t>(length, buffer.size());
+                    size_t read = TimedRead(in, buffer.data(), length32, nullptr);
+                    if (throttle) {
+                        throttle->Read(read);
+                    }
+                    if (read != length32) {
+                        return false;
+                    }
+                    TimedHash(hash, buffer.data(), read);
+                    length -= read;
+                }
+                return true;
+            };
+
+            if (whole || size <= 2 * PartialHashBytes) {
+                if (!hashRange(size)) return false;
+            }
+            else {
+                if (!hashRange(PartialHashBytes)) return false;
+                in.seekg((std::streamoff)(size - PartialHashBytes));
+                if (!hashRange(PartialHashBytes)) return false;
+            }
+            digest = hash.Digest();
+            return true;
+        }
+
+        // For each file, the index of the first identical file before it, or
+        // -1. Candidates of the same size are told apart by the hash of their
+        // ends, and only those still alike are read whole; 'hashes' gets the
+        // full hash of every duplicate. Files that change meanwhile are caught
+        // after the copy, when the original's hash is known.
+        std::vector<int64_t> FindDuplicates(const std::vector<FileEntry>& files, const std::vector<fs::path>& paths,
+            const FileBackupOptions& options, std::vector<uint64_t>& hashes) {
+
+            std::vector<int64_t> sameAs(files.size(), -1);
+            hashes.assign(files.size(), 0);
+            IoThrottle* throttle = options.control ? &options.control->Throttle() : nullptr;
+
+            std::map<uint64_t, std::vector<size_t>> bySize;
+            for (size_t i = 0; i < files.size(); i++) {
+                if (files[i].size >= MinDuplicateSize) {
+                    bySize[files[i].size].push_back(i);
+                }
+            }
+            std::vector<std::vector<size_t>> groups;
+            for (auto& group : bySize) {
+                if (group.second.size() > 1) groups.push_back(std::move(group.second));
+            }
+
+            // Each round hashes every file of every group and splits the
+            // groups by hash, keeping the files in scan order
+            std::vector<char> readable(files.size(), 1);
+            auto refine = [&](bool whole) {
+                std::vector<size_t> pending;
+                for (const auto& group : groups) {
+                    pending.insert(pending.end(), group.begin(), group.end());
+                }
+                ForEachRun(pending.size(), options.threads, options.priority, nullptr, [&](size_t begin, size_t end) {
+                    std::vector<uint8_t> buffer(std::min<size_t>(options.blockSize, 1024 * 1024));
+                    for (size_t k = begin; k < end; k++) {
+                        size_t i = pending[k];
+                        if (!Checkpoint(options.control) ||
+                            !HashForDuplicates(paths[i], files[i].size, whole, throttle, buffer, hashes[i])) {
+                            readable[i] = 0;
+                        }
+                    }
+                });
+
+                std::vector<std::vector<size_t>> split;
+                for (const auto& group : groups) {
+                    std::map<uint64_t, std::vector<size_t>> byHash;
+                    for (size_t i : group) {
+                        if (readable[i]) byHash[hashes[i]].push_back(i);
+                    }
+                    for (auto& alike : byHash) {
+                        if (alike.second.size() > 1) split.push_back(std::move(alike.second));
+                    }
+                }
+                groups.swap(split);
+            };
+
+            refine(false);
+            // Files no longer than both ends were hashed whole already
+            std::vector<std::vector<size_t>> small;
+            for (auto it = groups.begin(); it != groups.end();) {
+                if (files[(*it)[0]].size <= 2 * PartialHashBytes) {
+                    small.push_back(std::move(*it));
+                    it = groups.erase(it);
+                }
+                else {
+                    ++it;
+                }
+            }
+            refine(true);
+            groups.insert(groups.end(), small.begin(), small.end());
+
+            for (const auto& group : groups) {
+                for (size_t k = 1; k < group.size(); k++) {
+                    sameAs[group[k]] = (int64_t)group[0];
+                }
+            }
+            return sameAs;
+        }
+
+        // Trains the dictionary for the set's small files from a sample of
+        // them spread over the set: three of every four samples train it and
+        // the fourth judges it, and it is kept only if what it saves on those,
+        // scaled to all the small files, pays for its hex in the catalog twice
+        // over. 'paths' is only filled in for small files.
+        std::vector<uint8_t> BuildDictionary(const std::vector<FileEntry>& files, const std::vector<fs::path>& paths,
+            const FileBackupOptions& options) {
+
+            std::vector<size_t> small;
+            uint64_t smallBytes = 0;
+            for (size_t i = 0; i < files.size(); i++) {
+                if (files[i].size > 0 && files[i].size < MaxDictionaryFileSize) {
+                    small.push_back(i);
+                    smallBytes += files[i].size;
+                }
+            }
+            if (small.size() < MinDictionarySamples) {
+                return std::vector<uint8_t>();
+            }
+            size_t stride = (size_t)(smallBytes / DictionarySampleBytes) + 1;
+            std::vector<size_t> picked;
+            for (size_t k = 0; k < small.size(); k += stride) {
+                picked.push_back(small[k]);
+            }
+
+            IoThrottle* throttle = options.control ? &options.control->Throttle() : nullptr;
+            std::vector<std::vector<uint8_t>> contents(picked.size());
+            ForEachRun(picked.size(), options.threads, options.priority, nullptr, [&](size_t begin, size_t end) {
+                for (size_t k = begin; k < end && Checkpoint(options.control); k++) {
+                    std::ifstream in(paths[picked[k]], std::ios::binary);
+                    std::vector<uint8_t>& content = contents[k];
+                    content.resize((size_t)files[picked[k]].size);
+                    size_t read = in.is_open() ? TimedRead(in, content.data(), content.size(), nullptr) : 0;
+                    if (throttle) {
+                        throttle->Read(read);
+                    }
+                    // A file that changed size since the scan still makes a fair sample
+                    content.resize(read);
+                }
+            });
+
+            std::vector<std::vector<uint8_t>> training;
+            std::vector<const std::vector<uint8_t>*> judging;
+            for (size_t k = 0; k < contents.size(); k++) {
+                if (contents[k].empty()) continue;
+                if (k % 4 == 3) {
+                    judging.push_back(&contents[k]);
+                }
+                else {
+                    training.push_back(std::move(contents[k]));
+                }
+            }
+            if (training.size() + judging.size() < MinDictionarySamples || !Checkpoint(options.control)) {
+                return std::vector<uint8_t>();
+            }
+
+            std::vector<uint8_t> trained = TrainDictionary(training);
+            if (trained.empty()) {
+                return trained;
+            }
+            CompressionDictionary dictionary(trained);
+            uint64_t judgedBytes = 0, plain = 0, against = 0;
+            std::vector<uint8_t> packed;
+            for (const std::vector<uint8_t>* content : judging) {
+                packed.resize(content->size());
+                size_t length = LzCompress(content->data(), content->size(), packed.data(), packed.size() - 1);
+                plain += length > 0 ? length : content->size();
+                length = LzCompress(content->data(), content->size(), packed.data(), packed.size() - 1, &dictionary);
+                against += length > 0 ? length : content->size();
+                judgedBytes += content->size();
+            }
+            if (against >= plain ||
+                (double)(plain - against) * smallBytes / judgedBytes < 4.0 * trained.size()) {
+                return std::vector<uint8_t>();
+            }
+            return trained;
+        }
+
+        // The dictionary as the catalog keeps it. In an encrypted set that is a
+        // random id, the sealed bytes and their tag, sealed like block 0 of a
+        // file with that id and with the length as the authenticated header.
+        bool SealDictionary(const std::vector<uint8_t>& dictionary, const EncryptionKey* key,
+            std::vector<uint8_t>& stored, std::string& error) {
+
+            if (!key) {
+                stored = dictionary;
+                return true;
+            }
+            BlockCipher cipher;
+            if (!cipher.Init(*key, error)) {
+                return false;
+            }
+            stored.resize(8 + dictionary.size() + CipherTagSize);
+            uint8_t* fileId = stored.data();
+            uint8_t* data = stored.data() + 8;
+            if (!RandomBytes(fileId, 8)) {
+                error = "Cannot generate a random dictionary id";
+                return false;
+            }
+            std::copy(dictionary.begin(), dictionary.end(), data);
+            uint8_t nonce[CipherNonceSize];
+            BlockNonce(nonce, fileId, 0);
+            uint8_t header[4];
+            PutLe32(header, (uint32_t)dictionary.size());
+            if (!cipher.Seal(nonce, header, sizeof(header), data, dictionary.size(), data + dictionary.size())) {
+                error = "Cannot encrypt the dictionary";
+                return false;
+            }
+            return true;
+        }
+
+        // Opens the catalog's dictionary, if it has one. Without the key of an
+        // encrypted set it stays empty: no stored file can be decoded then anyway.
+        bool OpenDictionary(const BackupCatalog& catalog, const EncryptionKey* key, CompressionDictionary& dictionary,
+            std::string& error) {
+
+            if (catalog.dictionary.empty() || (catalog.encryption.cipher != CipherKind::None && !key)) {
+                return true;
+            }
+            if (!key) {
+                dictionary = CompressionDictionary(catalog.dictionary);
+                return true;
+            }
+            if (catalog.dictionary.size() < 8 + CipherTagSize) {
+                error = "The catalog's dictionary is damaged";
+                return false;
+            }
+            std::vector<uint8_t> contents(catalog.dictionary.begin() + 8, catalog.dictionary.end() - CipherTagSize);
+            BlockCipher cipher;
+            if (!cipher.Init(*key, error)) {
+                return false;
+            }
+            uint8_t nonce[CipherNonceSize];
+            BlockNonce(nonce, catalog.dictionary.data(), 0);
+            uint8_t header[4];
+            PutLe32(header, (uint32_t)contents.size());
+            if (!cipher.Open(nonce, header, sizeof(header), contents.data(), contents.size(),
+                    catalog.dictionary.data() + catalog.dictionary.size() - CipherTagSize)) {
+                error = "The catalog's dictionary is damaged";
+                return false;
+            }
+            dictionary = CompressionDictionary(std::move(contents));
+            return true;
+        }
+
+        uint64_t CatalogBytes(const BackupCatalog& catalog) {
+            uint64_t total = 0;
+            for (const auto& entry : catalog.entries) {
+                total += entry.file.size;
+            }
+            return total;
+        }
+    }
+
+    const char* FileErrorName(FileErrorCode code) {
+        switch (code) {
+        case FileErrorCode::None: return "none";
+        case FileErrorCode::OpenFailed: return "open failed";
+        case FileErrorCode::CreateFailed: return "create failed";
+        case FileErrorCode::ReadFailed: return "read failed";
+        case FileErrorCode::WriteFailed: return "write failed";
+        case FileErrorCode::MissingFromBackup: return "missing from backup";
+        case FileErrorCode::Corrupt: return "corrupt";
+        case FileErrorCode::ChecksumMismatch: return "checksum mismatch";
+        case FileErrorCode::InvalidPath: return "invalid path";
+        case FileErrorCode::Cancelled: return "cancelled";
+        }
+        return "unknown";
+    }
+
+    std::vector<std::string> SourceFolders(const std::vector<fs::path>& sources) {
+        std::vector<std::string> folders;
+        if (sources.size() < 2) {
+            folders.resize(sources.size());
+            return folders;
+        }
+
+        for (const auto& source : sources) {
+            // "C:\" or "/" has no name of its own
+            std::string name = source.filename().u8string();
+            if (name.empty()) name = source.parent_path().filename().u8string();
+            if (name.empty()) name = "source";
+            for (char& c : name) {
+                if (c == ':' || c == '|') c = '_';
+            }
+
+            std::string folder = name;
+            for (int n = 2; std::find(folders.begin(), folders.end(), folder) != folders.end(); n++) {
+                folder = name + "_" + std::to_string(n);
+            }
+            folders.push_back(folder);
+        }
+        return folders;
+    }
+
+    int BackupFileSet(
+        const fs::path& source,
+        const fs::path& destDir,
+        const FileBackupOptions& options,
+        const BackupProgress& progress,
+        FileSetResult& result,
+        std::string& error) {
+
+        return BackupFileSources(std::vector<fs::path>{ source }, destDir, options, progress, result, error);
+    }
+
+    int BackupFileSources(
+        const std::vector<fs::path>& sources,
+        const fs::path& destDir,
+        const FileBackupOptions& options,
+        const BackupProgress& progress,
+        FileSetResult& result,
+        std::string& error) {
+
+        TraceSpan jobSpan("job", "BackupFileSet", sources.empty() ? std::string() : sources[0].u8string());
+        ProgressFinish finish(options.channel);
+        result = FileSetResult();
+        if (options.blockSize == 0 || options.blockSize > MaxFrameBlock) {
+            error = "Invalid block size";
+            return -1;
+        }
+        if (sources.empty()) {
+            error = "No sources to back up";
+            return -1;
+        }
+        if (options.parityShards > MaxParityShards) {
+            error = "At most " + std::to_string(MaxParityShards) + " parity shards are supported";
+            return -1;
+        }
+
+        if (progress) {
+            progress(0, "Scanning files...");
+        }
+        SetPhase(options.channel, ProgressPhase::Scanning);
+
+        // All sources are scanned into one list. Entries of a set of several
+        // carry their source's folder, and 'origins' says where each came from.
+        struct Origin {
+            fs::path root;
+            size_t prefixLength;    // Folder plus '/' to drop again for the source path
+        };
+        std::vector<std::string> folders = SourceFolders(sources);
+        std::vector<Origin> origins;
+        std::vector<FileEntry> files;
+        std::vector<uint32_t> fileOrigin;
+        uint64_t totalBytes = 0;
+        {
+            PhaseTimer timer(MetricPhase::Scan);
+            for (size_t s = 0; s < sources.size(); s++) {
+                std::vector<FileEntry> found;
+                uint64_t bytes = 0;
+                if (!ScanFiles(sources[s], found, bytes, error)) {
+                    return -2;
+                }
+
+                std::string prefix = folders[s].empty() ? std::string() : folders[s] + "/";
+                origins.push_back(Origin{ ScanRoot(sources[s]), prefix.size() });
+                for (auto& file : found) {
+                    file.relativePath.insert(0, prefix);
+                    files.push_back(std::move(file));
+                    fileOrigin.push_back((uint32_t)s);
+                }
+                totalBytes += bytes;
+            }
+            timer.SetBytes(totalBytes);
+        }
+        if (files.empty()) {
+            error = "No files to backup";
+            return -3;
+        }
+
+        // Parity files live under their own folder, which a source must not bring along
+        if (options.parityShards > 0) {
+            std::string reserved = std::string(ParityDirName) + "/";
+            for (const auto& file : files) {
+                if (file.relativePath.compare(0, reserved.size(), reserved) == 0) {
+                    error = "Cannot add parity: the source has a folder named " + std::string(ParityDirName);
+                    return -3;
+                }
+            }
+        }
+
+        // Files grouped by the disk they are on, each group in scan order
+        std::vector<uint64_t> deviceIds;
+        std::vector<std::vector<size_t>> devices;
+        {
+            std::vector<size_t> sourceDevice;
+            for (const auto& source : sources) {
+                uint64_t id = DeviceId(source);
+                size_t group = std::find(deviceIds.begin(), deviceIds.end(), id) - deviceIds.begin();
+                if (group == deviceIds.size()) {
+                    deviceIds.push_back(id);
+                    devices.emplace_back();
+                }
+                sourceDevice.push_back(group);
+            }
+            for (size_t i = 0; i < files.size(); i++) {
+                devices[sourceDevice[fileOrigin[i]]].push_back(i);
+            }
+        }
+
+        std::error_code ec;
+        fs::create_directories(destDir, ec);
+        if (ec) {
+            error = "Cannot create " + destDir.u8string() + ": " + ec.message();
+            return -4;
+        }
+        SetLock lock;
+        if (!lock.Acquire(destDir, error)) {
+            return -4;
+        }
+
+        auto sourcePathOf = [&](size_t i) {
+            const Origin& origin = origins[fileOrigin[i]];
+            return EntryPath(origin.root, files[i].relativePath.substr(origin.prefixLength));
+        };
+        std::vector<int64_t> sameAs(files.size(), -1);
+        std::vector<uint64_t> duplicateHashes;
+        if (options.storeDuplicatesOnce) {
+            if (progress) {
+                progress(2, "Looking for identical files...");
+            }
+            std::vector<fs::path> paths(files.size());
+            for (size_t i = 0; i < files.size(); i++) {
+                if (files[i].size >= MinDuplicateSize) paths[i] = sourcePathOf(i);
+            }
+            sameAs = FindDuplicates(files, paths, options, duplicateHashes);
+        }
+        std::vector<uint8_t> trained;
+        if (options.codec != CompressionCodec::None && options.dictionaryForSmallFiles) {
+            if (progress) {
+                progress(3, "Training a dictionary for small files...");
+            }
+            std::vector<fs::path> paths(files.size());
+            for (size_t i = 0; i < files.size(); i++) {
+                if (files[i].size < MaxDictionaryFileSize) paths[i] = sourcePathOf(i);
+            }
+            trained = BuildDictionary(files, paths, options);
+        }
+
+        if (progress) {
+            progress(5, "Backing up " + std::to_string(files.size()) + " files (" +
+                std::to_string(totalBytes / (1024 * 1024)) + " MB)...");
+        }
+        if (options.channel) {
+            options.channel->SetTotals(files.size(), totalBytes);
+            options.channel->SetPhase(ProgressPhase::Copying);
+        }
+
+        BackupCatalog catalog;
+        for (const auto& source : sources) {
+            catalog.sources.push_back(source.u8string());
+        }
+        catalog.platform = CurrentPlatform();
+        catalog.created = (int64_t)std::time(nullptr);
+        catalog.parityShards = options.parityShards;
+
+        EncryptionKey key;
+        const EncryptionKey* setKey = nullptr;
+        if (!options.password.empty()) {
+            CipherKind cipher = options.cipher == CipherKind::None ? PreferredCipher() : options.cipher;
+            if (!CreateSetKey(options.password, cipher, catalog.encryption, key, error)) {
+                return -6;
+            }
+            setKey = &key;
+        }
+
+        CompressionDictionary dictionary;
+        const CompressionDictionary* smallFiles = nullptr;
+        if (!trained.empty()) {
+            if (!SealDictionary(trained, setKey, catalog.dictionary, error)) {
+                return -6;
+            }
+            dictionary = CompressionDictionary(std::move(trained));
+            smallFiles = &dictionary;
+        }
+
+        ProgressTracker tracker(progress, options.channel, options.control, 5, 90, totalBytes);
+
+        // Entries are filled in by index so the catalog keeps scan order
+        std::vector<CatalogEntry> entries(files.size());
+        std::vector<char> stored(files.size(), 0);
+        std::mutex resultLock;
+        std::atomic<bool> cancelled{ false };
+
+        // Sketches of the files stored whole so far, which later look-alikes
+        // may be stored against
+        SimilarityIndex similarFiles;
+        std::mutex similarLock;
+
+        // One compression effort for the whole job, since every disk's files
+        // are compressed on the same CPUs
+        AdaptiveCompression compressionEffort;
+        AdaptiveCompression* compression =
+            options.codec != CompressionCodec::None && options.adaptiveCompression ? &compressionEffort : nullptr;
+
+        // Every disk gets its own file threads and its own adaptive limit, since
+        // one disk queueing says nothing about another
+        auto backupDevice = [&](const std::vector<size_t>& indices) {
+            AdaptiveConcurrency concurrency(1, options.threads, InitialFileThreads);
+            AdaptiveConcurrency* adaptive = options.adaptive ? &concurrency : nullptr;
+
+            ForEachRun(indices.size(), options.threads, options.priority, adaptive, [&](size_t begin, size_t end) {
+                std::vector<uint8_t> buffer(options.blockSize);
+                std::vector<uint8_t> packed(options.blockSize);
+                std::unique_ptr<BlockCipher> cipher = ThreadCipher(setKey);
+                DirectorySpans directories;
+                std::vector<uint8_t> content, baseContent, delta;
+
+                // A delta candidate is stored whole and sketched on the way.
+                // If an earlier file is alike, both are read again and, when
+                // the delta against it saves at least a quarter, the delta
+                // replaces the stored copy; otherwise the file may serve as a
+                // base itself.
+                auto storeSimilar = [&](size_t i, const fs::path& sourcePath, const fs::path& storedPath,
+                    CatalogEntry& entry, FileProgress& fileProgress, FileError& fileError) {
+
+                    SketchBuilder builder;
+                    if (!StoreWithParity(sourcePath, storedPath, destDir, options, cipher.get(), nullptr, buffer, packed,
+                            entry, fileProgress, fileError, nullptr, &builder)) {
+                        return false;
+                    }
+                    SimilaritySketch sketch = builder.Finish();
+                    size_t base = 0;
+                    {
+                        std::lock_guard<std::mutex> guard(similarLock);
+                        if (!similarFiles.Find(sketch, base)) {
+                            similarFiles.Add(sketch, i);
+                            return true;
+                        }
+                    }
+
+                    // Both are read from the source again, so both must still be what was stored
+                    FileProgress quiet = fileProgress.Quiet();
+                    FileError readError;
+                    if (!ReadSource(sourcePath, content, quiet, readError) || ContentHash(content) != entry.hash ||
+                        !ReadSource(sourcePathOf(base), baseContent, quiet, readError) ||
+                        ContentHash(baseContent) != entries[base].hash) {
+                        return !tracker.Cancelled();
+                    }
+                    {
+                        PhaseTimer timer(MetricPhase::Compress, content.size());
+                        EncodeDelta(baseContent.data(), baseContent.size(), content.data(), content.size(), delta);
+                    }
+                    if (delta.size() > content.size() / 4 * 3) {
+                        std::lock_guard<std::mutex> guard(similarLock);
+                        similarFiles.Add(sketch, i);
+                        return true;
+                    }
+
+                    CatalogEntry whole = entry;
+                    if (!StoreWithParity(sourcePath, storedPath, destDir, options, cipher.get(), nullptr, buffer, packed,
+                            entry, quiet, fileError, &delta)) {
+                        return false;
+                    }
+                    entry.file.size = whole.file.size;
+                    entry.hash = whole.hash;
+                    entry.deltaOf = (int64_t)base;
+                    return true;
+                };
+
+                for (size_t k = begin; k < end; k++) {
+                    size_t i = indices[k];
+                    const FileEntry& file = files[i];
+                    if (sameAs[i] >= 0) {
+                        continue;
+                    }
+                    if (cancelled || !tracker.Continue()) {
+                        cancelled = true;
+                        return;
+                    }
+                    directories.Enter(file.relativePath);
+                    TraceSpan fileSpan("file", "backup", file.relativePath);
+                    CatalogEntry& entry = entries[i];
+                    entry.file = file;
+                    fs::path sourcePath = sourcePathOf(i);
+                    fs::path storedPath = EntryPath(destDir, file.relativePath);
+
+                    FileError fileError;
+                    fileError.path = file.relativePath;
+                    FileProgress fileProgress(tracker, adaptive, compression);
+                    bool similar = options.storeSimilarAsDelta && file.size >= MinDeltaSize && file.size <= MaxDeltaSize;
+                    const CompressionDictionary* dictionary = file.size < MaxDictionaryFileSize ? smallFiles : nullptr;
+                    if (similar ? !storeSimilar(i, sourcePath, storedPath, entry, fileProgress, fileError) :
+                        !StoreWithParity(sourcePath, storedPath, destDir, options, cipher.get(), dictionary, buffer, packed,
+                            entry, fileProgress, fileError)) {
+                        if (tracker.Cancelled()) {
+                            cancelled = true;
+                            return;
+                        }
+                        EngineMetrics::Global().CountFile(false);
+                        std::lock_guard<std::mutex> guard(resultLock);
+                        NoteFailure(result, std::move(fileError));
+                        tracker.Advance(file.size, fileProgress.Counted(), false, [&] { return "Skipped " + file.relativePath; });
+                        continue;
+                    }
+
+                    // The stored copy keeps the original timestamp and attributes
+                    {
+                        PhaseTimer timer(MetricPhase::Metadata);
+                        ApplyFileMetadata(storedPath, entry.file, true);
+                    }
+                    EngineMetrics::Global().CountFile(true);
+                    stored[i] = 1;
+
+                    std::lock_guard<std::mutex> guard(resultLock);
+                    result.files++;
+                    result.bytes += entry.file.size;
+                    result.storedBytes += entry.storedSize;
+                    result.deltas += entry.deltaOf >= 0 ? 1 : 0;
+                    result.dictionaryFiles += entry.codec == CompressionCodec::LzDictionary ? 1 : 0;
+                    tracker.Advance(file.size, fileProgress.Counted(), true, [&] {
+                        return "Backed up " + std::to_string(result.files) + " of " + std::to_string(files.size()) + " files";
+                    });
+                }
+            });
+        };
+
+        if (devices.size() == 1) {
+            backupDevice(devices[0]);
+        }
+        else {
+            // Disks are read at the same time; this thread takes one of them
+            TaskGroup group(devices.size() - 1, options.priority);
+            for (const auto& indices : devices) {
+                group.Run([&backupDevice, &indices] { backupDevice(indices); });
+            }
+            group.Wait();
+        }
+
+        // A duplicate shares its original's stored file if that was copied
+        // with the contents the duplicate was hashed against; any other is
+        // copied on its own after all
+        std::vector<size_t> unmatched;
+        for (size_t i = 0; i < files.size() && !cancelled; i++) {
+            if (sameAs[i] < 0) {
+                continue;
+            }
+            size_t original = (size_t)sameAs[i];
+            if (!stored[original] || entries[original].hash != duplicateHashes[i]) {
+                sameAs[i] = -1;
+                unmatched.push_back(i);
+                continue;
+            }
+            CatalogEntry& entry = entries[i];
+            entry.file = files[i];
+            entry.hash = duplicateHashes[i];
+            entry.codec = entries[original].codec;
+            stored[i] = 1;
+            result.files++;
+            result.bytes += entry.file.size;
+            result.duplicates++;
+            tracker.Advance(entry.file.size, 0, true, [&] {
+                return "Backed up " + std::to_string(result.files) + " of " + std::to_string(files.size()) + " files";
+            });
+        }
+        if (!unmatched.empty() && !cancelled) {
+            backupDevice(unmatched);
+        }
+
+        if (cancelled) {
+            error = "Job cancelled";
+            return JobCancelledResult;
+        }
+        if (compression) {
+            result.rawBlocks = compression->Blocks(BlockEffort::Raw);
+            result.strongBlocks = compression->Blocks(BlockEffort::Strong);
+        }
+
+        // References become catalog indices; a delta's base may come later in the list
+        std::vector<int64_t> position(entries.size(), -1);
+        int64_t next = 0;
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (stored[i]) {
+                position[i] = next++;
+            }
+        }
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (!stored[i]) {
+                continue;
+            }
+            if (sameAs[i] >= 0) {
+                entries[i].sameAs = position[(size_t)sameAs[i]];
+            }
+            if (entries[i].deltaOf >= 0) {
+                entries[i].deltaOf = position[(size_t)entries[i].deltaOf];
+            }
+            catalog.entries.push_back(std::move(entries[i]));
+        }
+
+        if (progress) {
+            progress(95, "Saving backup catalog...");
+        }
+        SetPhase(options.channel, ProgressPhase::Finalizing);
+
+        {
+            PhaseTimer timer(MetricPhase::Metadata);
+            if (!SaveCatalog(destDir, catalog, error)) {
+                return -5;
+            }
+        }
+
+        if (progress) {
+            progress(100, "Backed up " + std::to_string(result.files) + " files (" +
+                std::to_string(result.bytes / (1024 * 1024)) + " MB, " +
+                std::to_string(result.storedBytes / (1024 * 1024)) + " MB stored" +
+                (result.duplicates > 0 ? ", " + std::to_string(result.duplicates) + " duplicates stored once" : "") +
+                (result.deltas > 0 ? ", " + std::to_string(result.deltas) + " stored as deltas" : "") + ")");
+        }
+        finish.Succeeded();
+        return 0;
+    }
+
+    int VerifyFileSet(
+        const fs::path& backupDir,
+        const FileVerifyOptions& options,
+        const BackupProgress& progress,
+        FileSetResult& result,
+        std::string& error) {
+
+        TraceSpan jobSpan("job", "VerifyFileSet", backupDir.u8string());
+        ProgressChannel* channel = options.channel;
+        ProgressFinish finish(channel);
+        result = FileSetResult();
+
+        BackupCatalog catalog;
+        {
+            PhaseTimer timer(MetricPhase::Metadata);
+            if (!LoadCatalog(backupDir, catalog, error)) {
+                return -2;
+            }
+        }
+
+        EncryptionKey key;
+        const EncryptionKey* setKey = nullptr;
+        if (catalog.encryption.cipher != CipherKind::None) {
+            if (!OpenSetKey(options.password, catalog.encryption, key, error)) {
+                return -5;
+            }
+            setKey = &key;
+        }
+
+        CompressionDictionary dictionary;
+        if (!OpenDictionary(catalog, setKey, dictionary, error)) {
+            return -2;
+        }
+
+        if (progress) {
+            progress(0, "Verifying " + std::to_string(catalog.entries.size()) + " files...");
+        }
+        if (channel) {
+            channel->SetTotals(catalog.entries.size(), CatalogBytes(catalog));
+            channel->SetPhase(ProgressPhase::Verifying);
+        }
+
+        AdaptiveConcurrency concurrency(1, options.threads, InitialFileThreads);
+        AdaptiveConcurrency* adaptive = options.adaptive ? &concurrency : nullptr;
+        ProgressTracker tracker(progress, channel, options.control, 0, 100, CatalogBytes(catalog));
+        std::mutex resultLock;
+        std::atomic<bool> cancelled{ false };
+
+        ForEachRun(catalog.entries.size(), options.threads, options.priority, adaptive, [&](size_t begin, size_t end) {
+            std::vector<uint8_t> buffer(1024 * 1024);
+            std::vector<uint8_t> packed(1024 * 1024);
+            std::unique_ptr<BlockCipher> cipher = ThreadCipher(setKey);
+            DirectorySpans directories;
+
+            for (size_t i = begin; i < end; i++) {
+                const CatalogEntry& entry = catalog.entries[i];
+                if (cancelled || !tracker.Continue()) {
+                    cancelled = true;
+                    return;
+                }
+                directories.Enter(entry.file.relativePath);
+                TraceSpan fileSpan("file", "verify", entry.file.relativePath);
+                FileError fileError = InvalidPath(entry.file.relativePath);
+                FileProgress fileProgress(tracker, adaptive);
+                bool repaired = false;
+                bool verified = IsSafeRelativePath(entry.file.relativePath) &&
+                    ExtractOrRepair(backupDir, catalog, entry, nullptr, cipher.get(), &dictionary, buffer, packed,
+                        fileProgress, fileError, repaired);
+                if (!verified && tracker.Cancelled()) {
+                    cancelled = true;
+                    return;
+                }
+                EngineMetrics::Global().CountFile(verified);
+
+                std::lock_guard<std::mutex> guard(resultLock);
+                if (!verified) {
+                    NoteFailure(result, std::move(fileError));
+                }
+                else {
+                    result.files++;
+                    result.bytes += entry.file.size;
+                    result.storedBytes += entry.storedSize;
+                    result.repaired += repaired ? 1 : 0;
+                }
+                tracker.Advance(entry.file.size, fileProgress.Counted(), verified, [&] {
+                    return "Verified " + std::to_string(result.files) + " of " + std::to_string(catalog.entries.size()) + " files";
+                });
+            }
+        });
+
+        if (cancelled) {
+            error = "Job cancelled";
+            return JobCancelledResult;
+        }
+
+        if (result.failed > 0) {
+            error = result.firstFailure + " (" + std::to_string(result.failed) + " files failed verification)";
+            return -3;
+        }
+
+        if (progress) {
+            progress(100, "Verified " + std::to_string(result.files) + " files" +
+                (result.repaired > 0 ? " (" + std::to_string(result.repaired) + " repaired from parity)" : ""));
+        }
+        finish.Succeeded();
+        return 0;
+    }
+
+    int ScrubFileSet(
+        const fs::path& backupDir,
+        const FileScrubOptions& options,
+        const BackupProgress& progress,
+        FileSetResult& result,
+        std::string& error) {
+
+        TraceSpan jobSpan("job", "ScrubFileSet", backupDir.u8string());
+        ProgressChannel* channel = options.channel;
+        ProgressFinish finish(channel);
+        result = FileSetResult();
+
+        BackupCatalog catalog;
+        {
+            PhaseTimer timer(MetricPhase::Metadata);
+            if (!LoadCatalog(backupDir, catalog, error)) {
+                return -2;
+            }
+        }
+
+        // Parity checks need no key, so a set with parity is scrubbed without
+        // the password unless one is given for files whose parity is gone
+        EncryptionKey key;
+        const EncryptionKey* setKey = nullptr;
+        if (catalog.encryption.cipher != CipherKind::None &&
+            (catalog.parityShards == 0 || !options.password.empty())) {
+            if (!OpenSetKey(options.password, catalog.encryption, key, error)) {
+                return -5;
+            }
+            setKey = &key;
+        }
+
+        CompressionDictionary dictionary;
+        if (!OpenDictionary(catalog, setKey, dictionary, error)) {
+            return -2;
+        }
+
+        JobControl ownControl;
+        JobControl* control = options.control ? options.control : &ownControl;
+        if (options.bytesPerSecond > 0) {
+            IoThrottle& throttle = control->Throttle();
+            throttle.SetLimits(options.bytesPerSecond, throttle.WriteLimit(), throttle.OperationLimit());
+        }
+
+        // Everything runs on this thread: a scrub is meant to be slow and
+        // out of the way, not fast
+        IdleIoScope idle(options.idleIo);
+
+        // A catalog that was rewritten since the position was saved starts over
+        ScrubState position;
+        if (!LoadScrubState(backupDir, catalog, position) || position.next >= catalog.entries.size()) {
+            position.next = 0;
+        }
+        if (position.passStarted == 0) {
+            position.passStarted = (int64_t)std::time(nullptr);
+        }
+
+        // A set on read-only storage is still scrubbed, just from the start each time
+        std::string saveError;
+        auto savePosition = [&] { SaveScrubState(backupDir, catalog, position, saveError); };
+
+        std::vector<uint8_t> buffer(1024 * 1024);
+        std::vector<uint8_t> packed(1024 * 1024);
+        std::unique_ptr<BlockCipher> cipher = ThreadCipher(setKey);
+        DirectorySpans directories;
+        uint64_t budgetUsed = 0;
+        bool budgetSpent = false;
+
+        while (!budgetSpent && !catalog.entries.empty()) {
+            uint64_t remainingBytes = 0;
+            for (size_t i = (size_t)position.next; i < catalog.entries.size(); i++) {
+                remainingBytes += catalog.entries[i].file.size;
+            }
+            size_t remainingFiles = catalog.entries.size() - (size_t)position.next;
+            if (progress) {
+                progress(0, (position.next > 0 ? "Resuming scrub pass " : "Scrub pass ") + std::to_string(position.pass) +
+                    ": " + std::to_string(remainingFiles) + " files to check...");
+            }
+            if (channel) {
+                channel->SetTotals(remainingFiles, remainingBytes);
+                channel->SetPhase(ProgressPhase::Verifying);
+            }
+
+            ProgressTracker tracker(progress, channel, control, 0, 100, remainingBytes);
+            uint64_t lastSave = MonotonicNanoseconds();
+            for (; position.next < catalog.entries.size(); position.next++) {
+                const CatalogEntry& entry = catalog.entries[(size_t)position.next];
+                if (options.budgetBytes > 0 && budgetUsed >= options.budgetBytes) {
+                    budgetSpent = true;
+                    break;
+                }
+                if (!tracker.Continue()) {
+                    savePosition();
+                    error = "Job cancelled";
+                    return JobCancelledResult;
+                }
+                if (MonotonicNanoseconds() - lastSave >= ScrubSaveIntervalNanoseconds) {
+                    savePosition();
+                    lastSave = MonotonicNanoseconds();
+                }
+                directories.Enter(entry.file.relativePath);
+                TraceSpan fileSpan("file", "scrub", entry.file.relativePath);
+                FileError fileError = InvalidPath(entry.file.relativePath);
+                FileProgress fileProgress(tracker, nullptr);
+                bool repaired = false;
+                bool clean = IsSafeRelativePath(entry.file.relativePath) &&
+                    ScrubEntry(backupDir, catalog, entry, cipher.get(), &dictionary, buffer, packed, fileProgress, fileError,
+                        repaired);
+                if (!clean && tracker.Cancelled()) {
+                    savePosition();
+                    error = "Job cancelled";
+                    return JobCancelledResult;
+                }
+                EngineMetrics::Global().CountFile(clean);
+                budgetUsed += entry.storedSize;
+
+                if (!clean) {
+                    NoteFailure(result, std::move(fileError));
+                }
+                else {
+                    result.files++;
+                    result.bytes += entry.file.size;
+                    result.storedBytes += entry.storedSize;
+                    result.repaired += repaired ? 1 : 0;
+                }
+                tracker.Advance(entry.file.size, fileProgress.Counted(), clean, [&] {
+                    return "Scrubbed " + std::to_string(result.files + result.failed) + " files (pass " +
+                        std::to_string(position.pass) + ")";
+                });
+            }
+
+            if (position.next == catalog.entries.size()) {
+                result.passes++;
+                position.lastCompleted = (int64_t)std::time(nullptr);
+                position.passStarted = position.lastCompleted;
+                position.pass++;
+                position.next = 0;
+            }
+            savePosition();
+            if (!options.continuous) {
+                break;
+            }
+        }
+
+        if (result.failed > 0) {
+            error = result.firstFailure + " (" + std::to_string(result.failed) + " files damaged beyond repair)";
+            return -3;
+        }
+
+        if (progress) {
+            progress(100, "Scrubbed " + std::to_string(result.files) + " files" +
+                (result.repaired > 0 ? " (" + std::to_string(result.repaired) + " repaired from parity)" : "") +
+                (budgetSpent ? ", stopping at the read budget" : ""));
+        }
+        finish.Succeeded();
+        return 0;
+    }
+
+    int CompactFileSet(
+        const fs::path& backupDir,
+        const FileCompactOptions& options,
+        const BackupProgress& progress,
+        FileSetResult& result,
+        std::string& error) {
+
+        TraceSpan jobSpan("job", "CompactFileSet", backupDir.u8string());
+        result = FileSetResult();
+        if (!HasCatalog(backupDir)) {
+            error = "No backup catalog in " + backupDir.u8string();
+            return -2;
+        }
+        SetLock lock;
+        if (!lock.Acquire(backupDir, error)) {
+            return -1;
+        }
+        BackupCatalog catalog;
+        if (!LoadCatalog(backupDir, catalog, error)) {
+            return -2;
+        }
+
+        if (progress) {
+            progress(0, "Looking for files the catalog no longer lists...");
+        }
+
+        std::unordered_set<std::string> live;
+        for (const auto& entry : catalog.entries) {
+            if (entry.sameAs >= 0) {
+                continue;
+            }
+            live.insert(LiveKey(entry.file.relativePath));
+            if (catalog.parityShards > 0) {
+                live.insert(LiveKey(std::string(ParityDirName) + "/" + entry.file.relativePath));
+            }
+        }
+
+        struct DeadFile {
+            std::string relativePath;
+            uint64_t size;
+        };
+        std::vector<DeadFile> dead;
+        uint64_t deadBytes = 0;
+        std::error_code ec;
+        for (fs::recursive_directory_iterator it(backupDir, ec), end; !ec && it != end; it.increment(ec)) {
+            std::error_code typeError;
+            if (it->is_symlink(typeError) || !it->is_regular_file(typeError)) {
+                continue;
+            }
+            std::string relativePath = it->path().lexically_relative(backupDir).generic_u8string();
+            if (live.count(LiveKey(relativePath))) {
+                continue;
+            }
+            // The set's own backup_* files sit at the top; of those only temp
+            // files left by a crash are dead
+            bool ownFile = relativePath.find('/') == std::string::npos && relativePath.compare(0, 7, "backup_") == 0;
+            if (ownFile && (relativePath.size() < 4 || relativePath.compare(relativePath.size() - 4, 4, ".tmp") != 0)) {
+                continue;
+            }
+            std::error_code sizeError;
+            uint64_t size = it->file_size(sizeError);
+            dead.push_back(DeadFile{ relativePath, sizeError ? 0 : size });
+            deadBytes += dead.back().size;
+        }
+        if (ec) {
+            error = "Cannot list " + backupDir.u8string() + ": " + ec.message();
+            return -2;
+        }
+
+        // Folder by folder, so each run leaves whole folders done
+        std::sort(dead.begin(), dead.end(), [](const DeadFile& a, const DeadFile& b) {
+            return a.relativePath < b.relativePath;
+        });
+        uint64_t target = options.budgetBytes > 0 ? std::min(options.budgetBytes, deadBytes) : deadBytes;
+
+        for (size_t i = 0; i < dead.size(); i++) {
+            if (options.budgetBytes > 0 && result.storedBytes >= options.budgetBytes) {
+                result.skipped = dead.size() - i;
+                break;
+            }
+            if (!Checkpoint(options.control)) {
+                error = "Job cancelled";
+                return JobCancelledResult;
+            }
+
+            const DeadFile& file = dead[i];
+            if (!options.dryRun) {
+                TraceSpan fileSpan("file", "compact", file.relativePath);
+                fs::path relativePath = fs::u8path(file.relativePath);
+                std::error_code removeError;
+                fs::remove(backupDir / relativePath, removeError);
+                if (removeError) {
+                    FileError fileError;
+                    fileError.path = file.relativePath;
+                    Fail(fileError, FileErrorCode::WriteFailed, "Cannot delete " + file.relativePath + ": " +
+                        removeError.message(), removeError.value());
+                    NoteFailure(result, std::move(fileError));
+                    continue;
+                }
+                // Folders the deletion emptied go with it
+                for (fs::path folder = relativePath.parent_path(); !folder.empty(); folder = folder.parent_path()) {
+                    std::error_code folderError;
+                    if (!fs::is_empty(backupDir / folder, folderError) || folderError ||
+                        !fs::remove(backupDir / folder, folderError)) {
+                        break;
+                    }
+                }
+            }
+
+            result.files++;
+            result.storedBytes += file.size;
+            if (progress) {
+                progress(target > 0 ? (int)(std::min(result.storedBytes, target) * 100 / target) : 100,
+                    (options.dryRun ? "Would delete " : "Deleted ") + file.relativePath);
+            }
+        }
+
+        if (result.failed > 0) {
+            error = result.firstFailure + " (" + std::to_string(result.failed) + " files not deleted)";
+            return -3;
+        }
+
+        if (progress) {
+            progress(100, (options.dryRun ? "Would reclaim " : "Reclaimed ") +
+                std::to_string(result.storedBytes / (1024 * 1024)) + " MB in " + std::to_string(result.files) + " files" +
+                (result.skipped > 0 ? ", " + std::to_string(result.skipped) + " left for the next run" : ""));
+        }
+        return 0;
+    }
+
+    int RestoreFileSet(
+        const fs::path& backupDir,
+        const fs::path& destDir,
+        const FileRestoreOptions& options,
+        const BackupProgress& progress,
+        FileSetResult& result,
+        std::string& error) {
+
+        TraceSpan jobSpan("job", "RestoreFileSet", backupDir.u8string());
+        ProgressFinish finish(options.channel);
+        result = FileSetResult();
+
+        BackupCatalog catalog;
+        {
+            PhaseTimer timer(MetricPhase::Metadata);
+            if (!LoadCatalog(backupDir, catalog, error)) {
+                return -2;
+            }
+        }
+
+        EncryptionKey key;
+        const EncryptionKey* setKey = nullptr;
+        if (catalog.encryption.cipher != CipherKind::None) {
+            if (!OpenSetKey(options.password, catalog.encryption, key, error)) {
+                return -5;
+            }
+            setKey = &key;
+        }
+
+        CompressionDictionary dictionary;
+        if (!OpenDictionary(catalog, setKey, dictionary, error)) {
+            return -2;
+        }
+
+        std::error_code ec;
+        fs::create_directories(destDir, ec);
+        if (ec) {
+            error = "Cannot create " + destDir.u8string() + ": " + ec.message();
+            return -4;
+        }
+
+        if (progress) {
+            progress(0, "Restoring " + std::to_string(catalog.entries.size()) + " files...");
+        }
+        if (options.channel) {
+            options.channel->SetTotals(catalog.entries.size(), CatalogBytes(catalog));
+            options.channel->SetPhase(ProgressPhase::Restoring);
+        }
+
+        // Windows attribute bits mean nothing as POSIX permissions and vice versa
+        bool applyAttributes = catalog.platform == CurrentPlatform();
+
+        AdaptiveConcurrency concurrency(1, options.threads, InitialFileThreads);
+        AdaptiveConcurrency* adaptive = options.adaptive ? &concurrency : nullptr;
+        ProgressTracker tracker(progress, options.channel, options.control, 0, 100, CatalogBytes(catalog));
+        std::mutex resultLock;
+        std::atomic<bool> cancelled{ false };
+        auto message = [&] {
+            return "Restored " + std::to_string(result.files) + " of " + std::to_string(catalog.entries.size()) + " files";
+        };
+
+        ForEachRun(catalog.entries.size(), options.threads, options.priority, adaptive, [&](size_t begin, size_t end) {
+            std::vector<uint8_t> buffer(1024 * 1024);
+            std::vector<uint8_t> packed(1024 * 1024);
+            std::unique_ptr<BlockCipher> cipher = ThreadCipher(setKey);
+            DirectorySpans directories;
+
+            for (size_t i = begin; i < end; i++) {
+                const CatalogEntry& entry = catalog.entries[i];
+                if (cancelled || !tracker.Continue()) {
+                    cancelled = true;
+                    return;
+                }
+                directories.Enter(entry.file.relativePath);
+                TraceSpan fileSpan("file", "restore", entry.file.relativePath);
+
+                if (!IsSafeRelativePath(entry.file.relativePath)) {
+                    std::lock_guard<std::mutex> guard(resultLock);
+                    NoteFailure(result, InvalidPath(entry.file.relativePath));
+                    tracker.Advance(entry.file.size, 0, false, message);
+                    continue;
+                }
+
+                std::error_code existsError;
+                fs::path destPath = EntryPath(destDir, entry.file.relativePath);
+                if (!options.overwriteExisting && fs::exists(destPath, existsError)) {
+                    std::lock_guard<std::mutex> guard(resultLock);
+                    result.skipped++;
+                    tracker.Advance(entry.file.size, 0, true, message);
+                    continue;
+                }
+
+                FileError fileError;
+                fileError.path = entry.file.relativePath;
+                FileProgress fileProgress(tracker, adaptive);
+                bool repaired = false;
+                bool restored = ExtractOrRepair(backupDir, catalog, entry, &destPath, cipher.get(), &dictionary,
+                    buffer, packed, fileProgress, fileError, repaired);
+                if (!restored && tracker.Cancelled()) {
+                    cancelled = true;
+                    return;
+                }
+                if (restored) {
+                    PhaseTimer timer(MetricPhase::Metadata);
+                    ApplyFileMetadata(destPath, entry.file, applyAttributes);
+                }
+                EngineMetrics::Global().CountFile(restored);
+
+                std::lock_guard<std::mutex> guard(resultLock);
+                if (!restored) {
+                    NoteFailure(result, std::move(fileError));
+                }
+                else {
+                    result.files++;
+                    result.bytes += entry.file.size;
+                    result.repaired += repaired ? 1 : 0;
+                }
+                tracker.Advance(entry.file.size, fileProgress.Counted(), restored, message);
+            }
+        });
+
+        if (cancelled) {
+            error = "Job cancelled";
+            return JobCancelledResult;
+        }
+
+        if (result.failed > 0) {
+            error = result.firstFailure + " (" + std::to_string(result.failed) + " files failed)";
+            return -3;
+        }
+
+        if (progress) {
+            progress(100, "Restore completed! Restored " + std::to_string(result.files) + " files" +
+                (result.skipped > 0 ? " (" + std::to_string(result.skipped) + " existing files kept)" : "") +
+                (result.repaired > 0 ? " (" + std::to_string(result.repaired) + " repaired from parity)" : ""));
+        }
+        finish.Succeeded();
+        return 0;
+    }
+}
@@ -0,0 +1,243 @@
+// FileBackup.h - Portable file backup, verification and restore
+//
+// A file backup set mirrors the source tree under the backup directory plus a
+// backup_catalog.dat (see Catalog.h). Uncompressed files are plain copies, so
+// older tools can still read them. Compressed files are framed blocks:
+//   "BKZ1", then per block: u32 rawLength, u32 storedLength, data
+// where storedLength == rawLength means the block is stored raw. Each block
+// of a compressed set gets its own effort (AdaptiveCompression, see
+// Compression.h), all in the same Lz layout. Files of an
+// encrypted set (Encryption.h) are always framed, with a sealed payload:
+//   "BKE1", u64 fileId, then per block: u32 rawLength, u32 storedLength,
+//   ciphertext, 16-byte tag
+// The nonce is fileId followed by the u32 block index, and the two lengths
+// are authenticated with the block.
+//
+// Identical files are found before copying (same size, then the same hash
+// of both ends, then the same full hash) and stored once; the others become
+// "same" entries of the catalog that restore reads from the stored copy.
+// A file much like one already stored in the same run (Delta.h sketches)
+// is stored as a delta against it, framed like any other stored file; its
+// "like" entry names the base, which restore decodes first.
+//
+// A set made with parity also has backup_parity/ (Parity.h). Verify and
+// restore rebuild a stored file from it when the file fails to read or
+// check, and use it if the rebuild succeeds.
+
+#pragma once
+
+#include "Catalog.h"
+#include "Compression.h"
+#include "Encryption.h"
+#include "Job.h"
+#include "Parity.h"
+#include "Progress.h"
+#include "ThreadPool.h"
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace BackupCore {
+
+    typedef std::function<void(int percentage, const std::string& message)> BackupProgress;
+
+    // Per-job cap on files processed at once. The extra threads come from the
+    // engine pool (ThreadPool.h), which every running job shares; progress
+    // callbacks may then arrive on those threads, one at a time. With
+    // 'adaptive' set the job starts at two and moves between one and this cap
+    // as I/O latency allows (Concurrency.h).
+    const uint32_t DefaultFileThreads = 8;
+
+    struct FileBackupOptions {
+        CompressionCodec codec = CompressionCodec::None;
+        uint32_t blockSize = 1024 * 1024;
+        ProgressChannel* channel = nullptr;     // Optional structured progress
+        JobControl* control = nullptr;          // Optional pause/cancel
+        uint32_t threads = DefaultFileThreads;  // Files in flight at once (1 = calling thread only)
+        bool adaptive = true;                   // Treat threads as a ceiling and tune below it
+        TaskPriority priority = TaskPriority::Normal;
+        std::string password;                   // Non-empty encrypts the set
+        CipherKind cipher = CipherKind::None;   // None picks PreferredCipher()
+        uint32_t parityShards = 0;              // Parity per ParityDataShards shards (0 = none, see Parity.h)
+        bool storeDuplicatesOnce = true;        // Identical files of MinDuplicateSize or more share one stored file
+        bool storeSimilarAsDelta = true;        // Files like one already stored keep only the difference
+        bool adaptiveCompression = true;        // Per block: skip incompressible data, compress harder when I/O-bound
+        bool dictionaryForSmallFiles = true;    // Compress files below MaxDictionaryFileSize against a trained dictionary
+    };
+
+    // Smaller files are cheaper to copy again than to read twice
+    const uint64_t MinDuplicateSize = 64 * 1024;
+
+    // Size range of delta candidates. A candidate is sketched while it is
+    // copied; only one with a similar base is read again, into memory with
+    // the base, and the base is held in memory while it is restored.
+    // Deltas are whole-file, so the cap bounds that memory. Larger files,
+    // which includes nearly every VHDX and database file, are always stored
+    // whole; a chunk-level delta for them is deliberately not done here.
+    const uint64_t MinDeltaSize = 64 * 1024;
+    const uint64_t MaxDeltaSize = 16 * 1024 * 1024;
+
+    // A compressed set trains one dictionary (Dictionary.h) from a sample of
+    // its files below this size, and compresses them against it if that pays
+    // for the dictionary's place in the catalog.
+    const uint64_t MaxDictionaryFileSize = 64 * 1024;
+
+    struct FileVerifyOptions {
+        ProgressChannel* channel = nullptr;
+        JobControl* control = nullptr;
+        uint32_t threads = DefaultFileThreads;
+        bool adaptive = true;
+        TaskPriority priority = TaskPriority::Normal;
+        std::string password;                   // Needed for an encrypted set
+    };
+
+    struct FileRestoreOptions {
+        bool overwriteExisting = false;
+        ProgressChannel* channel = nullptr;     // Optional structured progress
+        JobControl* control = nullptr;          // Optional pause/cancel
+        uint32_t threads = DefaultFileThreads;
+        bool adaptive = true;
+        TaskPriority priority = TaskPriority::Normal;
+        std::string password;                   // Needed for an encrypted set
+    };
+
+    // Default scrub rate: about 100 TB in three weeks
+    const uint64_t DefaultScrubBytesPerSecond = 64ull * 1024 * 1024;
+
+    struct FileScrubOptions {
+        ProgressChannel* channel = nullptr;
+        JobControl* control = nullptr;          // Optional pause/cancel
+        uint64_t bytesPerSecond = DefaultScrubBytesPerSecond;   // Read rate (0 = unlimited)
+        bool idleIo = true;                     // Only use the disk when nothing else does
+        bool continuous = false;                // Start the next pass when one ends, until cancelled
+        uint64_t budgetBytes = 0;               // Stop after reading this much (0 = to the end of the pass)
+        std::string password;                   // Encrypted sets without parity are checked by decoding
+    };
+
+    struct FileCompactOptions {
+        JobControl* control = nullptr;          // Optional pause/cancel, checked between files
+        uint64_t budgetBytes = 0;               // Stop after reclaiming this much (0 = all of it)
+        bool dryRun = false;                    // Count what would go, delete nothing
+    };
+
+    // Why a single file failed. The values are part of the C APIs (FILE_ERROR_*).
+    enum class FileErrorCode : int32_t {
+        None = 0,
+        OpenFailed,             // Source file cannot be opened
+        CreateFailed,           // Stored or restored file cannot be created
+        ReadFailed,
+        WriteFailed,
+        MissingFromBackup,      // Catalog entry without its stored file
+        Corrupt,                // Malformed or truncated compressed file
+        ChecksumMismatch,
+        InvalidPath,            // Catalog path outside the backup set
+        Cancelled               // Job cancelled while the file was in progress
+    };
+
+    struct FileError {
+        std::string path;           // Relative path as in the catalog
+        FileErrorCode code = FileErrorCode::None;
+        int osError = 0;            // errno when the failure came from the OS, else 0
+        std::string message;
+    };
+
+    // Short lower-case name, e.g. "checksum mismatch"
+    const char* FileErrorName(FileErrorCode code);
+
+    // Failures beyond this many are counted but not kept
+    const size_t MaxRecordedFileErrors = 1000;
+
+    struct FileSetResult {
+        uint64_t files = 0;         // Files backed up / verified / restored
+        uint64_t bytes = 0;         // Original bytes in those files
+        uint64_t storedBytes = 0;   // Bytes occupied in the backup set
+        uint64_t skipped = 0;       // Existing files left alone on restore; dead files left for the next compaction
+        uint64_t failed = 0;
+        uint64_t repaired = 0;      // Damaged stored files rebuilt from parity
+        uint64_t duplicates = 0;    // Backed-up files that share another file's stored copy
+        uint64_t deltas = 0;        // Backed-up files stored as a delta against a similar one
+        uint64_t rawBlocks = 0;     // Blocks of a compressed set stored without trying, as incompressible
+        uint64_t strongBlocks = 0;  // Blocks compressed with the strong effort while I/O-bound
+        uint64_t dictionaryFiles = 0;  // Small files compressed against the set's dictionary
+        uint64_t passes = 0;        // Full scrub passes finished
+        std::string firstFailure;
+        std::vector<FileError> errors;
+    };
+
+    // Back up 'source' (a directory or a single file) into 'destDir'.
+    // Files that cannot be read are counted in result.failed and the run continues.
+    // All three functions return JobCancelledResult if options.control is cancelled.
+    int BackupFileSet(
+        const std::filesystem::path& source,
+        const std::filesystem::path& destDir,
+        const FileBackupOptions& options,
+        const BackupProgress& progress,
+        FileSetResult& result,
+        std::string& error);
+
+    // Back up several sources into one set with one catalog. Each source is
+    // kept under a folder of its own (SourceFolders); with a single source this
+    // is BackupFileSet. Sources on different disks are copied at the same
+    // time, each disk with its own file threads, while sources sharing a disk
+    // are taken one after another.
+    int BackupFileSources(
+        const std::vector<std::filesystem::path>& sources,
+        const std::filesystem::path& destDir,
+        const FileBackupOptions& options,
+        const BackupProgress& progress,
+        FileSetResult& result,
+        std::string& error);
+
+    // Folder of each source inside a multi-source set: the source's name,
+    // numbered if two are alike ("Documents", "Documents_2"). Empty strings
+    // for a single source, whose files sit at the top of the set.
+    std::vector<std::string> SourceFolders(const std::vector<std::filesystem::path>& sources);
+
+    // Re-read every file of a backup set and check it against the catalog hash
+    int VerifyFileSet(
+        const std::filesystem::path& backupDir,
+        const FileVerifyOptions& options,
+        const BackupProgress& progress,
+        FileSetResult& result,
+        std::string& error);
+
+    // Re-read the stored files of a backup set slowly, in the background,
+    // to find damage before a restore needs them. A set with parity is
+    // checked shard by shard against its parity file and repaired on the
+    // spot; one without is decoded and checked against the catalog hash.
+    // The position is kept in backup_scrub.dat in the set, so the next run
+    // (or the next pass, with 'continuous') carries on where this one stopped.
+    // Returns -3 if any file is damaged beyond repair; cancelling keeps the position.
+    int ScrubFileSet(
+        const std::filesystem::path& backupDir,
+        const FileScrubOptions& options,
+        const BackupProgress& progress,
+        FileSetResult& result,
+        std::string& error);
+
+    // Reclaim the space of stored and parity files the catalog no longer
+    // lists. Backing up into an existing set rewrites the catalog but leaves
+    // the files of sources deleted since behind; they are never read again.
+    // The catalog is not touched, and the set is locked (SetLock) for the
+    // run, so a backup cannot write into it meanwhile. result.files and
+    // result.storedBytes count what was deleted, result.skipped the dead files
+    // the budget left for the next run. Returns -1 if the set is in use,
+    // -2 without a catalog and -3 if some files could not be deleted.
+    int CompactFileSet(
+        const std::filesystem::path& backupDir,
+        const FileCompactOptions& options,
+        const BackupProgress& progress,
+        FileSetResult& result,
+        std::string& error);
+
+    // Restore a backup set into 'destDir', verifying each file as it is written
+    int RestoreFileSet(
+        const std::filesystem::path& backupDir,
+        const std::filesystem::path& destDir,
+        const FileRestoreOptions& options,
+        const BackupProgress& progress,
+        FileSetResult& result,
+        std::string& error);
+}
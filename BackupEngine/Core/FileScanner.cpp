@@ -0,0 +1,218 @@
+// FileScanner.cpp - Portable source enumeration and file metadata
+#include "FileScanner.h"
+
+#include <fstream>
+#include <functional>
+#include <string>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <winioctl.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace BackupCore {
+
+#ifdef _WIN32
+    namespace {
+        // FILETIME counts 100 ns intervals since 1601-01-01
+        const int64_t UnixEpochTicks = 116444736000000000LL;
+
+        int64_t FileTimeToUnixNanos(const FILETIME& ft) {
+            int64_t ticks = ((int64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+            return (ticks - UnixEpochTicks) * 100;
+        }
+
+        FILETIME UnixNanosToFileTime(int64_t nanos) {
+            int64_t ticks = nanos / 100 + UnixEpochTicks;
+            FILETIME ft;
+            ft.dwLowDateTime = (DWORD)(ticks & 0xFFFFFFFF);
+            ft.dwHighDateTime = (DWORD)(ticks >> 32);
+            return ft;
+        }
+    }
+
+    const char* CurrentPlatform() {
+        return "windows";
+    }
+
+    bool ReadFileMetadata(const fs::path& path, FileEntry& entry) {
+        WIN32_FILE_ATTRIBUTE_DATA data;
+        if (!GetFileAttributesExW(path.wstring().c_str(), GetFileExInfoStandard, &data)) {
+            return false;
+        }
+        entry.size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+        entry.modifiedTime = FileTimeToUnixNanos(data.ftLastWriteTime);
+        entry.attributes = data.dwFileAttributes;
+        return true;
+    }
+
+    void ApplyFileMetadata(const fs::path& path, const FileEntry& entry, bool applyAttributes) {
+        HANDLE file = CreateFileW(path.wstring().c_str(), FILE_WRITE_ATTRIBUTES, 0, NULL,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file != INVALID_HANDLE_VALUE) {
+            FILETIME modified = UnixNanosToFileTime(entry.modifiedTime);
+            SetFileTime(file, nullptr, nullptr, &modified);
+            CloseHandle(file);
+        }
+
+        // Attributes last, so a read-only file still gets its timestamp
+        if (applyAttributes) {
+            SetFileAttributesW(path.wstring().c_str(), entry.attributes);
+        }
+    }
+
+    uint64_t DeviceId(const fs::path& path) {
+        std::error_code ec;
+        fs::path absolute = fs::absolute(path, ec);
+        wchar_t volumePath[MAX_PATH];
+        if (ec || !GetVolumePathNameW(absolute.wstring().c_str(), volumePath, MAX_PATH)) {
+            return 0;
+        }
+
+        // A local volume maps to the disk it lives on (the first, if it spans several)
+        wchar_t volumeName[MAX_PATH];
+        if (GetVolumeNameForVolumeMountPointW(volumePath, volumeName, MAX_PATH)) {
+            std::wstring device(volumeName);
+            if (!device.empty() && device.back() == L'\\') {
+                device.pop_back();
+            }
+            HANDLE volume = CreateFileW(device.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                OPEN_EXISTING, 0, NULL);
+            if (volume != INVALID_HANDLE_VALUE) {
+                VOLUME_DISK_EXTENTS extents;
+                DWORD returned = 0;
+                BOOL ok = DeviceIoControl(volume, IOCTL_VOLUME_GET_VOLUME_DISK_EXTENTS, NULL, 0,
+                    &extents, sizeof(extents), &returned, NULL);
+                CloseHandle(volume);
+                if (ok || GetLastError() == ERROR_MORE_DATA) {
+                    return 1 + (uint64_t)extents.Extents[0].DiskNumber;
+                }
+            }
+        }
+
+        // Shares and anything else: one device per volume root, kept apart from disk numbers
+        return (uint64_t)std::hash<std::wstring>()(volumePath) | (1ULL << 63);
+    }
+
+#else
+
+    const char* CurrentPlatform() {
+        return "posix";
+    }
+
+    bool ReadFileMetadata(const fs::path& path, FileEntry& entry) {
+        struct stat st;
+        if (::stat(path.c_str(), &st) != 0) {
+            return false;
+        }
+        entry.size = (uint64_t)st.st_size;
+        entry.modifiedTime = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+        entry.attributes = (uint32_t)(st.st_mode & 07777);
+        return true;
+    }
+
+    void ApplyFileMetadata(const fs::path& path, const FileEntry& entry, bool applyAttributes) {
+        struct timespec times[2];
+        times[0].tv_sec = 0;
+        times[0].tv_nsec = UTIME_OMIT;
+        times[1].tv_sec = (time_t)(entry.modifiedTime / 1000000000LL);
+        times[1].tv_nsec = (long)(entry.modifiedTime % 1000000000LL);
+        if (times[1].tv_nsec < 0) {
+            times[1].tv_sec -= 1;
+            times[1].tv_nsec += 1000000000L;
+        }
+        utimensat(AT_FDCWD, path.c_str(), times, 0);
+
+        if (applyAttributes) {
+            ::chmod(path.c_str(), (mode_t)(entry.attributes & 07777));
+        }
+    }
+
+    uint64_t DeviceId(const fs::path& path) {
+        struct stat st;
+        if (::stat(path.c_str(), &st) != 0) {
+            return 0;
+        }
+
+        // A partition's sysfs entry sits inside its disk's, next to the disk's "dev"
+        std::string block = "/sys/dev/block/" + std::to_string(major(st.st_dev)) + ":" + std::to_string(minor(st.st_dev));
+        std::error_code ec;
+        if (fs::exists(block + "/partition", ec)) {
+            std::ifstream in(block + "/../dev");
+            unsigned diskMajor = 0, diskMinor = 0;
+            char colon = 0;
+            if (in >> diskMajor >> colon >> diskMinor && colon == ':') {
+                return 1 + (uint64_t)makedev(diskMajor, diskMinor);
+            }
+        }
+        return 1 + (uint64_t)st.st_dev;
+    }
+
+#endif
+
+    fs::path ScanRoot(const fs::path& source) {
+        std::error_code ec;
+        return fs::is_directory(source, ec) ? source : source.parent_path();
+    }
+
+    fs::path EntryPath(const fs::path& root, const std::string& relativePath) {
+        return root / fs::u8path(relativePath);
+    }
+
+    bool ScanFiles(const fs::path& source, std::vector<FileEntry>& files, uint64_t& totalBytes, std::string& error) {
+        files.clear();
+        totalBytes = 0;
+
+        std::error_code ec;
+        if (fs::is_regular_file(source, ec)) {
+            FileEntry entry;
+            if (!ReadFileMetadata(source, entry)) {
+                error = "Cannot read " + source.u8string();
+                return false;
+            }
+            entry.relativePath = source.filename().u8string();
+            totalBytes = entry.size;
+            files.push_back(entry);
+            return true;
+        }
+
+        if (!fs::is_directory(source, ec)) {
+            error = "Source is not a valid file or directory: " + source.u8string();
+            return false;
+        }
+
+        fs::recursive_directory_iterator it(source, fs::directory_options::skip_permission_denied, ec);
+        if (ec) {
+            error = "Cannot scan " + source.u8string() + ": " + ec.message();
+            return false;
+        }
+
+        for (fs::recursive_directory_iterator end; it != end; it.increment(ec)) {
+            if (ec) {
+                // Skip entries that vanish or cannot be read mid-scan
+                ec.clear();
+                continue;
+            }
+
+            std::error_code typeError;
+            if (!it->is_regular_file(typeError)) {
+                continue;
+            }
+
+            FileEntry entry;
+            if (!ReadFileMetadata(it->path(), entry)) {
+                continue;
+            }
+            entry.relativePath = it->path().lexically_relative(source).generic_u8string();
+            totalBytes += entry.size;
+            files.push_back(entry);
+        }
+        return true;
+    }
+}
@@ -0,0 +1,46 @@
+// FileScanner.h - Portable source enumeration and file metadata
+// Replaces the FILETIME / GetFileAttributesW handling that used to live in the Windows-only backup code
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace BackupCore {
+
+    struct FileEntry {
+        std::string relativePath;   // UTF-8, '/' separated, relative to the scan root
+        uint64_t size = 0;
+        int64_t modifiedTime = 0;   // Nanoseconds since 1970-01-01 UTC
+        uint32_t attributes = 0;    // FILE_ATTRIBUTE_* on Windows, permission bits on POSIX
+    };
+
+    // "windows" or "posix" - tells whether recorded attributes can be applied here
+    const char* CurrentPlatform();
+
+    // Directory that entry paths are relative to: the source itself, or its parent for a single file
+    std::filesystem::path ScanRoot(const std::filesystem::path& source);
+
+    // Identifies the disk holding 'path', so that work on different disks can
+    // run in parallel. Partitions of one disk give the same id; 0 if unknown.
+    uint64_t DeviceId(const std::filesystem::path& path);
+
+    // Enumerate regular files under 'source' (or 'source' itself if it is a file).
+    // Entries that cannot be read are skipped, as the Windows engine always did.
+    bool ScanFiles(
+        const std::filesystem::path& source,
+        std::vector<FileEntry>& files,
+        uint64_t& totalBytes,
+        std::string& error);
+
+    // Full path of an entry below 'root'
+    std::filesystem::path EntryPath(const std::filesystem::path& root, const std::string& relativePath);
+
+    // Fill size, timestamp and attributes of 'entry' from the file at 'path'
+    bool ReadFileMetadata(const std::filesystem::path& path, FileEntry& entry);
+
+    // Restore the timestamp, and the attributes if they were recorded on this platform
+    void ApplyFileMetadata(const std::filesystem::path& path, const FileEntry& entry, bool applyAttributes);
+}
@@ -0,0 +1,134 @@
+// Job.cpp - Asynchronous jobs with cancel, pause and resume
+#include "Job.h"
+#include "Trace.h"
+#include <chrono>
+
+namespace BackupCore {
+
+    void JobControl::Pause() {
+        int expected = Active;
+        state.compare_exchange_strong(expected, Pausing);
+    }
+
+    void JobControl::Resume() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            int expected = Pausing;
+            state.compare_exchange_strong(expected, Active);
+        }
+        resumed.notify_all();
+    }
+
+    void JobControl::Cancel() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            state.store(Cancelling);
+        }
+        resumed.notify_all();
+        throttle.Release();
+    }
+
+    bool JobControl::WaitWhilePaused() {
+        std::unique_lock<std::mutex> guard(lock);
+        resumed.wait(guard, [this] { return state.load() != Pausing; });
+        return state.load() != Cancelling;
+    }
+
+    Job::Job(Work work, ProgressChannel::Sink sink, uint32_t intervalMilliseconds)
+        : work(std::move(work)),
+          channel([this](const ProgressStatus& status) {
+              {
+                  std::lock_guard<std::mutex> guard(lock);
+                  lastStatus = status;
+              }
+              if (this->sink) {
+                  this->sink(status);
+              }
+          }, intervalMilliseconds),
+          sink(std::move(sink)) {}
+
+    JobState Job::State() const {
+        std::lock_guard<std::mutex> guard(lock);
+        if (state == JobState::Queued || state == JobState::Running) {
+            if (control.Paused()) return JobState::Paused;
+        }
+        return state;
+    }
+
+    ProgressStatus Job::Status() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return lastStatus;
+    }
+
+    bool Job::Wait(int timeoutMilliseconds) {
+        std::unique_lock<std::mutex> guard(lock);
+        auto done = [this] {
+            return state == JobState::Completed || state == JobState::Failed || state == JobState::Cancelled;
+        };
+        if (timeoutMilliseconds < 0) {
+            finished.wait(guard, done);
+            return true;
+        }
+        return finished.wait_for(guard, std::chrono::milliseconds(timeoutMilliseconds), done);
+    }
+
+    int Job::Result() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return result;
+    }
+
+    std::string Job::Error() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return error;
+    }
+
+    void Job::SetError(const std::string& message) {
+        std::lock_guard<std::mutex> guard(lock);
+        error = message;
+    }
+
+    void Job::Run() {
+        int rc = JobCancelledResult;
+        // A job cancelled while still queued never starts
+        if (control.Checkpoint()) {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                state = JobState::Running;
+            }
+            TraceSpan span("job", "Job::Run");
+            try {
+                rc = work(*this);
+            }
+            catch (const std::exception& e) {
+                SetError(std::string("Exception: ") + e.what());
+                rc = -99;
+            }
+            catch (...) {
+                SetError("Unknown exception");
+                rc = -99;
+            }
+        }
+
+        bool cancelled = rc != 0 && control.Cancelled();
+        if (cancelled) {
+            SetError("Job cancelled");
+            rc = JobCancelledResult;
+        }
+        channel.Finish(rc == 0);
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            result = rc;
+            state = rc == 0 ? JobState::Completed : (cancelled ? JobState::Cancelled : JobState::Failed);
+        }
+        finished.notify_all();
+    }
+
+    std::shared_ptr<Job> StartJob(Job::Work work, ProgressChannel::Sink sink, uint32_t intervalMilliseconds,
+                                  TaskPriority priority) {
+        auto job = std::make_shared<Job>(std::move(work), std::move(sink), intervalMilliseconds);
+        // The pool holds its own reference, so callers may drop theirs at any time
+        ThreadPool::Engine().Submit([job] { job->Run(); }, priority);
+        return job;
+    }
+}
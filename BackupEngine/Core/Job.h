@@ -0,0 +1,119 @@
+// Job.h - Asynchronous jobs with cancel, pause and resume
+//
+// StartJob queues work on the engine thread pool and returns at once. The
+// caller polls or waits on the Job and can pause, resume or cancel it at any
+// time. The work itself cooperates through JobControl::Checkpoint, which the
+// file backup, verify and restore loops call per block and per file: it
+// blocks while the job is paused and returns false once it is cancelled.
+// JobControl also carries the job's I/O limits (Throttle.h).
+
+#pragma once
+
+#include "Progress.h"
+#include "ThreadPool.h"
+#include "Throttle.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace BackupCore {
+
+    // Returned by work that stopped because its job was cancelled
+    const int JobCancelledResult = -10;
+
+    enum class JobState : int32_t {
+        Queued = 0,
+        Running,
+        Paused,
+        Completed,
+        Failed,
+        Cancelled
+    };
+
+    class JobControl {
+    public:
+        void Pause();
+        void Resume();
+        void Cancel();
+
+        // Read/write/IOPS limits, adjustable at any time; cancelling releases them
+        IoThrottle& Throttle() { return throttle; }
+
+        bool Paused() const { return state.load(std::memory_order_relaxed) == Pausing; }
+        bool Cancelled() const { return state.load(std::memory_order_relaxed) == Cancelling; }
+
+        // Returns true to carry on, false if the job was cancelled; waits while paused
+        bool Checkpoint() {
+            return state.load(std::memory_order_relaxed) == Active || WaitWhilePaused();
+        }
+
+    private:
+        enum { Active = 0, Pausing, Cancelling };
+
+        bool WaitWhilePaused();
+
+        std::atomic<int> state{ Active };
+        std::mutex lock;
+        std::condition_variable resumed;
+        IoThrottle throttle;
+    };
+
+    // Checkpoint for code that may run without a job
+    inline bool Checkpoint(JobControl* control) {
+        return !control || control->Checkpoint();
+    }
+
+    class Job {
+    public:
+        // Work returns 0 on success; on failure it sets an error with SetError
+        typedef std::function<int(Job& job)> Work;
+
+        Job(Work work, ProgressChannel::Sink sink, uint32_t intervalMilliseconds);
+
+        Job(const Job&) = delete;
+        Job& operator=(const Job&) = delete;
+
+        JobControl& Control() { return control; }
+        ProgressChannel& Progress() { return channel; }
+
+        JobState State() const;
+
+        // The most recently delivered progress
+        ProgressStatus Status() const;
+
+        // Waits for the job to finish; a negative timeout waits forever.
+        // Returns true once the job has finished.
+        bool Wait(int timeoutMilliseconds);
+
+        // Valid once the job has finished
+        int Result() const;
+        std::string Error() const;
+
+        void SetError(const std::string& message);
+
+        // Runs the work on the calling thread; StartJob calls it on the pool
+        void Run();
+
+    private:
+        Work work;
+        JobControl control;
+        ProgressChannel channel;
+        ProgressChannel::Sink sink;
+
+        mutable std::mutex lock;
+        std::condition_variable finished;
+        JobState state = JobState::Queued;
+        ProgressStatus lastStatus;
+        int result = 0;
+        std::string error;
+    };
+
+    // Queue work on the engine thread pool
+    std::shared_ptr<Job> StartJob(Job::Work work, ProgressChannel::Sink sink = nullptr,
+                                  uint32_t intervalMilliseconds = 100,
+                                  TaskPriority priority = TaskPriority::Normal);
+}
@@ -0,0 +1,368 @@
+// JobStatus.cpp - Live job status shared with other processes
+#include "JobStatus.h"
+#include "Metrics.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <sddl.h>
+#pragma comment(lib, "advapi32.lib")
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace BackupCore {
+
+    namespace {
+        const uint32_t RegionMagic = 0x534A4B42;    // "BKJS"
+        const uint32_t RegionVersion = 1;
+
+        // A reader gives up on a slot that stays busy this many times
+        const int ReadAttempts = 64;
+
+        struct Slot {
+            std::atomic<uint32_t> sequence;         // Odd while the entry is being written
+            std::atomic<uint32_t> owner;            // Publishing process id, 0 when free
+            JobStatusEntry entry;
+        };
+
+        struct Region {
+            std::atomic<uint32_t> magic;            // Stored last, once the header is valid
+            uint32_t version;
+            uint32_t slotCount;
+            uint32_t slotSize;
+            Slot slots[JobStatusSlotCount];
+        };
+
+        static_assert(std::atomic<uint32_t>::is_always_lock_free,
+            "Shared-memory slots need lock-free 32-bit atomics");
+
+        // Every process maps the region zero-filled, so filling in the header
+        // is idempotent and needs no creator/opener handshake
+        bool PrepareRegion(Region* region, bool writable, std::string& error) {
+            if (writable && region->magic.load(std::memory_order_acquire) == 0) {
+                region->version = RegionVersion;
+                region->slotCount = JobStatusSlotCount;
+                region->slotSize = sizeof(Slot);
+                region->magic.store(RegionMagic, std::memory_order_release);
+            }
+
+            uint32_t magic = region->magic.load(std::memory_order_acquire);
+            if (magic == 0) {
+                return false;   // Creator has not finished; nothing published yet
+            }
+            if (magic != RegionMagic || region->version != RegionVersion ||
+                region->slotCount != JobStatusSlotCount || region->slotSize != sizeof(Slot)) {
+                error = "Job status region has an incompatible layout";
+                return false;
+            }
+            return true;
+        }
+
+#ifdef _WIN32
+
+        // Global so the service (session 0) and the UIs see the same jobs;
+        // Local for processes that may not create global objects
+        const wchar_t* const RegionNames[] = { L"Global\\BackupEngineJobStatus", L"Local\\BackupEngineJobStatus" };
+        const int RegionNameCount = 2;
+
+        uint32_t CurrentProcessId() {
+            return GetCurrentProcessId();
+        }
+
+        bool ProcessAlive(uint32_t processId) {
+            HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId);
+            if (!process) {
+                // Access denied means it exists but belongs to someone else
+                return ::GetLastError() == ERROR_ACCESS_DENIED;
+            }
+            DWORD exitCode = 0;
+            bool alive = GetExitCodeProcess(process, &exitCode) && exitCode == STILL_ACTIVE;
+            CloseHandle(process);
+            return alive;
+        }
+
+        Region* MapRegion(int nameIndex, bool writable, std::string& error) {
+            HANDLE mapping = NULL;
+            if (writable) {
+                // SYSTEM and administrators own it; signed-in users may publish and read
+                PSECURITY_DESCRIPTOR descriptor = NULL;
+                ConvertStringSecurityDescriptorToSecurityDescriptorW(
+                    L"D:(A;;GA;;;SY)(A;;GA;;;BA)(A;;GRGW;;;AU)", SDDL_REVISION_1, &descriptor, NULL);
+                SECURITY_ATTRIBUTES attributes = { sizeof(attributes), descriptor, FALSE };
+
+                mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, descriptor ? &attributes : NULL,
+                    PAGE_READWRITE, 0, sizeof(Region), RegionNames[nameIndex]);
+                if (descriptor) {
+                    LocalFree(descriptor);
+                }
+            } else {
+                mapping = OpenFileMappingW(FILE_MAP_READ, FALSE, RegionNames[nameIndex]);
+            }
+
+            if (!mapping) {
+                DWORD code = ::GetLastError();
+                if (code != ERROR_FILE_NOT_FOUND) {
+                    error = "Cannot map job status region (Error: " + std::to_string(code) + ")";
+                }
+                return nullptr;
+            }
+
+            void* view = MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, sizeof(Region));
+            // The view keeps the mapping alive for the life of the process
+            CloseHandle(mapping);
+            if (!view) {
+                error = "Cannot map job status region (Error: " + std::to_string(::GetLastError()) + ")";
+                return nullptr;
+            }
+
+            Region* region = static_cast<Region*>(view);
+            if (!PrepareRegion(region, writable, error)) {
+                UnmapViewOfFile(view);
+                return nullptr;
+            }
+            return region;
+        }
+
+#else
+
+        const char* const RegionNames[] = { "/backup_engine_jobs" };
+        const int RegionNameCount = 1;
+
+        uint32_t CurrentProcessId() {
+            return (uint32_t)getpid();
+        }
+
+        bool ProcessAlive(uint32_t processId) {
+            return kill((pid_t)processId, 0) == 0 || errno == EPERM;
+        }
+
+        Region* MapRegion(int nameIndex, bool writable, std::string& error) {
+            // Readable by everyone, writable by the user who created it
+            int fd = shm_open(RegionNames[nameIndex], writable ? (O_RDWR | O_CREAT) : O_RDONLY, 0644);
+            if (fd < 0) {
+                if (errno != ENOENT) {
+                    error = std::string("Cannot open job status region: ") + std::strerror(errno);
+                }
+                return nullptr;
+            }
+
+            struct stat info;
+            bool sized = fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(Region);
+            if (!sized && writable) {
+                // Growing a fresh object zero-fills it; racing creators set the same size
+                sized = ftruncate(fd, sizeof(Region)) == 0;
+            }
+            if (!sized) {
+                if (writable) {
+                    error = std::string("Cannot size job status region: ") + std::strerror(errno);
+                }
+                close(fd);
+                return nullptr;
+            }
+
+            void* view = mmap(nullptr, sizeof(Region), writable ? (PROT_READ | PROT_WRITE) : PROT_READ,
+                MAP_SHARED, fd, 0);
+            close(fd);
+            if (view == MAP_FAILED) {
+                error = std::string("Cannot map job status region: ") + std::strerror(errno);
+                return nullptr;
+            }
+
+            Region* region = static_cast<Region*>(view);
+            if (!PrepareRegion(region, writable, error)) {
+                munmap(view, sizeof(Region));
+                return nullptr;
+            }
+            return region;
+        }
+
+#endif
+
+        struct Mappings {
+            std::mutex lock;
+            Region* writer = nullptr;
+            bool writerFailed = false;
+            Region* readers[RegionNameCount] = {};
+        };
+
+        Mappings& GetMappings() {
+            static Mappings mappings;
+            return mappings;
+        }
+
+        // The first region this process can create or open for writing, mapped once
+        Region* WriterRegion() {
+            Mappings& mappings = GetMappings();
+            std::lock_guard<std::mutex> guard(mappings.lock);
+            if (!mappings.writer && !mappings.writerFailed) {
+                for (int i = 0; i < RegionNameCount && !mappings.writer; i++) {
+                    std::string error;
+                    mappings.writer = MapRegion(i, true, error);
+                }
+                mappings.writerFailed = mappings.writer == nullptr;
+            }
+            return mappings.writer;
+        }
+
+        // Seqlock write: readers that overlap it see an odd or changed sequence and retry
+        void WriteSlot(Slot& slot, const JobStatusEntry& entry) {
+            uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+            // A crashed writer can leave the sequence odd; carry on from there
+            uint32_t begin = (sequence & 1) ? sequence : sequence + 1;
+            slot.sequence.store(begin, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            std::memcpy(static_cast<void*>(&slot.entry), &entry, sizeof(entry));
+            slot.sequence.store(begin + 1, std::memory_order_release);
+        }
+
+        bool ReadSlot(const Slot& slot, JobStatusEntry& entry) {
+            for (int attempt = 0; attempt < ReadAttempts; attempt++) {
+                uint32_t before = slot.sequence.load(std::memory_order_acquire);
+                if (before & 1) {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                uint32_t owner = slot.owner.load(std::memory_order_relaxed);
+                std::memcpy(&entry, static_cast<const void*>(&slot.entry), sizeof(entry));
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.sequence.load(std::memory_order_relaxed) != before) {
+                    continue;
+                }
+                return owner != 0 && entry.processId == owner && entry.jobId != 0 && ProcessAlive(owner);
+            }
+            return false;
+        }
+
+        int64_t UnixMilliseconds() {
+            return (int64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+    }
+
+    JobStatusPublisher::JobStatusPublisher(const std::string& name)
+        : startNs(MonotonicNanoseconds()) {
+
+        Region* region = WriterRegion();
+        if (!region) {
+            return;
+        }
+
+        uint32_t processId = CurrentProcessId();
+        for (int i = 0; i < JobStatusSlotCount && slot < 0; i++) {
+            Slot& candidate = region->slots[i];
+            uint32_t owner = candidate.owner.load(std::memory_order_acquire);
+            // Free slots, and slots left behind by a process that has exited
+            if (owner != 0 && ProcessAlive(owner)) {
+                continue;
+            }
+            if (candidate.owner.compare_exchange_strong(owner, processId, std::memory_order_acq_rel)) {
+                slot = i;
+            }
+        }
+        if (slot < 0) {
+            return;
+        }
+
+        static std::atomic<uint32_t> nextJob{ 1 };
+        entry.jobId = ((uint64_t)processId << 32) | nextJob.fetch_add(1, std::memory_order_relaxed);
+        entry.processId = processId;
+
+        // Truncate on a UTF-8 character boundary
+        size_t length = name.size() < (size_t)JobStatusNameLength - 1 ? name.size() : (size_t)JobStatusNameLength - 1;
+        while (length > 0 && length < name.size() && ((unsigned char)name[length] & 0xC0) == 0x80) {
+            length--;
+        }
+        std::memcpy(entry.name, name.data(), length);
+        entry.name[length] = '\0';
+
+        Update(ProgressPhase::Idle, 0);
+    }
+
+    JobStatusPublisher::~JobStatusPublisher() {
+        if (slot >= 0) {
+            Slot& own = WriterRegion()->slots[slot];
+            own.owner.store(0, std::memory_order_release);
+        }
+    }
+
+    void JobStatusPublisher::Update(const ProgressStatus& status) {
+        if (slot < 0) {
+            return;
+        }
+
+        entry.phase = status.phase;
+        entry.percent = status.percent;
+        entry.filesDone = status.filesDone;
+        entry.filesTotal = status.filesTotal;
+        entry.filesFailed = status.filesFailed;
+        entry.bytesDone = status.bytesDone;
+        entry.bytesTotal = status.bytesTotal;
+        entry.bytesPerSecond = status.bytesPerSecond;
+        entry.elapsedSeconds = status.elapsedSeconds;
+        entry.etaSeconds = status.etaSeconds;
+        entry.updatedUnixMs = UnixMilliseconds();
+        WriteSlot(WriterRegion()->slots[slot], entry);
+    }
+
+    void JobStatusPublisher::Update(ProgressPhase phase, int percent) {
+        if (slot < 0) {
+            return;
+        }
+
+        ProgressStatus status;
+        status.phase = (int32_t)phase;
+        status.percent = percent;
+        status.elapsedSeconds = (MonotonicNanoseconds() - startNs) / 1e9;
+        Update(status);
+    }
+
+    bool ReadJobStatus(std::vector<JobStatusEntry>& jobs, std::string& error) {
+        jobs.clear();
+        Mappings& mappings = GetMappings();
+        std::lock_guard<std::mutex> guard(mappings.lock);
+
+        bool ok = true;
+        for (int i = 0; i < RegionNameCount; i++) {
+            // Regions that do not exist yet are looked for again on the next call
+            if (!mappings.readers[i]) {
+                std::string mapError;
+                mappings.readers[i] = MapRegion(i, false, mapError);
+                if (!mapError.empty()) {
+                    error = mapError;
+                    ok = false;
+                }
+            }
+
+            const Region* region = mappings.readers[i];
+            if (!region) {
+                continue;
+            }
+            for (const Slot& slot : region->slots) {
+                JobStatusEntry entry;
+                if (!ReadSlot(slot, entry)) {
+                    continue;
+                }
+                // In session 0 the Global and Local names are the same object
+                bool seen = false;
+                for (const auto& job : jobs) {
+                    seen = seen || job.jobId == entry.jobId;
+                }
+                if (!seen) {
+                    jobs.push_back(entry);
+                }
+            }
+        }
+        return ok;
+    }
+}
@@ -0,0 +1,68 @@
+// JobStatus.h - Live job status shared with other processes
+//
+// Every running job publishes its progress into one slot of a small shared
+// memory region ("Global\BackupEngineJobStatus" on Windows, POSIX shm
+// "/backup_engine_jobs" on Linux). The service, the UIs and the restore tools
+// map the region and poll it without ever blocking the job: each slot is a
+// seqlock, so a writer never waits and a reader simply retries if it caught
+// a slot half-written. Slots left behind by a crashed process are reclaimed.
+
+#pragma once
+
+#include "Progress.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace BackupCore {
+
+    const int JobStatusSlotCount = 32;
+    const int JobStatusNameLength = 128;
+
+    // One published job; plain data so other processes and languages can read it
+    struct JobStatusEntry {
+        uint64_t jobId = 0;             // Unique per publication
+        uint32_t processId = 0;
+        int32_t phase = 0;              // ProgressPhase
+        int32_t percent = 0;
+        uint32_t reserved = 0;
+        uint64_t filesDone = 0;
+        uint64_t filesTotal = 0;
+        uint64_t filesFailed = 0;
+        uint64_t bytesDone = 0;
+        uint64_t bytesTotal = 0;
+        double bytesPerSecond = 0;
+        double elapsedSeconds = 0;
+        double etaSeconds = -1;
+        int64_t updatedUnixMs = 0;      // Wall-clock time of the last update
+        char name[JobStatusNameLength] = {};  // UTF-8, NUL-terminated
+    };
+
+    // Claims a slot for one job on construction and frees it on destruction.
+    // If the region cannot be mapped or is full the publisher stays inactive
+    // and updates are ignored; publishing never fails a job.
+    class JobStatusPublisher {
+    public:
+        explicit JobStatusPublisher(const std::string& name);
+        ~JobStatusPublisher();
+
+        JobStatusPublisher(const JobStatusPublisher&) = delete;
+        JobStatusPublisher& operator=(const JobStatusPublisher&) = delete;
+
+        bool Active() const { return slot >= 0; }
+
+        void Update(const ProgressStatus& status);
+
+        // For jobs that only track a percentage (disk imaging and restore)
+        void Update(ProgressPhase phase, int percent);
+
+    private:
+        int slot = -1;
+        uint64_t startNs;
+        JobStatusEntry entry;
+    };
+
+    // Snapshot of every job currently published by any process.
+    // A missing region means no jobs are running and is not an error.
+    bool ReadJobStatus(std::vector<JobStatusEntry>& jobs, std::string& error);
+}
@@ -0,0 +1,193 @@
+// Metrics.cpp - Per-phase counters, timers and latency histograms for the engine
+#include "Metrics.h"
+#include <chrono>
+#include <cstdio>
+
+namespace BackupCore {
+
+    namespace {
+        const char* const PhaseNames[(int)MetricPhase::Count] = {
+            "scan", "read", "hash", "compress", "write", "metadata", "throttle", "encrypt", "parity"
+        };
+
+        std::string Seconds(uint64_t nanoseconds) {
+            char text[32];
+            std::snprintf(text, sizeof(text), "%.6f", nanoseconds / 1e9);
+            return text;
+        }
+
+        void HistogramJson(std::string& out, const char* name, const LatencyHistogram& histogram) {
+            LatencyHistogram::Snapshot snap = histogram.Read();
+            out += "\"" + std::string(name) + "\": {\"count\": " + std::to_string(snap.count) +
+                ", \"sumSeconds\": " + Seconds(snap.sumNanoseconds) +
+                ", \"maxSeconds\": " + Seconds(snap.maxNanoseconds) + ", \"buckets\": [";
+
+            // Only occupied buckets; the overflow bucket has no upper bound
+            bool first = true;
+            for (int i = 0; i < LatencyHistogram::BucketCount; i++) {
+                if (snap.buckets[i] == 0) continue;
+                uint64_t limit = LatencyHistogram::BucketLimitMicroseconds(i);
+                out += std::string(first ? "" : ", ") + "{\"ltMicroseconds\": " +
+                    (limit ? std::to_string(limit) : std::string("null")) +
+                    ", \"count\": " + std::to_string(snap.buckets[i]) + "}";
+                first = false;
+            }
+            out += "]}";
+        }
+
+        void HistogramPrometheus(std::string& out, const char* name, const char* help, const LatencyHistogram& histogram) {
+            LatencyHistogram::Snapshot snap = histogram.Read();
+            out += "# HELP " + std::string(name) + " " + help + "\n";
+            out += "# TYPE " + std::string(name) + " histogram\n";
+
+            uint64_t cumulative = 0;
+            for (int i = 0; i < LatencyHistogram::BucketCount - 1; i++) {
+                cumulative += snap.buckets[i];
+                out += std::string(name) + "_bucket{le=\"" +
+                    Seconds(LatencyHistogram::BucketLimitMicroseconds(i) * 1000) + "\"} " +
+                    std::to_string(cumulative) + "\n";
+            }
+            out += std::string(name) + "_bucket{le=\"+Inf\"} " + std::to_string(snap.count) + "\n";
+            out += std::string(name) + "_sum " + Seconds(snap.sumNanoseconds) + "\n";
+            out += std::string(name) + "_count " + std::to_string(snap.count) + "\n";
+        }
+    }
+
+    const char* PhaseName(MetricPhase phase) {
+        int index = (int)phase;
+        return (index >= 0 && index < (int)MetricPhase::Count) ? PhaseNames[index] : "unknown";
+    }
+
+    uint64_t MonotonicNanoseconds() {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    uint64_t LatencyHistogram::BucketLimitMicroseconds(int bucket) {
+        return (bucket >= 0 && bucket < BucketCount - 1) ? (1ULL << bucket) : 0;
+    }
+
+    void LatencyHistogram::Record(uint64_t nanoseconds) {
+        uint64_t micros = nanoseconds / 1000;
+        int bucket = 0;
+        while (bucket < BucketCount - 1 && micros >= (1ULL << bucket)) {
+            bucket++;
+        }
+
+        buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sumNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+        uint64_t seen = maxNanoseconds.load(std::memory_order_relaxed);
+        while (nanoseconds > seen &&
+               !maxNanoseconds.compare_exchange_weak(seen, nanoseconds, std::memory_order_relaxed)) {
+        }
+    }
+
+    LatencyHistogram::Snapshot LatencyHistogram::Read() const {
+        Snapshot snap;
+        for (int i = 0; i < BucketCount; i++) {
+            snap.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+        }
+        snap.count = count.load(std::memory_order_relaxed);
+        snap.sumNanoseconds = sumNanoseconds.load(std::memory_order_relaxed);
+        snap.maxNanoseconds = maxNanoseconds.load(std::memory_order_relaxed);
+        return snap;
+    }
+
+    void LatencyHistogram::Reset() {
+        for (auto& bucket : buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        count.store(0, std::memory_order_relaxed);
+        sumNanoseconds.store(0, std::memory_order_relaxed);
+        maxNanoseconds.store(0, std::memory_order_relaxed);
+    }
+
+    EngineMetrics& EngineMetrics::Global() {
+        static EngineMetrics metrics;
+        return metrics;
+    }
+
+    void EngineMetrics::AddPhase(MetricPhase phase, uint64_t bytes, uint64_t nanoseconds) {
+        PhaseCounters& counters = phases[(int)phase];
+        counters.calls.fetch_add(1, std::memory_order_relaxed);
+        counters.bytes.fetch_add(bytes, std::memory_order_relaxed);
+        counters.nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+    }
+
+    PhaseSnapshot EngineMetrics::Phase(MetricPhase phase) const {
+        const PhaseCounters& counters = phases[(int)phase];
+        PhaseSnapshot snap;
+        snap.calls = counters.calls.load(std::memory_order_relaxed);
+        snap.bytes = counters.bytes.load(std::memory_order_relaxed);
+        snap.nanoseconds = counters.nanoseconds.load(std::memory_order_relaxed);
+        return snap;
+    }
+
+    void EngineMetrics::CountFile(bool succeeded) {
+        (succeeded ? filesSucceeded : filesFailed).fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void EngineMetrics::Reset() {
+        for (auto& counters : phases) {
+            counters.calls.store(0, std::memory_order_relaxed);
+            counters.bytes.store(0, std::memory_order_relaxed);
+            counters.nanoseconds.store(0, std::memory_order_relaxed);
+        }
+        filesSucceeded.store(0, std::memory_order_relaxed);
+        filesFailed.store(0, std::memory_order_relaxed);
+        fileOpen.Reset();
+        fileCopy.Reset();
+    }
+
+    std::string EngineMetrics::ToJson() const {
+        std::string out = "{\"phases\": {";
+        for (int i = 0; i < (int)MetricPhase::Count; i++) {
+            PhaseSnapshot snap = Phase((MetricPhase)i);
+            out += std::string(i ? ", " : "") + "\"" + PhaseNames[i] + "\": {\"calls\": " +
+                std::to_string(snap.calls) + ", \"bytes\": " + std::to_string(snap.bytes) +
+                ", \"seconds\": " + Seconds(snap.nanoseconds) + "}";
+        }
+        out += "}, \"files\": {\"succeeded\": " + std::to_string(filesSucceeded.load(std::memory_order_relaxed)) +
+            ", \"failed\": " + std::to_string(filesFailed.load(std::memory_order_relaxed)) + "}, \"histograms\": {";
+        HistogramJson(out, "fileOpen", fileOpen);
+        out += ", ";
+        HistogramJson(out, "fileCopy", fileCopy);
+        out += "}}";
+        return out;
+    }
+
+    std::string EngineMetrics::ToPrometheus() const {
+        std::string out;
+        const struct {
+            const char* name;
+            const char* help;
+            int field;
+        } phaseMetrics[] = {
+            { "backup_phase_seconds_total", "Time spent in each engine phase", 0 },
+            { "backup_phase_bytes_total", "Bytes handled by each engine phase", 1 },
+            { "backup_phase_calls_total", "Operations performed by each engine phase", 2 },
+        };
+
+        for (const auto& metric : phaseMetrics) {
+            out += "# HELP " + std::string(metric.name) + " " + metric.help + "\n";
+            out += "# TYPE " + std::string(metric.name) + " counter\n";
+            for (int i = 0; i < (int)MetricPhase::Count; i++) {
+                PhaseSnapshot snap = Phase((MetricPhase)i);
+                std::string value = metric.field == 0 ? Seconds(snap.nanoseconds)
+                    : std::to_string(metric.field == 1 ? snap.bytes : snap.calls);
+                out += std::string(metric.name) + "{phase=\"" + PhaseNames[i] + "\"} " + value + "\n";
+            }
+        }
+
+        out += "# HELP backup_files_total Files processed by result\n";
+        out += "# TYPE backup_files_total counter\n";
+        out += "backup_files_total{result=\"succeeded\"} " + std::to_string(filesSucceeded.load(std::memory_order_relaxed)) + "\n";
+        out += "backup_files_total{result=\"failed\"} " + std::to_string(filesFailed.load(std::memory_order_relaxed)) + "\n";
+
+        HistogramPrometheus(out, "backup_file_open_seconds", "Time to open a file and its destination", fileOpen);
+        HistogramPrometheus(out, "backup_file_copy_seconds", "Time to copy one whole file", fileCopy);
+        return out;
+    }
+}
@@ -0,0 +1,142 @@
+// Metrics.h - Per-phase counters, timers and latency histograms for the engine
+//
+// Every backup, verify, restore and imaging run adds to one process-wide set
+// of metrics. Callers read them through GetEngineMetrics (C API) as JSON or
+// Prometheus text and reset them between jobs if they want per-job numbers.
+// All updates are relaxed atomics, so worker threads can record freely.
+
+#pragma once
+
+#include "Trace.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace BackupCore {
+
+    enum class MetricPhase : int {
+        Scan = 0,       // Enumerating source files
+        Read,           // Reading source files, image streams and devices
+        Hash,           // XXH64 over file and block contents
+        Compress,       // LZ compression and decompression
+        Write,          // Writing backup files, restored files and devices
+        Metadata,       // Catalogs, manifests, timestamps and attributes
+        Throttle,       // Sleeping to stay within a job's I/O limits
+        Encrypt,        // Sealing and opening encrypted blocks
+        Parity,         // Reed-Solomon parity, and repairs from it
+        Count
+    };
+
+    const char* PhaseName(MetricPhase phase);
+
+    // Steady-clock nanoseconds; the same time base as TraceClock
+    uint64_t MonotonicNanoseconds();
+
+    // Latency distribution with power-of-two microsecond buckets:
+    // bucket i holds samples below 2^i us, the last bucket everything slower
+    class LatencyHistogram {
+    public:
+        static const int BucketCount = 24;
+
+        struct Snapshot {
+            uint64_t buckets[BucketCount] = {};
+            uint64_t count = 0;
+            uint64_t sumNanoseconds = 0;
+            uint64_t maxNanoseconds = 0;
+        };
+
+        // Upper bound of bucket i in microseconds (0 for the overflow bucket)
+        static uint64_t BucketLimitMicroseconds(int bucket);
+
+        void Record(uint64_t nanoseconds);
+        Snapshot Read() const;
+        void Reset();
+
+    private:
+        std::atomic<uint64_t> buckets[BucketCount] = {};
+        std::atomic<uint64_t> count{ 0 };
+        std::atomic<uint64_t> sumNanoseconds{ 0 };
+        std::atomic<uint64_t> maxNanoseconds{ 0 };
+    };
+
+    struct PhaseSnapshot {
+        uint64_t calls = 0;
+        uint64_t bytes = 0;
+        uint64_t nanoseconds = 0;
+    };
+
+    class EngineMetrics {
+    public:
+        static EngineMetrics& Global();
+
+        void AddPhase(MetricPhase phase, uint64_t bytes, uint64_t nanoseconds);
+        PhaseSnapshot Phase(MetricPhase phase) const;
+
+        void CountFile(bool succeeded);
+
+        // Time to open a source file and its destination
+        LatencyHistogram fileOpen;
+        // Time to copy one whole file (open, read, hash, compress, write)
+        LatencyHistogram fileCopy;
+
+        void Reset();
+
+        std::string ToJson() const;
+        std::string ToPrometheus() const;
+
+    private:
+        struct PhaseCounters {
+            std::atomic<uint64_t> calls{ 0 };
+            std::atomic<uint64_t> bytes{ 0 };
+            std::atomic<uint64_t> nanoseconds{ 0 };
+        };
+
+        PhaseCounters phases[(int)MetricPhase::Count];
+        std::atomic<uint64_t> filesSucceeded{ 0 };
+        std::atomic<uint64_t> filesFailed{ 0 };
+    };
+
+    // Adds the time between construction and destruction to one phase,
+    // and records it as a "stage" span while tracing is on
+    class PhaseTimer {
+    public:
+        explicit PhaseTimer(MetricPhase phase, uint64_t bytes = 0)
+            : phase(phase), bytes(bytes), start(MonotonicNanoseconds()) {}
+
+        ~PhaseTimer() {
+            uint64_t end = MonotonicNanoseconds();
+            EngineMetrics::Global().AddPhase(phase, bytes, end - start);
+            if (TraceEnabled()) {
+                TraceComplete("stage", PhaseName(phase), start, end);
+            }
+        }
+
+        void SetBytes(uint64_t count) { bytes = count; }
+
+        PhaseTimer(const PhaseTimer&) = delete;
+        PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+    private:
+        MetricPhase phase;
+        uint64_t bytes;
+        uint64_t start;
+    };
+
+    // Records the time between construction and destruction into a histogram
+    class LatencyTimer {
+    public:
+        explicit LatencyTimer(LatencyHistogram& histogram)
+            : histogram(histogram), start(MonotonicNanoseconds()) {}
+
+        ~LatencyTimer() {
+            histogram.Record(MonotonicNanoseconds() - start);
+        }
+
+        LatencyTimer(const LatencyTimer&) = delete;
+        LatencyTimer& operator=(const LatencyTimer&) = delete;
+
+    private:
+        LatencyHistogram& histogram;
+        uint64_t start;
+    };
+}
@@ -0,0 +1,343 @@
+// Parity.cpp - Reed-Solomon parity for the stored files of a backup set
+#include "Parity.h"
+#include "Metrics.h"
+#include "Throttle.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+namespace fs = std::filesystem;
+
+namespace BackupCore {
+
+    const char* const ParityDirName = "backup_parity";
+
+    namespace {
+        const char ParityMagic[4] = { 'B', 'K', 'R', '1' };
+        const size_t HeaderSize = 20;
+        const size_t StoredSizeOffset = 12;
+
+        // Shards are a sixteenth of the file, rounded to a sector, within these bounds
+        const uint32_t MinShardSize = 512;
+        const uint32_t MaxShardSize = 64 * 1024;
+
+        void PutLe(uint8_t* p, uint64_t value, int bytes) {
+            for (int i = 0; i < bytes; i++) {
+                p[i] = (uint8_t)(value >> (8 * i));
+            }
+        }
+
+        uint64_t GetLe(const uint8_t* p, int bytes) {
+            uint64_t value = 0;
+            for (int i = 0; i < bytes; i++) {
+                value |= (uint64_t)p[i] << (8 * i);
+            }
+            return value;
+        }
+
+        uint32_t ShardSizeFor(uint64_t size) {
+            uint64_t shard = (size + ParityDataShards - 1) / ParityDataShards;
+            shard = (shard + MinShardSize - 1) / MinShardSize * MinShardSize;
+            return (uint32_t)std::min<uint64_t>(std::max<uint64_t>(shard, MinShardSize), MaxShardSize);
+        }
+
+        uint64_t EmptyHash() {
+            return Hash64(nullptr, 0);
+        }
+
+        // RepairStoredFile once the stored file exists
+        // With 'repair' false, damage is reported as Damaged and nothing is written
+        ParityResult RepairInPlace(const fs::path& storedPath, const fs::path& parityPath,
+            uint64_t& shards, std::string& error, IoThrottle* throttle, bool repair) {
+
+            // Reads are paced by the throttle and timed as reads, so a slow scrub
+            // does not show up as parity work
+            auto readInto = [&](std::istream& stream, uint8_t* buffer, size_t length) -> bool {
+                if (throttle) {
+                    throttle->Read(length);
+                }
+                PhaseTimer timer(MetricPhase::Read, length);
+                return (bool)stream.read(reinterpret_cast<char*>(buffer), length);
+            };
+
+            std::ifstream in(parityPath, std::ios::binary);
+            uint8_t header[HeaderSize];
+            if (!in.is_open() || !readInto(in, header, sizeof(header)) ||
+                std::memcmp(header, ParityMagic, sizeof(ParityMagic)) != 0) {
+                error = "No parity for " + storedPath.u8string();
+                return ParityResult::Missing;
+            }
+            uint32_t shardSize = (uint32_t)GetLe(header + 4, 4);
+            uint32_t dataShards = header[8];
+            uint32_t parityShards = header[9];
+            uint64_t storedSize = GetLe(header + StoredSizeOffset, 8);
+            if (shardSize == 0 || shardSize > MaxShardSize || dataShards == 0 ||
+                parityShards == 0 || parityShards > MaxParityShards) {
+                error = "Corrupt parity file " + parityPath.u8string();
+                return ParityResult::Missing;
+            }
+
+            std::error_code ec;
+            uint64_t actualSize = fs::file_size(storedPath, ec);
+
+            // Opened for writing only once there is something to write, so clean
+            // files on read-only storage still check out
+            std::fstream file(storedPath, std::ios::binary | std::ios::in);
+            bool writable = false;
+            if (!file.is_open()) {
+                error = "Cannot open " + storedPath.u8string();
+                return ParityResult::Unrepairable;
+            }
+
+            ReedSolomon code(dataShards, parityShards);
+            std::vector<std::vector<uint8_t>> data(dataShards, std::vector<uint8_t>(shardSize));
+            std::vector<std::vector<uint8_t>> parity(parityShards, std::vector<uint8_t>(shardSize));
+            std::vector<uint8_t*> dataPointers;
+            std::vector<const uint8_t*> parityPointers;
+            for (auto& shard : data) dataPointers.push_back(shard.data());
+            for (auto& shard : parity) parityPointers.push_back(shard.data());
+            std::vector<uint8_t> record((dataShards + parityShards) * 8);
+            std::unique_ptr<bool[]> dataPresent(new bool[dataShards]);
+            std::unique_ptr<bool[]> parityPresent(new bool[parityShards]);
+
+            uint64_t stripeSize = (uint64_t)shardSize * dataShards;
+            for (uint64_t start = 0; start < storedSize; start += stripeSize) {
+                uint64_t stripeLength = std::min(stripeSize, storedSize - start);
+                size_t length = (size_t)std::min<uint64_t>(stripeLength, shardSize);
+
+                if (!readInto(in, record.data(), record.size())) {
+                    error = "Truncated parity file " + parityPath.u8string();
+                    return ParityResult::Missing;
+                }
+                for (uint32_t p = 0; p < parityShards; p++) {
+                    parityPresent[p] = readInto(in, parity[p].data(), length);
+                    if (parityPresent[p]) {
+                        PhaseTimer timer(MetricPhase::Parity, length);
+                        parityPresent[p] = Hash64(parity[p].data(), length) == GetLe(record.data() + (dataShards + p) * 8, 8);
+                    }
+                }
+                if (!in) {
+                    error = "Truncated parity file " + parityPath.u8string();
+                    return ParityResult::Missing;
+                }
+
+                // A shard that cannot be read, or reads back different, is an erasure
+                uint32_t damaged = 0;
+                for (uint32_t j = 0; j < dataShards; j++) {
+                    uint64_t shardStart = (uint64_t)j * shardSize;
+                    size_t shardLength = shardStart < stripeLength
+                        ? (size_t)std::min<uint64_t>(stripeLength - shardStart, shardSize) : 0;
+                    std::fill(data[j].begin(), data[j].end(), 0);
+                    if (shardLength == 0) {
+                        dataPresent[j] = true;
+                        continue;
+                    }
+                    file.clear();
+                    file.seekg(start + shardStart);
+                    dataPresent[j] = readInto(file, data[j].data(), shardLength);
+                    if (dataPresent[j]) {
+                        PhaseTimer timer(MetricPhase::Parity, shardLength);
+                        dataPresent[j] = Hash64(data[j].data(), shardLength) == GetLe(record.data() + j * 8, 8);
+                    }
+                    if (!dataPresent[j]) {
+                        std::fill(data[j].begin(), data[j].end(), 0);
+                        damaged++;
+                    }
+                }
+                if (damaged == 0) {
+                    continue;
+                }
+                if (!repair) {
+                    error = std::to_string(damaged) + " damaged shards at offset " + std::to_string(start) +
+                        " of " + storedPath.u8string();
+                    return ParityResult::Damaged;
+                }
+
+                PhaseTimer timer(MetricPhase::Parity, (uint64_t)damaged * length);
+                if (!code.Reconstruct(dataPointers.data(), dataPresent.get(), parityPointers.data(), parityPresent.get(), length)) {
+                    error = std::to_string(damaged) + " damaged shards at offset " + std::to_string(start) +
+                        " of " + storedPath.u8string() + " are more than its parity can rebuild";
+                    return ParityResult::Unrepairable;
+                }
+                if (!writable) {
+                    file.close();
+                    file.open(storedPath, std::ios::binary | std::ios::in | std::ios::out);
+                    if (!file.is_open()) {
+                        error = "Cannot open " + storedPath.u8string() + " for repair";
+                        return ParityResult::Unrepairable;
+                    }
+                    writable = true;
+                }
+                for (uint32_t j = 0; j < dataShards; j++) {
+                    if (dataPresent[j]) continue;
+                    uint64_t shardStart = (uint64_t)j * shardSize;
+                    size_t shardLength = (size_t)std::min<uint64_t>(stripeLength - shardStart, shardSize);
+                    if (Hash64(data[j].data(), shardLength) != GetLe(record.data() + j * 8, 8)) {
+                        error = "Rebuilt shard does not match its hash in " + storedPath.u8string();
+                        return ParityResult::Unrepairable;
+                    }
+                    file.clear();
+                    file.seekp(start + shardStart);
+                    file.write(reinterpret_cast<const char*>(data[j].data()), shardLength);
+                    shards++;
+                }
+            }
+
+            if (writable) {
+                file.flush();
+                if (!file.good()) {
+                    error = "Failed to write repaired data to " + storedPath.u8string();
+                    return ParityResult::Unrepairable;
+                }
+            }
+            file.close();
+
+            // Anything past the end the parity knows about does not belong there
+            bool trimmed = false;
+            if (actualSize > storedSize && !repair) {
+                error = storedPath.u8string() + " is longer than its parity says";
+                return ParityResult::Damaged;
+            }
+            if (actualSize > storedSize) {
+                fs::resize_file(storedPath, storedSize, ec);
+                trimmed = !ec;
+            }
+            return (shards > 0 || trimmed) ? ParityResult::Repaired : ParityResult::Clean;
+        }
+    }
+
+    fs::path ParityPath(const fs::path& backupDir, const std::string& relativePath) {
+        return backupDir / ParityDirName / fs::u8path(relativePath);
+    }
+
+    ParityWriter::ParityWriter(uint32_t parityShards, uint64_t expectedSize)
+        : code(ParityDataShards, std::min(parityShards, MaxParityShards)),
+          shardSize(ShardSizeFor(expectedSize)),
+          parity(code.ParityShards(), std::vector<uint8_t>(shardSize, 0)),
+          hashes(ParityDataShards, EmptyHash()) {}
+
+    bool ParityWriter::Open(const fs::path& parityPath, std::string& error) {
+        path = parityPath;
+        std::error_code ec;
+        fs::create_directories(path.parent_path(), ec);
+        out.open(path, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            error = "Cannot create " + path.u8string();
+            return false;
+        }
+
+        uint8_t header[HeaderSize] = {};
+        std::memcpy(header, ParityMagic, sizeof(ParityMagic));
+        PutLe(header + 4, shardSize, 4);
+        header[8] = (uint8_t)code.DataShards();
+        header[9] = (uint8_t)code.ParityShards();
+        out.write(reinterpret_cast<const char*>(header), sizeof(header));
+        return true;
+    }
+
+    void ParityWriter::Add(const void* data, size_t length) {
+        PhaseTimer timer(MetricPhase::Parity, length);
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        while (length > 0) {
+            uint32_t index = (uint32_t)(stripeBytes / shardSize);
+            uint32_t offset = (uint32_t)(stripeBytes % shardSize);
+            size_t n = std::min<size_t>(length, shardSize - offset);
+
+            for (uint32_t p = 0; p < code.ParityShards(); p++) {
+                GfMultiplyAdd(code.Coefficient(p, index), bytes, parity[p].data() + offset, n);
+            }
+            shardHash.Update(bytes, n);
+
+            bytes += n;
+            length -= n;
+            stripeBytes += n;
+            total += n;
+            if (stripeBytes % shardSize == 0) {
+                hashes[index] = shardHash.Digest();
+                shardHash = Hash64Stream();
+                if (stripeBytes == (uint64_t)shardSize * code.DataShards()) {
+                    FlushStripe();
+                }
+            }
+        }
+    }
+
+    void ParityWriter::FlushStripe() {
+        if (stripeBytes == 0) {
+            return;
+        }
+        if (stripeBytes % shardSize != 0) {
+            hashes[stripeBytes / shardSize] = shardHash.Digest();
+            shardHash = Hash64Stream();
+        }
+
+        // Parity is only as long as the stripe's longest (first) shard
+        size_t length = (size_t)std::min<uint64_t>(stripeBytes, shardSize);
+        std::vector<uint8_t> record((code.DataShards() + code.ParityShards()) * 8);
+        for (uint32_t j = 0; j < code.DataShards(); j++) {
+            PutLe(record.data() + j * 8, hashes[j], 8);
+        }
+        for (uint32_t p = 0; p < code.ParityShards(); p++) {
+            PutLe(record.data() + (code.DataShards() + p) * 8, Hash64(parity[p].data(), length), 8);
+        }
+        out.write(reinterpret_cast<const char*>(record.data()), record.size());
+        for (uint32_t p = 0; p < code.ParityShards(); p++) {
+            out.write(reinterpret_cast<const char*>(parity[p].data()), length);
+            std::memset(parity[p].data(), 0, length);
+        }
+
+        std::fill(hashes.begin(), hashes.end(), EmptyHash());
+        stripeBytes = 0;
+    }
+
+    bool ParityWriter::Finish(std::string& error) {
+        FlushStripe();
+        uint8_t size[8];
+        PutLe(size, total, 8);
+        out.seekp(StoredSizeOffset);
+        out.write(reinterpret_cast<const char*>(size), sizeof(size));
+        out.flush();
+        if (!out.good()) {
+            error = "Failed to write " + path.u8string();
+            return false;
+        }
+        out.close();
+        return true;
+    }
+
+    ParityResult RepairStoredFile(const fs::path& storedPath, const fs::path& parityPath,
+        uint64_t& shards, std::string& error, IoThrottle* throttle) {
+
+        TraceSpan span("parity", "RepairStoredFile", storedPath.u8string());
+        shards = 0;
+
+        // A stored file that vanished is rebuilt from nothing, if parity
+        // allows; if not, the empty stand-in goes again
+        std::error_code ec;
+        bool created = false;
+        if (!fs::exists(storedPath, ec) && fs::exists(parityPath, ec)) {
+            fs::create_directories(storedPath.parent_path(), ec);
+            std::ofstream create(storedPath, std::ios::binary);
+            created = create.is_open();
+        }
+        ParityResult result = RepairInPlace(storedPath, parityPath, shards, error, throttle, true);
+        if (created && result != ParityResult::Repaired) {
+            fs::remove(storedPath, ec);
+        }
+        return result;
+    }
+
+    ParityResult CheckStoredFile(const fs::path& storedPath, const fs::path& parityPath,
+        std::string& error, IoThrottle* throttle) {
+
+        TraceSpan span("parity", "CheckStoredFile", storedPath.u8string());
+        std::error_code ec;
+        if (!fs::exists(storedPath, ec) && fs::exists(parityPath, ec)) {
+            error = storedPath.u8string() + " is missing";
+            return ParityResult::Damaged;
+        }
+        uint64_t shards = 0;
+        return RepairInPlace(storedPath, parityPath, shards, error, throttle, false);
+    }
+}
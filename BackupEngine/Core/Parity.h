@@ -0,0 +1,77 @@
+// Parity.h - Reed-Solomon parity for the stored files of a backup set
+//
+// With parity enabled, every stored file gets a parity file of the same
+// relative path under backup_parity/ in the set. The stored bytes are cut
+// into stripes of ParityDataShards shards; each stripe adds m parity shards
+// (ReedSolomon.h) and the XXH64 of every shard:
+//   "BKR1", u32 shardSize, u8 dataShards, u8 parityShards, u16 0, u64 storedSize
+//   then per stripe: (dataShards + parityShards) x u64 shard hash,
+//                    parityShards x shard (as long as the stripe's first shard)
+// The hashes say which shards a bad sector or a stray write damaged, so up
+// to m damaged shards per stripe are rebuilt in place. The last stripe may
+// be short; its missing shards count as empty.
+
+#pragma once
+
+#include "Checksum.h"
+#include "ReedSolomon.h"
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace BackupCore {
+
+    class IoThrottle;
+
+    extern const char* const ParityDirName;
+
+    const uint32_t ParityDataShards = 16;
+    const uint32_t MaxParityShards = 8;
+
+    std::filesystem::path ParityPath(const std::filesystem::path& backupDir, const std::string& relativePath);
+
+    // Computes parity while a stored file is written; sees every byte that
+    // goes into the stored file, in order
+    class ParityWriter {
+    public:
+        // expectedSize picks the shard size, so small files get small shards
+        ParityWriter(uint32_t parityShards, uint64_t expectedSize);
+
+        bool Open(const std::filesystem::path& path, std::string& error);
+        void Add(const void* data, size_t length);
+        bool Finish(std::string& error);
+
+    private:
+        void FlushStripe();
+
+        ReedSolomon code;
+        uint32_t shardSize;
+        std::filesystem::path path;
+        std::ofstream out;
+        std::vector<std::vector<uint8_t>> parity;
+        std::vector<uint64_t> hashes;   // Data shards of the current stripe
+        Hash64Stream shardHash;         // The data shard being filled
+        uint64_t stripeBytes = 0;
+        uint64_t total = 0;
+    };
+
+    enum class ParityResult {
+        Clean,          // Every shard matched its hash
+        Repaired,       // Damaged shards were rebuilt and written back
+        Unrepairable,   // More damage in a stripe than it has parity
+        Missing,        // No usable parity file
+        Damaged         // CheckStoredFile only: damage that RepairStoredFile may rebuild
+    };
+
+    // Checks a stored file against its parity file and rewrites damaged
+    // shards; 'shards' gets how many were rebuilt. Reads of both files are
+    // charged to 'throttle' if one is given.
+    ParityResult RepairStoredFile(const std::filesystem::path& storedPath, const std::filesystem::path& parityPath,
+        uint64_t& shards, std::string& error, IoThrottle* throttle = nullptr);
+
+    // The same check without writing anything, so it needs no lock on the set
+    ParityResult CheckStoredFile(const std::filesystem::path& storedPath, const std::filesystem::path& parityPath,
+        std::string& error, IoThrottle* throttle = nullptr);
+}
@@ -0,0 +1,401 @@
+// PartitionTable.cpp - MBR/GPT partition table parsing and filesystem detection
+#include "PartitionTable.h"
+#include "Checksum.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace BackupCore {
+
+    namespace {
+        const uint64_t GptSignature = 0x5452415020494645ULL;   // "EFI PART"
+        const uint32_t MaxGptEntries = 1024;
+
+        uint16_t Le16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+        uint32_t Le32(const uint8_t* p) { return (uint32_t)Le16(p) | ((uint32_t)Le16(p + 2) << 16); }
+        uint64_t Le64(const uint8_t* p) { return (uint64_t)Le32(p) | ((uint64_t)Le32(p + 4) << 32); }
+
+        bool IsZero(const uint8_t* p, size_t length) {
+            for (size_t i = 0; i < length; i++) {
+                if (p[i] != 0) return false;
+            }
+            return true;
+        }
+
+        // GUIDs are stored mixed-endian: the first three fields are little-endian
+        std::string FormatGuid(const uint8_t* g) {
+            char text[37];
+            snprintf(text, sizeof(text),
+                "%08X-%04X-%04X-%02X%02X-%02X%02X%02X%02X%02X%02X",
+                Le32(g), Le16(g + 4), Le16(g + 6),
+                g[8], g[9], g[10], g[11], g[12], g[13], g[14], g[15]);
+            return text;
+        }
+
+        std::string Utf16ToUtf8(const uint8_t* p, size_t maxChars) {
+            std::string out;
+            for (size_t i = 0; i < maxChars; i++) {
+                uint32_t c = Le16(p + i * 2);
+                if (c == 0) break;
+
+                if (c >= 0xD800 && c <= 0xDBFF && i + 1 < maxChars) {
+                    uint32_t low = Le16(p + (i + 1) * 2);
+                    if (low >= 0xDC00 && low <= 0xDFFF) {
+                        c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                        i++;
+                    }
+                }
+
+                if (c < 0x80) {
+                    out += (char)c;
+                }
+                else if (c < 0x800) {
+                    out += (char)(0xC0 | (c >> 6));
+                    out += (char)(0x80 | (c & 0x3F));
+                }
+                else if (c < 0x10000) {
+                    out += (char)(0xE0 | (c >> 12));
+                    out += (char)(0x80 | ((c >> 6) & 0x3F));
+                    out += (char)(0x80 | (c & 0x3F));
+                }
+                else {
+                    out += (char)(0xF0 | (c >> 18));
+                    out += (char)(0x80 | ((c >> 12) & 0x3F));
+                    out += (char)(0x80 | ((c >> 6) & 0x3F));
+                    out += (char)(0x80 | (c & 0x3F));
+                }
+            }
+            return out;
+        }
+
+        bool IsExtendedType(uint8_t type) {
+            return type == 0x05 || type == 0x0F || type == 0x85;
+        }
+
+        // Read and validate a GPT header at 'lba'; fills entries on success
+        bool ReadGptAt(BlockDevice& device, uint32_t sectorSize, uint64_t lba,
+            DiskLayout& layout, uint64_t& firstUsable, uint64_t& lastUsable) {
+
+            std::vector<uint8_t> header(sectorSize);
+            if (!device.ReadAt(lba * sectorSize, header.data(), sectorSize)) {
+                return false;
+            }
+            if (Le64(header.data()) != GptSignature) {
+                return false;
+            }
+
+            uint32_t headerSize = Le32(&header[12]);
+            if (headerSize < 92 || headerSize > sectorSize) {
+                return false;
+            }
+
+            uint32_t storedCrc = Le32(&header[16]);
+            std::memset(&header[16], 0, 4);
+            if (Crc32(header.data(), headerSize) != storedCrc) {
+                return false;
+            }
+
+            firstUsable = Le64(&header[40]);
+            lastUsable = Le64(&header[48]);
+            uint64_t entriesLba = Le64(&header[72]);
+            uint32_t entryCount = Le32(&header[80]);
+            uint32_t entrySize = Le32(&header[84]);
+            uint32_t entriesCrc = Le32(&header[88]);
+
+            if (entrySize < 128 || entrySize > 4096 || entryCount == 0 || entryCount > MaxGptEntries) {
+                return false;
+            }
+
+            std::vector<uint8_t> entries((size_t)entryCount * entrySize);
+            if (!device.ReadAt(entriesLba * sectorSize, entries.data(), entries.size())) {
+                return false;
+            }
+            if (Crc32(entries.data(), entries.size()) != entriesCrc) {
+                return false;
+            }
+
+            layout.diskId = FormatGuid(&header[56]);
+            layout.partitions.clear();
+
+            for (uint32_t i = 0; i < entryCount; i++) {
+                const uint8_t* e = &entries[(size_t)i * entrySize];
+                if (IsZero(e, 16)) {
+                    continue;   // Unused entry
+                }
+
+                uint64_t firstLba = Le64(e + 32);
+                uint64_t lastLba = Le64(e + 40);
+                if (lastLba < firstLba) {
+                    continue;
+                }
+
+                PartitionInfo part;
+                part.index = (int)i + 1;
+                part.typeId = FormatGuid(e);
+                part.uniqueId = FormatGuid(e + 16);
+                part.offset = firstLba * sectorSize;
+                part.length = (lastLba - firstLba + 1) * sectorSize;
+                part.name = Utf16ToUtf8(e + 56, 36);
+                layout.partitions.push_back(part);
+            }
+            return true;
+        }
+
+        bool ReadGpt(BlockDevice& device, uint32_t sectorSize, DiskLayout& layout) {
+            uint64_t firstUsable = 0;
+            uint64_t lastUsable = 0;
+            uint64_t lastLba = device.Size() / sectorSize - 1;
+
+            // Fall back to the backup header if the primary one is damaged
+            if (!ReadGptAt(device, sectorSize, 1, layout, firstUsable, lastUsable) &&
+                !ReadGptAt(device, sectorSize, lastLba, layout, firstUsable, lastUsable)) {
+                return false;
+            }
+
+            layout.scheme = PartitionScheme::GPT;
+            layout.sectorSize = sectorSize;
+
+            // Protective MBR + primary header/entries, and backup entries/header
+            layout.reservedRanges.push_back({ 0, firstUsable * sectorSize });
+            if (lastUsable < lastLba) {
+                layout.reservedRanges.push_back({
+                    (lastUsable + 1) * sectorSize,
+                    device.Size() - (lastUsable + 1) * sectorSize });
+            }
+            return true;
+        }
+
+        void ReadMbrEntries(const uint8_t* mbr, uint64_t baseLba, uint32_t sectorSize,
+            int& nextIndex, bool logical, DiskLayout& layout,
+            uint64_t& extendedLba, uint64_t& nextEbrLba) {
+
+            for (int i = 0; i < 4; i++) {
+                const uint8_t* e = mbr + 446 + i * 16;
+                uint8_t type = e[4];
+                uint32_t startLba = Le32(e + 8);
+                uint32_t sectors = Le32(e + 12);
+
+                if (type == 0 || sectors == 0) {
+                    continue;
+                }
+
+                if (IsExtendedType(type)) {
+                    if (!logical) {
+                        extendedLba = startLba;
+                    }
+                    else {
+                        nextEbrLba = extendedLba + startLba;
+                    }
+                    continue;
+                }
+
+                PartitionInfo part;
+                part.index = logical ? nextIndex++ : i + 1;
+                part.offset = (baseLba + startLba) * (uint64_t)sectorSize;
+                part.length = (uint64_t)sectors * sectorSize;
+                part.bootable = (e[0] & 0x80) != 0;
+
+                char typeText[3];
+                snprintf(typeText, sizeof(typeText), "%02X", type);
+                part.typeId = typeText;
+                layout.partitions.push_back(part);
+            }
+        }
+
+        bool ReadMbr(BlockDevice& device, const uint8_t* mbr, uint32_t sectorSize, DiskLayout& layout) {
+            layout.scheme = PartitionScheme::MBR;
+            layout.sectorSize = sectorSize;
+
+            char signature[9];
+            snprintf(signature, sizeof(signature), "%08X", Le32(mbr + 440));
+            layout.diskId = signature;
+
+            int nextIndex = 5;
+            uint64_t extendedLba = 0;
+            uint64_t unused = 0;
+            ReadMbrEntries(mbr, 0, sectorSize, nextIndex, false, layout, extendedLba, unused);
+
+            uint64_t firstPartitionLba = device.Size() / sectorSize;
+            for (const auto& part : layout.partitions) {
+                firstPartitionLba = std::min(firstPartitionLba, part.offset / sectorSize);
+            }
+
+            // Walk the chain of extended boot records
+            std::vector<uint8_t> ebr(sectorSize);
+            uint64_t ebrLba = extendedLba;
+            int guard = 0;
+            while (ebrLba != 0 && guard++ < 128) {
+                firstPartitionLba = std::min(firstPartitionLba, ebrLba);
+                if (!device.ReadAt(ebrLba * sectorSize, ebr.data(), sectorSize) ||
+                    ebr[510] != 0x55 || ebr[511] != 0xAA) {
+                    break;
+                }
+
+                layout.reservedRanges.push_back({ ebrLba * sectorSize, sectorSize });
+
+                uint64_t nextEbrLba = 0;
+                ReadMbrEntries(ebr.data(), ebrLba, sectorSize, nextIndex, true, layout, extendedLba, nextEbrLba);
+                ebrLba = nextEbrLba;
+            }
+
+            // MBR plus the post-MBR gap (legacy boot loaders live there)
+            layout.reservedRanges.insert(layout.reservedRanges.begin(),
+                { 0, std::max<uint64_t>(1, firstPartitionLba) * sectorSize });
+            return true;
+        }
+    }
+
+    bool ReadDiskLayout(BlockDevice& device, DiskLayout& layout, std::string& error) {
+        layout = DiskLayout();
+        layout.diskSize = device.Size();
+        layout.sectorSize = device.SectorSize();
+
+        if (layout.diskSize < 2 * 512) {
+            error = "Device is too small to hold a partition table";
+            return false;
+        }
+
+        std::vector<uint8_t> mbr(512);
+        if (!device.ReadAt(0, mbr.data(), mbr.size())) {
+            error = "Failed to read sector 0";
+            return false;
+        }
+
+        bool hasMbrSignature = mbr[510] == 0x55 && mbr[511] == 0xAA;
+        bool protective = false;
+        for (int i = 0; i < 4; i++) {
+            if (mbr[446 + i * 16 + 4] == 0xEE) {
+                protective = true;
+            }
+        }
+
+        // Image files do not report a sector size; probe 4Kn layouts as well
+        std::vector<uint32_t> sectorSizes = { device.SectorSize() };
+        if (!device.IsDisk() && device.SectorSize() != 4096) {
+            sectorSizes.push_back(4096);
+        }
+
+        if (protective || !hasMbrSignature) {
+            for (uint32_t sectorSize : sectorSizes) {
+                if (layout.diskSize >= 3ULL * sectorSize && ReadGpt(device, sectorSize, layout)) {
+                    break;
+                }
+            }
+        }
+
+        if (layout.scheme == PartitionScheme::None && hasMbrSignature && !protective) {
+            ReadMbr(device, mbr.data(), device.SectorSize(), layout);
+        }
+
+        if (layout.scheme == PartitionScheme::None && protective) {
+            error = "Protective MBR found but GPT headers are damaged";
+            return false;
+        }
+
+        std::sort(layout.partitions.begin(), layout.partitions.end(),
+            [](const PartitionInfo& a, const PartitionInfo& b) { return a.offset < b.offset; });
+        std::sort(layout.reservedRanges.begin(), layout.reservedRanges.end(),
+            [](const ByteRange& a, const ByteRange& b) { return a.offset < b.offset; });
+
+        for (auto& part : layout.partitions) {
+            if (part.offset + part.length > layout.diskSize) {
+                error = "Partition " + std::to_string(part.index) + " extends past the end of the disk";
+                return false;
+            }
+            part.fileSystem = DetectFileSystem(device, part.offset, part.length);
+        }
+
+        return true;
+    }
+
+    FileSystemType DetectFileSystem(BlockDevice& device, uint64_t offset, uint64_t length) {
+        if (length < 4096) {
+            return FileSystemType::Unknown;
+        }
+
+        uint8_t sector[4096];
+        if (!device.ReadAt(offset, sector, sizeof(sector))) {
+            return FileSystemType::Unknown;
+        }
+
+        if (std::memcmp(sector + 3, "NTFS    ", 8) == 0) return FileSystemType::NTFS;
+        if (std::memcmp(sector + 3, "ReFS\0\0\0\0", 8) == 0) return FileSystemType::ReFS;
+        if (std::memcmp(sector + 3, "EXFAT   ", 8) == 0) return FileSystemType::ExFAT;
+        if (std::memcmp(sector + 3, "-FVE-FS-", 8) == 0) return FileSystemType::BitLocker;
+        if (std::memcmp(sector + 82, "FAT32   ", 8) == 0) return FileSystemType::FAT;
+        if (std::memcmp(sector + 54, "FAT1", 4) == 0) return FileSystemType::FAT;
+        if (std::memcmp(sector, "XFSB", 4) == 0) return FileSystemType::XFS;
+        if (Le16(sector + 1024 + 56) == 0xEF53) return FileSystemType::Ext;
+        if (std::memcmp(sector + 4096 - 10, "SWAPSPACE2", 10) == 0) return FileSystemType::Swap;
+
+        return FileSystemType::Unknown;
+    }
+
+    const char* SchemeName(PartitionScheme scheme) {
+        switch (scheme) {
+            case PartitionScheme::MBR: return "MBR";
+            case PartitionScheme::GPT: return "GPT";
+            default: return "None";
+        }
+    }
+
+    const char* FileSystemName(FileSystemType type) {
+        switch (type) {
+            case FileSystemType::NTFS: return "NTFS";
+            case FileSystemType::ReFS: return "ReFS";
+            case FileSystemType::FAT: return "FAT";
+            case FileSystemType::ExFAT: return "exFAT";
+            case FileSystemType::BitLocker: return "BitLocker";
+            case FileSystemType::Ext: return "ext";
+            case FileSystemType::XFS: return "XFS";
+            case FileSystemType::Swap: return "swap";
+            default: return "Unknown";
+        }
+    }
+
+    PartitionScheme ParseSchemeName(const std::string& name) {
+        if (name == "MBR") return PartitionScheme::MBR;
+        if (name == "GPT") return PartitionScheme::GPT;
+        return PartitionScheme::None;
+    }
+
+    FileSystemType ParseFileSystemName(const std::string& name) {
+        const FileSystemType all[] = {
+            FileSystemType::NTFS, FileSystemType::ReFS, FileSystemType::FAT,
+            FileSystemType::ExFAT, FileSystemType::BitLocker, FileSystemType::Ext,
+            FileSystemType::XFS, FileSystemType::Swap
+        };
+        for (FileSystemType type : all) {
+            if (name == FileSystemName(type)) return type;
+        }
+        return FileSystemType::Unknown;
+    }
+
+    std::string PartitionTypeName(const std::string& typeId) {
+        static const struct { const char* id; const char* name; } knownTypes[] = {
+            { "C12A7328-F81F-11D2-BA4B-00A0C93EC93B", "EFI System" },
+            { "E3C9E316-0B5C-4DB8-817D-F92DF00215AE", "Microsoft Reserved" },
+            { "EBD0A0A2-B9E5-4433-87C0-68B6B72699C7", "Basic Data" },
+            { "DE94BBA4-06D1-4D40-A16A-BFD50179D6AC", "Windows Recovery" },
+            { "5808C8AA-7E8F-42E0-85D2-E1E90434CFB3", "LDM Metadata" },
+            { "AF9B60A0-1431-4F62-BC68-3311714A69AD", "LDM Data" },
+            { "E75CAF8F-F680-4CEE-AFA3-B001E56EFC2D", "Storage Spaces" },
+            { "0FC63DAF-8483-4772-8E79-3D69D8477DE4", "Linux Filesystem" },
+            { "0657FD6D-A4AB-43C4-84E5-0933C84B4F4F", "Linux Swap" },
+            { "E6D6D379-F507-44C2-A23C-238F2A3DF928", "Linux LVM" },
+            { "21686148-6449-6E6F-744E-656564454649", "BIOS Boot" },
+            { "07", "NTFS/exFAT" },
+            { "0B", "FAT32" },
+            { "0C", "FAT32 (LBA)" },
+            { "27", "Windows Recovery" },
+            { "82", "Linux Swap" },
+            { "83", "Linux" },
+            { "8E", "Linux LVM" }
+        };
+
+        for (const auto& known : knownTypes) {
+            if (typeId == known.id) return known.name;
+        }
+        return typeId;
+    }
+}
@@ -0,0 +1,74 @@
+// PartitionTable.h - MBR/GPT partition table parsing and filesystem detection
+
+#pragma once
+
+#include "BlockDevice.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace BackupCore {
+
+    enum class PartitionScheme {
+        None,       // No recognizable table (superfloppy or blank disk)
+        MBR,
+        GPT
+    };
+
+    enum class FileSystemType {
+        Unknown,
+        NTFS,
+        ReFS,
+        FAT,
+        ExFAT,
+        BitLocker,
+        Ext,
+        XFS,
+        Swap
+    };
+
+    struct ByteRange {
+        uint64_t offset = 0;
+        uint64_t length = 0;
+
+        uint64_t End() const { return offset + length; }
+    };
+
+    struct PartitionInfo {
+        int index = 0;              // 1-based; MBR logical partitions start at 5
+        uint64_t offset = 0;        // Byte offset on disk
+        uint64_t length = 0;        // Byte length
+        std::string typeId;         // GPT type GUID, or MBR type as two hex digits
+        std::string uniqueId;       // GPT partition GUID (empty for MBR)
+        std::string name;           // GPT partition name (UTF-8)
+        bool bootable = false;      // MBR active flag
+        FileSystemType fileSystem = FileSystemType::Unknown;
+    };
+
+    struct DiskLayout {
+        PartitionScheme scheme = PartitionScheme::None;
+        uint32_t sectorSize = 512;
+        uint64_t diskSize = 0;
+        std::string diskId;         // GPT disk GUID, or MBR disk signature
+
+        std::vector<PartitionInfo> partitions;      // Sorted by offset
+
+        // Regions outside every partition that still have to be preserved:
+        // MBR/boot code, GPT headers and entry arrays, EBR sectors
+        std::vector<ByteRange> reservedRanges;
+    };
+
+    // Parse the partition table of a disk or disk image
+    bool ReadDiskLayout(BlockDevice& device, DiskLayout& layout, std::string& error);
+
+    // Probe the boot sector/superblock at 'offset' for a known filesystem
+    FileSystemType DetectFileSystem(BlockDevice& device, uint64_t offset, uint64_t length);
+
+    const char* SchemeName(PartitionScheme scheme);
+    const char* FileSystemName(FileSystemType type);
+    PartitionScheme ParseSchemeName(const std::string& name);
+    FileSystemType ParseFileSystemName(const std::string& name);
+
+    // Human-readable name for well-known GPT type GUIDs and MBR type bytes
+    std::string PartitionTypeName(const std::string& typeId);
+}
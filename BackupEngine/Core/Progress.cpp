@@ -0,0 +1,130 @@
+// Progress.cpp - Aggregated, rate-limited progress reporting
+#include "Progress.h"
+#include "JobStatus.h"
+#include "Metrics.h"
+
+namespace BackupCore {
+
+    namespace {
+        const char* const PhaseNames[] = {
+            "idle", "scanning", "copying", "verifying", "restoring", "finalizing", "completed", "failed"
+        };
+
+        // Weight of the newest interval in the smoothed rate
+        const double RateSmoothing = 0.3;
+    }
+
+    const char* ProgressPhaseName(ProgressPhase phase) {
+        int index = (int)phase;
+        return (index >= 0 && index < (int)(sizeof(PhaseNames) / sizeof(PhaseNames[0]))) ? PhaseNames[index] : "unknown";
+    }
+
+    ProgressChannel::ProgressChannel(Sink sink, uint32_t intervalMilliseconds)
+        : sink(std::move(sink)),
+          intervalNs((uint64_t)(intervalMilliseconds ? intervalMilliseconds : 1) * 1000000),
+          startNs(MonotonicNanoseconds()) {
+        lastNs = startNs;
+        nextDueNs.store(startNs + intervalNs, std::memory_order_relaxed);
+    }
+
+    ProgressChannel::~ProgressChannel() = default;
+
+    void ProgressChannel::Publish(const std::string& jobName) {
+        std::lock_guard<std::mutex> guard(deliverLock);
+        publisher.reset(new JobStatusPublisher(jobName));
+        publisher->Update(Snapshot());
+    }
+
+    void ProgressChannel::SetPhase(ProgressPhase newPhase) {
+        phase.store((int32_t)newPhase, std::memory_order_relaxed);
+        Deliver(MonotonicNanoseconds(), true);
+    }
+
+    void ProgressChannel::SetTotals(uint64_t files, uint64_t bytes) {
+        filesTotal.store(files, std::memory_order_relaxed);
+        bytesTotal.store(bytes, std::memory_order_relaxed);
+    }
+
+    void ProgressChannel::Finish(bool succeeded) {
+        if (finished.exchange(true)) {
+            return;
+        }
+        phase.store((int32_t)(succeeded ? ProgressPhase::Completed : ProgressPhase::Failed), std::memory_order_relaxed);
+        Deliver(MonotonicNanoseconds(), true);
+    }
+
+    ProgressStatus ProgressChannel::Snapshot() const {
+        ProgressStatus status;
+        status.phase = phase.load(std::memory_order_relaxed);
+        status.filesDone = filesDone.load(std::memory_order_relaxed);
+        status.filesTotal = filesTotal.load(std::memory_order_relaxed);
+        status.filesFailed = filesFailed.load(std::memory_order_relaxed);
+        status.bytesDone = bytesDone.load(std::memory_order_relaxed);
+        status.bytesTotal = bytesTotal.load(std::memory_order_relaxed);
+
+        uint64_t filesSeen = status.filesDone + status.filesFailed;
+        if (status.phase == (int32_t)ProgressPhase::Completed) {
+            status.percent = 100;
+        } else if (status.bytesTotal > 0) {
+            status.percent = (int32_t)(status.bytesDone * 100 / status.bytesTotal);
+        } else if (status.filesTotal > 0) {
+            status.percent = (int32_t)(filesSeen * 100 / status.filesTotal);
+        }
+        if (status.percent > 100) status.percent = 100;
+
+        status.elapsedSeconds = (MonotonicNanoseconds() - startNs) / 1e9;
+        return status;
+    }
+
+    void ProgressChannel::Tick() {
+        // Fast path: one relaxed load and a clock read until the interval is up
+        uint64_t due = nextDueNs.load(std::memory_order_relaxed);
+        uint64_t now = MonotonicNanoseconds();
+        if (now < due) {
+            return;
+        }
+
+        // Exactly one thread wins the interval and reports it
+        if (nextDueNs.compare_exchange_strong(due, now + intervalNs, std::memory_order_relaxed)) {
+            Deliver(now, false);
+        }
+    }
+
+    void ProgressChannel::Deliver(uint64_t now, bool wait) {
+        std::unique_lock<std::mutex> guard(deliverLock, std::defer_lock);
+        if (wait) {
+            guard.lock();
+        } else if (!guard.try_lock()) {
+            // The previous status is still being delivered; skip this one
+            return;
+        }
+
+        ProgressStatus status = Snapshot();
+
+        if (now > lastNs && status.bytesDone >= lastBytes) {
+            double seconds = (now - lastNs) / 1e9;
+            double current = (status.bytesDone - lastBytes) / seconds;
+            rate = (lastBytes == 0 && rate == 0) ? current : rate + RateSmoothing * (current - rate);
+            lastNs = now;
+            lastBytes = status.bytesDone;
+        }
+
+        status.bytesPerSecond = rate;
+        if (rate > 0 && status.bytesTotal >= status.bytesDone) {
+            status.etaSeconds = (status.bytesTotal - status.bytesDone) / rate;
+        }
+
+        // The final status carries the average over the whole run
+        if (status.phase == (int32_t)ProgressPhase::Completed || status.phase == (int32_t)ProgressPhase::Failed) {
+            status.bytesPerSecond = status.elapsedSeconds > 0 ? status.bytesDone / status.elapsedSeconds : 0;
+            status.etaSeconds = 0;
+        }
+
+        if (publisher) {
+            publisher->Update(status);
+        }
+        if (sink) {
+            sink(status);
+        }
+    }
+}
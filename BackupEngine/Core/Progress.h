@@ -0,0 +1,107 @@
+// Progress.h - Aggregated, rate-limited progress reporting
+//
+// Workers add bytes and files with relaxed atomics; whichever call first
+// crosses the reporting interval builds one ProgressStatus and hands it to
+// the sink. Callers therefore see at most one update per interval (10 Hz by
+// default) no matter how many small files go by, plus one on every phase
+// change and a final one from Finish.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace BackupCore {
+
+    enum class ProgressPhase : int32_t {
+        Idle = 0,
+        Scanning,
+        Copying,
+        Verifying,
+        Restoring,
+        Finalizing,
+        Completed,
+        Failed
+    };
+
+    const char* ProgressPhaseName(ProgressPhase phase);
+
+    class JobStatusPublisher;
+
+    // Plain layout; mirrored by BACKUP_PROGRESS in the C API
+    struct ProgressStatus {
+        int32_t phase = 0;
+        int32_t percent = 0;
+        uint64_t filesDone = 0;
+        uint64_t filesTotal = 0;
+        uint64_t filesFailed = 0;
+        uint64_t bytesDone = 0;
+        uint64_t bytesTotal = 0;
+        double bytesPerSecond = 0;  // Smoothed over recent intervals
+        double elapsedSeconds = 0;
+        double etaSeconds = -1;     // -1 while unknown
+    };
+
+    class ProgressChannel {
+    public:
+        typedef std::function<void(const ProgressStatus&)> Sink;
+
+        explicit ProgressChannel(Sink sink, uint32_t intervalMilliseconds = 100);
+        ~ProgressChannel();
+
+        ProgressChannel(const ProgressChannel&) = delete;
+        ProgressChannel& operator=(const ProgressChannel&) = delete;
+
+        // Also publish every delivered status to the shared job status region
+        // (see JobStatus.h) until the channel is destroyed
+        void Publish(const std::string& jobName);
+
+        // Phase changes are always delivered
+        void SetPhase(ProgressPhase phase);
+
+        void SetTotals(uint64_t files, uint64_t bytes);
+
+        void AddBytes(uint64_t bytes) {
+            bytesDone.fetch_add(bytes, std::memory_order_relaxed);
+            Tick();
+        }
+
+        void AddFile(bool succeeded) {
+            (succeeded ? filesDone : filesFailed).fetch_add(1, std::memory_order_relaxed);
+            Tick();
+        }
+
+        // Deliver the final status (Completed or Failed); later calls do nothing
+        void Finish(bool succeeded);
+
+        ProgressStatus Snapshot() const;
+
+    private:
+        void Tick();
+        void Deliver(uint64_t now, bool wait);
+
+        Sink sink;
+        std::unique_ptr<JobStatusPublisher> publisher;
+        uint64_t intervalNs;
+        uint64_t startNs;
+
+        std::atomic<int32_t> phase{ (int32_t)ProgressPhase::Idle };
+        std::atomic<uint64_t> filesDone{ 0 };
+        std::atomic<uint64_t> filesTotal{ 0 };
+        std::atomic<uint64_t> filesFailed{ 0 };
+        std::atomic<uint64_t> bytesDone{ 0 };
+        std::atomic<uint64_t> bytesTotal{ 0 };
+        std::atomic<uint64_t> nextDueNs{ 0 };
+        std::atomic<bool> finished{ false };
+
+        // Held only while one status is built and delivered
+        std::mutex deliverLock;
+        uint64_t lastBytes = 0;
+        uint64_t lastNs = 0;
+        double rate = 0;
+    };
+}
@@ -0,0 +1,305 @@
+// ReedSolomon.cpp - Systematic Reed-Solomon erasure code over GF(2^8)
+#include "ReedSolomon.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define GF_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define GF_NEON 1
+#include <arm_neon.h>
+#endif
+
+// GCC and Clang compile a function for an instruction set only when asked;
+// MSVC allows the intrinsics anywhere
+#if defined(__GNUC__) || defined(__clang__)
+#define GF_TARGET(isa) __attribute__((target(isa)))
+#else
+#define GF_TARGET(isa)
+#endif
+
+namespace BackupCore {
+
+    namespace {
+        // x^8 + x^4 + x^3 + x^2 + 1, the usual polynomial for RS over bytes
+        const unsigned Polynomial = 0x11d;
+
+        struct GfTables {
+            uint8_t exp[512];
+            uint8_t log[256];
+
+            GfTables() {
+                unsigned x = 1;
+                for (int i = 0; i < 255; i++) {
+                    exp[i] = (uint8_t)x;
+                    log[x] = (uint8_t)i;
+                    x <<= 1;
+                    if (x & 0x100) x ^= Polynomial;
+                }
+                for (int i = 255; i < 512; i++) {
+                    exp[i] = exp[i - 255];
+                }
+                log[0] = 0;
+            }
+        };
+
+        const GfTables& Tables() {
+            static const GfTables tables;
+            return tables;
+        }
+
+        uint8_t GfInverse(uint8_t a) {
+            const GfTables& t = Tables();
+            return t.exp[255 - t.log[a]];
+        }
+
+        typedef void (*MultiplyAddKernel)(const uint8_t* low, const uint8_t* high,
+            const uint8_t* src, uint8_t* dst, size_t length);
+
+        // low[n] = c * n and high[n] = c * (n << 4), so c * b = low[b & 15] ^ high[b >> 4]
+        void MultiplyAddScalar(const uint8_t* low, const uint8_t* high, const uint8_t* src, uint8_t* dst, size_t length) {
+            for (size_t i = 0; i < length; i++) {
+                dst[i] ^= low[src[i] & 15] ^ high[src[i] >> 4];
+            }
+        }
+
+#if GF_X86
+        GF_TARGET("ssse3")
+        void MultiplyAddSsse3(const uint8_t* low, const uint8_t* high, const uint8_t* src, uint8_t* dst, size_t length) {
+            __m128i lowTable = _mm_loadu_si128(reinterpret_cast<const __m128i*>(low));
+            __m128i highTable = _mm_loadu_si128(reinterpret_cast<const __m128i*>(high));
+            __m128i mask = _mm_set1_epi8(0x0f);
+            size_t i = 0;
+            for (; i + 16 <= length; i += 16) {
+                __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+                __m128i product = _mm_xor_si128(
+                    _mm_shuffle_epi8(lowTable, _mm_and_si128(s, mask)),
+                    _mm_shuffle_epi8(highTable, _mm_and_si128(_mm_srli_epi64(s, 4), mask)));
+                __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(d, product));
+            }
+            MultiplyAddScalar(low, high, src + i, dst + i, length - i);
+        }
+
+        GF_TARGET("avx2")
+        void MultiplyAddAvx2(const uint8_t* low, const uint8_t* high, const uint8_t* src, uint8_t* dst, size_t length) {
+            __m256i lowTable = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(low)));
+            __m256i highTable = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(high)));
+            __m256i mask = _mm256_set1_epi8(0x0f);
+            size_t i = 0;
+            for (; i + 32 <= length; i += 32) {
+                __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+                __m256i product = _mm256_xor_si256(
+                    _mm256_shuffle_epi8(lowTable, _mm256_and_si256(s, mask)),
+                    _mm256_shuffle_epi8(highTable, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask)));
+                __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_xor_si256(d, product));
+            }
+            MultiplyAddScalar(low, high, src + i, dst + i, length - i);
+        }
+
+        bool CpuHasAvx2() {
+#ifdef _MSC_VER
+            int info[4];
+            __cpuid(info, 1);
+            bool osSavesYmm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+            __cpuidex(info, 7, 0);
+            return osSavesYmm && (info[1] & (1 << 5)) != 0;
+#else
+            return __builtin_cpu_supports("avx2");
+#endif
+        }
+
+        bool CpuHasSsse3() {
+#ifdef _MSC_VER
+            int info[4];
+            __cpuid(info, 1);
+            return (info[2] & (1 << 9)) != 0;
+#else
+            return __builtin_cpu_supports("ssse3");
+#endif
+        }
+#endif
+
+#if GF_NEON
+        void MultiplyAddNeon(const uint8_t* low, const uint8_t* high, const uint8_t* src, uint8_t* dst, size_t length) {
+            uint8x16_t lowTable = vld1q_u8(low);
+            uint8x16_t highTable = vld1q_u8(high);
+            uint8x16_t mask = vdupq_n_u8(0x0f);
+            size_t i = 0;
+            for (; i + 16 <= length; i += 16) {
+                uint8x16_t s = vld1q_u8(src + i);
+                uint8x16_t product = veorq_u8(vqtbl1q_u8(lowTable, vandq_u8(s, mask)),
+                    vqtbl1q_u8(highTable, vshrq_n_u8(s, 4)));
+                vst1q_u8(dst + i, veorq_u8(vld1q_u8(dst + i), product));
+            }
+            MultiplyAddScalar(low, high, src + i, dst + i, length - i);
+        }
+#endif
+
+        // The kernels' 16-entry tables for multiplying by c
+        void ProductTables(uint8_t c, uint8_t* low, uint8_t* high) {
+            for (int n = 0; n < 16; n++) {
+                low[n] = GfMultiply(c, (uint8_t)n);
+                high[n] = GfMultiply(c, (uint8_t)(n << 4));
+            }
+        }
+
+        struct Kernel {
+            MultiplyAddKernel function;
+            const char* name;
+        };
+
+        Kernel PickKernel() {
+#if GF_X86
+            if (CpuHasAvx2()) return { MultiplyAddAvx2, "avx2" };
+            if (CpuHasSsse3()) return { MultiplyAddSsse3, "ssse3" };
+#elif GF_NEON
+            return { MultiplyAddNeon, "neon" };
+#endif
+            return { MultiplyAddScalar, "scalar" };
+        }
+
+        const Kernel& ActiveKernel() {
+            static const Kernel kernel = PickKernel();
+            return kernel;
+        }
+
+        // In-place Gauss-Jordan inversion of an n x n matrix; false if singular
+        bool Invert(std::vector<uint8_t>& a, size_t n) {
+            std::vector<uint8_t> inverse(n * n, 0);
+            for (size_t i = 0; i < n; i++) {
+                inverse[i * n + i] = 1;
+            }
+            for (size_t col = 0; col < n; col++) {
+                size_t pivot = col;
+                while (pivot < n && a[pivot * n + col] == 0) pivot++;
+                if (pivot == n) return false;
+                if (pivot != col) {
+                    for (size_t k = 0; k < n; k++) {
+                        std::swap(a[pivot * n + k], a[col * n + k]);
+                        std::swap(inverse[pivot * n + k], inverse[col * n + k]);
+                    }
+                }
+                uint8_t scale = GfInverse(a[col * n + col]);
+                for (size_t k = 0; k < n; k++) {
+                    a[col * n + k] = GfMultiply(a[col * n + k], scale);
+                    inverse[col * n + k] = GfMultiply(inverse[col * n + k], scale);
+                }
+                for (size_t row = 0; row < n; row++) {
+                    uint8_t factor = a[row * n + col];
+                    if (row == col || factor == 0) continue;
+                    for (size_t k = 0; k < n; k++) {
+                        a[row * n + k] ^= GfMultiply(factor, a[col * n + k]);
+                        inverse[row * n + k] ^= GfMultiply(factor, inverse[col * n + k]);
+                    }
+                }
+            }
+            a.swap(inverse);
+            return true;
+        }
+    }
+
+    uint8_t GfMultiply(uint8_t a, uint8_t b) {
+        if (a == 0 || b == 0) return 0;
+        const GfTables& t = Tables();
+        return t.exp[t.log[a] + t.log[b]];
+    }
+
+    void GfMultiplyAdd(uint8_t c, const uint8_t* src, uint8_t* dst, size_t length) {
+        if (c == 0 || length == 0) {
+            return;
+        }
+        uint8_t low[16], high[16];
+        ProductTables(c, low, high);
+        ActiveKernel().function(low, high, src, dst, length);
+    }
+
+    void GfMultiplyAddScalar(uint8_t c, const uint8_t* src, uint8_t* dst, size_t length) {
+        if (c == 0 || length == 0) {
+            return;
+        }
+        uint8_t low[16], high[16];
+        ProductTables(c, low, high);
+        MultiplyAddScalar(low, high, src, dst, length);
+    }
+
+    const char* GfKernelName() {
+        return ActiveKernel().name;
+    }
+
+    ReedSolomon::ReedSolomon(uint32_t dataShards, uint32_t parityShards)
+        : dataShards(dataShards), parityShards(parityShards), matrix((size_t)dataShards * parityShards) {
+
+        // Cauchy matrix 1 / (x_p + y_j) with x_p = p and y_j = m + j; the
+        // two sets never meet, so no entry divides by zero
+        for (uint32_t p = 0; p < parityShards; p++) {
+            for (uint32_t j = 0; j < dataShards; j++) {
+                matrix[p * dataShards + j] = GfInverse((uint8_t)(p ^ (parityShards + j)));
+            }
+        }
+    }
+
+    void ReedSolomon::Encode(const uint8_t* const* data, uint8_t* const* parity, size_t length) const {
+        for (uint32_t p = 0; p < parityShards; p++) {
+            std::memset(parity[p], 0, length);
+        }
+        // Each data shard is used for every parity row while it is in cache
+        for (uint32_t j = 0; j < dataShards; j++) {
+            for (uint32_t p = 0; p < parityShards; p++) {
+                GfMultiplyAdd(Coefficient(p, j), data[j], parity[p], length);
+            }
+        }
+    }
+
+    bool ReedSolomon::Reconstruct(uint8_t* const* data, const bool* dataPresent,
+        const uint8_t* const* parity, const bool* parityPresent, size_t length) const {
+
+        std::vector<uint32_t> missing, rows;
+        for (uint32_t j = 0; j < dataShards; j++) {
+            if (!dataPresent[j]) missing.push_back(j);
+        }
+        for (uint32_t p = 0; p < parityShards && rows.size() < missing.size(); p++) {
+            if (parityPresent[p]) rows.push_back(p);
+        }
+        if (missing.empty()) {
+            return true;
+        }
+        if (rows.size() < missing.size()) {
+            return false;
+        }
+
+        // Each chosen parity row, minus what the surviving data contributes,
+        // is a combination of the missing shards alone
+        size_t count = missing.size();
+        std::vector<std::vector<uint8_t>> remainders(count);
+        std::vector<uint8_t> system(count * count);
+        for (size_t r = 0; r < count; r++) {
+            remainders[r].assign(parity[rows[r]], parity[rows[r]] + length);
+            for (uint32_t j = 0; j < dataShards; j++) {
+                if (dataPresent[j]) {
+                    GfMultiplyAdd(Coefficient(rows[r], j), data[j], remainders[r].data(), length);
+                }
+            }
+            for (size_t c = 0; c < count; c++) {
+                system[r * count + c] = Coefficient(rows[r], missing[c]);
+            }
+        }
+        if (!Invert(system, count)) {
+            return false;
+        }
+
+        for (size_t c = 0; c < count; c++) {
+            uint8_t* shard = data[missing[c]];
+            std::memset(shard, 0, length);
+            for (size_t r = 0; r < count; r++) {
+                GfMultiplyAdd(system[c * count + r], remainders[r].data(), shard, length);
+            }
+        }
+        return true;
+    }
+}
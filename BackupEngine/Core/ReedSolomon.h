@@ -0,0 +1,60 @@
+// ReedSolomon.h - Systematic Reed-Solomon erasure code over GF(2^8)
+//
+// k data shards are protected by m parity shards; any k of the k+m shards
+// are enough to rebuild the rest. Parity row p holds sum_j C[p][j] * data_j
+// with a Cauchy matrix C, so every square submatrix is invertible and the
+// code needs no search for a working generator.
+//
+// The inner loop is a multiply-accumulate of a whole shard by one constant.
+// It splits each byte into nibbles and looks both up in 16-entry product
+// tables, which PSHUFB (SSSE3), VPSHUFB (AVX2) and TBL (NEON) do 16 or 32
+// bytes at a time. The kernel is picked once from what the CPU supports.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace BackupCore {
+
+    // dst[i] ^= c * src[i] in GF(2^8)
+    void GfMultiplyAdd(uint8_t c, const uint8_t* src, uint8_t* dst, size_t length);
+
+    uint8_t GfMultiply(uint8_t a, uint8_t b);
+
+    // GfMultiplyAdd with the scalar kernel whatever the CPU supports, as the
+    // reference the picked kernel is checked against
+    void GfMultiplyAddScalar(uint8_t c, const uint8_t* src, uint8_t* dst, size_t length);
+
+    // "avx2", "ssse3", "neon" or "scalar"
+    const char* GfKernelName();
+
+    class ReedSolomon {
+    public:
+        // dataShards + parityShards must not exceed 256
+        ReedSolomon(uint32_t dataShards, uint32_t parityShards);
+
+        uint32_t DataShards() const { return dataShards; }
+        uint32_t ParityShards() const { return parityShards; }
+
+        // Weight of data shard 'data' in parity shard 'parity'
+        uint8_t Coefficient(uint32_t parity, uint32_t data) const {
+            return matrix[parity * dataShards + data];
+        }
+
+        // Computes all parity shards; every shard is 'length' bytes
+        void Encode(const uint8_t* const* data, uint8_t* const* parity, size_t length) const;
+
+        // Rebuilds the data shards whose dataPresent is false from the others
+        // and the parity shards whose parityPresent is true. Fails if fewer
+        // parity shards are present than data shards are missing.
+        bool Reconstruct(uint8_t* const* data, const bool* dataPresent,
+            const uint8_t* const* parity, const bool* parityPresent, size_t length) const;
+
+    private:
+        uint32_t dataShards;
+        uint32_t parityShards;
+        std::vector<uint8_t> matrix;    // parityShards x dataShards
+    };
+}
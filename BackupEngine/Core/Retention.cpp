@@ -0,0 +1,334 @@
+// Retention.cpp - Retention policy and pruning of timestamped backup sets
+#include "Retention.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+#include <algorithm>
+#include <atomic>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <mutex>
+
+namespace fs = std::filesystem;
+
+namespace BackupCore {
+
+    const char* const BaseFileName = "backup_base.txt";
+
+    namespace {
+        const char* DeletingSuffix = ".deleting";
+        const int64_t SecondsPerDay = 86400;
+
+        // Days since 1970-01-01 of a proleptic Gregorian date
+        int64_t DaysFromCivil(int64_t year, unsigned month, unsigned day) {
+            year -= month <= 2;
+            int64_t era = (year >= 0 ? year : year - 399) / 400;
+            unsigned yearOfEra = (unsigned)(year - era * 400);
+            unsigned dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+            unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+            return era * 146097 + (int64_t)dayOfEra - 719468;
+        }
+
+        // Year * 12 + month - 1 of a day number
+        int64_t MonthOfDay(int64_t days) {
+            days += 719468;
+            int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+            unsigned dayOfEra = (unsigned)(days - era * 146097);
+            unsigned yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+            unsigned dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+            unsigned shifted = (5 * dayOfYear + 2) / 153;
+            unsigned month = shifted < 10 ? shifted + 3 : shifted - 9;
+            int64_t year = (int64_t)yearOfEra + era * 400 + (month <= 2);
+            return year * 12 + month - 1;
+        }
+
+        int64_t FloorDiv(int64_t value, int64_t divisor) {
+            return value / divisor - (value % divisor < 0 ? 1 : 0);
+        }
+
+        // "YYYYMMDD_HHMMSS" as wall-clock seconds; false if it is not one
+        bool ParseStamp(const std::string& stamp, int64_t& time) {
+            if (stamp.size() != 15 || stamp[8] != '_') {
+                return false;
+            }
+            for (size_t i = 0; i < stamp.size(); i++) {
+                if (i != 8 && (stamp[i] < '0' || stamp[i] > '9')) {
+                    return false;
+                }
+            }
+            auto field = [&](size_t at, size_t length) { return std::stoi(stamp.substr(at, length)); };
+            int month = field(4, 2), day = field(6, 2);
+            int hour = field(9, 2), minute = field(11, 2), second = field(13, 2);
+            if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60) {
+                return false;
+            }
+            time = DaysFromCivil(field(0, 4), (unsigned)month, (unsigned)day) * SecondsPerDay +
+                hour * 3600 + minute * 60 + second;
+            return true;
+        }
+
+        // Set names come from the same wall clock, so 'now' must too
+        int64_t LocalNow() {
+            std::time_t now = std::time(nullptr);
+            std::tm local = {};
+#ifdef _WIN32
+            localtime_s(&local, &now);
+#else
+            localtime_r(&now, &local);
+#endif
+            return DaysFromCivil(local.tm_year + 1900, (unsigned)local.tm_mon + 1, (unsigned)local.tm_mday) * SecondsPerDay +
+                local.tm_hour * 3600 + local.tm_min * 60 + local.tm_sec;
+        }
+
+        std::string ReadBase(const fs::path& setPath) {
+            std::ifstream in(setPath / BaseFileName, std::ios::binary);
+            std::string line;
+            std::getline(in, line);
+            while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) {
+                line.pop_back();
+            }
+            return line;
+        }
+
+        // Keeps the newest set of each of the last 'count' periods that have one
+        void KeepPeriods(std::vector<BackupSetInfo>& sets, uint32_t count, const char* reason,
+            int64_t (*period)(int64_t time)) {
+            bool any = false;
+            int64_t last = 0;
+            for (auto& set : sets) {
+                if (count == 0) {
+                    break;
+                }
+                if (set.interrupted) {
+                    continue;
+                }
+                int64_t current = period(set.time);
+                if (any && current == last) {
+                    continue;
+                }
+                any = true;
+                last = current;
+                count--;
+                if (!set.keep) {
+                    set.keep = true;
+                    set.reason = reason;
+                }
+            }
+        }
+
+        int64_t DayOf(int64_t time) {
+            return FloorDiv(time, SecondsPerDay);
+        }
+
+        // 1970-01-01 was a Thursday; weeks are keyed by their Monday
+        int64_t WeekOf(int64_t time) {
+            int64_t day = DayOf(time);
+            return day - (day + 3 - FloorDiv(day + 3, 7) * 7);
+        }
+
+        int64_t MonthOf(int64_t time) {
+            return MonthOfDay(DayOf(time));
+        }
+    }
+
+    std::vector<BackupSetInfo> ListBackupSets(const fs::path& destDir, const std::string& jobName) {
+        std::vector<BackupSetInfo> sets;
+        std::string prefix = jobName + "_";
+        std::error_code ec;
+        for (fs::directory_iterator it(destDir, ec), end; !ec && it != end; it.increment(ec)) {
+            std::error_code typeError;
+            if (!it->is_directory(typeError)) {
+                continue;
+            }
+            std::string name = it->path().filename().u8string();
+            if (name.compare(0, prefix.size(), prefix) != 0) {
+                continue;
+            }
+
+            BackupSetInfo set;
+            set.path = it->path();
+            set.name = name;
+            std::string stamp = name.substr(prefix.size());
+            size_t suffix = std::char_traits<char>::length(DeletingSuffix);
+            if (stamp.size() > suffix && stamp.compare(stamp.size() - suffix, suffix, DeletingSuffix) == 0) {
+                stamp.resize(stamp.size() - suffix);
+                set.interrupted = true;
+            }
+            if (ParseStamp(stamp, set.time)) {
+                sets.push_back(set);
+            }
+        }
+
+        std::stable_sort(sets.begin(), sets.end(), [](const BackupSetInfo& a, const BackupSetInfo& b) {
+            if (a.interrupted != b.interrupted) return b.interrupted;
+            return a.time > b.time;
+        });
+        return sets;
+    }
+
+    void ApplyRetention(std::vector<BackupSetInfo>& sets, const RetentionPolicy& policy,
+        int64_t now, int64_t minimumAgeSeconds, std::vector<std::string>& warnings) {
+
+        for (auto& set : sets) {
+            set.keep = false;
+            set.reason.clear();
+        }
+
+        // The newest set always stays: it is what the next incremental is taken against
+        uint32_t last = std::max<uint32_t>(policy.keepLast, 1);
+        for (auto& set : sets) {
+            if (set.interrupted || last == 0) continue;
+            set.keep = true;
+            set.reason = "last";
+            last--;
+        }
+        KeepPeriods(sets, policy.keepDaily, "daily", DayOf);
+        KeepPeriods(sets, policy.keepWeekly, "weekly", WeekOf);
+        KeepPeriods(sets, policy.keepMonthly, "monthly", MonthOf);
+        for (auto& set : sets) {
+            if (!set.interrupted && !set.keep && now - set.time < minimumAgeSeconds) {
+                set.keep = true;
+                set.reason = "recent";
+            }
+        }
+
+        // Mark: a kept set keeps its whole chain of bases
+        std::map<std::string, size_t> byName;
+        for (size_t i = 0; i < sets.size(); i++) {
+            if (!sets[i].interrupted) {
+                byName[sets[i].name] = i;
+            }
+        }
+        std::vector<size_t> pending;
+        for (size_t i = 0; i < sets.size(); i++) {
+            if (sets[i].keep) pending.push_back(i);
+        }
+        while (!pending.empty()) {
+            const BackupSetInfo& set = sets[pending.back()];
+            pending.pop_back();
+            if (set.base.empty()) {
+                continue;
+            }
+            auto it = byName.find(set.base);
+            if (it == byName.end()) {
+                warnings.push_back(set.name + " depends on " + set.base + ", which is gone");
+                continue;
+            }
+            BackupSetInfo& base = sets[it->second];
+            if (!base.keep) {
+                base.keep = true;
+                base.reason = "base of " + set.name;
+                pending.push_back(it->second);
+            }
+        }
+    }
+
+    int PruneBackupSets(
+        const fs::path& destDir,
+        const std::string& jobName,
+        const PruneOptions& options,
+        const BackupProgress& progress,
+        PruneResult& result,
+        std::string& error) {
+
+        TraceSpan jobSpan("job", "PruneBackupSets", destDir.u8string());
+        result = PruneResult();
+
+        std::error_code ec;
+        if (!fs::is_directory(destDir, ec)) {
+            error = "Cannot list " + destDir.u8string();
+            return -1;
+        }
+        result.sets = ListBackupSets(destDir, jobName);
+        std::vector<BackupSetInfo>& sets = result.sets;
+        size_t workers = std::max<uint32_t>(options.threads, 1) - 1;
+
+        // References sit in every set; on a share, reading them one by one is
+        // mostly round trips
+        {
+            TaskGroup group(workers, TaskPriority::Low);
+            for (auto& set : sets) {
+                if (set.interrupted) continue;
+                BackupSetInfo* target = &set;
+                group.Run([target] { target->base = ReadBase(target->path); });
+            }
+            group.Wait();
+        }
+
+        ApplyRetention(sets, options.policy, LocalNow(), options.minimumAgeSeconds, result.warnings);
+
+        std::vector<BackupSetInfo*> doomed;
+        for (auto& set : sets) {
+            if (!set.keep) doomed.push_back(&set);
+        }
+        if (progress) {
+            progress(0, std::to_string(sets.size() - doomed.size()) + " backups kept, " +
+                std::to_string(doomed.size()) + (options.dryRun ? " would be deleted" : " to delete"));
+        }
+        if (options.dryRun || doomed.empty()) {
+            return 0;
+        }
+
+        std::mutex resultLock;
+        std::atomic<bool> cancelled{ false };
+        size_t finished = 0;
+        {
+            TaskGroup group(workers, TaskPriority::Low);
+            for (BackupSetInfo* set : doomed) {
+                group.Run([&, set] {
+                    if (cancelled || !Checkpoint(options.control)) {
+                        cancelled = true;
+                        return;
+                    }
+                    TraceSpan span("prune", "delete", set->name);
+
+                    // Renamed first, so no reader ever sees a half-deleted set as a backup
+                    std::error_code ec;
+                    fs::path doomedPath = set->path;
+                    if (!set->interrupted) {
+                        doomedPath += DeletingSuffix;
+                        fs::rename(set->path, doomedPath, ec);
+                    }
+                    uint64_t bytes = 0;
+                    if (!ec) {
+                        for (fs::recursive_directory_iterator it(doomedPath, ec), end; !ec && it != end; it.increment(ec)) {
+                            std::error_code sizeError;
+                            if (it->is_regular_file(sizeError)) {
+                                bytes += it->file_size(sizeError);
+                            }
+                        }
+                        ec.clear();
+                        fs::remove_all(doomedPath, ec);
+                    }
+
+                    std::lock_guard<std::mutex> guard(resultLock);
+                    finished++;
+                    if (ec) {
+                        if (result.failed++ == 0) {
+                            result.firstFailure = "Cannot delete " + set->name + ": " + ec.message();
+                        }
+                    }
+                    else {
+                        result.deleted++;
+                        result.bytesFreed += bytes;
+                    }
+                    if (progress) {
+                        progress((int)(finished * 100 / doomed.size()),
+                            (ec ? "Failed to delete " : "Deleted ") + set->name);
+                    }
+                });
+            }
+            group.Wait();
+        }
+
+        if (cancelled) {
+            error = "Job cancelled";
+            return JobCancelledResult;
+        }
+        if (result.failed > 0) {
+            error = result.firstFailure + " (" + std::to_string(result.failed) + " backups not deleted)";
+            return -3;
+        }
+        return 0;
+    }
+}
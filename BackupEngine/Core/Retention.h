@@ -0,0 +1,84 @@
+// Retention.h - Retention policy and pruning of timestamped backup sets
+//
+// Scheduled jobs write every run to <destination>/<job name>_YYYYMMDD_HHMMSS,
+// and each Hyper-V machine to <job name>_<vm>_YYYYMMDD_HHMMSS, which is pruned
+// as a job of its own named <job name>_<vm>.
+// Pruning keeps what the policy asks for and deletes the rest, in three steps:
+//   select  newest to oldest, the keepLast newest sets, plus the newest set of
+//           each of the last keepDaily days, keepWeekly weeks (Monday to
+//           Sunday) and keepMonthly months that have one
+//   mark    an incremental or differential set names the set it was taken
+//           against in backup_base.txt; whatever a kept set depends on,
+//           directly or down a chain, is kept with it. The references of all
+//           sets are read in parallel.
+//   sweep   each unmarked set is renamed to <name>.deleting, which takes it
+//           out of the list in one step, and then deleted, several at a time.
+//           A prune that was interrupted finishes its .deleting sets first.
+// The newest set and any set younger than minimumAgeSeconds are never
+// deleted, so a backup still being written, and the base an incremental is
+// being taken against, are safe while pruning runs next to them.
+
+#pragma once
+
+#include "FileBackup.h"
+#include "Job.h"
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace BackupCore {
+
+    extern const char* const BaseFileName;
+
+    struct RetentionPolicy {
+        uint32_t keepLast = 1;      // Never less than one
+        uint32_t keepDaily = 0;
+        uint32_t keepWeekly = 0;
+        uint32_t keepMonthly = 0;
+    };
+
+    struct BackupSetInfo {
+        std::filesystem::path path;
+        std::string name;           // Directory name
+        int64_t time = 0;           // From the name: local wall-clock seconds since 1970
+        std::string base;           // Name of the set this one was taken against, if any
+        bool interrupted = false;   // A .deleting set left by an earlier prune
+        bool keep = false;
+        std::string reason;         // Why it is kept: "last", "daily", "base of <name>", ...
+    };
+
+    struct PruneOptions {
+        RetentionPolicy policy;
+        bool dryRun = false;                    // Decide and report, delete nothing
+        int64_t minimumAgeSeconds = 24 * 3600;
+        uint32_t threads = 4;                   // Sets read or deleted at once
+        JobControl* control = nullptr;          // Optional pause/cancel, checked between sets
+    };
+
+    struct PruneResult {
+        std::vector<BackupSetInfo> sets;        // Every set found, newest first, with its verdict
+        uint64_t deleted = 0;
+        uint64_t bytesFreed = 0;
+        uint64_t failed = 0;
+        std::string firstFailure;
+        std::vector<std::string> warnings;      // e.g. a kept set whose base is gone
+    };
+
+    // Sets of one job in destDir, newest first; .deleting leftovers last
+    std::vector<BackupSetInfo> ListBackupSets(const std::filesystem::path& destDir, const std::string& jobName);
+
+    // Fills in keep and reason. 'now' is local wall-clock seconds, like BackupSetInfo::time.
+    void ApplyRetention(std::vector<BackupSetInfo>& sets, const RetentionPolicy& policy,
+        int64_t now, int64_t minimumAgeSeconds, std::vector<std::string>& warnings);
+
+    // Returns -1 if destDir cannot be listed, -3 if some sets could not be
+    // deleted, and JobCancelledResult if options.control is cancelled
+    int PruneBackupSets(
+        const std::filesystem::path& destDir,
+        const std::string& jobName,
+        const PruneOptions& options,
+        const BackupProgress& progress,
+        PruneResult& result,
+        std::string& error);
+}
@@ -0,0 +1,274 @@
+// ThreadPool.cpp - Engine-wide work-stealing thread pool
+#include "ThreadPool.h"
+#include "Trace.h"
+#include <algorithm>
+#include <string>
+
+namespace BackupCore {
+
+    namespace {
+        // The pool and worker index of the calling thread, if it is a pool worker
+        thread_local const ThreadPool* currentPool = nullptr;
+        thread_local size_t currentWorker = 0;
+
+        // A worker busy with its own tasks still looks at the shared queues this
+        // often, so jobs submitted from outside are not starved by running ones
+        const unsigned SharedCheckInterval = 16;
+    }
+
+    ThreadPool::ThreadPool(size_t threadCount) {
+        if (threadCount == 0) {
+            threadCount = 1;
+        }
+        for (size_t i = 0; i < threadCount; i++) {
+            workers.push_back(std::unique_ptr<Worker>(new Worker));
+        }
+        // Started only once every queue exists, since workers steal from each other
+        for (size_t i = 0; i < threadCount; i++) {
+            workers[i]->thread = std::thread(&ThreadPool::WorkerLoop, this, i);
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker->thread.join();
+        }
+    }
+
+    void ThreadPool::Submit(Task task, TaskPriority priority) {
+        int level = (int)priority;
+        if (currentPool == this) {
+            Worker& worker = *workers[currentWorker];
+            std::lock_guard<std::mutex> guard(worker.lock);
+            worker.queues[level].push_back(std::move(task));
+        }
+        else {
+            std::lock_guard<std::mutex> guard(lock);
+            shared[level].push_back(std::move(task));
+        }
+
+        pending.fetch_add(1);
+        if (sleeping.load() > 0) {
+            std::lock_guard<std::mutex> guard(lock);
+            wake.notify_one();
+        }
+    }
+
+    ThreadPool& ThreadPool::Engine() {
+        // Jobs are I/O bound, so a few threads go a long way. The pool is never
+        // destroyed: joining threads while a DLL unloads can deadlock the loader.
+        static ThreadPool* pool = new ThreadPool(
+            std::max<size_t>(2, std::min<size_t>(std::thread::hardware_concurrency(), 8)));
+        return *pool;
+    }
+
+    bool ThreadPool::TakeShared(int priority, Task& task) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (shared[priority].empty()) {
+            return false;
+        }
+        task = std::move(shared[priority].front());
+        shared[priority].pop_front();
+        return true;
+    }
+
+    bool ThreadPool::Steal(size_t thief, int priority, Task& task) {
+        for (size_t i = 1; i < workers.size(); i++) {
+            Worker& victim = *workers[(thief + i) % workers.size()];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.queues[priority].empty()) {
+                // The newest task, leaving the victim the ones it queued first
+                task = std::move(victim.queues[priority].back());
+                victim.queues[priority].pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool ThreadPool::TryPop(Worker* self, size_t index, Task& task) {
+        static thread_local unsigned ticks = 0;
+        bool sharedFirst = ++ticks % SharedCheckInterval == 0;
+
+        for (int priority = 0; priority < PriorityLevels; priority++) {
+            if (sharedFirst && TakeShared(priority, task)) {
+                return true;
+            }
+            {
+                // Oldest first, so tasks of different jobs on one worker take turns
+                std::lock_guard<std::mutex> guard(self->lock);
+                if (!self->queues[priority].empty()) {
+                    task = std::move(self->queues[priority].front());
+                    self->queues[priority].pop_front();
+                    return true;
+                }
+            }
+            if ((!sharedFirst && TakeShared(priority, task)) || Steal(index, priority, task)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void ThreadPool::WorkerLoop(size_t index) {
+        currentPool = this;
+        currentWorker = index;
+        Worker* self = workers[index].get();
+
+        while (true) {
+            Task task;
+            if (TryPop(self, index, task)) {
+                pending.fetch_sub(1);
+
+                // Named per task, since tracing may have started after the pool
+                if (TraceEnabled()) {
+                    TraceThreadName("job worker " + std::to_string(index));
+                }
+                task();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> guard(lock);
+            if (stopping && pending.load() == 0) {
+                return;
+            }
+            sleeping.fetch_add(1);
+            wake.wait(guard, [this] { return stopping || pending.load() > 0; });
+            sleeping.fetch_sub(1);
+        }
+    }
+
+    struct TaskGroup::State {
+        ThreadPool* pool;
+        TaskPriority priority;
+        size_t maxWorkers;
+
+        std::mutex lock;
+        std::condition_variable idle;
+        std::deque<ThreadPool::Task> tasks;
+        size_t pumps = 0;           // Pool tasks currently draining this group
+        size_t unfinished = 0;      // Queued plus running tasks
+        std::exception_ptr failure;
+    };
+
+    TaskGroup::TaskGroup(size_t maxWorkers, TaskPriority priority, ThreadPool& pool)
+        : state(std::make_shared<State>()) {
+        state->pool = &pool;
+        state->priority = priority;
+        state->maxWorkers = maxWorkers;
+    }
+
+    TaskGroup::~TaskGroup() {
+        try {
+            Wait();
+        }
+        catch (...) {
+            // Already reported by an explicit Wait, or nobody is left to tell
+        }
+    }
+
+    void TaskGroup::Run(ThreadPool::Task task) {
+        bool startPump = false;
+        {
+            std::lock_guard<std::mutex> guard(state->lock);
+            state->tasks.push_back(std::move(task));
+            state->unfinished++;
+            if (state->pumps < state->maxWorkers) {
+                state->pumps++;
+                startPump = true;
+            }
+        }
+        if (startPump) {
+            std::shared_ptr<State> shared = state;
+            state->pool->Submit([shared] { Pump(shared); }, state->priority);
+        }
+    }
+
+    void TaskGroup::SetMaxWorkers(size_t maxWorkers) {
+        size_t startPumps = 0;
+        {
+            std::lock_guard<std::mutex> guard(state->lock);
+            state->maxWorkers = maxWorkers;
+            if (maxWorkers > state->pumps) {
+                startPumps = std::min(maxWorkers - state->pumps, state->tasks.size());
+                state->pumps += startPumps;
+            }
+        }
+        for (size_t i = 0; i < startPumps; i++) {
+            std::shared_ptr<State> shared = state;
+            state->pool->Submit([shared] { Pump(shared); }, state->priority);
+        }
+    }
+
+    void TaskGroup::Wait() {
+        std::unique_lock<std::mutex> guard(state->lock);
+        while (state->unfinished > 0) {
+            if (state->tasks.empty()) {
+                state->idle.wait(guard);
+                continue;
+            }
+            ThreadPool::Task task = std::move(state->tasks.front());
+            state->tasks.pop_front();
+            guard.unlock();
+            Execute(*state, task);
+            guard.lock();
+        }
+
+        if (state->failure) {
+            std::exception_ptr failure = state->failure;
+            state->failure = nullptr;
+            std::rethrow_exception(failure);
+        }
+    }
+
+    // Runs one task, then goes to the back of the pool's queue if more are
+    // waiting, so a worker alternates between the groups that share it. A pump
+    // over the cap (SetMaxWorkers lowered it) retires instead.
+    void TaskGroup::Pump(const std::shared_ptr<State>& state) {
+        ThreadPool::Task task;
+        {
+            std::lock_guard<std::mutex> guard(state->lock);
+            if (state->tasks.empty() || state->pumps > state->maxWorkers) {
+                state->pumps--;
+                return;
+            }
+            task = std::move(state->tasks.front());
+            state->tasks.pop_front();
+        }
+
+        Execute(*state, task);
+
+        {
+            std::lock_guard<std::mutex> guard(state->lock);
+            if (state->tasks.empty() || state->pumps > state->maxWorkers) {
+                state->pumps--;
+                return;
+            }
+        }
+        std::shared_ptr<State> shared = state;
+        state->pool->Submit([shared] { Pump(shared); }, state->priority);
+    }
+
+    void TaskGroup::Execute(State& state, ThreadPool::Task& task) {
+        std::exception_ptr failure;
+        try {
+            task();
+        }
+        catch (...) {
+            failure = std::current_exception();
+        }
+
+        std::lock_guard<std::mutex> guard(state.lock);
+        if (failure && !state.failure) {
+            state.failure = failure;
+        }
+        if (--state.unfinished == 0) {
+            state.idle.notify_all();
+        }
+    }
+}
@@ -0,0 +1,110 @@
+// ThreadPool.h - Engine-wide work-stealing thread pool
+//
+// Asynchronous jobs (see Job.h) and the files inside them all run here, so
+// several jobs in one process share a fixed set of threads instead of each
+// starting its own. Every worker has its own queue per priority; tasks
+// submitted from a worker go to that worker's queue, tasks from any other
+// thread to a shared one, and an idle worker steals from the others.
+// Higher priorities are always taken first.
+//
+// TaskGroup is how a job fans out: it caps how many pool threads the job's
+// tasks may occupy at once, so concurrent jobs interleave rather than one
+// job filling every worker.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace BackupCore {
+
+    enum class TaskPriority : int {
+        High = 0,
+        Normal,
+        Low
+    };
+
+    class ThreadPool {
+    public:
+        typedef std::function<void()> Task;
+
+        explicit ThreadPool(size_t threadCount);
+
+        // Runs the tasks already queued, then joins the workers
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        void Submit(Task task, TaskPriority priority = TaskPriority::Normal);
+
+        size_t ThreadCount() const { return workers.size(); }
+
+        // The process-wide pool used for engine jobs, created on first use
+        static ThreadPool& Engine();
+
+    private:
+        static const int PriorityLevels = 3;
+
+        struct Worker {
+            std::thread thread;
+            std::mutex lock;
+            std::deque<Task> queues[PriorityLevels];
+        };
+
+        void WorkerLoop(size_t index);
+        bool TryPop(Worker* self, size_t index, Task& task);
+        bool TakeShared(int priority, Task& task);
+        bool Steal(size_t thief, int priority, Task& task);
+
+        std::vector<std::unique_ptr<Worker>> workers;
+
+        std::mutex lock;                            // Shared queues, sleeping and stopping
+        std::condition_variable wake;
+        std::deque<Task> shared[PriorityLevels];
+        std::atomic<size_t> pending{ 0 };           // Tasks queued anywhere
+        std::atomic<size_t> sleeping{ 0 };
+        bool stopping = false;
+    };
+
+    // A batch of tasks that runs on the pool with at most maxWorkers pool
+    // threads busy on it. Wait runs queued tasks on the calling thread too, so
+    // a job already on a pool thread can wait without tying up a second one,
+    // and maxWorkers = 0 runs everything inside Wait.
+    class TaskGroup {
+    public:
+        explicit TaskGroup(size_t maxWorkers, TaskPriority priority = TaskPriority::Normal,
+                           ThreadPool& pool = ThreadPool::Engine());
+
+        // Waits for the remaining tasks
+        ~TaskGroup();
+
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+
+        void Run(ThreadPool::Task task);
+
+        // Changes the cap for the tasks still to start; extra workers finish
+        // the task they are on first
+        void SetMaxWorkers(size_t maxWorkers);
+
+        // Returns once every task has finished; rethrows the first exception a task threw
+        void Wait();
+
+    private:
+        struct State;
+
+        static void Pump(const std::shared_ptr<State>& state);
+        static void Execute(State& state, ThreadPool::Task& task);
+
+        std::shared_ptr<State> state;
+    };
+}
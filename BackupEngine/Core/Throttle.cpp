@@ -0,0 +1,112 @@
+// Throttle.cpp - Read/write bandwidth and IOPS limits for a running job
+#include "Throttle.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace BackupCore {
+
+    namespace {
+        // Up to this much I/O passes at full speed after an idle spell
+        const int64_t BurstNanoseconds = 100 * 1000 * 1000;
+
+        // Sleeps are cut into slices so a limit change or cancel is noticed
+        const int64_t SleepSliceNanoseconds = 50 * 1000 * 1000;
+
+#ifndef _WIN32
+        // From linux/ioprio.h, which not every libc ships
+        const int IoprioWhoProcess = 1;     // With id 0: the calling thread
+        const int IoprioClassIdle = 3;
+        const int IoprioClassShift = 13;
+#endif
+    }
+
+    void IoThrottle::SetLimits(uint64_t readBytesPerSecond, uint64_t writeBytesPerSecond, uint64_t operationsPerSecond) {
+        // Start every bucket afresh so the new rates apply from now
+        int64_t now = (int64_t)MonotonicNanoseconds();
+        Bucket* buckets[] = { &readBytes, &writeBytes, &operations };
+        uint64_t rates[] = { readBytesPerSecond, writeBytesPerSecond, operationsPerSecond };
+        for (int i = 0; i < 3; i++) {
+            buckets[i]->rate.store(rates[i]);
+            buckets[i]->nextFree.store(now);
+        }
+        limited.store(!released.load() && (readBytesPerSecond || writeBytesPerSecond || operationsPerSecond));
+        generation.fetch_add(1);
+    }
+
+    void IoThrottle::Release() {
+        released.store(true);
+        limited.store(false);
+        generation.fetch_add(1);
+    }
+
+    void IoThrottle::Charge(Bucket& bytes, size_t length) {
+        uint32_t current = generation.load();
+        int64_t now = (int64_t)MonotonicNanoseconds();
+        // Bandwidth and IOPS are independent limits; the longer wait wins
+        int64_t wait = std::max(Reserve(bytes, length, now), Reserve(operations, 1, now));
+        if (wait > 0) {
+            Sleep(wait, current);
+        }
+    }
+
+    int64_t IoThrottle::Reserve(Bucket& bucket, uint64_t amount, int64_t now) {
+        uint64_t rate = bucket.rate.load(std::memory_order_relaxed);
+        if (rate == 0) {
+            return 0;
+        }
+
+        int64_t cost = (int64_t)((double)amount * 1e9 / (double)rate);
+        int64_t next = bucket.nextFree.load(std::memory_order_relaxed);
+        int64_t reserved;
+        do {
+            reserved = std::max(next, now) + cost;
+        } while (!bucket.nextFree.compare_exchange_weak(next, reserved, std::memory_order_relaxed));
+
+        return reserved - BurstNanoseconds - now;
+    }
+
+    void IoThrottle::Sleep(int64_t nanoseconds, uint32_t startGeneration) {
+        PhaseTimer timer(MetricPhase::Throttle);
+        int64_t deadline = (int64_t)MonotonicNanoseconds() + nanoseconds;
+        while (generation.load(std::memory_order_relaxed) == startGeneration) {
+            int64_t remaining = deadline - (int64_t)MonotonicNanoseconds();
+            if (remaining <= 0) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::nanoseconds(std::min(remaining, SleepSliceNanoseconds)));
+        }
+    }
+
+    IdleIoScope::IdleIoScope(bool enable) {
+        if (!enable) {
+            return;
+        }
+#ifdef _WIN32
+        active = SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN) != 0;
+#elif defined(SYS_ioprio_set)
+        previous = (int)syscall(SYS_ioprio_get, IoprioWhoProcess, 0);
+        active = previous >= 0 &&
+            syscall(SYS_ioprio_set, IoprioWhoProcess, 0, IoprioClassIdle << IoprioClassShift) == 0;
+#endif
+    }
+
+    IdleIoScope::~IdleIoScope() {
+        if (!active) {
+            return;
+        }
+#ifdef _WIN32
+        SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
+#elif defined(SYS_ioprio_set)
+        syscall(SYS_ioprio_set, IoprioWhoProcess, 0, previous);
+#endif
+    }
+}
@@ -0,0 +1,76 @@
+// Throttle.h - Read/write bandwidth and IOPS limits for a running job
+//
+// Each limit is a token bucket kept as a single atomic "next free time"
+// (the GCRA form), so any number of file threads can charge the same
+// throttle without a lock: an operation reserves its cost with one
+// compare-and-swap and sleeps off whatever exceeds the burst allowance.
+// Limits can be changed while the job runs; the new rate applies to the
+// next operation, and threads sleeping on the old rate wake up early.
+//
+// IdleIoScope is the other way to stay out of the way: the operating system
+// serves the thread's disk requests only when nobody else has any.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace BackupCore {
+
+    class IoThrottle {
+    public:
+        // 0 means unlimited for each of the three
+        void SetLimits(uint64_t readBytesPerSecond, uint64_t writeBytesPerSecond, uint64_t operationsPerSecond);
+
+        uint64_t ReadLimit() const { return readBytes.rate.load(std::memory_order_relaxed); }
+        uint64_t WriteLimit() const { return writeBytes.rate.load(std::memory_order_relaxed); }
+        uint64_t OperationLimit() const { return operations.rate.load(std::memory_order_relaxed); }
+
+        // Charge one read or write of 'bytes', sleeping if a limit is exceeded
+        void Read(size_t bytes) {
+            if (limited.load(std::memory_order_relaxed)) Charge(readBytes, bytes);
+        }
+        void Write(size_t bytes) {
+            if (limited.load(std::memory_order_relaxed)) Charge(writeBytes, bytes);
+        }
+
+        // Stop limiting for good and wake any sleeping threads (the job is ending)
+        void Release();
+
+    private:
+        struct Bucket {
+            std::atomic<uint64_t> rate{ 0 };            // Units per second; 0 = unlimited
+            std::atomic<int64_t> nextFree{ 0 };         // Monotonic ns when the bucket is next empty
+        };
+
+        void Charge(Bucket& bytes, size_t length);
+        int64_t Reserve(Bucket& bucket, uint64_t amount, int64_t now);
+        void Sleep(int64_t nanoseconds, uint32_t generation);
+
+        Bucket readBytes;
+        Bucket writeBytes;
+        Bucket operations;
+        std::atomic<bool> limited{ false };
+        std::atomic<bool> released{ false };
+        std::atomic<uint32_t> generation{ 0 };          // Bumped by SetLimits
+    };
+
+    // Idle I/O priority for the calling thread while in scope: the ioprio idle
+    // class on Linux, background mode on Windows (which also lowers its CPU
+    // priority). Does nothing if enable is false or the system refuses.
+    class IdleIoScope {
+    public:
+        explicit IdleIoScope(bool enable = true);
+        ~IdleIoScope();
+
+        IdleIoScope(const IdleIoScope&) = delete;
+        IdleIoScope& operator=(const IdleIoScope&) = delete;
+
+        bool Active() const { return active; }
+
+    private:
+        bool active = false;
+        int previous = 0;
+    };
+}
@@ -0,0 +1,189 @@
+// Trace.cpp - Optional span tracing in Chrome trace-event format
+#include "Trace.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace BackupCore {
+
+    namespace TraceState {
+        std::atomic<bool> enabled{ false };
+    }
+
+    namespace {
+        // Bounds memory on very long runs; later spans are counted but dropped
+        const size_t MaxEvents = 4 * 1024 * 1024;
+
+        struct TraceEvent {
+            const char* category;
+            const char* name;
+            std::string detail;
+            uint64_t startNs;
+            uint64_t durationNs;
+            uint32_t thread;
+        };
+
+        struct TraceSession {
+            std::mutex lock;
+            fs::path path;
+            uint64_t originNs = 0;
+            std::vector<TraceEvent> events;
+            std::map<uint32_t, std::string> threadNames;
+            uint64_t dropped = 0;
+        };
+
+        TraceSession& Session() {
+            static TraceSession session;
+            return session;
+        }
+
+        // Small sequential ids read better in the viewer than native thread ids
+        uint32_t CurrentThread() {
+            static std::atomic<uint32_t> nextThread{ 1 };
+            thread_local uint32_t thread = nextThread.fetch_add(1, std::memory_order_relaxed);
+            return thread;
+        }
+
+        std::string JsonString(const std::string& text) {
+            std::string out = "\"";
+            for (char c : text) {
+                if (c == '"' || c == '\\') {
+                    out += '\\';
+                    out += c;
+                } else if ((unsigned char)c < 0x20) {
+                    char escape[8];
+                    std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+                    out += escape;
+                } else {
+                    out += c;
+                }
+            }
+            return out + "\"";
+        }
+
+        // Trace-event timestamps are microseconds
+        std::string Micros(uint64_t nanoseconds) {
+            char text[32];
+            std::snprintf(text, sizeof(text), "%.3f", nanoseconds / 1000.0);
+            return text;
+        }
+    }
+
+    uint64_t TraceClock() {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    bool StartTrace(const fs::path& path, std::string& error) {
+        TraceSession& session = Session();
+        std::lock_guard<std::mutex> guard(session.lock);
+
+        if (TraceEnabled()) {
+            error = "Tracing is already running to " + session.path.u8string();
+            return false;
+        }
+
+        // Fail now rather than after the run if the file cannot be created
+        std::ofstream probe(path, std::ios::trunc);
+        if (!probe.is_open()) {
+            error = "Cannot create trace file " + path.u8string();
+            return false;
+        }
+
+        session.path = path;
+        session.originNs = TraceClock();
+        session.events.clear();
+        session.threadNames.clear();
+        session.dropped = 0;
+        session.threadNames[CurrentThread()] = "main";
+        TraceState::enabled.store(true, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool StopTrace(std::string& error) {
+        TraceSession& session = Session();
+        std::lock_guard<std::mutex> guard(session.lock);
+
+        if (!TraceEnabled()) {
+            error = "Tracing is not running";
+            return false;
+        }
+        TraceState::enabled.store(false, std::memory_order_relaxed);
+
+        std::ofstream out(session.path, std::ios::trunc);
+        if (!out.is_open()) {
+            error = "Cannot write trace file " + session.path.u8string();
+            return false;
+        }
+
+        out << "{\"displayTimeUnit\": \"ms\", \"otherData\": {\"producer\": \"BackupEngine\", \"droppedEvents\": "
+            << session.dropped << "},\n\"traceEvents\": [\n";
+        out << "{\"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"name\": \"process_name\", \"args\": {\"name\": \"backup engine\"}}";
+
+        for (const auto& thread : session.threadNames) {
+            out << ",\n{\"ph\": \"M\", \"pid\": 1, \"tid\": " << thread.first
+                << ", \"name\": \"thread_name\", \"args\": {\"name\": " << JsonString(thread.second) << "}}";
+        }
+
+        for (const auto& event : session.events) {
+            out << ",\n{\"ph\": \"X\", \"pid\": 1, \"tid\": " << event.thread
+                << ", \"cat\": \"" << event.category << "\", \"name\": \"" << event.name
+                << "\", \"ts\": " << Micros(event.startNs) << ", \"dur\": " << Micros(event.durationNs);
+            if (!event.detail.empty()) {
+                out << ", \"args\": {\"detail\": " << JsonString(event.detail) << "}";
+            }
+            out << "}";
+        }
+        out << "\n]}\n";
+
+        session.events.clear();
+        session.events.shrink_to_fit();
+
+        if (!out.good()) {
+            error = "Failed to write trace file " + session.path.u8string();
+            return false;
+        }
+        return true;
+    }
+
+    void TraceComplete(const char* category, const char* name, uint64_t startNs, uint64_t endNs,
+                       const std::string& detail) {
+        if (!TraceEnabled()) {
+            return;
+        }
+
+        uint32_t thread = CurrentThread();
+        TraceSession& session = Session();
+        std::lock_guard<std::mutex> guard(session.lock);
+
+        // Spans that began before StartTrace are clipped to the start of the trace
+        uint64_t origin = session.originNs;
+        if (!TraceEnabled() || endNs < origin) {
+            return;
+        }
+        if (session.events.size() >= MaxEvents) {
+            session.dropped++;
+            return;
+        }
+
+        uint64_t start = startNs > origin ? startNs - origin : 0;
+        uint64_t end = endNs - origin;
+        session.events.push_back({ category, name, detail, start, end > start ? end - start : 0, thread });
+    }
+
+    void TraceThreadName(const std::string& name) {
+        if (!TraceEnabled()) {
+            return;
+        }
+
+        uint32_t thread = CurrentThread();
+        TraceSession& session = Session();
+        std::lock_guard<std::mutex> guard(session.lock);
+        session.threadNames[thread] = name;
+    }
+}
@@ -0,0 +1,69 @@
+// Trace.h - Optional span tracing in Chrome trace-event format
+//
+// StartTrace turns on recording for the whole process; StopTrace writes the
+// spans collected so far as a trace-event JSON file that Perfetto
+// (ui.perfetto.dev) and chrome://tracing open directly. Spans cover jobs,
+// directories, files, pipeline stages (see PhaseTimer) and worker threads.
+// While tracing is off a span costs one relaxed atomic load.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace BackupCore {
+
+    namespace TraceState {
+        extern std::atomic<bool> enabled;
+    }
+
+    inline bool TraceEnabled() {
+        return TraceState::enabled.load(std::memory_order_relaxed);
+    }
+
+    // Begin recording; the file is written by StopTrace. Fails if a trace is already running.
+    bool StartTrace(const std::filesystem::path& path, std::string& error);
+
+    // Stop recording and write the trace file
+    bool StopTrace(std::string& error);
+
+    // Steady-clock nanoseconds, the time base of TraceComplete
+    uint64_t TraceClock();
+
+    // Record a finished span on the calling thread.
+    // category and name are kept by pointer, so pass string literals.
+    void TraceComplete(const char* category, const char* name, uint64_t startNs, uint64_t endNs,
+                       const std::string& detail = std::string());
+
+    // Label the calling thread in the trace (e.g. "clone reader")
+    void TraceThreadName(const std::string& name);
+
+    // Records a span from construction to destruction
+    class TraceSpan {
+    public:
+        TraceSpan(const char* category, const char* name)
+            : category(category), name(name), start(TraceEnabled() ? TraceClock() : 0) {}
+
+        TraceSpan(const char* category, const char* name, const std::string& spanDetail)
+            : TraceSpan(category, name) {
+            if (start) detail = spanDetail;
+        }
+
+        ~TraceSpan() {
+            if (start && TraceEnabled()) {
+                TraceComplete(category, name, start, TraceClock(), detail);
+            }
+        }
+
+        TraceSpan(const TraceSpan&) = delete;
+        TraceSpan& operator=(const TraceSpan&) = delete;
+
+    private:
+        const char* category;
+        const char* name;
+        uint64_t start;
+        std::string detail;
+    };
+}
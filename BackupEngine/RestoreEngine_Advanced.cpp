@@ -1,12 +1,18 @@
 // RestoreEngine_Advanced.cpp - Advanced restore functions
 #include "BackupEngine.h"
+#include "Core/BlockDevice.h"
+#include "Core/DiskImage.h"
+#include "Core/FileBackup.h"
 #include <Windows.h>
 #include <string>
 #include <filesystem>
+#include <memory>
 #include <vector>
 
 namespace fs = std::filesystem;
 extern void SetLastErrorMessage(const std::wstring& error);
+extern std::wstring Widen(const std::string& utf8);
+extern void SetLastFileErrors(const std::vector<BackupCore::FileError>& errors);
 
 extern "C" {
 
@@ -16,6 +22,7 @@ extern "C" {
         bool restoreSystemState,
         ProgressCallback callback) {
         
+        SetLastFileErrors({});
         if (!backupPath || !targetVolume) {
             SetLastErrorMessage(L"Invalid parameters");
             return -1;
@@ -47,42 +54,69 @@ extern "C" {
                 callback(10, L"Restoring volume files...");
             }
 
-            // Restore all files from backup
-            size_t totalFiles = 0;
-            size_t processedFiles = 0;
-
-            // Count files
-            for (const auto& entry : fs::recursive_directory_iterator(backupPath)) {
-                if (entry.is_regular_file()) {
-                    totalFiles++;
+            if (BackupCore::HasCatalog(backupPath)) {
+                // Catalogued backup set: decompress and verify through the portable core
+                BackupCore::FileRestoreOptions options;
+                options.overwriteExisting = true;
+
+                BackupCore::FileSetResult result;
+                std::string error;
+                int rc = BackupCore::RestoreFileSet(backupPath, volumePath, options,
+                    [callback](int percentage, const std::string& message) {
+                        if (callback) {
+                            callback(10 + percentage * 70 / 100, Widen(message).c_str());
+                        }
+                    },
+                    result, error);
+                SetLastFileErrors(result.errors);
+
+                if (rc != 0) {
+                    SetLastErrorMessage(Widen(error));
+                    return rc;
+                }
+                if (result.failed > 0) {
+                    SetLastErrorMessage(L"Failed to restore " + std::to_wstring(result.failed) + L" files");
+                    return -5;
                 }
             }
-
-            // Restore files
-            for (const auto& entry : fs::recursive_directory_iterator(backupPath)) {
-                if (entry.is_regular_file()) {
-                    fs::path sourceFile = entry.path();
-                    
-                    // Skip metadata files
-                    if (sourceFile.filename() == L"backup_metadata.dat") {
-                        continue;
+            else {
+                // Restore all files from backup
+                size_t totalFiles = 0;
+                size_t processedFiles = 0;
+
+                // Count files
+                for (const auto& entry : fs::recursive_directory_iterator(backupPath)) {
+                    if (entry.is_regular_file()) {
+                        totalFiles++;
                     }
+                }
 
-                    fs::path relativePath = fs::relative(sourceFile, backupPath);
-                    fs::path destFile = fs::path(volumePath) / relativePath;
-
-                    // Create destination directory
-                    fs::create_directories(destFile.parent_path());
-
-                    // Copy file
-                    fs::copy_file(sourceFile, destFile, fs::copy_options::overwrite_existing);
-
-                    processedFiles++;
-                    if (callback && totalFiles > 0) {
-                        int percent = 10 + (int)((processedFiles * 70) / totalFiles);
-                        std::wstring msg = L"Restored " + std::to_wstring(processedFiles) +
-                            L" of " + std::to_wstring(totalFiles) + L" files";
-                        callback(percent, msg.c_str());
+                // Restore files
+                for (const auto& entry : fs::recursive_directory_iterator(backupPath)) {
+                    if (entry.is_regular_file()) {
+                        fs::path sourceFile = entry.path();
+                        
+                        // Skip metadata files
+                        if (sourceFile.filename() == L"backup_metadata.dat") {
+                            continue;
+                        }
+
+                        fs::path relativePath = fs::relative(sourceFile, backupPath);
+                        fs::path destFile = fs::path(volumePath) / relativePath;
+
+                        // Create destination directory
+                        fs::create_directories(destFile.parent_path());
+
+                        // Copy file
+                        fs::copy_file(sourceFile, destFile, fs::copy_options::overwrite_existing);
+
+                        processedFiles++;
+                        if (callback && totalFiles > 0) {
+                            int percent = 10 + (int)((processedFiles * 70) / totalFiles);
+                            std::wstring msg = L"Restored " + std::to_wstring(processedFiles) +
+                                L" of " + std::to_wstring(totalFiles) + L" files";
+                            callback(percent, msg.c_str());
+                        }
                     }
                 }
             }
@@ -119,6 +153,16 @@ extern "C" {
         int targetDiskNumber,
         bool restoreSystemState,
         ProgressCallback callback) {
+
+        return RestoreDiskEx(backupPath, targetDiskNumber, restoreSystemState, 0, callback);
+    }
+
+    BACKUPENGINE_API int RestoreDiskEx(
+        const wchar_t* backupPath,
+        int targetDiskNumber,
+        bool restoreSystemState,
+        int restoreFlags,
+        ProgressCallback callback) {
         
         if (!backupPath || targetDiskNumber < 0) {
             SetLastErrorMessage(L"Invalid parameters");
@@ -130,6 +174,56 @@ extern "C" {
                 callback(0, L"Starting disk restore...");
             }
 
+            // Partition-aware images carry a .layout manifest; older backups are one raw .img
+            fs::path layoutFile = BackupCore::FindDiskImageLayout(
+                backupPath, "disk_" + std::to_string(targetDiskNumber));
+
+            if (!layoutFile.empty()) {
+                std::string error;
+                BackupCore::DiskImageManifest manifest;
+                if (!BackupCore::LoadDiskImageManifest(layoutFile, manifest, error)) {
+                    SetLastErrorMessage(Widen(error));
+                    return -2;
+                }
+
+                if (callback) {
+                    callback(10, L"Opening target disk...");
+                }
+
+                std::wstring diskPath = L"\\\\.\\PhysicalDrive" + std::to_wstring(targetDiskNumber);
+                std::unique_ptr<BackupCore::BlockDevice> disk =
+                    BackupCore::BlockDevice::Open(diskPath, true, error);
+
+                if (!disk) {
+                    SetLastErrorMessage(L"Failed to open target disk - requires administrator privileges");
+                    return -3;
+                }
+
+                BackupCore::DiskRestoreOptions options;
+                options.compareBeforeWrite = (restoreFlags & RESTORE_FLAG_COMPARE_BEFORE_WRITE) != 0;
+                options.discardZeroRanges = (restoreFlags & RESTORE_FLAG_DISCARD_ZERO_RANGES) != 0;
+                options.verifyWrites = (restoreFlags & RESTORE_FLAG_VERIFY_WRITES) != 0;
+
+                int result = BackupCore::RestoreDiskImage(manifest, *disk, options,
+                    [callback](int percentage, const std::string& message) {
+                        if (callback) {
+                            callback(10 + (percentage * 90) / 100, Widen(message).c_str());
+                        }
+                    },
+                    error);
+
+                if (result != 0) {
+                    SetLastErrorMessage(Widen(error));
+                    return result;
+                }
+
+                if (callback) {
+                    callback(100, L"Disk restore completed successfully");
+                }
+
+                return 0;
+            }
+
             // Find backup image file
             std::wstring backupFile = std::wstring(backupPath) + L"\\disk_" + 
                 std::to_wstring(targetDiskNumber) + L".img";
@@ -246,7 +340,71 @@ extern "C" {
             return 0;
         }
         catch (...) {
-            SetLastErrorMessage(L"Exception in RestoreDisk");
+            SetLastErrorMessage(L"Exception in RestoreDiskEx");
+            return -99;
+        }
+    }
+
+    BACKUPENGINE_API int CloneDisk(
+        int sourceDiskNumber,
+        int targetDiskNumber,
+        int cloneFlags,
+        ProgressCallback callback) {
+
+        if (sourceDiskNumber < 0 || targetDiskNumber < 0) {
+            SetLastErrorMessage(L"Invalid parameters");
+            return -1;
+        }
+
+        if (sourceDiskNumber == targetDiskNumber) {
+            SetLastErrorMessage(L"Source and target disk must be different");
+            return -1;
+        }
+
+        try {
+            if (callback) {
+                callback(0, L"Opening disks...");
+            }
+
+            std::string error;
+            std::unique_ptr<BackupCore::BlockDevice> source = BackupCore::BlockDevice::Open(
+                L"\\\\.\\PhysicalDrive" + std::to_wstring(sourceDiskNumber), false, error);
+
+            if (!source) {
+                SetLastErrorMessage(L"Failed to open source disk - requires administrator privileges");
+                return -3;
+            }
+
+            std::unique_ptr<BackupCore::BlockDevice> target = BackupCore::BlockDevice::Open(
+                L"\\\\.\\PhysicalDrive" + std::to_wstring(targetDiskNumber), true, error);
+
+            if (!target) {
+                SetLastErrorMessage(L"Failed to open target disk - requires administrator privileges");
+                return -3;
+            }
+
+            BackupCore::DiskRestoreOptions options;
+            options.compareBeforeWrite = (cloneFlags & RESTORE_FLAG_COMPARE_BEFORE_WRITE) != 0;
+            options.discardZeroRanges = (cloneFlags & RESTORE_FLAG_DISCARD_ZERO_RANGES) != 0;
+            options.verifyWrites = (cloneFlags & RESTORE_FLAG_NO_VERIFY) == 0;
+
+            int result = BackupCore::CloneDisk(*source, *target, BackupCore::DiskImageOptions(), options,
+                [callback](int percentage, const std::string& message) {
+                    if (callback) {
+                        callback(percentage, Widen(message).c_str());
+                    }
+                },
+                error);
+
+            if (result != 0) {
+                SetLastErrorMessage(Widen(error));
+                return result;
+            }
+
+            return 0;
+        }
+        catch (...) {
+            SetLastErrorMessage(L"Exception in CloneDisk");
             return -99;
         }
     }
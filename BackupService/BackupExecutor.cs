@@ -3,17 +3,67 @@ using System.IO;
 using System.Linq;
 using System.Runtime.InteropServices;
 using System.Text;
+using System.Threading;
 using System.Threading.Tasks;
 
 namespace BackupService
 {
+    // Matches PROGRESS_PHASE_* in BackupEngine.h
+    public enum BackupPhase
+    {
+        Idle = 0,
+        Scanning,
+        Copying,
+        Verifying,
+        Restoring,
+        Finalizing,
+        Completed,
+        Failed
+    }
+
+    // Matches BACKUP_PROGRESS in BackupEngine.h
+    [StructLayout(LayoutKind.Sequential)]
+    public struct BackupProgress
+    {
+        public BackupPhase Phase;
+        public int Percent;
+        public ulong FilesDone;
+        public ulong FilesTotal;
+        public ulong FilesFailed;
+        public ulong BytesDone;
+        public ulong BytesTotal;
+        public double BytesPerSecond;
+        public double ElapsedSeconds;
+        public double EtaSeconds;      // -1 while unknown
+    }
+
+    // Matches BACKUP_FILE_ERROR in BackupEngine.h
+    [StructLayout(LayoutKind.Sequential, CharSet = CharSet.Unicode)]
+    public struct BackupFileError
+    {
+        public int Code;               // FILE_ERROR_*
+        public int SystemError;
+        [MarshalAs(UnmanagedType.ByValTStr, SizeConst = 512)]
+        public string Path;
+        [MarshalAs(UnmanagedType.ByValTStr, SizeConst = 256)]
+        public string Message;
+    }
+
     public class BackupExecutor
     {
         private const string DllName = "BackupEngine.dll";
+        private const int BackupFlagCompress = 0x0001;
+        private const int BackupFlagParity = 0x0002;
+        private const int StatusIntervalMs = 100;
+        private const int ResultCancelled = -10;
+        private const int LoggedFileErrors = 20;
 
         [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
         private delegate void ProgressCallback(int percentage, [MarshalAs(UnmanagedType.LPWStr)] string message);
 
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        private delegate void ProgressStatusCallback(ref BackupProgress progress, IntPtr context);
+
         [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Unicode)]
         private static extern int BackupFiles(string sourcePath, string destPath, ProgressCallback? callback);
 
@@ -35,10 +85,147 @@ namespace BackupService
         [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Unicode)]
         private static extern int VerifyBackup(string backupPath, ProgressCallback? callback);
 
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Unicode)]
+        private static extern int PruneBackups(string destPath, string jobName, int keepLast, int keepDaily,
+            int keepWeekly, int keepMonthly, bool dryRun, ProgressCallback? callback);
+
         [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Unicode)]
         private static extern void GetLastErrorMessage(StringBuilder buffer, int bufferSize);
 
-        public async Task<bool> ExecuteBackupJob(BackupJob job, Action<string>? logger = null)
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Unicode)]
+        private static extern IntPtr StartBackupJob(string sourcePath, string destPath, int backupFlags,
+            ProgressStatusCallback? callback, IntPtr context, int intervalMs);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Unicode)]
+        private static extern IntPtr StartBackupSourcesJob(string[] sourcePaths, int sourceCount, string destPath,
+            int backupFlags, ProgressStatusCallback? callback, IntPtr context, int intervalMs);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Unicode)]
+        private static extern IntPtr StartVerifyJob(string backupPath, ProgressStatusCallback? callback,
+            IntPtr context, int intervalMs);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int WaitJob(IntPtr job, int timeoutMs, out int result);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int CancelJob(IntPtr job);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int SetJobThrottle(IntPtr job, ulong readBytesPerSecond, ulong writeBytesPerSecond,
+            ulong operationsPerSecond);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Unicode)]
+        private static extern int GetJobError(IntPtr job, StringBuilder buffer, int bufferSize);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int GetJobFileErrors(IntPtr job, [Out] BackupFileError[] errors, int maxErrors);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        private static extern void CloseJob(IntPtr job);
+
+        // Held in a field so the delegate outlives every native call that uses it
+        private readonly ProgressStatusCallback _statusCallback;
+        private Action<string>? _statusLogger;
+        private BackupPhase _lastPhase = BackupPhase.Idle;
+        private string? _jobError;
+
+        // Raised at most StatusIntervalMs apart while a file backup or verify runs
+        public event Action<BackupProgress>? ProgressChanged;
+
+        public BackupExecutor()
+        {
+            _statusCallback = OnStatus;
+        }
+
+        private void OnStatus(ref BackupProgress progress, IntPtr context)
+        {
+            // The engine already throttles updates; only phase changes go to the log
+            if (progress.Phase != _lastPhase)
+            {
+                _lastPhase = progress.Phase;
+                _statusLogger?.Invoke($"{progress.Phase}: {progress.FilesDone + progress.FilesFailed} of " +
+                    $"{progress.FilesTotal} files, {progress.BytesDone / (1024 * 1024)} of " +
+                    $"{progress.BytesTotal / (1024 * 1024)} MB, {progress.BytesPerSecond / (1024 * 1024):F1} MB/s");
+            }
+
+            ProgressChanged?.Invoke(progress);
+        }
+
+        private void BeginStatus(Action<string>? logger)
+        {
+            _statusLogger = logger;
+            _lastPhase = BackupPhase.Idle;
+        }
+
+        // Waits for an engine job, cancelling it if the token fires, logs the
+        // files that failed and frees the handle
+        private int RunJob(IntPtr job, CancellationToken cancellationToken, Action<string>? logger)
+        {
+            _jobError = null;
+            if (job == IntPtr.Zero)
+            {
+                return -1;
+            }
+
+            try
+            {
+                int result;
+                using (cancellationToken.Register(() => CancelJob(job)))
+                {
+                    WaitJob(job, -1, out result);
+                }
+
+                if (result != 0)
+                {
+                    var error = new StringBuilder(1024);
+                    GetJobError(job, error, error.Capacity);
+                    _jobError = error.ToString();
+                }
+
+                var fileErrors = new BackupFileError[LoggedFileErrors];
+                int failed = GetJobFileErrors(job, fileErrors, fileErrors.Length);
+                for (int i = 0; i < Math.Min(failed, fileErrors.Length); i++)
+                {
+                    logger?.Invoke($"  {fileErrors[i].Path}: {fileErrors[i].Message}");
+                }
+                if (failed > fileErrors.Length)
+                {
+                    logger?.Invoke($"  ... and {failed - fileErrors.Length} more files");
+                }
+                return result;
+            }
+            finally
+            {
+                CloseJob(job);
+            }
+        }
+
+        // Applies the job's I/O limits to a job that has just started
+        private static IntPtr Throttled(IntPtr handle, BackupJob job)
+        {
+            if (handle != IntPtr.Zero && (job.ReadLimitMBps > 0 || job.WriteLimitMBps > 0 || job.IopsLimit > 0))
+            {
+                SetJobThrottle(handle, (ulong)Math.Max(job.ReadLimitMBps, 0) * 1024 * 1024,
+                    (ulong)Math.Max(job.WriteLimitMBps, 0) * 1024 * 1024, (ulong)Math.Max(job.IopsLimit, 0));
+            }
+            return handle;
+        }
+
+        // Jobs keep their own error; everything else reports through GetLastErrorMessage
+        private string LastError()
+        {
+            if (_jobError != null)
+            {
+                return _jobError;
+            }
+
+            var error = new StringBuilder(1024);
+            GetLastErrorMessage(error, error.Capacity);
+            return error.ToString();
+        }
+
+        public async Task<bool> ExecuteBackupJob(BackupJob job, Action<string>? logger = null,
+            CancellationToken cancellationToken = default)
         {
             return await Task.Run(() =>
             {
@@ -46,28 +233,38 @@ namespace BackupService
                 {
                     logger?.Invoke($"Starting backup job: {job.Name}");
 
-                    foreach (var sourcePath in job.SourcePaths)
+                    // A full file backup takes every source in one engine call, giving one
+                    // set with one catalog; the other kinds still run once per source
+                    var batches = job.Type == BackupType.Full && job.Target != BackupTarget.Volume
+                        ? new[] { job.SourcePaths.ToArray() }
+                        : job.SourcePaths.Select(p => new[] { p }).ToArray();
+
+                    foreach (var sourcePaths in batches.Where(b => b.Length > 0))
                     {
                         var destPath = Path.Combine(job.DestinationPath,
                             $"{job.Name}_{DateTime.Now:yyyyMMdd_HHmmss}");
 
-                        int result = ExecuteBackup(job, sourcePath, destPath, logger);
+                        int result = ExecuteBackup(job, sourcePaths, destPath, logger, cancellationToken);
 
+                        if (result == ResultCancelled)
+                        {
+                            logger?.Invoke($"Backup cancelled: {job.Name}");
+                            return false;
+                        }
                         if (result != 0)
                         {
-                            var error = new StringBuilder(1024);
-                            GetLastErrorMessage(error, error.Capacity);
-                            logger?.Invoke($"Backup failed: {error}");
+                            logger?.Invoke($"Backup failed: {LastError()}");
                             return false;
                         }
                     }
 
                     if (job.IsHyperVBackup)
                     {
+                        // Named under the job so its retention policy covers them too
                         foreach (var vm in job.HyperVMachines)
                         {
                             var destPath = Path.Combine(job.DestinationPath,
-                                $"{vm}_{DateTime.Now:yyyyMMdd_HHmmss}");
+                                $"{job.Name}_{vm}_{DateTime.Now:yyyyMMdd_HHmmss}");
                             
                             int result = BackupHyperVVM(vm, destPath, null);
 
@@ -84,7 +281,14 @@ namespace BackupService
                     if (job.VerifyAfterBackup)
                     {
                         logger?.Invoke("Verifying backup...");
-                        int result = VerifyBackup(job.DestinationPath, null);
+                        BeginStatus(logger);
+                        int result = RunJob(Throttled(StartVerifyJob(job.DestinationPath, _statusCallback,
+                            IntPtr.Zero, StatusIntervalMs), job), cancellationToken, logger);
+                        if (result == ResultCancelled)
+                        {
+                            logger?.Invoke($"Verification cancelled: {job.Name}");
+                            return false;
+                        }
                         if (result != 0)
                         {
                             logger?.Invoke("Backup verification failed!");
@@ -92,6 +296,30 @@ namespace BackupService
                         }
                     }
 
+                    // Old backups go only after a new one succeeded; a failed prune
+                    // is logged but does not fail the job
+                    if (job.KeepLast > 0 || job.KeepDaily > 0 || job.KeepWeekly > 0 || job.KeepMonthly > 0)
+                    {
+                        logger?.Invoke("Applying retention policy...");
+                        ProgressCallback pruneLog = (percentage, message) => logger?.Invoke(message);
+
+                        // Each VM's sets are a series of their own, pruned separately
+                        var series = new[] { job.Name }.Concat(job.IsHyperVBackup
+                            ? job.HyperVMachines.Select(vm => $"{job.Name}_{vm}")
+                            : Enumerable.Empty<string>());
+                        foreach (var name in series)
+                        {
+                            _jobError = null;
+                            int result = PruneBackups(job.DestinationPath, name, job.KeepLast, job.KeepDaily,
+                                job.KeepWeekly, job.KeepMonthly, false, pruneLog);
+                            if (result != 0)
+                            {
+                                logger?.Invoke($"Pruning old backups failed: {LastError()}");
+                            }
+                        }
+                        GC.KeepAlive(pruneLog);
+                    }
+
                     logger?.Invoke($"Backup job completed successfully: {job.Name}");
                     return true;
                 }
@@ -103,8 +331,11 @@ namespace BackupService
             });
         }
 
-        private int ExecuteBackup(BackupJob job, string sourcePath, string destPath, Action<string>? logger)
+        private int ExecuteBackup(BackupJob job, string[] sourcePaths, string destPath, Action<string>? logger,
+            CancellationToken cancellationToken)
         {
+            _jobError = null;
+            string sourcePath = sourcePaths[0];
             int result;
 
             switch (job.Type)
@@ -117,8 +348,14 @@ namespace BackupService
                     }
                     else
                     {
-                        logger?.Invoke($"Backing up files: {sourcePath}");
-                        result = BackupFiles(sourcePath, destPath, null);
+                        logger?.Invoke($"Backing up files: {string.Join(", ", sourcePaths)}");
+                        BeginStatus(logger);
+                        int flags = (job.CompressData ? BackupFlagCompress : 0) | (job.AddParity ? BackupFlagParity : 0);
+                        IntPtr handle = sourcePaths.Length == 1
+                            ? StartBackupJob(sourcePath, destPath, flags, _statusCallback, IntPtr.Zero, StatusIntervalMs)
+                            : StartBackupSourcesJob(sourcePaths, sourcePaths.Length, destPath, flags, _statusCallback,
+                                IntPtr.Zero, StatusIntervalMs);
+                        result = RunJob(Throttled(handle, job), cancellationToken, logger);
                     }
                     break;
 
@@ -46,7 +46,7 @@ namespace BackupService
                         _logger.LogInformation("Executing scheduled job: {jobName}", job.Name);
                         LogToFile($"Executing scheduled job: {job.Name}");
 
-                        bool success = await _backupExecutor.ExecuteBackupJob(job, LogToFile);
+                        bool success = await _backupExecutor.ExecuteBackupJob(job, LogToFile, stoppingToken);
 
                         if (success)
                         {
@@ -16,7 +16,18 @@ namespace BackupService
         public string DestinationPath { get; set; } = string.Empty;
         public bool IncludeSystemState { get; set; }
         public bool CompressData { get; set; }
+        // Reed-Solomon parity so damaged files in the set can be rebuilt
+        public bool AddParity { get; set; }
         public bool VerifyAfterBackup { get; set; }
+        // File jobs only; 0 means unlimited
+        public int ReadLimitMBps { get; set; }
+        public int WriteLimitMBps { get; set; }
+        public int IopsLimit { get; set; }
+        // Retention of the job's timestamped backups; all 0 keeps every one
+        public int KeepLast { get; set; }
+        public int KeepDaily { get; set; }
+        public int KeepWeekly { get; set; }
+        public int KeepMonthly { get; set; }
         public DateTime? LastRunTime { get; set; }
         public BackupSchedule? Schedule { get; set; }
         public bool IsHyperVBackup { get; set; }
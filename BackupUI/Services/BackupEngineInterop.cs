@@ -124,5 +124,43 @@ namespace BackupUI.Services
             string usbDriveLetter,
             string programPath,
             ProgressCallback? callback);
+
+        // Matches JOB_STATUS in BackupEngine.h
+        [StructLayout(LayoutKind.Sequential, CharSet = CharSet.Unicode)]
+        public struct JobStatus
+        {
+            public ulong JobId;
+            public uint ProcessId;
+            public int Phase;               // PROGRESS_PHASE_*
+            public int Percent;
+            public ulong FilesDone;
+            public ulong FilesTotal;
+            public ulong FilesFailed;
+            public ulong BytesDone;
+            public ulong BytesTotal;
+            public double BytesPerSecond;
+            public double ElapsedSeconds;
+            public double EtaSeconds;       // -1 while unknown
+            public long UpdatedUnixMs;
+            [MarshalAs(UnmanagedType.ByValTStr, SizeConst = 128)]
+            public string Name;
+        }
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Unicode)]
+        public static extern int GetRunningJobs(
+            [Out] JobStatus[]? jobs,
+            int maxJobs);
+
+        // Jobs running in the service or any other process, read from shared memory
+        public static JobStatus[] GetRunningJobs()
+        {
+            var jobs = new JobStatus[32];
+            int count = GetRunningJobs(jobs, jobs.Length);
+            if (count <= 0)
+                return Array.Empty<JobStatus>();
+
+            Array.Resize(ref jobs, Math.Min(count, jobs.Length));
+            return jobs;
+        }
     }
 }
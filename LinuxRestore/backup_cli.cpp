@@ -0,0 +1,486 @@
+// LinuxRestore/backup_cli.cpp
+// Command-line backup for Linux, built on the same core as the Windows engine
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "Core/BlockDevice.h"
+#include "Core/DiskImage.h"
+#include "Core/FileBackup.h"
+#include "Core/Job.h"
+#include "Core/JobStatus.h"
+#include "Core/Metrics.h"
+#include "Core/Progress.h"
+#include "Core/Retention.h"
+#include "Core/Trace.h"
+
+void printHeader() {
+    std::cout << "\n";
+    std::cout << "========================================\n";
+    std::cout << " Backup & Restore - Linux Backup CLI\n";
+    std::cout << " Version 4.6.0\n";
+    std::cout << "========================================\n";
+    std::cout << "\n";
+}
+
+void printUsage(const char* program) {
+    std::cout << "Usage:\n";
+    std::cout << "  File backup:  " << program << " --files <source>... <backup-dir> [--compress]\n";
+    std::cout << "  Verify:       " << program << " --verify <backup-dir>\n";
+    std::cout << "  Scrub:        " << program << " --scrub <backup-dir> [--continuous] [--budget <GB>]\n";
+    std::cout << "  Compact:      " << program << " --compact <backup-dir> [--budget <GB>] [--dry-run]\n";
+    std::cout << "  Prune:        " << program << " --prune <dest-dir> <job-name> [--keep-last <n>] [--keep-daily <n>]\n";
+    std::cout << "                [--keep-weekly <n>] [--keep-monthly <n>] [--dry-run]\n";
+    std::cout << "  Disk image:   sudo " << program << " --disk <device> <backup-dir>\n";
+    std::cout << "  Running jobs: " << program << " --jobs\n";
+    std::cout << "\n";
+    std::cout << "  --compress        Store files LZ-compressed (restore and verify decompress transparently)\n";
+    std::cout << "  --metrics <file>  Write phase timings and latency histograms when done\n";
+    std::cout << "                    (Prometheus text if the name ends in .prom, JSON otherwise)\n";
+    std::cout << "  --trace <file>    Record a trace-event timeline (open in ui.perfetto.dev or chrome://tracing)\n";
+    std::cout << "  --limit-read <MB/s>   Cap read bandwidth\n";
+    std::cout << "  --limit-write <MB/s>  Cap write bandwidth\n";
+    std::cout << "  --limit-iops <n>      Cap reads plus writes per second\n";
+    std::cout << "  --password <p>    Encrypt the set, or open an encrypted one to verify\n";
+    std::cout << "                    (BACKUP_PASSWORD is used when not given)\n";
+    std::cout << "  --cipher <name>   aes-256-gcm or chacha20-poly1305 (default: AES if the CPU has it)\n";
+    std::cout << "  --parity <n>      Add n Reed-Solomon parity shards per 16 (1-8); verify and restore\n";
+    std::cout << "                    rebuild damaged files from them\n";
+    std::cout << "  --continuous      Scrub pass after pass until stopped (default: finish the current pass)\n";
+    std::cout << "  --budget <GB>     Stop scrubbing after reading this much, or compacting after reclaiming\n";
+    std::cout << "                    this much; the next run carries on\n";
+    std::cout << "                    (scrubs read at idle I/O priority and 64 MB/s unless --limit-read says otherwise)\n";
+    std::cout << "  --keep-last/-daily/-weekly/-monthly <n>\n";
+    std::cout << "                    Which <job-name>_YYYYMMDD_HHMMSS backups --prune keeps; the bases\n";
+    std::cout << "                    of kept incrementals and anything under a day old stay too\n";
+    std::cout << "  --dry-run         Show what --prune or --compact would delete without deleting it\n";
+    std::cout << "\n";
+    std::cout << "Examples:\n";
+    std::cout << "  " << program << " --files /home/user /media/usb/backup --compress\n";
+    std::cout << "  " << program << " --files /home /srv/data /media/usb/backup\n";
+    std::cout << "  BACKUP_PASSWORD=secret " << program << " --files /home/user /media/usb/backup --compress\n";
+    std::cout << "  " << program << " --verify /media/usb/backup\n";
+    std::cout << "  " << program << " --scrub /srv/backup --budget 500\n";
+    std::cout << "  " << program << " --compact /media/usb/backup\n";
+    std::cout << "  " << program << " --prune /srv/backup Documents --keep-daily 7 --keep-weekly 4 --keep-monthly 12\n";
+    std::cout << "  sudo " << program << " --disk /dev/sda /media/usb/disk_backup\n";
+}
+
+void reportProgress(int percentage, const std::string& message) {
+    std::cout << "[" << percentage << "%] " << message << std::endl;
+}
+
+// File backup and verify status: one line redrawn at 10 Hz on a terminal,
+// one line per phase change when output is redirected
+class StatusLine {
+public:
+    StatusLine()
+        : interactive(isatty(STDOUT_FILENO) != 0),
+          channel([this](const BackupCore::ProgressStatus& status) { Show(status); }) {}
+
+    BackupCore::ProgressChannel* Channel() { return &channel; }
+
+private:
+    void Show(const BackupCore::ProgressStatus& status) {
+        bool phaseChanged = status.phase != lastPhase;
+        lastPhase = status.phase;
+        if (!interactive && !phaseChanged) {
+            return;
+        }
+
+        char line[160];
+        std::snprintf(line, sizeof(line), "[%3d%%] %-10s %llu/%llu files, %llu/%llu MB, %.1f MB/s",
+            status.percent, BackupCore::ProgressPhaseName((BackupCore::ProgressPhase)status.phase),
+            (unsigned long long)(status.filesDone + status.filesFailed), (unsigned long long)status.filesTotal,
+            (unsigned long long)(status.bytesDone >> 20), (unsigned long long)(status.bytesTotal >> 20),
+            status.bytesPerSecond / (1024 * 1024));
+        std::string text = line;
+        if (status.etaSeconds > 0) {
+            int eta = (int)status.etaSeconds;
+            std::snprintf(line, sizeof(line), ", ETA %d:%02d", eta / 60, eta % 60);
+            text += line;
+        }
+
+        bool final = status.phase == (int32_t)BackupCore::ProgressPhase::Completed ||
+                     status.phase == (int32_t)BackupCore::ProgressPhase::Failed;
+        if (interactive) {
+            std::cout << "\r" << text << "\033[K" << (final ? "\n" : "") << std::flush;
+        } else {
+            std::cout << text << std::endl;
+        }
+    }
+
+    bool interactive;
+    int32_t lastPhase = -1;
+    BackupCore::ProgressChannel channel;
+};
+
+// The first few per-file failures of a file backup or verify
+void printFileErrors(const BackupCore::FileSetResult& result) {
+    const size_t shown = 10;
+    for (size_t i = 0; i < result.errors.size() && i < shown; i++) {
+        const BackupCore::FileError& failure = result.errors[i];
+        std::cerr << "  " << failure.path << ": " << BackupCore::FileErrorName(failure.code);
+        if (failure.osError != 0) {
+            std::cerr << " (" << std::strerror(failure.osError) << ")";
+        }
+        std::cerr << "\n";
+    }
+    if (result.failed > shown) {
+        std::cerr << "  ... and " << (result.failed - shown) << " more\n";
+    }
+}
+
+// Several sources go into one set, each under a folder of its own name
+int backupFiles(const std::vector<std::filesystem::path>& sources, const std::string& dest, bool compress,
+    const std::string& password, BackupCore::CipherKind cipher, uint32_t parityShards, BackupCore::JobControl* control) {
+    std::string names;
+    for (const auto& source : sources) {
+        std::cout << (names.empty() ? "Backing up: " : "            ") << source.string() << "\n";
+        names += (names.empty() ? "" : ", ") + source.string();
+    }
+    std::cout << "        to: " << dest << "\n\n";
+
+    StatusLine status;
+    BackupCore::FileBackupOptions options;
+    options.codec = compress ? BackupCore::CompressionCodec::Lz : BackupCore::CompressionCodec::None;
+    options.password = password;
+    options.cipher = cipher;
+    options.parityShards = parityShards;
+    options.channel = status.Channel();
+    options.control = control;
+    options.channel->Publish("Backup files " + names + " -> " + dest);
+
+    BackupCore::FileSetResult result;
+    std::string error;
+    int rc = BackupCore::BackupFileSources(sources, dest, options, nullptr, result, error);
+    if (rc != 0) {
+        std::cerr << "ERROR: " << error << std::endl;
+        return 1;
+    }
+
+    if (result.duplicates > 0) {
+        std::cout << result.duplicates << " identical files stored once\n";
+    }
+    if (result.deltas > 0) {
+        std::cout << result.deltas << " files stored as deltas against similar ones\n";
+    }
+    if (result.rawBlocks > 0) {
+        std::cout << result.rawBlocks << " incompressible blocks stored without compressing\n";
+    }
+    if (result.strongBlocks > 0) {
+        std::cout << result.strongBlocks << " blocks compressed harder while waiting on I/O\n";
+    }
+    if (result.dictionaryFiles > 0) {
+        std::cout << result.dictionaryFiles << " small files compressed against the set's dictionary\n";
+    }
+    if (result.failed > 0) {
+        std::cerr << "WARNING: " << result.failed << " files could not be backed up:" << std::endl;
+        printFileErrors(result);
+    }
+    return 0;
+}
+
+int verifyBackup(const std::string& backupDir, const std::string& password, BackupCore::JobControl* control) {
+    StatusLine status;
+    status.Channel()->Publish("Verify " + backupDir);
+    BackupCore::FileVerifyOptions options;
+    options.password = password;
+    options.channel = status.Channel();
+    options.control = control;
+
+    BackupCore::FileSetResult result;
+    std::string error;
+    int rc = BackupCore::VerifyFileSet(backupDir, options, nullptr, result, error);
+    if (result.repaired > 0) {
+        std::cout << "Repaired " << result.repaired << " damaged files from parity\n";
+    }
+    if (rc != 0) {
+        std::cerr << "ERROR: " << error << std::endl;
+        printFileErrors(result);
+        return 1;
+    }
+    return 0;
+}
+
+// Picks up where the previous scrub of the set stopped
+int scrubBackup(const std::string& backupDir, const std::string& password, bool continuous, double budgetGb,
+    BackupCore::JobControl* control) {
+    StatusLine status;
+    status.Channel()->Publish("Scrub " + backupDir);
+    BackupCore::FileScrubOptions options;
+    options.password = password;
+    options.continuous = continuous;
+    options.budgetBytes = (uint64_t)(std::max(budgetGb, 0.0) * 1024 * 1024 * 1024);
+    if (control->Throttle().ReadLimit() > 0) {
+        options.bytesPerSecond = control->Throttle().ReadLimit();
+    }
+    options.channel = status.Channel();
+    options.control = control;
+
+    BackupCore::FileSetResult result;
+    std::string error;
+    int rc = BackupCore::ScrubFileSet(backupDir, options, nullptr, result, error);
+    std::cout << "Scrubbed " << result.files + result.failed << " files";
+    if (result.passes > 0) {
+        std::cout << ", finishing " << result.passes << (result.passes == 1 ? " pass" : " passes");
+    }
+    std::cout << "\n";
+    if (result.repaired > 0) {
+        std::cout << "Repaired " << result.repaired << " damaged files from parity\n";
+    }
+    if (rc != 0) {
+        std::cerr << "ERROR: " << error << std::endl;
+        printFileErrors(result);
+        return 1;
+    }
+    return 0;
+}
+
+// Deletes what earlier backups into the set left behind
+int compactBackup(const std::string& backupDir, double budgetGb, bool dryRun, BackupCore::JobControl* control) {
+    BackupCore::FileCompactOptions options;
+    options.budgetBytes = (uint64_t)(std::max(budgetGb, 0.0) * 1024 * 1024 * 1024);
+    options.dryRun = dryRun;
+    options.control = control;
+
+    BackupCore::FileSetResult result;
+    std::string error;
+    // Reports each file it deletes, or would delete, and the totals
+    int rc = BackupCore::CompactFileSet(backupDir, options, reportProgress, result, error);
+    if (rc != 0) {
+        std::cerr << "ERROR: " << error << std::endl;
+        printFileErrors(result);
+        return 1;
+    }
+    return 0;
+}
+
+int pruneBackups(const std::string& destDir, const std::string& jobName, const BackupCore::RetentionPolicy& policy,
+    bool dryRun, BackupCore::JobControl* control) {
+    BackupCore::PruneOptions options;
+    options.policy = policy;
+    options.dryRun = dryRun;
+    options.control = control;
+
+    BackupCore::PruneResult result;
+    std::string error;
+    int rc = BackupCore::PruneBackupSets(destDir, jobName, options, reportProgress, result, error);
+    for (const auto& set : result.sets) {
+        if (set.keep) {
+            std::cout << "  keep    " << set.name << " (" << set.reason << ")\n";
+        } else {
+            std::cout << "  " << (dryRun ? "would delete " : "delete  ") << set.name << "\n";
+        }
+    }
+    for (const auto& warning : result.warnings) {
+        std::cerr << "WARNING: " << warning << std::endl;
+    }
+    if (rc != 0) {
+        std::cerr << "ERROR: " << error << std::endl;
+        return 1;
+    }
+    if (!dryRun) {
+        std::cout << "Deleted " << result.deleted << " backups, " << (result.bytesFreed >> 20) << " MB freed\n";
+    }
+    return 0;
+}
+
+int backupDisk(const std::string& device, const std::string& dest, BackupCore::IoThrottle* throttle) {
+    std::string error;
+    auto disk = BackupCore::BlockDevice::Open(device, false, error);
+    if (!disk) {
+        std::cerr << "ERROR: " << error << std::endl;
+        return 1;
+    }
+
+    std::cout << "Imaging disk: " << device << "\n";
+    std::cout << "          to: " << dest << "\n\n";
+
+    BackupCore::JobStatusPublisher jobStatus("Image disk " + device + " -> " + dest);
+    BackupCore::DiskImageOptions options;
+    options.throttle = throttle;
+    int rc = BackupCore::ImageDisk(*disk, dest, "disk_0", options,
+        [&jobStatus](int percentage, const std::string& message) {
+            jobStatus.Update(BackupCore::ProgressPhase::Copying, percentage);
+            reportProgress(percentage, message);
+        },
+        error);
+    if (rc != 0) {
+        std::cerr << "ERROR: " << error << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Jobs published by any backup or restore process on this machine
+int listJobs() {
+    std::vector<BackupCore::JobStatusEntry> jobs;
+    std::string error;
+    if (!BackupCore::ReadJobStatus(jobs, error)) {
+        std::cerr << "ERROR: " << error << std::endl;
+        return 1;
+    }
+
+    if (jobs.empty()) {
+        std::cout << "No jobs are running\n";
+        return 0;
+    }
+
+    for (const auto& job : jobs) {
+        char line[256];
+        std::snprintf(line, sizeof(line), "%7u  %-10s %3d%%  %llu/%llu files  %llu/%llu MB  %.1f MB/s  %ds  ",
+            job.processId, BackupCore::ProgressPhaseName((BackupCore::ProgressPhase)job.phase), job.percent,
+            (unsigned long long)(job.filesDone + job.filesFailed), (unsigned long long)job.filesTotal,
+            (unsigned long long)(job.bytesDone >> 20), (unsigned long long)(job.bytesTotal >> 20),
+            job.bytesPerSecond / (1024 * 1024), (int)job.elapsedSeconds);
+        std::cout << line << job.name << "\n";
+    }
+    return 0;
+}
+
+bool writeMetrics(const std::string& path) {
+    const BackupCore::EngineMetrics& metrics = BackupCore::EngineMetrics::Global();
+    bool prometheus = path.size() > 5 && path.compare(path.size() - 5, 5, ".prom") == 0;
+
+    std::ofstream out(path, std::ios::trunc);
+    out << (prometheus ? metrics.ToPrometheus() : metrics.ToJson() + "\n");
+    if (!out.good()) {
+        std::cerr << "WARNING: could not write metrics to " << path << std::endl;
+        return false;
+    }
+    std::cout << "Metrics written to " << path << "\n";
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    printHeader();
+
+    // Options that apply to every mode are taken out first
+    std::vector<std::string> args;
+    std::string metricsPath;
+    std::string tracePath;
+    bool compress = false;
+    std::string password;
+    std::string cipherName;
+    uint32_t parityShards = 0;
+    bool continuous = false;
+    bool dryRun = false;
+    BackupCore::RetentionPolicy retention;
+    double budgetGb = 0;
+    double readLimit = 0, writeLimit = 0, operationLimit = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--metrics" && i + 1 < argc) {
+            metricsPath = argv[++i];
+        } else if (arg == "--trace" && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (arg == "--limit-read" && i + 1 < argc) {
+            readLimit = std::atof(argv[++i]);
+        } else if (arg == "--limit-write" && i + 1 < argc) {
+            writeLimit = std::atof(argv[++i]);
+        } else if (arg == "--limit-iops" && i + 1 < argc) {
+            operationLimit = std::atof(argv[++i]);
+        } else if (arg == "--password" && i + 1 < argc) {
+            password = argv[++i];
+        } else if (arg == "--cipher" && i + 1 < argc) {
+            cipherName = argv[++i];
+        } else if (arg == "--parity" && i + 1 < argc) {
+            parityShards = (uint32_t)std::atoi(argv[++i]);
+        } else if (arg == "--budget" && i + 1 < argc) {
+            budgetGb = std::atof(argv[++i]);
+        } else if (arg == "--keep-last" && i + 1 < argc) {
+            retention.keepLast = (uint32_t)std::atoi(argv[++i]);
+        } else if (arg == "--keep-daily" && i + 1 < argc) {
+            retention.keepDaily = (uint32_t)std::atoi(argv[++i]);
+        } else if (arg == "--keep-weekly" && i + 1 < argc) {
+            retention.keepWeekly = (uint32_t)std::atoi(argv[++i]);
+        } else if (arg == "--keep-monthly" && i + 1 < argc) {
+            retention.keepMonthly = (uint32_t)std::atoi(argv[++i]);
+        } else if (arg == "--dry-run") {
+            dryRun = true;
+        } else if (arg == "--continuous") {
+            continuous = true;
+        } else if (arg == "--compress") {
+            compress = true;
+        } else {
+            args.push_back(arg);
+        }
+    }
+
+    if (args.empty()) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (password.empty() && std::getenv("BACKUP_PASSWORD")) {
+        password = std::getenv("BACKUP_PASSWORD");
+    }
+    BackupCore::CipherKind cipher = BackupCore::CipherKind::None;
+    if (!cipherName.empty()) {
+        cipher = BackupCore::ParseCipherName(cipherName);
+        if (cipher == BackupCore::CipherKind::None) {
+            std::cerr << "ERROR: unknown cipher " << cipherName << std::endl;
+            return 1;
+        }
+    }
+
+    std::string error;
+    if (!tracePath.empty() && !BackupCore::StartTrace(tracePath, error)) {
+        std::cerr << "WARNING: tracing disabled: " << error << std::endl;
+        tracePath.clear();
+    }
+
+    BackupCore::JobControl control;
+    if (readLimit > 0 || writeLimit > 0 || operationLimit > 0) {
+        control.Throttle().SetLimits((uint64_t)(std::max(readLimit, 0.0) * 1024 * 1024),
+            (uint64_t)(std::max(writeLimit, 0.0) * 1024 * 1024), (uint64_t)std::max(operationLimit, 0.0));
+    }
+
+    int result = -1;
+    const std::string& mode = args[0];
+    if (mode == "--files" && args.size() >= 3) {
+        std::vector<std::filesystem::path> sources(args.begin() + 1, args.end() - 1);
+        result = backupFiles(sources, args.back(), compress, password, cipher, parityShards, &control);
+    } else if (mode == "--verify" && args.size() >= 2) {
+        result = verifyBackup(args[1], password, &control);
+    } else if (mode == "--scrub" && args.size() >= 2) {
+        result = scrubBackup(args[1], password, continuous, budgetGb, &control);
+    } else if (mode == "--compact" && args.size() >= 2) {
+        result = compactBackup(args[1], budgetGb, dryRun, &control);
+    } else if (mode == "--prune" && args.size() >= 3) {
+        result = pruneBackups(args[1], args[2], retention, dryRun, &control);
+    } else if (mode == "--disk" && args.size() >= 3) {
+        result = backupDisk(args[1], args[2], &control.Throttle());
+    } else if (mode == "--jobs") {
+        result = listJobs();
+    } else if (mode == "--help") {
+        printUsage(argv[0]);
+        result = 0;
+    }
+
+    if (!tracePath.empty()) {
+        if (BackupCore::StopTrace(error)) {
+            std::cout << "Trace written to " << tracePath << "\n";
+        } else {
+            std::cerr << "WARNING: " << error << std::endl;
+        }
+    }
+
+    if (result < 0) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (!metricsPath.empty()) {
+        writeMetrics(metricsPath);
+    }
+    return result;
+}
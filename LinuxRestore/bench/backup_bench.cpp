@@ -0,0 +1,760 @@
+// LinuxRestore/bench/backup_bench.cpp
+// Throughput benchmarks for the portable backup core.
+// Generates synthetic datasets, times scan/copy/hash/compress/catalog/restore
+// and disk imaging over them, and writes the results as JSON so runs from
+// different versions can be compared (see --baseline).
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/utsname.h>
+#include "Core/BlockDevice.h"
+#include "Core/Catalog.h"
+#include "Core/Checksum.h"
+#include "Core/Compression.h"
+#include "Core/DiskImage.h"
+#include "Core/Encryption.h"
+#include "Core/FileBackup.h"
+#include "Core/FileScanner.h"
+#include "Core/Parity.h"
+#include "Core/ReedSolomon.h"
+#include "checks.h"
+#include "dataset.h"
+
+#ifndef BENCH_VERSION
+#define BENCH_VERSION "unknown"
+#endif
+
+namespace fs = std::filesystem;
+
+struct BenchConfig {
+    fs::path workDir;
+    fs::path output = "bench_results.json";
+    fs::path baseline;
+    std::set<std::string> only;
+    int repeat = 3;
+    uint64_t seed = 1;
+    bool keep = false;
+
+    uint32_t tinyFiles = 10000;
+    uint32_t tinyMaxSize = 4096;
+    uint32_t depth = 64;
+    uint32_t filesPerLevel = 4;
+    uint32_t deepFileSize = 16 * 1024;
+    uint64_t sparseSize = 1024ULL * 1024 * 1024;
+    uint32_t sparseExtents = 16;
+    uint32_t sparseExtentSize = 1024 * 1024;
+    Bench::ImageSpec image;
+};
+
+struct BenchResult {
+    std::string name;
+    std::string dataset;
+    uint64_t items = 0;         // Files or blocks processed per run
+    uint64_t bytes = 0;         // Input bytes per run
+    uint64_t outputBytes = 0;   // Bytes produced per run (stored, compressed, restored)
+    std::vector<double> seconds;
+};
+
+// A benchmark: 'prepare' runs untimed before every repetition, 'run' is timed
+struct BenchCase {
+    std::string name;
+    std::string dataset;
+    std::function<bool(std::string&)> prepare;
+    std::function<bool(BenchResult&, std::string&)> run;
+};
+
+void printHeader() {
+    std::cout << "\n";
+    std::cout << "========================================\n";
+    std::cout << " Backup & Restore - Benchmark Suite\n";
+    std::cout << " Version " << BENCH_VERSION << "\n";
+    std::cout << "========================================\n";
+    std::cout << "\n";
+}
+
+void printUsage(const char* program) {
+    std::cout << "Usage:\n";
+    std::cout << "  Run benchmarks:    " << program << " [options]\n";
+    std::cout << "  Generate datasets: " << program << " --generate <dir> [options]\n";
+    std::cout << "  Run the checks:    " << program << " --check [--workdir <dir>]\n";
+    std::cout << "\n";
+    std::cout << "Options:\n";
+    std::cout << "  --workdir <dir>        Scratch directory (default: a new directory under /tmp)\n";
+    std::cout << "  --output <file>        JSON results (default: bench_results.json)\n";
+    std::cout << "  --baseline <file>      Compare against an earlier JSON result\n";
+    std::cout << "  --only <a,b,...>       Run only these benchmarks\n";
+    std::cout << "  --repeat <n>           Timed repetitions per benchmark (default: 3)\n";
+    std::cout << "  --seed <n>             Dataset seed (default: 1)\n";
+    std::cout << "  --keep                 Keep the work directory afterwards\n";
+    std::cout << "  --tiny-files <n>       Number of tiny files (default: 10000)\n";
+    std::cout << "  --tiny-max <bytes>     Largest tiny file (default: 4096)\n";
+    std::cout << "  --depth <n>            Deep tree depth (default: 64)\n";
+    std::cout << "  --sparse-mb <n>        Logical size of the sparse file (default: 1024)\n";
+    std::cout << "  --image-mb <n>         Size of the synthetic disk image (default: 256)\n";
+    std::cout << "  --zero-ratio <r>       Share of zero blocks in the image (default: 0.3)\n";
+    std::cout << "  --dup-ratio <r>        Share of duplicate blocks in the image (default: 0.2)\n";
+    std::cout << "\n";
+    std::cout << "Benchmarks: scan, copy, copy_encrypted, copy_lz_image, copy_lz_sparse, hash,\n";
+    std::cout << "            compress, decompress, encrypt, parity, catalog_load, restore, image_disk\n";
+}
+
+uint64_t DirectoryBytes(const fs::path& dir) {
+    uint64_t total = 0;
+    std::error_code ec;
+    for (auto it = fs::recursive_directory_iterator(dir, ec); !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (it->is_regular_file(ec)) {
+            total += it->file_size(ec);
+        }
+    }
+    return total;
+}
+
+bool RemoveTree(const fs::path& dir, std::string& error) {
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+    if (ec) {
+        error = "Cannot remove " + dir.string() + ": " + ec.message();
+        return false;
+    }
+    return true;
+}
+
+bool GenerateDatasets(const BenchConfig& config, const fs::path& root, std::string& error) {
+    Bench::DatasetStats tiny, deep, sparse, image;
+
+    std::cout << "Generating " << config.tinyFiles << " tiny files...\n";
+    if (!Bench::GenerateTinyFiles(root / "files" / "tiny", config.tinyFiles, config.tinyMaxSize,
+                                  config.seed, tiny, error)) {
+        return false;
+    }
+
+    std::cout << "Generating deep tree (" << config.depth << " levels)...\n";
+    if (!Bench::GenerateDeepTree(root / "files" / "deep", config.depth, config.filesPerLevel,
+                                 config.deepFileSize, config.seed + 1, deep, error)) {
+        return false;
+    }
+
+    std::cout << "Generating sparse file (" << (config.sparseSize >> 20) << " MB)...\n";
+    fs::create_directories(root / "sparse");
+    if (!Bench::GenerateSparseFile(root / "sparse" / "sparse.img", config.sparseSize, config.sparseExtents,
+                                   config.sparseExtentSize, config.seed + 2, sparse, error)) {
+        return false;
+    }
+
+    std::cout << "Generating disk image (" << (config.image.size >> 20) << " MB, zero "
+              << config.image.zeroRatio << ", duplicate " << config.image.duplicateRatio << ")...\n";
+    fs::create_directories(root / "image");
+    if (!Bench::GenerateImage(root / "image" / "disk.img", config.image, config.seed + 3, image, error)) {
+        return false;
+    }
+
+    std::cout << "  files:  " << (tiny.files + deep.files) << " files in "
+              << (tiny.directories + deep.directories) << " directories, "
+              << ((tiny.bytes + deep.bytes) >> 10) << " KB\n";
+    std::cout << "  sparse: " << (sparse.bytes >> 20) << " MB logical, "
+              << (sparse.dataBytes >> 20) << " MB data\n";
+    std::cout << "  image:  " << (image.bytes >> 20) << " MB\n\n";
+    return true;
+}
+
+// Whole image in memory, split into blocks, for the CPU-only benchmarks
+bool LoadBlocks(const fs::path& path, uint32_t blockSize, std::vector<std::vector<uint8_t>>& blocks, std::string& error) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        error = "Cannot open " + path.string();
+        return false;
+    }
+
+    blocks.clear();
+    std::vector<uint8_t> block(blockSize);
+    while (in.read(reinterpret_cast<char*>(block.data()), blockSize) || in.gcount() > 0) {
+        block.resize((size_t)in.gcount());
+        blocks.push_back(block);
+        block.resize(blockSize);
+    }
+    return true;
+}
+
+std::vector<BenchCase> BuildCases(const BenchConfig& config, const fs::path& data, const fs::path& out,
+                                  std::vector<std::vector<uint8_t>>& blocks,
+                                  std::vector<std::vector<uint8_t>>& compressed) {
+    std::vector<BenchCase> cases;
+    fs::path files = data / "files";
+    fs::path imageFile = data / "image" / "disk.img";
+    fs::path sparseFile = data / "sparse" / "sparse.img";
+    fs::path copyDir = out / "copy";
+
+    auto noPrepare = [](std::string&) { return true; };
+
+    auto backupCase = [](const fs::path& source, const fs::path& dest, BackupCore::CompressionCodec codec,
+                         const std::string& password) {
+        return [source, dest, codec, password](BenchResult& result, std::string& error) {
+            BackupCore::FileBackupOptions options;
+            options.codec = codec;
+            options.password = password;
+            BackupCore::FileSetResult set;
+            if (BackupCore::BackupFileSet(source, dest, options, nullptr, set, error) != 0) {
+                return false;
+            }
+            result.items = set.files;
+            result.bytes = set.bytes;
+            result.outputBytes = set.storedBytes;
+            return true;
+        };
+    };
+
+    auto cleanPrepare = [](const fs::path& dir) {
+        return [dir](std::string& error) { return RemoveTree(dir, error); };
+    };
+
+    cases.push_back({ "scan", "files", noPrepare,
+        [files](BenchResult& result, std::string& error) {
+            std::vector<BackupCore::FileEntry> entries;
+            uint64_t totalBytes = 0;
+            if (!BackupCore::ScanFiles(files, entries, totalBytes, error)) {
+                return false;
+            }
+            result.items = entries.size();
+            result.bytes = totalBytes;
+            return true;
+        } });
+
+    cases.push_back({ "copy", "files", cleanPrepare(copyDir),
+        backupCase(files, copyDir, BackupCore::CompressionCodec::None, "") });
+
+    // Same files as "copy"; the difference between the two is the cost of encryption
+    cases.push_back({ "copy_encrypted", "files", cleanPrepare(out / "copy_encrypted"),
+        backupCase(files, out / "copy_encrypted", BackupCore::CompressionCodec::None, "bench") });
+
+    cases.push_back({ "copy_lz_image", "image", cleanPrepare(out / "image_lz"),
+        backupCase(imageFile, out / "image_lz", BackupCore::CompressionCodec::Lz, "") });
+
+    cases.push_back({ "copy_lz_sparse", "sparse", cleanPrepare(out / "sparse_lz"),
+        backupCase(sparseFile, out / "sparse_lz", BackupCore::CompressionCodec::Lz, "") });
+
+    cases.push_back({ "hash", "image",
+        [&blocks, &config, imageFile](std::string& error) {
+            return !blocks.empty() || LoadBlocks(imageFile, config.image.blockSize, blocks, error);
+        },
+        [&blocks](BenchResult& result, std::string&) {
+            // The hashes go into a volatile, so the hashing is not optimized away
+            static volatile uint64_t sink;
+            uint64_t combined = 0;
+            for (const auto& block : blocks) {
+                combined ^= BackupCore::Hash64(block.data(), block.size());
+                result.bytes += block.size();
+            }
+            sink = sink ^ combined;
+            result.items = blocks.size();
+            result.outputBytes = 8 * blocks.size();
+            return true;
+        } });
+
+    cases.push_back({ "compress", "image",
+        [&blocks, &config, imageFile](std::string& error) {
+            return !blocks.empty() || LoadBlocks(imageFile, config.image.blockSize, blocks, error);
+        },
+        [&blocks, &compressed](BenchResult& result, std::string&) {
+            compressed.resize(blocks.size());
+            for (size_t i = 0; i < blocks.size(); i++) {
+                compressed[i].resize(blocks[i].size());
+                size_t size = BackupCore::LzCompress(blocks[i].data(), blocks[i].size(),
+                                                     compressed[i].data(), compressed[i].size());
+                // Blocks that do not shrink are stored raw, as the backup code does
+                compressed[i].resize(size);
+                result.bytes += blocks[i].size();
+                result.outputBytes += size ? size : blocks[i].size();
+            }
+            result.items = blocks.size();
+            return true;
+        } });
+
+    cases.push_back({ "compress_strong", "image",
+        [&blocks, &config, imageFile](std::string& error) {
+            return !blocks.empty() || LoadBlocks(imageFile, config.image.blockSize, blocks, error);
+        },
+        [&blocks](BenchResult& result, std::string&) {
+            std::vector<uint8_t> packed;
+            for (const auto& block : blocks) {
+                packed.resize(block.size());
+                size_t size = BackupCore::LzCompressStrong(block.data(), block.size(), packed.data(), packed.size());
+                result.bytes += block.size();
+                result.outputBytes += size ? size : block.size();
+            }
+            result.items = blocks.size();
+            return true;
+        } });
+
+    cases.push_back({ "decompress", "image",
+        [&blocks, &compressed, &config, imageFile](std::string& error) {
+            if (blocks.empty() && !LoadBlocks(imageFile, config.image.blockSize, blocks, error)) {
+                return false;
+            }
+            if (compressed.size() != blocks.size()) {
+                compressed.resize(blocks.size());
+                for (size_t i = 0; i < blocks.size(); i++) {
+                    compressed[i].resize(blocks[i].size());
+                    compressed[i].resize(BackupCore::LzCompress(blocks[i].data(), blocks[i].size(),
+                                                                compressed[i].data(), compressed[i].size()));
+                }
+            }
+            return true;
+        },
+        [&blocks, &compressed](BenchResult& result, std::string& error) {
+            std::vector<uint8_t> plain;
+            for (size_t i = 0; i < blocks.size(); i++) {
+                if (compressed[i].empty()) continue;
+                plain.resize(blocks[i].size());
+                if (!BackupCore::LzDecompress(compressed[i].data(), compressed[i].size(), plain.data(), plain.size())) {
+                    error = "Block " + std::to_string(i) + " failed to decompress";
+                    return false;
+                }
+                // Throughput is counted in decompressed bytes, like the other benchmarks
+                result.items++;
+                result.bytes += plain.size();
+                result.outputBytes += plain.size();
+            }
+            return true;
+        } });
+
+    // Seals every block with the cipher new sets would use, under a fixed key
+    cases.push_back({ "encrypt", "image",
+        [&blocks, &config, imageFile](std::string& error) {
+            return !blocks.empty() || LoadBlocks(imageFile, config.image.blockSize, blocks, error);
+        },
+        [&blocks](BenchResult& result, std::string& error) {
+            BackupCore::EncryptionKey key;
+            key.cipher = BackupCore::PreferredCipher();
+            std::fill(key.bytes, key.bytes + sizeof(key.bytes), 0x5a);
+            BackupCore::BlockCipher cipher;
+            if (!cipher.Init(key, error)) {
+                return false;
+            }
+
+            std::vector<uint8_t> data;
+            uint8_t nonce[BackupCore::CipherNonceSize] = { 1 };
+            uint8_t tag[BackupCore::CipherTagSize];
+            for (size_t i = 0; i < blocks.size(); i++) {
+                data.assign(blocks[i].begin(), blocks[i].end());
+                nonce[8] = (uint8_t)i;
+                nonce[9] = (uint8_t)(i >> 8);
+                nonce[10] = (uint8_t)(i >> 16);
+                if (!cipher.Seal(nonce, nullptr, 0, data.data(), data.size(), tag)) {
+                    error = "Block " + std::to_string(i) + " failed to encrypt";
+                    return false;
+                }
+                result.bytes += data.size();
+                result.outputBytes += data.size() + sizeof(tag);
+            }
+            result.items = blocks.size();
+            return true;
+        } });
+
+    // Two parity shards per 16 data shards of each block, as BACKUP_FLAG_PARITY stores them
+    cases.push_back({ "parity", "image",
+        [&blocks, &config, imageFile](std::string& error) {
+            return !blocks.empty() || LoadBlocks(imageFile, config.image.blockSize, blocks, error);
+        },
+        [&blocks](BenchResult& result, std::string&) {
+            BackupCore::ReedSolomon code(BackupCore::ParityDataShards, 2);
+            std::vector<std::vector<uint8_t>> parity(2);
+            for (const auto& block : blocks) {
+                size_t shard = block.size() / BackupCore::ParityDataShards;
+                std::vector<const uint8_t*> data;
+                for (uint32_t j = 0; j < BackupCore::ParityDataShards; j++) {
+                    data.push_back(block.data() + j * shard);
+                }
+                std::vector<uint8_t*> outputs;
+                for (auto& p : parity) {
+                    p.resize(shard);
+                    outputs.push_back(p.data());
+                }
+                code.Encode(data.data(), outputs.data(), shard);
+                result.bytes += shard * BackupCore::ParityDataShards;
+                result.outputBytes += shard * 2;
+            }
+            result.items = blocks.size();
+            return true;
+        } });
+
+    cases.push_back({ "catalog_load", "files",
+        [copyDir, files](std::string& error) {
+            if (BackupCore::HasCatalog(copyDir)) return true;
+            BackupCore::FileSetResult set;
+            return BackupCore::BackupFileSet(files, copyDir, BackupCore::FileBackupOptions(), nullptr, set, error) == 0;
+        },
+        [copyDir](BenchResult& result, std::string& error) {
+            BackupCore::BackupCatalog catalog;
+            if (!BackupCore::LoadCatalog(copyDir, catalog, error)) {
+                return false;
+            }
+            result.items = catalog.entries.size();
+            result.bytes = fs::file_size(copyDir / BackupCore::CatalogFileName);
+            return true;
+        } });
+
+    cases.push_back({ "restore", "files",
+        [copyDir, files, out](std::string& error) {
+            if (!BackupCore::HasCatalog(copyDir)) {
+                BackupCore::FileSetResult set;
+                if (BackupCore::BackupFileSet(files, copyDir, BackupCore::FileBackupOptions(), nullptr, set, error) != 0) {
+                    return false;
+                }
+            }
+            return RemoveTree(out / "restore", error);
+        },
+        [copyDir, out](BenchResult& result, std::string& error) {
+            BackupCore::FileRestoreOptions options;
+            options.overwriteExisting = true;
+            BackupCore::FileSetResult set;
+            if (BackupCore::RestoreFileSet(copyDir, out / "restore", options, nullptr, set, error) != 0) {
+                return false;
+            }
+            if (set.failed > 0) {
+                error = "Restore failed for " + set.firstFailure;
+                return false;
+            }
+            result.items = set.files;
+            result.bytes = set.bytes;
+            result.outputBytes = set.bytes;
+            return true;
+        } });
+
+    cases.push_back({ "image_disk", "image", cleanPrepare(out / "disk"),
+        [imageFile, out](BenchResult& result, std::string& error) {
+            auto disk = BackupCore::BlockDevice::Open(imageFile, false, error);
+            if (!disk) {
+                return false;
+            }
+            fs::create_directories(out / "disk");
+            if (BackupCore::ImageDisk(*disk, out / "disk", "bench", BackupCore::DiskImageOptions(), nullptr, error) != 0) {
+                return false;
+            }
+            result.items = 1;
+            result.bytes = disk->Size();
+            result.outputBytes = DirectoryBytes(out / "disk");
+            return true;
+        } });
+
+    return cases;
+}
+
+double Best(const std::vector<double>& seconds) {
+    return seconds.empty() ? 0.0 : *std::min_element(seconds.begin(), seconds.end());
+}
+
+double Mean(const std::vector<double>& seconds) {
+    double total = 0;
+    for (double s : seconds) total += s;
+    return seconds.empty() ? 0.0 : total / seconds.size();
+}
+
+double MegabytesPerSecond(const BenchResult& result) {
+    double best = Best(result.seconds);
+    return best > 0 ? (result.bytes / (1024.0 * 1024.0)) / best : 0.0;
+}
+
+std::string JsonString(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char)c < 0x20) {
+            char escape[8];
+            std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+            out += escape;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+// Each result is written on its own line so --baseline can read it back without a JSON parser
+bool WriteResults(const BenchConfig& config, const std::vector<BenchResult>& results, std::string& error) {
+    std::ofstream out(config.output, std::ios::trunc);
+    if (!out.is_open()) {
+        error = "Cannot write " + config.output.string();
+        return false;
+    }
+
+    char timestamp[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    struct utsname host = {};
+    uname(&host);
+
+    out << std::fixed;
+    out << "{\n";
+    out << "  \"suite\": \"backup_bench\",\n";
+    out << "  \"version\": " << JsonString(BENCH_VERSION) << ",\n";
+    out << "  \"timestamp\": " << JsonString(timestamp) << ",\n";
+    out << "  \"host\": " << JsonString(std::string(host.nodename) + " " + host.sysname + " " +
+                                        host.release + " " + host.machine) << ",\n";
+#ifdef __VERSION__
+    out << "  \"compiler\": " << JsonString(__VERSION__) << ",\n";
+#endif
+    out << "  \"cache\": \"warm\",\n";
+    out << "  \"config\": {"
+        << "\"repeat\": " << config.repeat
+        << ", \"seed\": " << config.seed
+        << ", \"tinyFiles\": " << config.tinyFiles
+        << ", \"tinyMaxSize\": " << config.tinyMaxSize
+        << ", \"depth\": " << config.depth
+        << ", \"sparseBytes\": " << config.sparseSize
+        << ", \"imageBytes\": " << config.image.size
+        << ", \"imageBlockSize\": " << config.image.blockSize
+        << std::setprecision(3)
+        << ", \"zeroRatio\": " << config.image.zeroRatio
+        << ", \"duplicateRatio\": " << config.image.duplicateRatio
+        << ", \"compressibleRatio\": " << config.image.compressibleRatio << "},\n";
+    out << "  \"results\": [\n";
+
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        double best = Best(r.seconds);
+        out << "    {\"name\": " << JsonString(r.name)
+            << ", \"dataset\": " << JsonString(r.dataset)
+            << ", \"runs\": " << r.seconds.size()
+            << ", \"items\": " << r.items
+            << ", \"bytes\": " << r.bytes
+            << ", \"outputBytes\": " << r.outputBytes
+            << std::setprecision(6)
+            << ", \"bestSeconds\": " << best
+            << ", \"meanSeconds\": " << Mean(r.seconds)
+            << std::setprecision(2)
+            << ", \"mbPerSecond\": " << MegabytesPerSecond(r)
+            << ", \"itemsPerSecond\": " << (best > 0 ? r.items / best : 0.0)
+            << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    out << "  ]\n";
+    out << "}\n";
+
+    if (!out.good()) {
+        error = "Failed to write " + config.output.string();
+        return false;
+    }
+    return true;
+}
+
+// Pull "key": number out of one result line written by WriteResults
+bool ReadNumber(const std::string& line, const std::string& key, double& value) {
+    size_t pos = line.find("\"" + key + "\": ");
+    if (pos == std::string::npos) return false;
+    value = std::strtod(line.c_str() + pos + key.size() + 4, nullptr);
+    return true;
+}
+
+void CompareBaseline(const fs::path& baseline, const std::vector<BenchResult>& results) {
+    std::ifstream in(baseline);
+    if (!in.is_open()) {
+        std::cerr << "WARNING: cannot read baseline " << baseline << std::endl;
+        return;
+    }
+
+    std::map<std::string, double> previous;
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t pos = line.find("\"name\": \"");
+        if (pos == std::string::npos) continue;
+        size_t start = pos + 9;
+        size_t end = line.find('"', start);
+        double seconds = 0;
+        if (end != std::string::npos && ReadNumber(line, "bestSeconds", seconds)) {
+            previous[line.substr(start, end - start)] = seconds;
+        }
+    }
+
+    std::cout << "\nCompared with " << baseline.string() << ":\n";
+    for (const auto& r : results) {
+        auto it = previous.find(r.name);
+        double best = Best(r.seconds);
+        if (it == previous.end() || it->second <= 0 || best <= 0) {
+            std::cout << "  " << std::left << std::setw(16) << r.name << "  (no baseline)\n";
+            continue;
+        }
+
+        // Positive means slower than the baseline
+        double change = (best - it->second) / it->second * 100.0;
+        std::cout << "  " << std::left << std::setw(16) << r.name << std::right
+                  << std::showpos << std::fixed << std::setprecision(1) << std::setw(8) << change << "%"
+                  << std::noshowpos << (change > 10.0 ? "  REGRESSION" : "") << "\n";
+    }
+}
+
+bool ParseArguments(int argc, char* argv[], BenchConfig& config, fs::path& generateDir, bool& check) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--help") {
+            return false;
+        } else if (arg == "--keep") {
+            config.keep = true;
+        } else if (arg == "--check") {
+            check = true;
+        } else if (!hasValue) {
+            std::cerr << "ERROR: missing value for " << arg << std::endl;
+            return false;
+        } else if (arg == "--generate") {
+            generateDir = argv[++i];
+        } else if (arg == "--workdir") {
+            config.workDir = argv[++i];
+        } else if (arg == "--output") {
+            config.output = argv[++i];
+        } else if (arg == "--baseline") {
+            config.baseline = argv[++i];
+        } else if (arg == "--only") {
+            std::stringstream list(argv[++i]);
+            std::string name;
+            while (std::getline(list, name, ',')) {
+                if (!name.empty()) config.only.insert(name);
+            }
+        } else if (arg == "--repeat") {
+            config.repeat = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--seed") {
+            config.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--tiny-files") {
+            config.tinyFiles = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--tiny-max") {
+            config.tinyMaxSize = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--depth") {
+            config.depth = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--sparse-mb") {
+            config.sparseSize = std::strtoull(argv[++i], nullptr, 10) * 1024 * 1024;
+        } else if (arg == "--image-mb") {
+            config.image.size = std::strtoull(argv[++i], nullptr, 10) * 1024 * 1024;
+        } else if (arg == "--zero-ratio") {
+            config.image.zeroRatio = std::atof(argv[++i]);
+        } else if (arg == "--dup-ratio") {
+            config.image.duplicateRatio = std::atof(argv[++i]);
+        } else {
+            std::cerr << "ERROR: unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    printHeader();
+
+    BenchConfig config;
+    fs::path generateDir;
+    bool check = false;
+    if (!ParseArguments(argc, argv, config, generateDir, check)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    std::string error;
+    if (!generateDir.empty()) {
+        if (!GenerateDatasets(config, generateDir, error)) {
+            std::cerr << "ERROR: " << error << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    bool ownWorkDir = config.workDir.empty();
+    if (ownWorkDir) {
+        char pattern[] = "/tmp/backup_bench_XXXXXX";
+        if (!mkdtemp(pattern)) {
+            std::cerr << "ERROR: cannot create a work directory under /tmp" << std::endl;
+            return 1;
+        }
+        config.workDir = pattern;
+    }
+
+    if (check) {
+        int failures = Bench::RunChecks(config.workDir / "checks");
+        std::cout << "\n" << (failures ? std::to_string(failures) + " checks failed" : "All checks passed") << "\n";
+        if (!config.keep) {
+            RemoveTree(ownWorkDir ? config.workDir : config.workDir / "checks", error);
+        }
+        return failures ? 1 : 0;
+    }
+
+    fs::path data = config.workDir / "data";
+    fs::path out = config.workDir / "out";
+    std::cout << "Work directory: " << config.workDir.string() << "\n\n";
+
+    if (!RemoveTree(data, error) || !RemoveTree(out, error) || !GenerateDatasets(config, data, error)) {
+        std::cerr << "ERROR: " << error << std::endl;
+        return 1;
+    }
+    fs::create_directories(out);
+
+    std::vector<std::vector<uint8_t>> blocks, compressed;
+    std::vector<BenchCase> cases = BuildCases(config, data, out, blocks, compressed);
+    std::vector<BenchResult> results;
+    int failures = 0;
+
+    for (const auto& benchCase : cases) {
+        if (!config.only.empty() && !config.only.count(benchCase.name)) {
+            continue;
+        }
+
+        BenchResult result;
+        result.name = benchCase.name;
+        result.dataset = benchCase.dataset;
+        bool ok = true;
+
+        for (int run = 0; run < config.repeat && ok; run++) {
+            BenchResult sample;
+            ok = benchCase.prepare(error);
+            if (!ok) break;
+
+            auto start = std::chrono::steady_clock::now();
+            ok = benchCase.run(sample, error);
+            auto stop = std::chrono::steady_clock::now();
+
+            result.items = sample.items;
+            result.bytes = sample.bytes;
+            result.outputBytes = sample.outputBytes;
+            result.seconds.push_back(std::chrono::duration<double>(stop - start).count());
+        }
+
+        if (!ok) {
+            std::cerr << "ERROR: " << benchCase.name << ": " << error << std::endl;
+            failures++;
+            continue;
+        }
+
+        std::cout << std::left << std::setw(16) << result.name << std::right << std::fixed
+                  << std::setprecision(4) << std::setw(10) << Best(result.seconds) << " s"
+                  << std::setprecision(1) << std::setw(10) << MegabytesPerSecond(result) << " MB/s"
+                  << std::setw(12) << result.items << " items\n";
+        results.push_back(result);
+    }
+
+    if (!WriteResults(config, results, error)) {
+        std::cerr << "ERROR: " << error << std::endl;
+        return 1;
+    }
+    std::cout << "\nResults written to " << config.output.string() << "\n";
+
+    if (!config.baseline.empty()) {
+        CompareBaseline(config.baseline, results);
+    }
+
+    if (!config.keep) {
+        RemoveTree(ownWorkDir ? config.workDir : data, error);
+        RemoveTree(out, error);
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,608 @@
+// LinuxRestore/bench/checks.cpp
+// Correctness checks of the portable backup core over generated datasets
+
+#include "checks.h"
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Core/BlockDevice.h"
+#include "Core/DiskImage.h"
+#include "Core/Encryption.h"
+#include "Core/FileBackup.h"
+#include "Core/JobStatus.h"
+#include "Core/Parity.h"
+#include "Core/ReedSolomon.h"
+#include "Core/PartitionTable.h"
+#include "dataset.h"
+
+namespace fs = std::filesystem;
+
+namespace Bench {
+
+    namespace {
+        const uint64_t GptImageSize = 16ULL * 1024 * 1024;
+
+        bool ReadWhole(const fs::path& path, std::vector<uint8_t>& data, std::string& error) {
+            std::ifstream in(path, std::ios::binary);
+            if (!in.is_open()) {
+                error = "Cannot open " + path.string();
+                return false;
+            }
+            data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            return true;
+        }
+
+        bool WriteWhole(const fs::path& path, const std::vector<uint8_t>& data, std::string& error) {
+            fs::create_directories(path.parent_path());
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            if (!out.write(reinterpret_cast<const char*>(data.data()), data.size())) {
+                error = "Cannot write " + path.string();
+                return false;
+            }
+            return true;
+        }
+
+        bool FlipByte(const fs::path& path, uint64_t offset, std::string& error) {
+            std::unique_ptr<BackupCore::BlockDevice> device = BackupCore::BlockDevice::Open(path, true, error);
+            uint8_t byte = 0;
+            if (!device || !device->ReadAt(offset, &byte, 1)) {
+                error = error.empty() ? "Cannot read " + path.string() : error;
+                return false;
+            }
+            byte ^= 0xFF;
+            return device->WriteAt(offset, &byte, 1);
+        }
+
+        // Every file under 'source' must be under 'restored' with the same bytes
+        bool TreesMatch(const fs::path& source, const fs::path& restored, std::string& error) {
+            std::vector<uint8_t> expected, actual;
+            for (const auto& entry : fs::recursive_directory_iterator(source)) {
+                if (!entry.is_regular_file()) {
+                    continue;
+                }
+                fs::path relative = entry.path().lexically_relative(source);
+                if (!ReadWhole(entry.path(), expected, error) || !ReadWhole(restored / relative, actual, error)) {
+                    return false;
+                }
+                if (actual != expected) {
+                    error = "Restored " + relative.string() + " differs from the original";
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // The largest file the set stores for its sources, leaving out its own backup_* files
+        fs::path LargestStoredFile(const fs::path& set) {
+            fs::path largest;
+            uint64_t largestSize = 0;
+            for (const auto& entry : fs::recursive_directory_iterator(set)) {
+                std::string name = entry.path().filename().string();
+                if (!entry.is_regular_file() || (entry.path().parent_path() == set && name.compare(0, 7, "backup_") == 0)) {
+                    continue;
+                }
+                if (entry.file_size() > largestSize) {
+                    largest = entry.path();
+                    largestSize = entry.file_size();
+                }
+            }
+            return largest;
+        }
+
+        // The layout must list exactly the generated partitions
+        bool LayoutMatches(const fs::path& image, const std::vector<GeneratedPartition>& expected, std::string& error) {
+            std::unique_ptr<BackupCore::BlockDevice> device = BackupCore::BlockDevice::Open(image, false, error);
+            BackupCore::DiskLayout layout;
+            if (!device || !BackupCore::ReadDiskLayout(*device, layout, error)) {
+                return false;
+            }
+            if (layout.scheme != BackupCore::PartitionScheme::GPT || layout.partitions.size() != expected.size()) {
+                error = std::string(BackupCore::SchemeName(layout.scheme)) + " table with " +
+                    std::to_string(layout.partitions.size()) + " partitions";
+                return false;
+            }
+            for (size_t i = 0; i < expected.size(); i++) {
+                const BackupCore::PartitionInfo& part = layout.partitions[i];
+                if (part.index != expected[i].index || part.offset != expected[i].offset ||
+                    part.length != expected[i].length || part.name != expected[i].name) {
+                    error = "Partition " + std::to_string(part.index) + " (" + part.name + ") at " +
+                        std::to_string(part.offset) + "+" + std::to_string(part.length) + " is not as generated";
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool CheckGptLayout(const fs::path& dir, std::string& error) {
+            std::vector<GeneratedPartition> partitions;
+            DatasetStats stats;
+            fs::path image = dir / "gpt.img";
+            if (!GenerateGptImage(image, GptImageSize, 1, partitions, stats, error) ||
+                !LayoutMatches(image, partitions, error)) {
+                return false;
+            }
+
+            // A damaged primary header, or primary entry array, falls back to the backup copy
+            const uint64_t damage[] = { 512 + 56, 2 * 512 };
+            for (uint64_t offset : damage) {
+                fs::path damaged = dir / "gpt_damaged.img";
+                fs::copy_file(image, damaged, fs::copy_options::overwrite_existing);
+                if (!FlipByte(damaged, offset, error) || !LayoutMatches(damaged, partitions, error)) {
+                    error = "Damage at byte " + std::to_string(offset) + ": " + error;
+                    return false;
+                }
+            }
+
+            // With both headers damaged the table must be refused, not read as empty
+            fs::path damaged = dir / "gpt_damaged.img";
+            if (!FlipByte(damaged, 512 + 56, error) || !FlipByte(damaged, GptImageSize - 512 + 56, error)) {
+                return false;
+            }
+            std::unique_ptr<BackupCore::BlockDevice> device = BackupCore::BlockDevice::Open(damaged, false, error);
+            BackupCore::DiskLayout layout;
+            if (!device || BackupCore::ReadDiskLayout(*device, layout, error)) {
+                error = "A GPT with both headers damaged was accepted";
+                return false;
+            }
+            return true;
+        }
+
+        bool CheckGptImaging(const fs::path& dir, std::string& error) {
+            std::vector<GeneratedPartition> partitions;
+            DatasetStats stats;
+            fs::path image = dir / "gpt.img";
+            if (!GenerateGptImage(image, GptImageSize, 2, partitions, stats, error)) {
+                return false;
+            }
+
+            std::unique_ptr<BackupCore::BlockDevice> source = BackupCore::BlockDevice::Open(image, false, error);
+            BackupCore::DiskImageOptions imageOptions;
+            if (!source || BackupCore::ImageDisk(*source, dir / "image", "disk_0", imageOptions, nullptr, error) != 0) {
+                return false;
+            }
+            BackupCore::DiskImageManifest manifest;
+            fs::path layoutFile = BackupCore::FindDiskImageLayout(dir / "image", "disk_0");
+            if (!BackupCore::LoadDiskImageManifest(layoutFile, manifest, error)) {
+                return false;
+            }
+            BackupCore::DiskRestoreOptions restoreOptions;
+
+            // The whole disk, onto an empty image of the same size
+            std::vector<uint8_t> original, restored;
+            fs::path diskCopy = dir / "restored.img";
+            std::unique_ptr<BackupCore::BlockDevice> target = BackupCore::BlockDevice::Create(diskCopy, error);
+            if (!target || !target->Truncate(GptImageSize) ||
+                BackupCore::RestoreDiskImage(manifest, *target, restoreOptions, nullptr, error) != 0) {
+                return false;
+            }
+            target.reset();
+            if (!ReadWhole(image, original, error) || !ReadWhole(diskCopy, restored, error)) {
+                return false;
+            }
+            if (restored != original) {
+                error = "The restored disk differs from the original";
+                return false;
+            }
+
+            // Each partition on its own, onto a partition-sized image
+            for (const GeneratedPartition& part : partitions) {
+                fs::path partCopy = dir / ("restored_p" + std::to_string(part.index) + ".img");
+                target = BackupCore::BlockDevice::Create(partCopy, error);
+                if (!target || !target->Truncate(part.length) ||
+                    BackupCore::RestorePartitionImage(manifest, part.index, *target, 0, restoreOptions, nullptr,
+                        error) != 0) {
+                    return false;
+                }
+                target.reset();
+                if (!ReadWhole(partCopy, restored, error)) {
+                    return false;
+                }
+                if (restored.size() != part.length ||
+                    !std::equal(restored.begin(), restored.end(), original.begin() + (size_t)part.offset)) {
+                    error = "Restored partition " + std::to_string(part.index) + " differs from the original";
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // A case-only rename of a source file, backed up into the same set and
+        // compacted, must still restore: on NTFS the stored file keeps its old
+        // spelling while the catalog lists the new one
+        bool CheckCaseRenameCompact(const fs::path& dir, std::string& error) {
+            const std::string content = "Quarterly figures\n";
+            fs::path source = dir / "source";
+            fs::create_directories(source);
+            std::ofstream(source / "Report.docx", std::ios::binary) << content;
+
+            BackupCore::FileBackupOptions backupOptions;
+            BackupCore::FileSetResult result;
+            fs::path set = dir / "set";
+            if (BackupCore::BackupFileSources({ source }, set, backupOptions, nullptr, result, error) != 0) {
+                return false;
+            }
+            fs::rename(source / "Report.docx", source / "report.docx");
+            if (BackupCore::BackupFileSources({ source }, set, backupOptions, nullptr, result, error) != 0) {
+                return false;
+            }
+
+            BackupCore::FileCompactOptions compactOptions;
+            BackupCore::FileRestoreOptions restoreOptions;
+            if (BackupCore::CompactFileSet(set, compactOptions, nullptr, result, error) != 0 ||
+                BackupCore::RestoreFileSet(set, dir / "restored", restoreOptions, nullptr, result, error) != 0) {
+                return false;
+            }
+            std::vector<uint8_t> restored;
+            if (!ReadWhole(dir / "restored" / "report.docx", restored, error)) {
+                return false;
+            }
+            if (std::string(restored.begin(), restored.end()) != content) {
+                error = "The restored file differs from the original";
+                return false;
+            }
+            return true;
+        }
+
+        // A published job must be readable through the shared region with the
+        // values it last wrote, and gone once its publisher is
+        bool CheckJobStatus(const fs::path&, std::string& error) {
+            const std::string name = "backup_bench job status check";
+            auto find = [&name](const std::vector<BackupCore::JobStatusEntry>& jobs) {
+                return std::find_if(jobs.begin(), jobs.end(),
+                    [&name](const BackupCore::JobStatusEntry& job) { return name == job.name; });
+            };
+
+            std::vector<BackupCore::JobStatusEntry> jobs;
+            {
+                BackupCore::JobStatusPublisher publisher(name);
+                if (!publisher.Active()) {
+                    error = "No slot in the job status region";
+                    return false;
+                }
+                BackupCore::ProgressStatus status;
+                status.phase = (int32_t)BackupCore::ProgressPhase::Copying;
+                status.percent = 42;
+                status.filesDone = 7;
+                status.filesTotal = 12;
+                status.bytesDone = 3 << 20;
+                status.bytesTotal = 5 << 20;
+                publisher.Update(status);
+
+                if (!BackupCore::ReadJobStatus(jobs, error)) {
+                    return false;
+                }
+                auto job = find(jobs);
+                if (job == jobs.end()) {
+                    error = "The published job is not in the region";
+                    return false;
+                }
+                if (job->phase != status.phase || job->percent != status.percent ||
+                    job->filesDone != status.filesDone || job->filesTotal != status.filesTotal ||
+                    job->bytesDone != status.bytesDone || job->bytesTotal != status.bytesTotal) {
+                    error = "The job read back differs from what was published";
+                    return false;
+                }
+            }
+
+            if (!BackupCore::ReadJobStatus(jobs, error)) {
+                return false;
+            }
+            if (find(jobs) != jobs.end()) {
+                error = "The job is still listed after its publisher ended";
+                return false;
+            }
+            return true;
+        }
+
+        // An encrypted set restores with its password and refuses a wrong one.
+        // A flipped byte in a stored file must fail its GCM or Poly1305 tag.
+        bool CheckEncryptedSet(const fs::path& dir, std::string& error) {
+            DatasetStats stats;
+            fs::path source = dir / "source";
+            if (!GenerateTinyFiles(source, 40, 256 * 1024, 3, stats, error)) {
+                return false;
+            }
+
+            const BackupCore::CipherKind ciphers[] = {
+                BackupCore::CipherKind::Aes256Gcm, BackupCore::CipherKind::ChaCha20Poly1305
+            };
+            for (BackupCore::CipherKind cipher : ciphers) {
+                std::string name = BackupCore::CipherName(cipher);
+                fs::path set = dir / ("set_" + name);
+                BackupCore::FileBackupOptions backupOptions;
+                backupOptions.password = "correct horse";
+                backupOptions.cipher = cipher;
+                BackupCore::FileSetResult result;
+                if (BackupCore::BackupFileSources({ source }, set, backupOptions, nullptr, result, error) != 0) {
+                    error = name + ": " + error;
+                    return false;
+                }
+
+                BackupCore::FileRestoreOptions restoreOptions;
+                restoreOptions.password = backupOptions.password;
+                fs::path restored = dir / ("restored_" + name);
+                if (BackupCore::RestoreFileSet(set, restored, restoreOptions, nullptr, result, error) != 0 ||
+                    !TreesMatch(source, restored, error)) {
+                    error = name + ": " + error;
+                    return false;
+                }
+
+                restoreOptions.password = "wrong horse";
+                if (BackupCore::RestoreFileSet(set, dir / ("wrong_" + name), restoreOptions, nullptr, result,
+                        error) == 0) {
+                    error = name + ": a wrong password was accepted";
+                    return false;
+                }
+
+                fs::path stored = LargestStoredFile(set);
+                if (stored.empty() || !FlipByte(stored, fs::file_size(stored) / 2, error)) {
+                    error = name + ": cannot damage a stored file " + error;
+                    return false;
+                }
+                restoreOptions.password = backupOptions.password;
+                if (BackupCore::RestoreFileSet(set, dir / ("damaged_" + name), restoreOptions, nullptr, result,
+                        error) == 0 || result.errors.size() != 1 ||
+                    result.errors[0].message.find("Authentication failed") == std::string::npos) {
+                    error = name + ": a flipped ciphertext byte in " + stored.filename().string() +
+                        " was not caught by its tag";
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Up to parityShards damaged shards in a stripe are rebuilt, by verify
+        // and by restore alike; one more is reported rather than rebuilt wrong
+        bool CheckParityRepair(const fs::path& dir, std::string& error) {
+            const uint32_t parityShards = 2;
+            std::vector<uint8_t> data(3 << 20);
+            Random random(4);
+            FillBlock(random, false, data);
+            fs::path source = dir / "source";
+            if (!WriteWhole(source / "data.bin", data, error)) {
+                return false;
+            }
+
+            BackupCore::FileBackupOptions backupOptions;
+            backupOptions.parityShards = parityShards;
+            BackupCore::FileSetResult result;
+            fs::path set = dir / "set";
+            if (BackupCore::BackupFileSources({ source }, set, backupOptions, nullptr, result, error) != 0) {
+                return false;
+            }
+            fs::path stored = set / "data.bin";
+            std::vector<uint8_t> intact, parity;
+            if (!ReadWhole(stored, intact, error) ||
+                !ReadWhole(BackupCore::ParityPath(set, "data.bin"), parity, error) || parity.size() < 8) {
+                return false;
+            }
+            uint32_t shardSize = parity[4] | parity[5] << 8 | parity[6] << 16 | (uint32_t)parity[7] << 24;
+
+            // Bytes in 'count' different shards of the first stripe
+            auto damage = [&](uint32_t count) {
+                for (uint32_t i = 0; i < count; i++) {
+                    if (!FlipByte(stored, (uint64_t)(i * 5 + 1) * shardSize + 100, error)) {
+                        return false;
+                    }
+                }
+                return true;
+            };
+
+            BackupCore::FileVerifyOptions verifyOptions;
+            std::vector<uint8_t> repaired;
+            if (!damage(parityShards) ||
+                BackupCore::VerifyFileSet(set, verifyOptions, nullptr, result, error) != 0) {
+                return false;
+            }
+            if (result.repaired != 1 || !ReadWhole(stored, repaired, error) || repaired != intact) {
+                error = "Verify did not rebuild " + std::to_string(parityShards) + " damaged shards";
+                return false;
+            }
+
+            BackupCore::FileRestoreOptions restoreOptions;
+            if (!damage(parityShards) ||
+                BackupCore::RestoreFileSet(set, dir / "restored", restoreOptions, nullptr, result, error) != 0 ||
+                !TreesMatch(source, dir / "restored", error)) {
+                return false;
+            }
+            if (result.repaired != 1) {
+                error = "Restore did not report the rebuilt file";
+                return false;
+            }
+
+            if (!damage(parityShards + 1)) {
+                return false;
+            }
+            if (BackupCore::VerifyFileSet(set, verifyOptions, nullptr, result, error) == 0) {
+                error = "Damage beyond the parity passed verification";
+                return false;
+            }
+            return true;
+        }
+
+        // The GF(2^8) kernel picked for this CPU must agree with the scalar one,
+        // on unaligned buffers and on tails shorter than a vector
+        bool CheckGfKernels(const fs::path&, std::string& error) {
+            Random random(5);
+            std::vector<uint8_t> src(4096 + 32), dst(src.size());
+            FillBlock(random, false, src);
+            FillBlock(random, false, dst);
+            const size_t lengths[] = { 4096 + 31, 33, 15 };
+            for (int c = 0; c < 256; c++) {
+                for (size_t length : lengths) {
+                    std::vector<uint8_t> picked(dst), scalar(dst);
+                    BackupCore::GfMultiplyAdd((uint8_t)c, src.data() + 1, picked.data() + 1, length);
+                    BackupCore::GfMultiplyAddScalar((uint8_t)c, src.data() + 1, scalar.data() + 1, length);
+                    if (picked != scalar) {
+                        error = std::string("The ") + BackupCore::GfKernelName() + " kernel differs from scalar for " +
+                            std::to_string(c) + " over " + std::to_string(length) + " bytes";
+                        return false;
+                    }
+                    for (size_t i = 0; i < length; i++) {
+                        if (scalar[i + 1] != (dst[i + 1] ^ BackupCore::GfMultiply((uint8_t)c, src[i + 1]))) {
+                            error = "The scalar kernel is wrong for " + std::to_string(c);
+                            return false;
+                        }
+                    }
+                }
+            }
+            return true;
+        }
+
+        // Identical files of MinDuplicateSize or more are stored once and all
+        // restore. Once the file whose name holds the stored copy is gone from
+        // the source, a new backup into the set and a compaction must leave
+        // the rest restorable.
+        bool CheckDuplicates(const fs::path& dir, std::string& error) {
+            std::vector<uint8_t> data(BackupCore::MinDuplicateSize * 3);
+            Random random(6);
+            FillBlock(random, false, data);
+            fs::path source = dir / "source";
+            const char* const names[] = { "first.bin", "second.bin", "third.bin" };
+            for (const char* name : names) {
+                if (!WriteWhole(source / name, data, error)) {
+                    return false;
+                }
+            }
+
+            BackupCore::FileBackupOptions backupOptions;
+            BackupCore::FileRestoreOptions restoreOptions;
+            BackupCore::FileCompactOptions compactOptions;
+            BackupCore::FileSetResult result;
+            fs::path set = dir / "set";
+            if (BackupCore::BackupFileSources({ source }, set, backupOptions, nullptr, result, error) != 0) {
+                return false;
+            }
+            if (result.duplicates != 2) {
+                error = std::to_string(result.duplicates) + " of 2 copies were stored as duplicates";
+                return false;
+            }
+            if (BackupCore::RestoreFileSet(set, dir / "restored", restoreOptions, nullptr, result, error) != 0 ||
+                !TreesMatch(source, dir / "restored", error)) {
+                return false;
+            }
+
+            // Files are stored in disk order, so any of them may hold the copy
+            auto holder = std::find_if(std::begin(names), std::end(names),
+                [&set](const char* name) { return fs::exists(set / name); });
+            if (holder == std::end(names)) {
+                error = "No stored copy in the set";
+                return false;
+            }
+            fs::remove(source / *holder);
+            if (BackupCore::BackupFileSources({ source }, set, backupOptions, nullptr, result, error) != 0 ||
+                BackupCore::CompactFileSet(set, compactOptions, nullptr, result, error) != 0) {
+                return false;
+            }
+            if (result.files != 1 || fs::exists(set / *holder)) {
+                error = "Compaction did not delete the stored copy";
+                return false;
+            }
+            if (BackupCore::RestoreFileSet(set, dir / "compacted", restoreOptions, nullptr, result, error) != 0 ||
+                !TreesMatch(source, dir / "compacted", error)) {
+                error = "After compacting: " + error;
+                return false;
+            }
+            return true;
+        }
+
+        // Of two near-identical files one is stored as a delta against the
+        // other. It restores byte for byte, also once its base has been
+        // dropped from the source and compacted out of the set.
+        bool CheckDeltas(const fs::path& dir, std::string& error) {
+            std::vector<uint8_t> original(512 * 1024);
+            Random random(7);
+            FillBlock(random, false, original);
+            std::vector<uint8_t> edited(original);
+            for (size_t i = 0; i < 100; i++) {
+                edited[300 * 1024 + i] ^= 0x5A;
+            }
+            edited.insert(edited.begin() + 4096, 50, 0x20);
+
+            fs::path source = dir / "source";
+            if (!WriteWhole(source / "original.bin", original, error) || !WriteWhole(source / "edited.bin", edited, error)) {
+                return false;
+            }
+
+            // One file at a time, so one is sketched before the other looks for it
+            BackupCore::FileBackupOptions backupOptions;
+            backupOptions.threads = 1;
+            BackupCore::FileRestoreOptions restoreOptions;
+            BackupCore::FileCompactOptions compactOptions;
+            BackupCore::FileSetResult result;
+            fs::path set = dir / "set";
+            if (BackupCore::BackupFileSources({ source }, set, backupOptions, nullptr, result, error) != 0) {
+                return false;
+            }
+
+            // Files are stored in disk order, so either may be the base
+            const uint64_t small = original.size() / 4;
+            bool originalIsDelta = fs::file_size(set / "original.bin") < small;
+            bool editedIsDelta = fs::file_size(set / "edited.bin") < small;
+            if (result.deltas != 1 || originalIsDelta == editedIsDelta) {
+                error = "Neither file was stored as a small delta against the other";
+                return false;
+            }
+            if (BackupCore::RestoreFileSet(set, dir / "restored", restoreOptions, nullptr, result, error) != 0 ||
+                !TreesMatch(source, dir / "restored", error)) {
+                return false;
+            }
+
+            std::string base = originalIsDelta ? "edited.bin" : "original.bin";
+            fs::remove(source / base);
+            if (BackupCore::BackupFileSources({ source }, set, backupOptions, nullptr, result, error) != 0 ||
+                BackupCore::CompactFileSet(set, compactOptions, nullptr, result, error) != 0) {
+                return false;
+            }
+            if (result.files != 1 || fs::exists(set / base)) {
+                error = "Compaction did not delete the base's stored file";
+                return false;
+            }
+            if (BackupCore::RestoreFileSet(set, dir / "compacted", restoreOptions, nullptr, result, error) != 0 ||
+                !TreesMatch(source, dir / "compacted", error)) {
+                error = "After compacting: " + error;
+                return false;
+            }
+            return true;
+        }
+    }
+
+    int RunChecks(const fs::path& workDir) {
+        struct Check {
+            const char* name;
+            std::function<bool(const fs::path&, std::string&)> run;
+        };
+        const Check checks[] = {
+            { "gpt_layout", CheckGptLayout },
+            { "gpt_imaging", CheckGptImaging },
+            { "case_rename_compact", CheckCaseRenameCompact },
+            { "job_status", CheckJobStatus },
+            { "encrypted_set", CheckEncryptedSet },
+            { "parity_repair", CheckParityRepair },
+            { "gf_kernels", CheckGfKernels },
+            { "duplicates", CheckDuplicates },
+            { "deltas", CheckDeltas },
+        };
+
+        int failures = 0;
+        for (const Check& check : checks) {
+            fs::path dir = workDir / check.name;
+            std::error_code ec;
+            fs::remove_all(dir, ec);
+            fs::create_directories(dir, ec);
+            std::string error;
+            bool passed = !ec && check.run(dir, error);
+            if (ec) {
+                error = "Cannot create " + dir.string() + ": " + ec.message();
+            }
+            std::cout << (passed ? "PASS  " : "FAIL  ") << check.name << (passed ? "" : ": " + error) << "\n";
+            failures += passed ? 0 : 1;
+        }
+        return failures;
+    }
+}
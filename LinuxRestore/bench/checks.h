@@ -0,0 +1,14 @@
+// LinuxRestore/bench/checks.h
+// Correctness checks of the portable backup core over generated datasets.
+// "backup_bench --check" runs them, and so does ctest.
+
+#pragma once
+
+#include <filesystem>
+
+namespace Bench {
+
+    // Run every check in 'workDir', printing one line per check.
+    // Returns the number of checks that failed.
+    int RunChecks(const std::filesystem::path& workDir);
+}
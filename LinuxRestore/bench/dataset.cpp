@@ -0,0 +1,379 @@
+// LinuxRestore/bench/dataset.cpp
+// Synthetic dataset generators for the benchmark suite
+
+#include "dataset.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+namespace Bench {
+
+    namespace {
+        const char* const Words[] = {
+            "backup", "restore", "volume", "partition", "sector", "image", "catalog",
+            "snapshot", "checksum", "the", "of", "and", "a", "to", "in", "is", "file",
+            "disk", "block", "data", "system", "user", "document", "report", "2024",
+            "config", "value", "index", "table", "record", "error", "status"
+        };
+        const size_t WordCount = sizeof(Words) / sizeof(Words[0]);
+
+        bool WriteFile(const fs::path& path, const std::vector<uint8_t>& data, std::string& error) {
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            if (!out.is_open()) {
+                error = "Cannot create " + path.string();
+                return false;
+            }
+            out.write(reinterpret_cast<const char*>(data.data()), (std::streamsize)data.size());
+            if (!out.good()) {
+                error = "Failed to write " + path.string();
+                return false;
+            }
+            return true;
+        }
+
+        bool MakeDirectory(const fs::path& dir, DatasetStats& stats, std::string& error) {
+            std::error_code ec;
+            if (fs::create_directories(dir, ec)) {
+                stats.directories++;
+            } else if (ec) {
+                error = "Cannot create directory " + dir.string() + ": " + ec.message();
+                return false;
+            }
+            return true;
+        }
+
+        void PutLe(uint8_t* p, uint64_t value, int bytes) {
+            for (int i = 0; i < bytes; i++) {
+                p[i] = (uint8_t)(value >> (8 * i));
+            }
+        }
+
+        // Bit by bit rather than through the core's table, so the images also check Crc32
+        uint32_t GptCrc32(const uint8_t* data, size_t length) {
+            uint32_t crc = 0xFFFFFFFFu;
+            for (size_t i = 0; i < length; i++) {
+                crc ^= data[i];
+                for (int k = 0; k < 8; k++) {
+                    crc = (crc & 1) ? (0xEDB88320u ^ (crc >> 1)) : (crc >> 1);
+                }
+            }
+            return ~crc;
+        }
+
+        std::string Numbered(const char* prefix, uint64_t number, const char* suffix) {
+            char name[64];
+            std::snprintf(name, sizeof(name), "%s%05llu%s", prefix, (unsigned long long)number, suffix);
+            return name;
+        }
+    }
+
+    uint64_t Random::Next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    void FillBlock(Random& random, bool compressible, std::vector<uint8_t>& buffer) {
+        size_t i = 0;
+        if (!compressible) {
+            while (i < buffer.size()) {
+                uint64_t value = random.Next();
+                size_t n = std::min<size_t>(8, buffer.size() - i);
+                for (size_t b = 0; b < n; b++) {
+                    buffer[i++] = (uint8_t)(value >> (b * 8));
+                }
+            }
+            return;
+        }
+
+        while (i < buffer.size()) {
+            const char* word = Words[random.Below(WordCount)];
+            for (; *word && i < buffer.size(); word++) {
+                buffer[i++] = (uint8_t)*word;
+            }
+            if (i < buffer.size()) {
+                buffer[i++] = (random.Below(12) == 0) ? '\n' : ' ';
+            }
+        }
+    }
+
+    bool GenerateTinyFiles(
+        const fs::path& dir,
+        uint32_t count,
+        uint32_t maxSize,
+        uint64_t seed,
+        DatasetStats& stats,
+        std::string& error) {
+
+        Random random(seed);
+        std::vector<uint8_t> buffer;
+
+        for (uint32_t i = 0; i < count; i++) {
+            fs::path subdir = dir / Numbered("set", i / 256, "");
+            if (i % 256 == 0 && !MakeDirectory(subdir, stats, error)) {
+                return false;
+            }
+
+            buffer.resize((size_t)random.Below((uint64_t)maxSize + 1));
+            FillBlock(random, random.Below(2) == 0, buffer);
+            if (!WriteFile(subdir / Numbered("file", i, ".dat"), buffer, error)) {
+                return false;
+            }
+
+            stats.files++;
+            stats.bytes += buffer.size();
+            stats.dataBytes += buffer.size();
+        }
+        return true;
+    }
+
+    bool GenerateDeepTree(
+        const fs::path& dir,
+        uint32_t depth,
+        uint32_t filesPerLevel,
+        uint32_t fileSize,
+        uint64_t seed,
+        DatasetStats& stats,
+        std::string& error) {
+
+        Random random(seed);
+        std::vector<uint8_t> buffer(fileSize);
+        fs::path level = dir;
+
+        for (uint32_t d = 0; d < depth; d++) {
+            level /= Numbered("level", d, "");
+            if (!MakeDirectory(level, stats, error)) {
+                return false;
+            }
+
+            for (uint32_t f = 0; f < filesPerLevel; f++) {
+                FillBlock(random, true, buffer);
+                if (!WriteFile(level / Numbered("node", f, ".txt"), buffer, error)) {
+                    return false;
+                }
+                stats.files++;
+                stats.bytes += buffer.size();
+                stats.dataBytes += buffer.size();
+            }
+        }
+        return true;
+    }
+
+    bool GenerateSparseFile(
+        const fs::path& path,
+        uint64_t logicalSize,
+        uint32_t extentCount,
+        uint32_t extentSize,
+        uint64_t seed,
+        DatasetStats& stats,
+        std::string& error) {
+
+        {
+            std::ofstream create(path, std::ios::binary | std::ios::trunc);
+            if (!create.is_open()) {
+                error = "Cannot create " + path.string();
+                return false;
+            }
+        }
+
+        // Extending with resize_file leaves a hole on every filesystem that supports them
+        std::error_code ec;
+        fs::resize_file(path, logicalSize, ec);
+        if (ec) {
+            error = "Cannot size " + path.string() + ": " + ec.message();
+            return false;
+        }
+
+        std::fstream out(path, std::ios::binary | std::ios::in | std::ios::out);
+        if (!out.is_open()) {
+            error = "Cannot open " + path.string();
+            return false;
+        }
+
+        Random random(seed);
+        std::vector<uint8_t> buffer(extentSize);
+        uint64_t stride = extentCount ? logicalSize / extentCount : 0;
+
+        for (uint32_t i = 0; i < extentCount && stride >= extentSize; i++) {
+            FillBlock(random, random.Below(2) == 0, buffer);
+            out.seekp((std::streamoff)(i * stride));
+            out.write(reinterpret_cast<const char*>(buffer.data()), (std::streamsize)buffer.size());
+            stats.dataBytes += buffer.size();
+        }
+
+        if (!out.good()) {
+            error = "Failed to write " + path.string();
+            return false;
+        }
+
+        stats.files++;
+        stats.bytes += logicalSize;
+        return true;
+    }
+
+    bool GenerateImage(
+        const fs::path& path,
+        const ImageSpec& spec,
+        uint64_t seed,
+        DatasetStats& stats,
+        std::string& error) {
+
+        if (spec.blockSize == 0) {
+            error = "Image block size must not be zero";
+            return false;
+        }
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            error = "Cannot create " + path.string();
+            return false;
+        }
+
+        // Duplicates are regenerated from the seed of the block they repeat,
+        // so no earlier block has to be kept in memory
+        struct UniqueBlock {
+            uint64_t seed;
+            bool compressible;
+        };
+        std::vector<UniqueBlock> unique;
+
+        Random layout(seed);
+        std::vector<uint8_t> buffer;
+
+        for (uint64_t offset = 0; offset < spec.size; offset += spec.blockSize) {
+            buffer.assign((size_t)std::min<uint64_t>(spec.blockSize, spec.size - offset), 0);
+
+            double kind = layout.Unit();
+            if (kind < spec.zeroRatio) {
+                // Leave the block zero
+            } else if (kind < spec.zeroRatio + spec.duplicateRatio && !unique.empty()) {
+                const UniqueBlock& source = unique[(size_t)layout.Below(unique.size())];
+                Random content(source.seed);
+                FillBlock(content, source.compressible, buffer);
+            } else {
+                UniqueBlock block = { layout.Next(), layout.Unit() < spec.compressibleRatio };
+                Random content(block.seed);
+                FillBlock(content, block.compressible, buffer);
+                unique.push_back(block);
+            }
+
+            out.write(reinterpret_cast<const char*>(buffer.data()), (std::streamsize)buffer.size());
+            if (!out.good()) {
+                error = "Failed to write " + path.string();
+                return false;
+            }
+        }
+
+        stats.files++;
+        stats.bytes += spec.size;
+        stats.dataBytes += spec.size;
+        return true;
+    }
+
+    bool GenerateGptImage(
+        const fs::path& path,
+        uint64_t size,
+        uint64_t seed,
+        std::vector<GeneratedPartition>& partitions,
+        DatasetStats& stats,
+        std::string& error) {
+
+        const uint64_t sector = 512;
+        const uint64_t mib = 1024 * 1024;
+        const uint32_t entryCount = 128;
+        const uint32_t entrySize = 128;
+        const uint64_t entrySectors = entryCount * entrySize / sector;
+        if (size % mib != 0 || size < 8 * mib) {
+            error = "A GPT image must be a whole number of MB, 8 MB or more";
+            return false;
+        }
+        uint64_t lastLba = size / sector - 1;
+        uint64_t firstUsable = 2 + entrySectors;
+        uint64_t lastUsable = lastLba - 1 - entrySectors;
+
+        // Both partitions start on a MB boundary, with a gap between them and
+        // free space after the second
+        uint64_t half = (size / mib - 2) / 2 * mib;
+        partitions.clear();
+        partitions.push_back(GeneratedPartition{ 1, mib, half - mib, "Data" });
+        partitions.push_back(GeneratedPartition{ 3, mib + half, half - mib, "Media" });
+
+        std::vector<uint8_t> disk((size_t)size, 0);
+        Random random(seed);
+        std::vector<uint8_t> buffer;
+        for (const GeneratedPartition& part : partitions) {
+            for (uint64_t offset = 0; offset < part.length; offset += mib) {
+                // The second partition has a zero MB in the middle, for the imager to skip
+                bool media = part.index == 3;
+                if (media && offset == part.length / 2 / mib * mib) {
+                    continue;
+                }
+                buffer.resize((size_t)std::min<uint64_t>(mib, part.length - offset));
+                FillBlock(random, !media, buffer);
+                std::copy(buffer.begin(), buffer.end(), disk.begin() + (size_t)(part.offset + offset));
+            }
+        }
+
+        // Protective MBR: one partition of type EE over the whole disk
+        uint8_t* mbr = disk.data();
+        uint8_t* protective = mbr + 446;
+        protective[1] = 0x00;
+        protective[2] = 0x02;
+        protective[4] = 0xEE;
+        protective[5] = protective[6] = protective[7] = 0xFF;
+        PutLe(protective + 8, 1, 4);
+        PutLe(protective + 12, std::min<uint64_t>(lastLba, 0xFFFFFFFFu), 4);
+        mbr[510] = 0x55;
+        mbr[511] = 0xAA;
+
+        // GUIDs are random bytes; only the Linux filesystem type GUID is fixed
+        const uint8_t linuxType[16] = { 0xAF, 0x3D, 0xC6, 0x0F, 0x83, 0x84, 0x72, 0x47,
+                                        0x8E, 0x79, 0x3D, 0x69, 0xD8, 0x47, 0x7D, 0xE4 };
+        std::vector<uint8_t> entries(entryCount * entrySize, 0);
+        for (const GeneratedPartition& part : partitions) {
+            uint8_t* e = &entries[(size_t)(part.index - 1) * entrySize];
+            std::copy(linuxType, linuxType + 16, e);
+            PutLe(e + 16, random.Next(), 8);
+            PutLe(e + 24, random.Next(), 8);
+            PutLe(e + 32, part.offset / sector, 8);
+            PutLe(e + 40, (part.offset + part.length) / sector - 1, 8);
+            for (size_t c = 0; c < part.name.size(); c++) {
+                PutLe(e + 56 + c * 2, (uint8_t)part.name[c], 2);
+            }
+        }
+        uint32_t entriesCrc = GptCrc32(entries.data(), entries.size());
+        uint64_t diskGuid[2] = { random.Next(), random.Next() };
+
+        auto writeHeader = [&](uint64_t lba, uint64_t alternateLba, uint64_t entriesLba) {
+            uint8_t* h = &disk[(size_t)(lba * sector)];
+            std::copy(entries.begin(), entries.end(), disk.begin() + (size_t)(entriesLba * sector));
+            std::copy("EFI PART", "EFI PART" + 8, h);
+            PutLe(h + 8, 0x00010000, 4);
+            PutLe(h + 12, 92, 4);
+            PutLe(h + 24, lba, 8);
+            PutLe(h + 32, alternateLba, 8);
+            PutLe(h + 40, firstUsable, 8);
+            PutLe(h + 48, lastUsable, 8);
+            PutLe(h + 56, diskGuid[0], 8);
+            PutLe(h + 64, diskGuid[1], 8);
+            PutLe(h + 72, entriesLba, 8);
+            PutLe(h + 80, entryCount, 4);
+            PutLe(h + 84, entrySize, 4);
+            PutLe(h + 88, entriesCrc, 4);
+            PutLe(h + 16, GptCrc32(h, 92), 4);
+        };
+        writeHeader(1, lastLba, 2);
+        writeHeader(lastLba, 1, lastUsable + 1);
+
+        if (!WriteFile(path, disk, error)) {
+            return false;
+        }
+        stats.files++;
+        stats.bytes += size;
+        stats.dataBytes += size;
+        return true;
+    }
+}
@@ -0,0 +1,103 @@
+// LinuxRestore/bench/dataset.h
+// Synthetic, reproducible datasets for the benchmark suite.
+// Every generator is driven by a seed, so two runs with the same options
+// produce byte-identical trees and results stay comparable between versions.
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace Bench {
+
+    // Small, fast deterministic PRNG (splitmix64)
+    class Random {
+    public:
+        explicit Random(uint64_t seed) : state(seed) {}
+
+        uint64_t Next();
+        uint64_t Below(uint64_t bound) { return bound ? Next() % bound : 0; }
+        double Unit() { return (Next() >> 11) * (1.0 / 9007199254740992.0); }
+
+    private:
+        uint64_t state;
+    };
+
+    struct DatasetStats {
+        uint64_t files = 0;
+        uint64_t directories = 0;
+        uint64_t bytes = 0;         // Logical size of everything generated
+        uint64_t dataBytes = 0;     // Bytes actually written (excludes sparse holes)
+    };
+
+    // Fill 'buffer' with content that compresses roughly like documents
+    // (compressible = true) or like already-compressed media (false)
+    void FillBlock(Random& random, bool compressible, std::vector<uint8_t>& buffer);
+
+    // 'count' files of 0..maxSize bytes, spread over directories of 256 entries
+    bool GenerateTinyFiles(
+        const std::filesystem::path& dir,
+        uint32_t count,
+        uint32_t maxSize,
+        uint64_t seed,
+        DatasetStats& stats,
+        std::string& error);
+
+    // A directory chain 'depth' levels deep with 'filesPerLevel' files of 'fileSize' at each level
+    bool GenerateDeepTree(
+        const std::filesystem::path& dir,
+        uint32_t depth,
+        uint32_t filesPerLevel,
+        uint32_t fileSize,
+        uint64_t seed,
+        DatasetStats& stats,
+        std::string& error);
+
+    // A file of 'logicalSize' bytes that is all hole except 'extentCount'
+    // evenly spaced data extents of 'extentSize' bytes
+    bool GenerateSparseFile(
+        const std::filesystem::path& path,
+        uint64_t logicalSize,
+        uint32_t extentCount,
+        uint32_t extentSize,
+        uint64_t seed,
+        DatasetStats& stats,
+        std::string& error);
+
+    struct ImageSpec {
+        uint64_t size = 256ULL * 1024 * 1024;
+        uint32_t blockSize = 1024 * 1024;
+        double zeroRatio = 0.3;         // Blocks that are entirely zero
+        double duplicateRatio = 0.2;    // Blocks that repeat an earlier data block
+        double compressibleRatio = 0.5; // Fresh data blocks that compress like text
+    };
+
+    // A flat disk-image-like file built block by block from 'spec'
+    bool GenerateImage(
+        const std::filesystem::path& path,
+        const ImageSpec& spec,
+        uint64_t seed,
+        DatasetStats& stats,
+        std::string& error);
+
+    struct GeneratedPartition {
+        int index = 0;          // 1-based GPT entry number
+        uint64_t offset = 0;
+        uint64_t length = 0;
+        std::string name;
+    };
+
+    // A GPT disk image of 'size' bytes with 512-byte sectors: protective MBR,
+    // primary and backup headers and entry arrays, and two partitions of seeded
+    // data in entries 1 and 3 (entry 2 is left unused). 'partitions' gets
+    // where they were put; everything outside them and the GPT is zero.
+    bool GenerateGptImage(
+        const std::filesystem::path& path,
+        uint64_t size,
+        uint64_t seed,
+        std::vector<GeneratedPartition>& partitions,
+        DatasetStats& stats,
+        std::string& error);
+}
@@ -4,6 +4,7 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <cstdlib>
 #include "restore_engine.cpp"
 
 void printHeader() {
@@ -101,6 +102,22 @@ void scanBackups(RestoreEngine& engine) {
     }
 }
 
+// The first few files that failed in the last restore
+void printFileErrors(RestoreEngine& engine) {
+    const auto& errors = engine.GetFileErrors();
+    const size_t shown = 20;
+    for (size_t i = 0; i < errors.size() && i < shown; i++) {
+        std::cout << "  " << errors[i].path << ": " << BackupCore::FileErrorName(errors[i].code);
+        if (errors[i].osError != 0) {
+            std::cout << " (" << std::strerror(errors[i].osError) << ")";
+        }
+        std::cout << "\n";
+    }
+    if (errors.size() > shown) {
+        std::cout << "  ... and " << (errors.size() - shown) << " more\n";
+    }
+}
+
 void restoreBackup(RestoreEngine& engine) {
     std::string backupPath, destPath;
     char overwrite;
@@ -140,6 +157,7 @@ void restoreBackup(RestoreEngine& engine) {
         std::cout << "\n? Restore completed successfully!\n";
     } else {
         std::cout << "\n? Restore failed: " << engine.GetLastError() << "\n";
+        printFileErrors(engine);
     }
 }
 
@@ -163,6 +181,64 @@ void unmountPartition(RestoreEngine& engine) {
     }
 }
 
+BackupCore::DiskRestoreOptions parseDiskRestoreOptions(int argc, char* argv[], int first,
+                                                       bool verifyByDefault = false) {
+    BackupCore::DiskRestoreOptions options;
+    options.verifyWrites = verifyByDefault;
+    for (int i = first; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--compare") {
+            options.compareBeforeWrite = true;
+        } else if (arg == "--discard") {
+            options.discardZeroRanges = true;
+        } else if (arg == "--verify") {
+            options.verifyWrites = true;
+        } else if (arg == "--no-verify") {
+            options.verifyWrites = false;
+        }
+    }
+    return options;
+}
+
+// Remove "<name> <value>" from argv wherever it appears and return the value
+std::string takeOption(int& argc, char* argv[], const std::string& name) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (name == argv[i]) {
+            std::string value = argv[i + 1];
+            for (int j = i; j + 2 <= argc; j++) {
+                argv[j] = argv[j + 2];
+            }
+            argc -= 2;
+            return value;
+        }
+    }
+    return std::string();
+}
+
+// Writes the trace file however main() returns
+class TraceGuard {
+public:
+    TraceGuard(RestoreEngine& engine, const std::string& path) : engine(engine), path(path) {
+        if (!path.empty() && engine.StartTrace(path) != 0) {
+            std::cerr << "WARNING: tracing disabled: " << engine.GetLastError() << std::endl;
+            this->path.clear();
+        }
+    }
+
+    ~TraceGuard() {
+        if (path.empty()) return;
+        if (engine.StopTrace() == 0) {
+            std::cout << "Trace written to " << path << " (open in ui.perfetto.dev or chrome://tracing)\n";
+        } else {
+            std::cerr << "WARNING: " << engine.GetLastError() << std::endl;
+        }
+    }
+
+private:
+    RestoreEngine& engine;
+    std::string path;
+};
+
 int main(int argc, char* argv[]) {
     // Check if running as root
     if (geteuid() != 0) {
@@ -173,7 +249,13 @@ int main(int argc, char* argv[]) {
 
     printHeader();
     
+    std::string tracePath = takeOption(argc, argv, "--trace");
+    std::string password = takeOption(argc, argv, "--password");
     RestoreEngine engine;
+    if (!password.empty()) {
+        engine.SetPassword(password);
+    }
+    TraceGuard trace(engine, tracePath);
     
     // Command-line mode
     if (argc > 1) {
@@ -186,16 +268,59 @@ int main(int argc, char* argv[]) {
             std::cout << "            to: " << destPath << "\n\n";
             
             int result = engine.RestoreFiles(backupPath, destPath, overwrite);
-            
+            printFileErrors(engine);
+
+            return (result == 0) ? 0 : 1;
+        } else if (std::string(argv[1]) == "--partitions" && argc >= 3) {
+            auto lines = engine.ListPartitions(argv[2]);
+            for (const auto& line : lines) {
+                std::cout << line << "\n";
+            }
+            return lines.empty() ? 1 : 0;
+        } else if (std::string(argv[1]) == "--restore-disk" && argc >= 4) {
+            std::cout << "Restoring disk image: " << argv[2] << "\n";
+            std::cout << "                  to: " << argv[3] << "\n\n";
+
+            int result = engine.RestoreDiskImage(argv[2], argv[3], parseDiskRestoreOptions(argc, argv, 4));
+
+            return (result == 0) ? 0 : 1;
+        } else if (std::string(argv[1]) == "--restore-partition" && argc >= 5) {
+            std::cout << "Restoring partition " << argv[3] << " of " << argv[2] << "\n";
+            std::cout << "                  to: " << argv[4] << "\n\n";
+
+            int result = engine.RestorePartitionImage(argv[2], std::atoi(argv[3]), argv[4],
+                                                      parseDiskRestoreOptions(argc, argv, 5));
+
+            return (result == 0) ? 0 : 1;
+        } else if (std::string(argv[1]) == "--clone" && argc >= 4) {
+            std::cout << "Cloning disk: " << argv[2] << "\n";
+            std::cout << "          to: " << argv[3] << "\n\n";
+
+            int result = engine.CloneDisk(argv[2], argv[3], parseDiskRestoreOptions(argc, argv, 4, true));
+
             return (result == 0) ? 0 : 1;
         } else if (std::string(argv[1]) == "--help") {
             std::cout << "Usage:\n";
             std::cout << "  Interactive mode: sudo " << argv[0] << "\n";
             std::cout << "  Direct restore:   sudo " << argv[0] << " --restore <backup> <dest> [--overwrite]\n";
+            std::cout << "  Show partitions:  sudo " << argv[0] << " --partitions <device|image>\n";
+            std::cout << "  Disk image:       sudo " << argv[0] << " --restore-disk <backup> <device> [--compare] [--discard]\n";
+            std::cout << "  One partition:    sudo " << argv[0] << " --restore-partition <backup> <N> <partition-device> [--compare] [--discard]\n";
+            std::cout << "  Clone disk:       sudo " << argv[0] << " --clone <source-device> <target-device> [--compare] [--discard] [--no-verify]\n";
+            std::cout << "\n";
+            std::cout << "  --compare    Read the target first and only write blocks that differ\n";
+            std::cout << "  --discard    TRIM zero ranges instead of writing zeros\n";
+            std::cout << "  --verify     Read every written block back (always on for --clone)\n";
+            std::cout << "  --no-verify  Skip read-back verification when cloning\n";
+            std::cout << "  --trace <f>  Record a trace-event timeline of the run to <f> (any mode)\n";
+            std::cout << "  --password <p>  Password of an encrypted backup (or set BACKUP_PASSWORD)\n";
             std::cout << "\n";
             std::cout << "Examples:\n";
             std::cout << "  sudo " << argv[0] << " --restore /media/usb/backup /mnt/restore\n";
             std::cout << "  sudo " << argv[0] << " --restore /mnt/backup /mnt/c --overwrite\n";
+            std::cout << "  sudo " << argv[0] << " --restore-disk /media/usb/backup /dev/sda\n";
+            std::cout << "  sudo " << argv[0] << " --restore-partition /media/usb/backup 3 /dev/sda3\n";
+            std::cout << "  sudo " << argv[0] << " --clone /dev/sda /dev/sdb --discard\n";
             return 0;
         }
     }
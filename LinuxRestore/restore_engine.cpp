@@ -6,11 +6,19 @@
 #include <vector>
 #include <filesystem>
 #include <fstream>
+#include <cstdlib>
 #include <cstring>
 #include <ctime>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include "Core/BlockDevice.h"
+#include "Core/DiskImage.h"
+#include "Core/FileBackup.h"
+#include "Core/JobStatus.h"
+#include "Core/Metrics.h"
+#include "Core/PartitionTable.h"
+#include "Core/Trace.h"
 
 namespace fs = std::filesystem;
 
@@ -21,6 +29,25 @@ class RestoreEngine {
 private:
     ProgressCallback progressCallback;
     std::string lastError;
+    // Per-file failures of the last RestoreFiles
+    std::vector<BackupCore::FileError> fileErrors;
+    // Opens encrypted backup sets; BACKUP_PASSWORD unless SetPassword says otherwise
+    std::string password;
+    // Shared-memory status of the operation in progress, if any
+    BackupCore::JobStatusPublisher* jobStatus = nullptr;
+
+    // Publishes one operation so other processes can watch it (see Core/JobStatus.h)
+    class JobScope {
+    public:
+        JobScope(RestoreEngine& engine, const std::string& name) : engine(engine), publisher(name) {
+            engine.jobStatus = &publisher;
+        }
+        ~JobScope() { engine.jobStatus = nullptr; }
+
+    private:
+        RestoreEngine& engine;
+        BackupCore::JobStatusPublisher publisher;
+    };
 
     void SetError(const std::string& error) {
         lastError = error;
@@ -31,19 +58,52 @@ private:
         if (progressCallback) {
             progressCallback(percentage, message.c_str());
         }
+        if (jobStatus) {
+            jobStatus->Update(BackupCore::ProgressPhase::Restoring, percentage);
+        }
         std::cout << "[" << percentage << "%] " << message << std::endl;
     }
 
 public:
     RestoreEngine(ProgressCallback callback = nullptr) 
-        : progressCallback(callback) {}
+        : progressCallback(callback) {
+        if (const char* value = std::getenv("BACKUP_PASSWORD")) {
+            password = value;
+        }
+    }
+
+    const std::string& GetLastError() const { return lastError; }
+    const std::vector<BackupCore::FileError>& GetFileErrors() const { return fileErrors; }
 
-    std::string GetLastError() const { return lastError; }
+    void SetPassword(const std::string& value) { password = value; }
+
+    // Record spans of everything this process does until StopTrace writes
+    // them to tracePath (Chrome trace-event JSON, opens in Perfetto)
+    int StartTrace(const std::string& tracePath) {
+        std::string error;
+        if (!BackupCore::StartTrace(tracePath, error)) {
+            SetError(error);
+            return -1;
+        }
+        return 0;
+    }
+
+    int StopTrace() {
+        std::string error;
+        if (!BackupCore::StopTrace(error)) {
+            SetError(error);
+            return -1;
+        }
+        return 0;
+    }
 
     // Restore files from backup to destination
     int RestoreFiles(const std::string& backupPath, 
                      const std::string& destPath, 
                      bool overwriteExisting) {
+        BackupCore::TraceSpan span("restore", "RestoreEngine::RestoreFiles", backupPath);
+        JobScope job(*this, "Restore files " + backupPath + " -> " + destPath);
+        fileErrors.clear();
         try {
             ReportProgress(0, "Starting file restore...");
 
@@ -53,6 +113,25 @@ public:
                 return -1;
             }
 
+            // Backups with a catalog are restored, and checked file by file, by the shared core
+            if (BackupCore::HasCatalog(backupPath)) {
+                BackupCore::FileRestoreOptions options;
+                options.overwriteExisting = overwriteExisting;
+                options.password = password;
+
+                BackupCore::FileSetResult result;
+                std::string error;
+                int rc = BackupCore::RestoreFileSet(backupPath, destPath, options,
+                    [this](int percentage, const std::string& message) { ReportProgress(percentage, message); },
+                    result, error);
+                fileErrors = std::move(result.errors);
+
+                if (rc != 0) {
+                    SetError(error);
+                }
+                return rc;
+            }
+
             // Create destination directory
             try {
                 fs::create_directories(destPath);
@@ -91,6 +170,7 @@ public:
             int filesRestored = 0;
 
             for (const auto& sourceFile : filesToRestore) {
+                BackupCore::TraceSpan fileSpan("file", "restore", sourceFile.string());
                 try {
                     // Calculate relative path
                     fs::path relativePath = fs::relative(sourceFile, backupPath);
@@ -166,6 +246,143 @@ public:
         }
     }
 
+    // Resolve a backup directory or .layout file to a disk image manifest
+    bool LoadDiskImage(const std::string& imagePath, BackupCore::DiskImageManifest& manifest) {
+        fs::path layoutFile = imagePath;
+        if (fs::is_directory(layoutFile)) {
+            layoutFile = BackupCore::FindDiskImageLayout(layoutFile, "");
+            if (layoutFile.empty()) {
+                SetError("No disk image (.layout) found in " + imagePath);
+                return false;
+            }
+        }
+
+        std::string error;
+        if (!BackupCore::LoadDiskImageManifest(layoutFile, manifest, error)) {
+            SetError(error);
+            return false;
+        }
+        return true;
+    }
+
+    // Describe the partition table of a device or raw image file
+    std::vector<std::string> ListPartitions(const std::string& devicePath) {
+        std::vector<std::string> lines;
+        std::string error;
+
+        auto device = BackupCore::BlockDevice::Open(devicePath, false, error);
+        BackupCore::DiskLayout layout;
+        if (!device || !BackupCore::ReadDiskLayout(*device, layout, error)) {
+            SetError(error);
+            return lines;
+        }
+
+        lines.push_back(std::string("Scheme: ") + BackupCore::SchemeName(layout.scheme) +
+            ", sector size " + std::to_string(layout.sectorSize) +
+            ", " + std::to_string(layout.diskSize / (1024 * 1024)) + " MB");
+
+        for (const auto& part : layout.partitions) {
+            std::string line = "  #" + std::to_string(part.index) +
+                "  offset " + std::to_string(part.offset) +
+                "  " + std::to_string(part.length / (1024 * 1024)) + " MB  " +
+                BackupCore::FileSystemName(part.fileSystem) + "  " +
+                BackupCore::PartitionTypeName(part.typeId);
+            if (!part.name.empty()) {
+                line += "  \"" + part.name + "\"";
+            }
+            lines.push_back(line);
+        }
+        return lines;
+    }
+
+    // Restore a partition-aware disk image onto a whole disk
+    int RestoreDiskImage(const std::string& imagePath, const std::string& devicePath,
+                         const BackupCore::DiskRestoreOptions& options = BackupCore::DiskRestoreOptions()) {
+        BackupCore::TraceSpan span("restore", "RestoreEngine::RestoreDiskImage", imagePath);
+        JobScope job(*this, "Restore disk " + imagePath + " -> " + devicePath);
+        BackupCore::DiskImageManifest manifest;
+        if (!LoadDiskImage(imagePath, manifest)) {
+            return -1;
+        }
+
+        std::string error;
+        auto device = BackupCore::BlockDevice::Open(devicePath, true, error);
+        if (!device) {
+            SetError(error);
+            return -1;
+        }
+
+        int result = BackupCore::RestoreDiskImage(manifest, *device, options,
+            [this](int percentage, const std::string& message) { ReportProgress(percentage, message); },
+            error);
+
+        if (result != 0) {
+            SetError(error);
+        }
+        return result;
+    }
+
+    // Restore a single partition stream onto a partition device (e.g. /dev/sda2)
+    int RestorePartitionImage(const std::string& imagePath, int partitionIndex, const std::string& devicePath,
+                              const BackupCore::DiskRestoreOptions& options = BackupCore::DiskRestoreOptions()) {
+        BackupCore::TraceSpan span("restore", "RestoreEngine::RestorePartitionImage", imagePath);
+        JobScope job(*this, "Restore partition " + imagePath + " -> " + devicePath);
+        BackupCore::DiskImageManifest manifest;
+        if (!LoadDiskImage(imagePath, manifest)) {
+            return -1;
+        }
+
+        std::string error;
+        auto device = BackupCore::BlockDevice::Open(devicePath, true, error);
+        if (!device) {
+            SetError(error);
+            return -1;
+        }
+
+        int result = BackupCore::RestorePartitionImage(manifest, partitionIndex, *device, 0, options,
+            [this](int percentage, const std::string& message) { ReportProgress(percentage, message); },
+            error);
+
+        if (result != 0) {
+            SetError(error);
+        }
+        return result;
+    }
+
+    // Copy one disk onto another directly, e.g. /dev/sda -> /dev/sdb
+    int CloneDisk(const std::string& sourcePath, const std::string& targetPath,
+                  const BackupCore::DiskRestoreOptions& options = BackupCore::DiskRestoreOptions()) {
+        BackupCore::TraceSpan span("restore", "RestoreEngine::CloneDisk", sourcePath);
+        JobScope job(*this, "Clone " + sourcePath + " -> " + targetPath);
+        std::error_code ec;
+        if (fs::equivalent(sourcePath, targetPath, ec)) {
+            SetError("Source and target are the same device");
+            return -1;
+        }
+
+        std::string error;
+        auto source = BackupCore::BlockDevice::Open(sourcePath, false, error);
+        if (!source) {
+            SetError(error);
+            return -1;
+        }
+
+        auto target = BackupCore::BlockDevice::Open(targetPath, true, error);
+        if (!target) {
+            SetError(error);
+            return -1;
+        }
+
+        int result = BackupCore::CloneDisk(*source, *target, BackupCore::DiskImageOptions(), options,
+            [this](int percentage, const std::string& message) { ReportProgress(percentage, message); },
+            error);
+
+        if (result != 0) {
+            SetError(error);
+        }
+        return result;
+    }
+
     // Mount NTFS partition for Windows restore
     int MountNTFSPartition(const std::string& device, const std::string& mountPoint) {
         ReportProgress(0, "Mounting NTFS partition...");
@@ -261,6 +478,34 @@ extern "C" {
         return eng->RestoreFiles(backupPath, destPath, overwrite != 0);
     }
 
+    // flags: 1 = compare before write, 2 = discard zero ranges, 4 = verify writes
+    int RestoreDiskImage(void* engine, const char* imagePath, const char* device, int flags) {
+        auto* eng = static_cast<RestoreEngine*>(engine);
+        BackupCore::DiskRestoreOptions options;
+        options.compareBeforeWrite = (flags & 1) != 0;
+        options.discardZeroRanges = (flags & 2) != 0;
+        options.verifyWrites = (flags & 4) != 0;
+        return eng->RestoreDiskImage(imagePath, device, options);
+    }
+
+    int RestorePartitionImage(void* engine, const char* imagePath, int partitionIndex, const char* device, int flags) {
+        auto* eng = static_cast<RestoreEngine*>(engine);
+        BackupCore::DiskRestoreOptions options;
+        options.compareBeforeWrite = (flags & 1) != 0;
+        options.discardZeroRanges = (flags & 2) != 0;
+        options.verifyWrites = (flags & 4) != 0;
+        return eng->RestorePartitionImage(imagePath, partitionIndex, device, options);
+    }
+
+    int CloneDisk(void* engine, const char* sourceDevice, const char* targetDevice, int flags) {
+        auto* eng = static_cast<RestoreEngine*>(engine);
+        BackupCore::DiskRestoreOptions options;
+        options.compareBeforeWrite = (flags & 1) != 0;
+        options.discardZeroRanges = (flags & 2) != 0;
+        options.verifyWrites = (flags & 4) != 0;
+        return eng->CloneDisk(sourceDevice, targetDevice, options);
+    }
+
     int MountNTFS(void* engine, const char* device, const char* mountPoint) {
         auto* eng = static_cast<RestoreEngine*>(engine);
         return eng->MountNTFSPartition(device, mountPoint);
@@ -275,4 +520,57 @@ extern "C" {
         auto* eng = static_cast<RestoreEngine*>(engine);
         return eng->GetLastError().c_str();
     }
+
+    // Files that failed in the last RestoreFiles (the first 1000 are kept)
+    int GetFileErrorCount(void* engine) {
+        auto* eng = static_cast<RestoreEngine*>(engine);
+        return (int)eng->GetFileErrors().size();
+    }
+
+    // code: 1 = open failed ... 8 = invalid path, as BackupCore::FileErrorCode.
+    // The strings stay valid until the next call on this engine.
+    int GetFileError(void* engine, int index, int* code, int* osError, const char** path, const char** message) {
+        auto* eng = static_cast<RestoreEngine*>(engine);
+        const auto& errors = eng->GetFileErrors();
+        if (index < 0 || index >= (int)errors.size()) {
+            return -1;
+        }
+        if (code) *code = (int)errors[index].code;
+        if (osError) *osError = errors[index].osError;
+        if (path) *path = errors[index].path.c_str();
+        if (message) *message = errors[index].message.c_str();
+        return 0;
+    }
+
+    // format: 0 = JSON, 1 = Prometheus text. Returns the text length,
+    // or -2 if it does not fit (bufferSize must exceed the length)
+    int GetEngineMetrics(char* buffer, int bufferSize, int format) {
+        if (!buffer || bufferSize <= 0) {
+            return -1;
+        }
+
+        BackupCore::EngineMetrics& metrics = BackupCore::EngineMetrics::Global();
+        std::string text = (format == 1) ? metrics.ToPrometheus() : metrics.ToJson();
+        if (text.size() >= (size_t)bufferSize) {
+            buffer[0] = '\0';
+            return -2;
+        }
+
+        std::memcpy(buffer, text.c_str(), text.size() + 1);
+        return (int)text.size();
+    }
+
+    void ResetEngineMetrics() {
+        BackupCore::EngineMetrics::Global().Reset();
+    }
+
+    int StartTrace(void* engine, const char* tracePath) {
+        auto* eng = static_cast<RestoreEngine*>(engine);
+        return eng->StartTrace(tracePath);
+    }
+
+    int StopTrace(void* engine) {
+        auto* eng = static_cast<RestoreEngine*>(engine);
+        return eng->StopTrace();
+    }
 }
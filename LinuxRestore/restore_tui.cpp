@@ -294,6 +294,44 @@ private:
         getch();
     }
 
+    // Jobs published by any process on this machine (see Core/JobStatus.h),
+    // e.g. restore_cli running on another console; refreshed until a key is pressed
+    void ShowRunningJobs() {
+        timeout(500);
+        while (true) {
+            wclear(mainWin);
+            box(mainWin, 0, 0);
+            ShowTitle();
+            mvwprintw(mainWin, 4, 4, "Running jobs (press any key to return):");
+
+            std::vector<BackupCore::JobStatusEntry> jobs;
+            std::string error;
+            if (!BackupCore::ReadJobStatus(jobs, error)) {
+                UpdateStatus(error, true);
+            }
+
+            int row = 6;
+            int lastRow = getmaxy(mainWin) - 3;
+            if (jobs.empty()) {
+                mvwprintw(mainWin, row, 6, "No jobs are running");
+            }
+            for (const auto& job : jobs) {
+                if (row + 1 > lastRow) break;
+                mvwprintw(mainWin, row++, 6, "%-50.50s %-10s %3d%%", job.name,
+                          BackupCore::ProgressPhaseName((BackupCore::ProgressPhase)job.phase), job.percent);
+                mvwprintw(mainWin, row++, 8, "pid %u, %llu/%llu files, %llu/%llu MB, %.1f MB/s, %d s elapsed",
+                          job.processId,
+                          (unsigned long long)(job.filesDone + job.filesFailed), (unsigned long long)job.filesTotal,
+                          (unsigned long long)(job.bytesDone >> 20), (unsigned long long)(job.bytesTotal >> 20),
+                          job.bytesPerSecond / (1024 * 1024), (int)job.elapsedSeconds);
+            }
+            wrefresh(mainWin);
+
+            if (getch() != ERR) break;
+        }
+        timeout(-1);
+    }
+
 public:
     RestoreTUI() : engine(std::make_unique<RestoreEngine>()) {
         InitializeUI();
@@ -313,7 +351,8 @@ public:
             "3. Scan for backups",
             "4. Select backup to restore",
             "5. Perform restore",
-            "6. Exit"
+            "6. Show running jobs",
+            "7. Exit"
         };
 
         while (true) {
@@ -340,6 +379,9 @@ public:
                     PerformRestore();
                     break;
                 case 5:
+                    ShowRunningJobs();
+                    break;
+                case 6:
                 case -1:
                     return;
             }